@@ -1,5 +1,6 @@
 #include "game.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
@@ -11,6 +12,7 @@
 
 /* Fw declarations */
 static void prepare_render_scene(struct game_context* ctx, struct render_scene* rscn);
+static void place_gi_probes(struct game_context* ctx, struct render_scene* rscn);
 
 static void on_key(struct window* wnd, int key, int scancode, int action, int mods)
 {
@@ -28,6 +30,14 @@ static void on_key(struct window* wnd, int key, int scancode, int action, int mo
         ctx->rndr_state.options.show_bboxes = !ctx->rndr_state.options.show_bboxes;
     else if (action == KEY_ACTION_RELEASE && key == KEY_C)
         ctx->rndr_state.options.use_occlusion_culling = !ctx->rndr_state.options.use_occlusion_culling;
+    else if (action == KEY_ACTION_RELEASE && key == KEY_L)
+        ctx->rndr_state.options.use_cluster_culling = !ctx->rndr_state.options.use_cluster_culling;
+    else if (action == KEY_ACTION_RELEASE && key == KEY_J)
+        ctx->rndr_state.options.use_lods = !ctx->rndr_state.options.use_lods;
+    else if (action == KEY_ACTION_RELEASE && key == KEY_I)
+        ctx->rndr_state.options.use_instancing = !ctx->rndr_state.options.use_instancing;
+    else if (action == KEY_ACTION_RELEASE && key == KEY_U)
+        ctx->rndr_state.options.use_tiled_lighting = !ctx->rndr_state.options.use_tiled_lighting;
     else if (action == KEY_ACTION_RELEASE && key == KEY_K)
         ctx->rndr_state.options.use_normal_mapping = !ctx->rndr_state.options.use_normal_mapping;
     else if (action == KEY_ACTION_RELEASE && key == KEY_T)
@@ -89,7 +99,7 @@ void game_init(struct game_context* ctx)
     window_set_callbacks(ctx->wnd, &wnd_callbacks);
 
     /* Initialize renderer */
-    renderer_init(&ctx->rndr_state);
+    renderer_init(&ctx->rndr_state, "ext");
     ctx->gi_dirty = 1;
 
     /* Pick scene file, try environment variable first */
@@ -129,6 +139,19 @@ void game_init(struct game_context* ctx)
 
     /* Build initial renderer input */
     prepare_render_scene(ctx, &ctx->cached_scene);
+    place_gi_probes(ctx, &ctx->cached_scene);
+
+    /* Skip probe updates when a baked GI cache matches the scene */
+    snprintf(ctx->gi_cache_file, sizeof(ctx->gi_cache_file), "%s.gicache", scene_file);
+    if (renderer_gi_load(&ctx->rndr_state, &ctx->cached_scene, ctx->gi_cache_file))
+        ctx->gi_dirty = 0;
+}
+
+int game_bake_gi(struct game_context* ctx)
+{
+    int ok = renderer_gi_bake(&ctx->rndr_state, &ctx->cached_scene, ctx->gi_cache_file);
+    printf("[+] GI cache %s: %s\n", ok ? "baked" : "bake failed", ctx->gi_cache_file);
+    return ok;
 }
 
 static vec3 sun_dir_from_params(float inclination, float azimuth)
@@ -240,6 +263,7 @@ static void prepare_render_scene(struct game_context* ctx, struct render_scene*
                     rl->type = LT_SPOT;
                     rl->type_data.spt.position = lc->position;
                     rl->type_data.spt.direction = lc->direction;
+                    rl->type_data.spt.radius = lc->falloff;
                     rl->type_data.spt.inner_cone = lc->inner_cone;
                     rl->type_data.spt.outer_cone = lc->outer_cone;
                     break;
@@ -248,6 +272,41 @@ static void prepare_render_scene(struct game_context* ctx, struct render_scene*
     }
 }
 
+static void place_gi_probes(struct game_context* ctx, struct render_scene* rscn)
+{
+    /* World space bounds of all scene shapes */
+    float bmin[3] = { INFINITY, INFINITY, INFINITY }, bmax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (unsigned int i = 0; i < rscn->num_objects; ++i) {
+        struct render_object* ro = &rscn->objects[i];
+        struct render_mesh* rm = resmgr_get_mesh(&ctx->rndr_state.rmgr, ro->mesh);
+        if (!rm)
+            continue;
+        mat4 model = *(mat4*)ro->model_mat;
+        for (unsigned int j = 0; j < rm->num_shapes; ++j) {
+            struct render_shape* sh = &rm->shapes[j];
+            for (unsigned int k = 0; k < 8; ++k) {
+                vec3 c = mat4_mul_vec3(model, vec3_new(k & 1 ? sh->bb_max[0] : sh->bb_min[0],
+                                                       k & 2 ? sh->bb_max[1] : sh->bb_min[1],
+                                                       k & 4 ? sh->bb_max[2] : sh->bb_min[2]));
+                for (unsigned int a = 0; a < 3; ++a) {
+                    bmin[a] = fminf(bmin[a], c.xyz[a]);
+                    bmax[a] = fmaxf(bmax[a], c.xyz[a]);
+                }
+            }
+        }
+    }
+    if (bmin[0] > bmax[0])
+        return;
+    /* Probe grid slightly inset to keep the outer layer off the boundary geometry */
+    for (unsigned int a = 0; a < 3; ++a) {
+        float inset = (bmax[a] - bmin[a]) * 0.05f;
+        bmin[a] += inset;
+        bmax[a] -= inset;
+    }
+    unsigned int dims[3] = { 6, 3, 6 };
+    renderer_gi_probe_grid(&ctx->rndr_state, bmin, bmax, dims);
+}
+
 void game_render(void* userdata, float interpolation)
 {
     struct game_context* ctx = userdata;
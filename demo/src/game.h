@@ -50,10 +50,14 @@ struct game_context
     struct renderer_state rndr_state;
     struct render_scene cached_scene;
     int gi_dirty;
+    /* Baked GI probes of the loaded scene */
+    char gi_cache_file[256];
 };
 
 /* Initializes the game instance */
 void game_init(struct game_context* ctx);
+/* Renders all GI probes offscreen and stores them in the scene's GI cache, returns zero on failure */
+int game_bake_gi(struct game_context* ctx);
 /* Update callback used by the main loop */
 void game_update(void* userdata, float dt);
 /* Render callback used by the main loop */
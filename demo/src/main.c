@@ -34,13 +34,21 @@
 
 int main(int argc, char* argv[])
 {
-    (void) argc;
-    (void) argv;
+    /* Bake mode renders GI probes into the cache and exits */
+    int bake_gi = 0;
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], "--bake-gi") == 0)
+            bake_gi = 1;
 
     /* Initialize */
     struct game_context ctx;
     memset(&ctx, 0, sizeof(struct game_context));
     game_init(&ctx);
+    if (bake_gi) {
+        int ok = game_bake_gi(&ctx);
+        game_shutdown(&ctx);
+        return ok ? 0 : 1;
+    }
 
     /* Setup mainloop parameters */
     struct mainloop_data mld;
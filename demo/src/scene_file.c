@@ -6,6 +6,7 @@
 #include <hashmap.h>
 #include <json.h>
 #include <energycore/asset.h>
+#include <energycore/fltparse.h>
 
 struct scene_prefab {
     struct scene_object* objects;
@@ -23,7 +24,7 @@ static void json_parse_float_arr(float* out, struct json_array_element_s* arr_e,
 {
     for (int i = 0; i < lim; ++i) {
         struct json_number_s* n = arr_e->value->payload;
-        out[i] = atof(n->number);
+        out[i] = fltparse_float(n->number, 0);
         arr_e = arr_e->next;
     }
 }
@@ -105,22 +106,22 @@ static void parse_scene_light(struct json_object_element_s* eso, struct scene_li
             json_parse_float_arr(scn_lgt->color, ev_jar->start, 3);
         } else if (strncmp(attr->name->string, "intensity", attr->name->string_size) == 0) {
             struct json_number_s* ev_jnb = attr->value->payload;
-            scn_lgt->intensity = atof(ev_jnb->number);
+            scn_lgt->intensity = fltparse_float(ev_jnb->number, 0);
         } else if (strncmp(attr->name->string, "position", attr->name->string_size) == 0) {
             struct json_array_s* ev_jar = attr->value->payload;
             json_parse_float_arr(scn_lgt->position, ev_jar->start, 3);
         } else if (strncmp(attr->name->string, "falloff", attr->name->string_size) == 0) {
             struct json_number_s* ev_jnb = attr->value->payload;
-            scn_lgt->falloff = atof(ev_jnb->number);
+            scn_lgt->falloff = fltparse_float(ev_jnb->number, 0);
         } else if (strncmp(attr->name->string, "direction", attr->name->string_size) == 0) {
             struct json_array_s* ev_jar = attr->value->payload;
             json_parse_float_arr(scn_lgt->direction, ev_jar->start, 3);
         } else if (strncmp(attr->name->string, "inner_cone", attr->name->string_size) == 0) {
             struct json_number_s* ev_jnb = attr->value->payload;
-            scn_lgt->inner_cone = atof(ev_jnb->number);
+            scn_lgt->inner_cone = fltparse_float(ev_jnb->number, 0);
         } else if (strncmp(attr->name->string, "outer_cone", attr->name->string_size) == 0) {
             struct json_number_s* ev_jnb = attr->value->payload;
-            scn_lgt->outer_cone = atof(ev_jnb->number);
+            scn_lgt->outer_cone = fltparse_float(ev_jnb->number, 0);
         }
     }
 }
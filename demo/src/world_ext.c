@@ -41,7 +41,6 @@ static image image_from_file_helper(const char* path)
         /* Try with external loader */
         int width = 0, height = 0, channels = 0;
         void* data = 0;
-        stbi_set_flip_vertically_on_load(1);
         data = stbi_load(path, &width, &height, &channels, 0);
         im  = (image) {
             .w                = width,
@@ -104,27 +103,42 @@ world_t world_external(const char* scene_file, struct resmgr* rmgr)
         }
         scene_destroy(sc);
     }
+    struct shape_vcache_stats* vs = &rmgr->vcache_stats;
+    if (vs->num_tris)
+        printf("[+] ACMR: %.3f -> %.3f, ATVR: %.3f -> %.3f\n",
+               (float)vs->misses_before / vs->num_tris, (float)vs->misses_after / vs->num_tris,
+               (float)vs->misses_before / vs->num_verts, (float)vs->misses_after / vs->num_verts);
 
     /* Load textures */
     struct hashmap texture_handles_map;
     hashmap_init(&texture_handles_map, hm_str_hash, hm_str_eql);
-    bench("[+] Tex time")
-    for (size_t i = 0; i < sc->num_textures; ++i) {
-        struct scene_texture* t = sc->textures + i;
-        if (!hashmap_exists(&texture_handles_map, hm_cast(t->ref))) {
-            /* Load, parse and upload texture */
-            image im;
-            timed_load(t->path)
-                im = image_from_file_helper(t->path);
-            struct texture tex = {
-                .name = 0,
-                .path = 0,
-                .img  = im,
-            };
-            rid id = resmgr_add_texture(rmgr, &tex);
-            hashmap_put(&texture_handles_map, hm_cast(t->ref), *((hm_ptr*)&id));
-            free(im.data);
+    bench("[+] Tex time") {
+        /* Gather unique textures and decode them all in parallel */
+        const char** tex_paths = calloc(sc->num_textures, sizeof(*tex_paths));
+        const char** tex_refs = calloc(sc->num_textures, sizeof(*tex_refs));
+        size_t num_tex = 0;
+        struct hashmap seen_refs;
+        hashmap_init(&seen_refs, hm_str_hash, hm_str_eql);
+        for (size_t i = 0; i < sc->num_textures; ++i) {
+            struct scene_texture* t = sc->textures + i;
+            if (!hashmap_exists(&seen_refs, hm_cast(t->ref))) {
+                hashmap_put(&seen_refs, hm_cast(t->ref), hm_cast(num_tex));
+                tex_paths[num_tex] = t->path;
+                tex_refs[num_tex++] = t->ref;
+            }
+        }
+        hashmap_destroy(&seen_refs);
+        rid* tex_ids = calloc(num_tex, sizeof(*tex_ids));
+        stbi_set_flip_vertically_on_load(1);
+        resmgr_add_textures(rmgr, tex_paths, num_tex, image_from_file_helper, tex_ids);
+        for (size_t i = 0; i < num_tex; ++i) {
+            if (rid_null(tex_ids[i]))
+                printf("Could not load texture %s!\n", tex_paths[i]);
+            hashmap_put(&texture_handles_map, hm_cast(tex_refs[i]), *((hm_ptr*)&tex_ids[i]));
         }
+        free(tex_ids);
+        free(tex_refs);
+        free(tex_paths);
     }
 
     /* Load materials */
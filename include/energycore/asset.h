@@ -44,8 +44,11 @@ struct scene* scene_from_file(const char* fpath);
 unsigned int shader_from_srcs(const char* vs_src, const char* gs_src, const char* fs_src);
 /* Texture utils */
 unsigned int texture_from_ktx(const char* filename);
+unsigned int texture_from_ktx_buffer(const void* data, size_t sz);
 unsigned int texture_from_hdr(const char* filename);
-unsigned int texture_cubemap_from_hdr(const char* fpath);
+/* Equirect HDR to cubemap, converted by the given compute shader or on the CPU when it is zero.
+ * Returns zero for undecodable images or ones narrower than 4 pixels */
+unsigned int texture_cubemap_from_hdr(const void* fdata, size_t fsize, unsigned int conv_shdr);
 /* Embedded files */
 int embedded_file(void** data, size_t* sz, const char* fpath);
 
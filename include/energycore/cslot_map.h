@@ -0,0 +1,149 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _CSLOT_MAP_H_
+#define _CSLOT_MAP_H_
+
+/*
+ * Concurrent Slot Map data structure
+ *
+ * A fixed capacity variant of the slot_map that can be shared between threads:
+ *  - Lock-free key reservation from any thread
+ *  - Publish semantics: a reserved key resolves only after its data is published
+ *  - Wait-free lookup
+ *  - Stable element addresses (storage is never moved)
+ *
+ * How it works:
+ *     Slots live in fixed size pages that are allocated on first use and
+ *  never freed or moved until destruction, so readers can never observe
+ *  a dangling table. Each slot carries a single atomic state word holding
+ *  its generation and a live bit. Reserving a key pops a slot from a
+ *  tagged (ABA-safe) free list or, if it is empty, bumps the high water mark.
+ *  Publishing copies the element data into the slot and then release-stores
+ *  the live state, so a reader that acquire-loads a matching state is
+ *  guaranteed to see the complete element. Removal bumps the generation
+ *  and pushes the slot back to the free list.
+ *
+ * Notes:
+ *  Removing a published element while another thread still holds a pointer
+ *  to it is the caller's responsibility (e.g. defer removal to frame end).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "slot_map.h"
+
+#define CSLOT_MAP_PAGE_SHIFT 10
+#define CSLOT_MAP_PAGE_SIZE  (1u << CSLOT_MAP_PAGE_SHIFT)
+#define CSLOT_MAP_MAX_PAGES  1024
+#define CSLOT_MAP_CAPACITY   (CSLOT_MAP_PAGE_SIZE * CSLOT_MAP_MAX_PAGES)
+
+struct cslot_map {
+    /*
+     * Array of lazily allocated slot pages,
+     * each page holds the slot headers followed by the element data
+     */
+    _Atomic(void*)* pages;
+
+    /*
+     * Tagged free list head:
+     * low 32 bits hold the slot index + 1 (0 for empty list),
+     * high 32 bits hold a counter bumped on every change to avoid ABA
+     */
+    _Atomic uint64_t free_list_head;
+
+    /* Number of slots ever handed out (high water mark) */
+    _Atomic uint32_t num_slots;
+
+    /* Size of each entry */
+    size_t esz;
+
+    /* Distance between entries inside a page, esz rounded up to pointer alignment */
+    size_t stride;
+};
+
+/*
+ * cslot_map_init - initialize the concurrent slot_map
+ * @sm: the slot map to initialize
+ * @esz: each element's size
+ */
+void cslot_map_init(struct cslot_map* sm, size_t esz);
+
+/*
+ * cslot_map_destroy - free the concurrent slot_map, no other thread may access it
+ * @sm: the slot map to free
+ */
+void cslot_map_destroy(struct cslot_map* sm);
+
+/*
+ * cslot_map_reserve - reserve a key, lock-free, callable from any thread
+ * @sm: the slot map
+ * Returns SM_INVALID_KEY if the map is full
+ */
+sm_key cslot_map_reserve(struct cslot_map* sm);
+
+/*
+ * cslot_map_publish - store element data for a reserved key and make it visible
+ * @sm: the slot map
+ * @k: a key returned by cslot_map_reserve that has not been published yet
+ * @data: the element's data to publish
+ * Returns 1 on success, 0 if the key is stale or already published
+ */
+int cslot_map_publish(struct cslot_map* sm, sm_key k, void* data);
+
+/*
+ * cslot_map_lookup - lookup a published element, wait-free
+ * @sm: the slot map
+ * @k: the key that references the element we want to lookup
+ */
+void* cslot_map_lookup(struct cslot_map* sm, sm_key k);
+
+/*
+ * cslot_map_remove - remove a published element or drop a reservation
+ * @sm: the slot map
+ * @k: the key that references the element we want to remove
+ */
+int cslot_map_remove(struct cslot_map* sm, sm_key k);
+
+/*
+ * cslot_map_slot_data - fetch the published data in slot index (or null)
+ * @sm: the slot map
+ * @idx: the slot index, up to cslot_map_num_slots
+ */
+void* cslot_map_slot_data(struct cslot_map* sm, size_t idx);
+
+/*
+ * cslot_map_num_slots - number of slots ever handed out
+ * @sm: the slot map
+ */
+size_t cslot_map_num_slots(struct cslot_map* sm);
+
+#endif /* ! _CSLOT_MAP_H_ */
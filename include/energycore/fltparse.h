@@ -28,19 +28,17 @@
 /*   ' ') '( (/                                                                                                      */
 /*     '   '  `                                                                                                      */
 /*********************************************************************************************************************/
-#ifndef _VCOPT_H_
-#define _VCOPT_H_
-
-#include <stdint.h>
+#ifndef _FLTPARSE_H_
+#define _FLTPARSE_H_
 
 /*
- * Linear-Speed Vertex Cache Optimisation
- * by Tom Forsyth
+ * Correctly rounded decimal to binary floating point conversion,
+ * shared by the text asset loaders.
+ * Accepts [+-]digits[.digits][(e|E)[+-]digits], inf and nan.
+ * On return *end (if not null) points past the consumed characters,
+ * or to str if no conversion could be performed (like strtod).
  */
-typedef uint32_t forsyth_vertex_index_type;
-forsyth_vertex_index_type* forsyth_reorder_indices(forsyth_vertex_index_type* out_indices,
-                                                   const forsyth_vertex_index_type* indices,
-                                                   int n_triangles,
-                                                   int n_vertices);
+double fltparse_double(const char* str, const char** end);
+float fltparse_float(const char* str, const char** end);
 
-#endif /* ! _VCOPT_H_ */
+#endif /* ! _FLTPARSE_H_ */
@@ -34,6 +34,8 @@
 #include <linalgb.h>
 #include "resource.h"
 
+#define RENDERER_MAX_SHADOW_CASCADES 4
+
 /*-----------------------------------------------------------------
  * Renderer input
  *-----------------------------------------------------------------*/
@@ -41,6 +43,8 @@ struct render_object {
     rid mesh;
     rid materials[16];
     float model_mat[16];
+    /* Set for objects that move, static ones get their shadows cached */
+    unsigned int dynamic;
 };
 
 struct render_light {
@@ -65,6 +69,8 @@ struct render_light {
         struct {
             vec3 position;
             vec3 direction;
+            float radius;
+            /* Half angles in radians */
             float inner_cone;
             float outer_cone;
         } spt;
@@ -109,23 +115,45 @@ struct renderer_state {
         unsigned int show_normals;
         unsigned int show_gidata;
         unsigned int use_occlusion_culling;
+        unsigned int use_cluster_culling;
+        unsigned int use_lods;
+        unsigned int use_instancing;
         unsigned int use_normal_mapping;
         unsigned int use_rough_met_maps;
         unsigned int use_detail_maps;
         unsigned int use_shadows;
+        unsigned int use_layered_shadows;
+        unsigned int use_tiled_lighting;
         unsigned int use_envlight;
         unsigned int use_bloom;
         unsigned int use_tonemapping;
         unsigned int use_gamma_correction;
         unsigned int use_antialiasing;
         unsigned int use_ssao;
+        /* Shadow cascade setup, resolutions are per cascade */
+        unsigned int shadow_cascades;
+        unsigned int shadow_resolution[RENDERER_MAX_SHADOW_CASCADES];
+        float shadow_split_lambda;
+        float shadow_distance;
+        /* GPU time spent on probe updates per frame, zero updates all pending probes at once */
+        float gi_budget_msec;
+        /* Existing directory caching data derived from unchanged inputs, the brdf lut and filtered skies, none when null.
+         * Shader binaries are only cached in the directory given to renderer_init */
+        const char* cache_dir;
     } options;
 };
 
 /* Public interface */
-void renderer_init(struct renderer_state* rs);
+/* Cache directory keeps data derived from unchanged inputs across runs, shader binaries included, none when null */
+void renderer_init(struct renderer_state* rs, const char* cache_dir);
 void renderer_render(struct renderer_state* rs, struct render_scene* rscn, float view_mat[16]);
 void renderer_gi_update(struct renderer_state* rs, struct render_scene* rscn);
+/* GI probe placement, a grid spanning the given bounds replaces any previous probes */
+void renderer_gi_probe_grid(struct renderer_state* rs, float bmin[3], float bmax[3], unsigned int dims[3]);
+void renderer_gi_add_probe(struct renderer_state* rs, float pos[3]);
+/* GI probe cache keyed by scene content, loading returns zero when missing or stale, baking updates all probes at once */
+int renderer_gi_load(struct renderer_state* rs, struct render_scene* rscn, const char* path);
+int renderer_gi_bake(struct renderer_state* rs, struct render_scene* rscn, const char* path);
 void renderer_resize(struct renderer_state* rs, unsigned int width, unsigned int height);
 void renderer_destroy(struct renderer_state* rs);
 
@@ -32,6 +32,7 @@
 #define _RESOURCE_H_
 
 #include "slot_map.h"
+#include "cslot_map.h"
 #include "scene_asset.h"
 
 /* Abstract resource handle */
@@ -44,6 +45,8 @@ int rid_null(rid);
 /* Texture resource */
 struct render_texture {
     unsigned int id;
+    /* Content hash of the source data, zero when unknown */
+    unsigned long long hash;
 };
 
 struct render_texture_info {
@@ -91,6 +94,7 @@ struct render_material {
 };
 
 /* Mesh resource */
+#define RENDER_SHAPE_MAX_LODS 5
 struct render_mesh {
     struct render_shape {
         unsigned int vao;
@@ -99,6 +103,19 @@ struct render_mesh {
         unsigned int num_elems;
         float bb_min[3], bb_max[3];
         unsigned int mat_idx;
+        /* Content hash of the uploaded vertex and index data */
+        unsigned long long hash;
+        /* Levels of detail as element buffer ranges, finest first */
+        struct render_lod {
+            unsigned int first_index;
+            unsigned int num_indices;
+            /* Upper bound of the simplification error, in mesh units */
+            float error;
+            /* Clusters over the range, used for culling */
+            struct meshlet* meshlets;
+            unsigned int num_meshlets;
+        } lods[RENDER_SHAPE_MAX_LODS];
+        unsigned int num_lods;
     } shapes[16];
     size_t num_shapes;
 };
@@ -108,10 +125,20 @@ struct resmgr {
     struct slot_map textures;
     struct slot_map materials;
     struct slot_map meshes;
+    /* Thread-safe registry, replaces the above when in concurrent mode */
+    struct {
+        struct cslot_map textures;
+        struct cslot_map materials;
+        struct cslot_map meshes;
+    } ts;
+    int concurrent;
+    /* Accumulated vertex cache behavior of added meshes */
+    struct shape_vcache_stats vcache_stats;
 };
 
 /* Resource manager constructor / destructor */
 void resmgr_init(struct resmgr* rmgr);
+void resmgr_init_concurrent(struct resmgr* rmgr);
 void resmgr_destroy(struct resmgr* rmgr);
 void resmgr_default_rmat(struct render_material* rmat);
 
@@ -122,7 +149,23 @@ rid resmgr_add_texture_file(struct resmgr* rmgr, const char* filepath);
 rid resmgr_add_material(struct resmgr* rmgr, struct render_material* rmat);
 rid resmgr_add_mesh(struct resmgr* rmgr, struct mesh* sh);
 
-/* Reference to resource */
+/* Image decoder for batch texture loading, called concurrently from pool threads */
+typedef image(*resmgr_image_load_fn)(const char* path);
+/* Decode files in parallel (image_from_file when load is null) and upload them,
+ * ids of files that fail to decode are set to INVALID_RID */
+void resmgr_add_textures(struct resmgr* rmgr, const char** paths, size_t count, resmgr_image_load_fn load, rid* ids);
+
+/* Reserve resource id from any thread (concurrent mode), resolvable once published */
+rid resmgr_reserve_texture(struct resmgr* rmgr);
+rid resmgr_reserve_material(struct resmgr* rmgr);
+rid resmgr_reserve_mesh(struct resmgr* rmgr);
+
+/* Publish uploaded resource behind a reserved id (concurrent mode) */
+int resmgr_publish_texture(struct resmgr* rmgr, rid id, struct render_texture* rt);
+int resmgr_publish_material(struct resmgr* rmgr, rid id, struct render_material* rmat);
+int resmgr_publish_mesh(struct resmgr* rmgr, rid id, struct render_mesh* rm);
+
+/* Reference to resource (wait-free in concurrent mode) */
 struct render_texture* resmgr_get_texture(struct resmgr* rmgr, rid id);
 struct render_material* resmgr_get_material(struct resmgr* rmgr, rid id);
 struct render_mesh* resmgr_get_mesh(struct resmgr* rmgr, rid id);
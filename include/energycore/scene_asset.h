@@ -491,6 +491,14 @@ vec2f scene_compute_animation_range(const struct scene* scn);
 void shape_compute_normals(struct shape* shp);
 /* Compute per-vertex tangent frame for triangle meshes. */
 void shape_compute_tangent_frame(struct shape* shp);
+/* Simulated vertex cache behavior of a shape, before and after index optimization.
+ * ACMR is misses per triangle, ATVR is misses per referenced vertex. */
+struct shape_vcache_stats {
+    size_t num_tris, num_verts;
+    size_t misses_before, misses_after;
+};
+/* Reorder triangles for vertex cache locality and overdraw, and vertices in first use order. */
+void shape_optimize_indices(struct shape* shp, struct shape_vcache_stats* stats);
 /* Computes a shape bounding box using a quick computation that ignores radius. */
 bbox3f shape_compute_bounds(const struct shape* shp);
 /* Compute a scene bounding box. */
@@ -14,8 +14,9 @@ uniform vec3 view_pos;
 uniform mat4 view;
 
 uniform bool shadows_enabled;
-uniform sampler2DArrayShadow shadowmap;
-uniform shadow_cascade cascades[4];
+uniform sampler2DShadow shadowmap;
+uniform shadow_cascade cascades[SHADOW_MAX_CASCADES];
+uniform int num_cascades;
 
 void main()
 {
@@ -40,7 +41,7 @@ void main()
 
     // Shadow
     float shadow = shadows_enabled
-        ? shadow_coef(shadowmap, cascades, d.ws_pos, d.normal, L, view)
+        ? shadow_coef(shadowmap, cascades, num_cascades, d.ws_pos, d.normal, L, view)
         : 0.0;
 
     // Final
@@ -1,24 +1,50 @@
-#version 330 core
+#version 430 core
 #include "inc/deferred.glsl"
 #include "inc/light.glsl"
-#ifdef SH
 #include "inc/sh.glsl"
-#endif
 out vec4 color;
 in vec2 uv;
 
 uniform vec3 view_pos;
 
-#ifndef SH
 uniform samplerCube irr_map;
 uniform samplerCube pf_map;
-#else
-uniform vec3 sh_coeffs[SH_COEFF_NUM];
-#endif
 uniform sampler2D brdf_lut;
 uniform bool use_occlussion;
 uniform sampler2D occlussion;
 
+// Probe volume, L2 SH coefficients per node
+layout(std430, binding = 5) readonly buffer gi_volume_buf { vec4 gi_volume_sh[]; };
+uniform bool gi_volume_enabled;
+uniform vec3 gi_volume_min;
+uniform vec3 gi_volume_cell;
+uniform ivec3 gi_volume_dims;
+
+// Blends the eight volume nodes around the position, nodes behind the surface are faded out to limit leaking
+vec3 gi_volume_irradiance(vec3 P, vec3 N)
+{
+    vec3 g = clamp((P - gi_volume_min) / gi_volume_cell, vec3(0.0), vec3(gi_volume_dims - 1));
+    ivec3 base = min(ivec3(g), gi_volume_dims - 2);
+    vec3 f = g - vec3(base);
+    vec3 coeffs[SH_L2_COEFF_NUM] = vec3[](vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0),
+                            vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0));
+    float wsum = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        ivec3 o = ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        vec3 t = mix(1.0 - f, f, vec3(o));
+        vec3 node_pos = gi_volume_min + vec3(base + o) * gi_volume_cell;
+        float facing = (dot(normalize(node_pos - P + N * 1e-3), N) + 1.0) * 0.5;
+        float w = t.x * t.y * t.z * (facing * facing + 0.05);
+        int n = ((base.z + o.z) * gi_volume_dims.y + base.y + o.y) * gi_volume_dims.x + base.x + o.x;
+        for (int c = 0; c < SH_L2_COEFF_NUM; ++c)
+            coeffs[c] += gi_volume_sh[n * SH_L2_COEFF_NUM + c].rgb * w;
+        wsum += w;
+    }
+    for (int c = 0; c < SH_L2_COEFF_NUM; ++c)
+        coeffs[c] /= max(wsum, 1e-4);
+    return max(sh_irradiance_l2(N, coeffs), vec3(0.0));
+}
+
 void main()
 {
     // Prologue
@@ -33,10 +59,10 @@ void main()
     if (d.normal == vec3(0.0))
         discard;
 
-#ifdef SH
-    // Diffuse irradiance from SH coeffs
-    vec3 env_col = sh_irradiance(d.normal, sh_coeffs);
-#endif
+    // Diffuse irradiance from the probe volume when there is one, from the fallback probe otherwise
+    vec3 irradiance = gi_volume_enabled
+        ? gi_volume_irradiance(d.ws_pos, d.normal)
+        : texture(irr_map, d.normal).rgb;
 
     // View vector
     vec3 V = normalize(view_pos - d.ws_pos);
@@ -44,9 +70,9 @@ void main()
     // Ambient
     float ao = use_occlussion ? texture(occlussion, uv).r : 1.0;
     float intensity = 0.2;
-    vec3 environ = env_radiance(
+    vec3 environ = env_radiance_irr(
         d.normal, V, d.albedo, d.metallic,
-        d.roughness, irr_map, pf_map, brdf_lut) * ao;
+        d.roughness, irradiance, pf_map, brdf_lut) * ao;
 
     color = vec4(intensity * environ, 1.0);
 }
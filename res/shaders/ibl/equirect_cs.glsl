@@ -0,0 +1,32 @@
+#version 430 core
+#define PI 3.14159265359
+#define GROUP_SIZE 8
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE, local_size_z = 1) in;
+layout(rgba16f, binding = 0) uniform writeonly imageCube cubemap;
+uniform sampler2D equirect;
+uniform int face_size;
+
+// Direction through a face position in [-1, 1], following the cubemap face layout
+vec3 cube_dir(uint face, vec2 uv)
+{
+    switch (face) {
+        case 0u: return vec3( 1.0, -uv.y, -uv.x);
+        case 1u: return vec3(-1.0, -uv.y,  uv.x);
+        case 2u: return vec3( uv.x,  1.0,  uv.y);
+        case 3u: return vec3( uv.x, -1.0, -uv.y);
+        case 4u: return vec3( uv.x, -uv.y,  1.0);
+        default: return vec3(-uv.x, -uv.y, -1.0);
+    }
+}
+
+void main()
+{
+    ivec3 texel = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(texel.xy, ivec2(face_size))))
+        return;
+    vec2 uv = (vec2(texel.xy) + 0.5) / float(face_size) * 2.0 - 1.0;
+    vec3 dir = cube_dir(uint(texel.z), uv);
+    // Longitude and latitude
+    vec2 eq = vec2(atan(dir.z, dir.x) / (2.0 * PI), atan(dir.y, length(dir.xz)) / PI) + 0.5;
+    imageStore(cubemap, texel, vec4(textureLod(equirect, eq, 0.0).rgb, 1.0));
+}
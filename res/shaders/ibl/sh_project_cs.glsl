@@ -0,0 +1,79 @@
+#version 430 core
+#include "../inc/sh.glsl"
+#define GROUP_SIZE 16
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE, local_size_z = 1) in;
+layout(binding = 0) uniform samplerCube envmap;
+layout(std430, binding = 6) writeonly buffer sh_partial_buf { vec4 partials[]; };
+
+shared vec4 group_sums[GROUP_SIZE * GROUP_SIZE];
+
+// Direction through a face position in [-1, 1], following the cubemap face layout
+vec3 cube_dir(uint face, vec2 uv)
+{
+    switch (face) {
+        case 0u: return vec3( 1.0, -uv.y, -uv.x);
+        case 1u: return vec3(-1.0, -uv.y,  uv.x);
+        case 2u: return vec3( uv.x,  1.0,  uv.y);
+        case 3u: return vec3( uv.x, -1.0, -uv.y);
+        case 4u: return vec3( uv.x, -uv.y,  1.0);
+        default: return vec3(-uv.x, -uv.y, -1.0);
+    }
+}
+
+float area_element(float x, float y)
+{
+    return atan(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+float texel_solid_angle(vec2 uv, float inv_size)
+{
+    vec2 p0 = uv - inv_size, p1 = uv + inv_size;
+    return area_element(p1.x, p1.y) - area_element(p0.x, p1.y)
+         - area_element(p1.x, p0.y) + area_element(p0.x, p0.y);
+}
+
+void main()
+{
+    int face_size = textureSize(envmap, 0).x;
+    float inv_size = 1.0 / float(face_size);
+    uint face = gl_WorkGroupID.z;
+
+    // Each invocation projects a 2x2 texel quad
+    vec3 acc[SH_L2_COEFF_NUM];
+    for (int i = 0; i < SH_L2_COEFF_NUM; ++i)
+        acc[i] = vec3(0.0);
+    float weight = 0.0;
+    uvec2 base = gl_GlobalInvocationID.xy * 2u;
+    for (uint i = 0u; i < 4u; ++i) {
+        uvec2 t = base + uvec2(i & 1u, i >> 1u);
+        if (any(greaterThanEqual(t, uvec2(face_size))))
+            continue;
+        vec2 uv = (vec2(t) + 0.5) * 2.0 * inv_size - 1.0;
+        vec3 dir = normalize(cube_dir(face, uv));
+        float w = texel_solid_angle(uv, inv_size);
+        vec3 col = textureLod(envmap, dir, 0.0).rgb;
+        float sh_basis[SH_L2_COEFF_NUM];
+        sh_eval_basis3(sh_basis, dir);
+        for (int c = 0; c < SH_L2_COEFF_NUM; ++c)
+            acc[c] += col * sh_basis[c] * w;
+        weight += w;
+    }
+
+    // Tree reduce every coefficient over the group, the solid angle sum rides along in w
+    uint idx = gl_LocalInvocationIndex;
+    uint group = (gl_WorkGroupID.z * gl_NumWorkGroups.y + gl_WorkGroupID.y) * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    for (int c = 0; c < SH_L2_COEFF_NUM; ++c) {
+        group_sums[idx] = vec4(acc[c], weight);
+        memoryBarrierShared();
+        barrier();
+        for (uint s = uint(GROUP_SIZE * GROUP_SIZE) / 2u; s > 0u; s >>= 1u) {
+            if (idx < s)
+                group_sums[idx] += group_sums[idx + s];
+            memoryBarrierShared();
+            barrier();
+        }
+        if (idx == 0u)
+            partials[group * uint(SH_L2_COEFF_NUM) + uint(c)] = group_sums[0];
+        barrier();
+    }
+}
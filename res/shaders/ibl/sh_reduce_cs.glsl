@@ -0,0 +1,36 @@
+#version 430 core
+#include "../inc/sh.glsl"
+#define GROUP_SIZE 256
+layout(local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(std430, binding = 6) readonly buffer sh_partial_buf { vec4 partials[]; };
+layout(std430, binding = 7) buffer sh_out_buf { vec4 sh_out[]; };
+
+uniform uint num_partials;
+uniform uint out_slot;
+
+shared vec4 group_sums[GROUP_SIZE];
+
+void main()
+{
+    uint idx = gl_LocalInvocationIndex;
+    for (int c = 0; c < SH_L2_COEFF_NUM; ++c) {
+        vec4 sum = vec4(0.0);
+        for (uint i = idx; i < num_partials; i += uint(GROUP_SIZE))
+            sum += partials[i * uint(SH_L2_COEFF_NUM) + uint(c)];
+        group_sums[idx] = sum;
+        memoryBarrierShared();
+        barrier();
+        for (uint s = uint(GROUP_SIZE) / 2u; s > 0u; s >>= 1u) {
+            if (idx < s)
+                group_sums[idx] += group_sums[idx + s];
+            memoryBarrierShared();
+            barrier();
+        }
+        // Normalize so that the texel solid angles cover the whole sphere
+        if (idx == 0u) {
+            vec4 total = group_sums[0];
+            sh_out[out_slot * uint(SH_L2_COEFF_NUM) + uint(c)] = vec4(total.rgb * (4.0 * SQRT_PI * SQRT_PI / total.w), 0.0);
+        }
+        barrier();
+    }
+}
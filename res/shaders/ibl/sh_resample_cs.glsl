@@ -0,0 +1,30 @@
+#version 430 core
+#include "../inc/sh.glsl"
+#define GROUP_SIZE 64
+#define NEAREST 4
+layout(local_size_x = GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+// Probes blended into each volume node, unused taps have zero weight
+struct node_taps {
+    uvec4 probes;
+    vec4 weights;
+};
+layout(std430, binding = 5) writeonly buffer volume_sh_buf { vec4 volume_sh[]; };
+layout(std430, binding = 6) readonly buffer taps_buf { node_taps taps[]; };
+layout(std430, binding = 7) readonly buffer probe_sh_buf { vec4 probe_sh[]; };
+
+uniform uint num_nodes;
+
+void main()
+{
+    uint n = gl_GlobalInvocationID.x;
+    if (n >= num_nodes)
+        return;
+    node_taps t = taps[n];
+    for (int c = 0; c < SH_L2_COEFF_NUM; ++c) {
+        vec4 sum = vec4(0.0);
+        for (int k = 0; k < NEAREST; ++k)
+            sum += probe_sh[t.probes[k] * uint(SH_L2_COEFF_NUM) + uint(c)] * t.weights[k];
+        volume_sh[n * uint(SH_L2_COEFF_NUM) + uint(c)] = sum;
+    }
+}
@@ -45,6 +45,22 @@ vec3 gbuffer_position(vec2 coord)
     return ws_pos_from_depth(coord, depth);
 }
 
+// Fetches gbuffer data of the given pixel
+void fetch_gbuffer_data_at(ivec2 st)
+{
+    vec2 coord = (vec2(st) + 0.5) / u_screen;
+    d.ws_pos = ws_pos_from_depth(coord, texelFetch(gbuf.depth, st, 0).r);
+    vec2 pckd_nm = texelFetch(gbuf.normal, st, 0).rg;
+    vec3 albedo  = texelFetch(gbuf.albedo, st, 0).rgb;
+    vec2 rgh_met = texelFetch(gbuf.roughness_metallic, st, 0).rg;
+    d.normal    = unpack_normal_octahedron(pckd_nm);
+    d.albedo    = albedo;
+    d.roughness = rgh_met.r;
+    d.metallic  = rgh_met.g;
+}
+
+// Compute shaders have no fragment coordinate and fetch by pixel
+#ifndef DEFERRED_COMPUTE
 vec3 reconstruct_wpos_from_depth()
 {
     vec2 st = gl_FragCoord.xy / u_screen;
@@ -54,13 +70,6 @@ vec3 reconstruct_wpos_from_depth()
 
 void fetch_gbuffer_data()
 {
-    ivec2 st = ivec2(gl_FragCoord.xy);
-    d.ws_pos = reconstruct_wpos_from_depth();
-    vec2 pckd_nm = texelFetch(gbuf.normal, st, 0).rg;
-    vec3 albedo  = texelFetch(gbuf.albedo, st, 0).rgb;
-    vec2 rgh_met = texelFetch(gbuf.roughness_metallic, st, 0).rg;
-    d.normal    = unpack_normal_octahedron(pckd_nm);
-    d.albedo    = albedo;
-    d.roughness = rgh_met.r;
-    d.metallic  = rgh_met.g;
+    fetch_gbuffer_data_at(ivec2(gl_FragCoord.xy));
 }
+#endif
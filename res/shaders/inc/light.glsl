@@ -130,7 +130,8 @@ vec3 radiance(vec3 N, vec3 V, vec3 L, vec3 light_col, float attenuation, vec3 al
     return Lo;
 }
 
-vec3 env_radiance(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, samplerCube irr_map, samplerCube pf_map, sampler2D brdf_lut)
+// Environment lighting with the diffuse irradiance given by the caller
+vec3 env_radiance_irr(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, vec3 irradiance, samplerCube pf_map, sampler2D brdf_lut)
 {
     // Calculate reflectance at normal incidence; if dia-electric (like plastic) use f0
     // of 0.04 and if it's a metal, use their albedo color as f0 (metallic workflow)
@@ -155,7 +156,6 @@ vec3 env_radiance(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness,
     kD *= 1.0 - metallic;
 
     // Calculate diffuse ambient component
-    vec3 irradiance = texture(irr_map, N).rgb;
     vec3 diffuse = irradiance * albedo;
 
     // Calculate specular ambient component
@@ -170,3 +170,8 @@ vec3 env_radiance(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness,
     vec3 ambient = (kD * diffuse + specular);
     return ambient;
 }
+
+vec3 env_radiance(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, samplerCube irr_map, samplerCube pf_map, sampler2D brdf_lut)
+{
+    return env_radiance_irr(N, V, albedo, metallic, roughness, texture(irr_map, N).rgb, pf_map, brdf_lut);
+}
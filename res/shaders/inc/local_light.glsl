@@ -0,0 +1,35 @@
+//
+// local_light.glsl
+//
+struct local_light {
+    vec4 pos_radius;
+    vec4 color_inner; // Color premultiplied by intensity, spot inner cone cosine
+    vec4 dir_outer;   // Spot direction and outer cone cosine, below -1 for point lights
+    vec4 bounds;      // World space bounding sphere
+};
+layout(std430, binding = 2) readonly buffer light_buf { local_light lights[]; };
+
+// Inverse square falloff windowed to reach zero at the light radius
+float distance_attenuation(float dist, float radius)
+{
+    float f = dist / radius;
+    f *= f;
+    float w = clamp(1.0 - f * f, 0.0, 1.0);
+    return w * w / (dist * dist + 1.0);
+}
+
+// Outgoing radiance towards V from a point or spot light, for the fetched gbuffer data
+vec3 local_light_radiance(local_light l, vec3 V)
+{
+    vec3 to_light = l.pos_radius.xyz - d.ws_pos;
+    float dist = length(to_light);
+    if (dist >= l.pos_radius.w)
+        return vec3(0.0);
+    vec3 L = to_light / dist;
+    float attenuation = distance_attenuation(dist, l.pos_radius.w);
+    if (l.dir_outer.w > -1.5)
+        attenuation *= smoothstep(l.dir_outer.w, l.color_inner.w, dot(-L, l.dir_outer.xyz));
+    return radiance(d.normal, V, L,
+                    l.color_inner.rgb, attenuation,
+                    d.albedo, d.metallic, d.roughness);
+}
@@ -4,6 +4,8 @@
 
 // Number off coefficients (5th order)
 const int SH_COEFF_NUM = 25;
+// Number of coefficients kept for irradiance (3rd order)
+const int SH_L2_COEFF_NUM = 9;
 
 // Precalculated basis constants
 const float SQRT_PI = 1.7724538509055160272981674833411451827975494561223871;
@@ -74,6 +76,25 @@ void sh_eval_basis5(inout float sh_basis[SH_COEFF_NUM], vec3 dir)
     sh_basis[24] = K18 * (x4 - 6.0 * y2 * x2 + y4);
 }
 
+void sh_eval_basis3(inout float sh_basis[SH_L2_COEFF_NUM], vec3 dir)
+{
+    float x = dir.x;
+    float y = dir.y;
+    float z = dir.z;
+
+    sh_basis[0] = K0;
+
+    sh_basis[1] = -K1 * y;
+    sh_basis[2] = K1 * z;
+    sh_basis[3] = -K1 * x;
+
+    sh_basis[4] = K2 * y * x;
+    sh_basis[5] = K3 * y * z;
+    sh_basis[6] = K4 * (3.0 * z * z - 1.0);
+    sh_basis[7] = K3 * x * z;
+    sh_basis[8] = K5 * (x * x - y * y);
+}
+
 vec3 sh_irradiance(vec3 dir, vec3 sh_coef[SH_COEFF_NUM])
 {
     /* Eval basis for current direction */
@@ -103,3 +124,21 @@ vec3 sh_irradiance(vec3 dir, vec3 sh_coef[SH_COEFF_NUM])
 
     return irr;
 }
+
+vec3 sh_irradiance_l2(vec3 dir, vec3 sh_coef[SH_L2_COEFF_NUM])
+{
+    /* Eval basis for current direction */
+    float sh_basis[SH_L2_COEFF_NUM];
+    sh_eval_basis3(sh_basis, dir);
+
+    /* Band 0 (factor 1.0) */
+    vec3 irr = sh_coef[0] * sh_basis[0];
+    /* Band 1 (factor 2/3). */
+    for (int ii = 1; ii < 4; ++ii)
+        irr += sh_coef[ii] * sh_basis[ii] * (2.0/3.0);
+    /* Band 2 (factor 1/4). */
+    for (int ii = 4; ii < 9; ++ii)
+        irr += sh_coef[ii] * sh_basis[ii] * (1.0/4.0);
+
+    return irr;
+}
@@ -2,40 +2,27 @@
 // swadow.glsl
 //
 #include "math.glsl"
+#define SHADOW_MAX_CASCADES 4
 struct shadow_cascade {
     vec2 plane;
     mat4 vp_mat;
+    vec4 rect; // Atlas region offset (xy) and scale (zw)
 };
 
-vec4 shadow_cascade_weights(float depth, vec4 split_nears, vec4 split_fars)
+int shadow_cascade_index(float depth, shadow_cascade cascades[SHADOW_MAX_CASCADES], int num_cascades)
 {
-    vec4 near = step(split_nears, vec4(depth));
-    vec4 far = step(depth, split_fars);
-    return near * far;
+    for (int i = 0; i < num_cascades; ++i)
+        if (depth >= cascades[i].plane.x && depth <= cascades[i].plane.y)
+            return i;
+    return -1;
 }
 
-float weighted_array_value(vec4 weights, float v[4])
+vec3 shadow_cascade_color(int cascade)
 {
-    return v[0] * weights.x
-         + v[1] * weights.y
-         + v[2] * weights.z
-         + v[3] * weights.w;
-}
-
-mat4 shadow_cascade_view_projection(vec4 weights, mat4 view_proj[4])
-{
-    return view_proj[0] * weights.x
-         + view_proj[1] * weights.y
-         + view_proj[2] * weights.z
-         + view_proj[3] * weights.w;
-}
-
-vec3 shadow_cascade_color(vec4 weights)
-{
-    return vec3(1,0,0) * weights.x
-         + vec3(0,1,0) * weights.y
-         + vec3(0,0,1) * weights.z
-         + vec3(1,0,1) * weights.w;
+    const vec3 colors[SHADOW_MAX_CASCADES] = vec3[](
+        vec3(1,0,0), vec3(0,1,0), vec3(0,0,1), vec3(1,0,1)
+    );
+    return cascade < 0 ? vec3(0.0) : colors[cascade];
 }
 
 bool is_vertex_in_shadow_map(vec3 coord)
@@ -48,23 +35,21 @@ bool is_vertex_in_shadow_map(vec3 coord)
 }
 
 float calc_shadow_coef(
-    sampler2DArrayShadow shadow_map,
+    sampler2DShadow shadow_map,
     vec3 vws_pos,
     vec3 vvs_pos,
-    mat4 lview_projs[4],
-    vec2 split_planes[4],
+    shadow_cascade cascades[SHADOW_MAX_CASCADES],
+    int num_cascades,
     float bias
 )
 {
     // Find frustum section
-    vec4 cascade_weights = shadow_cascade_weights(-vvs_pos.z,
-        vec4(split_planes[0].x, split_planes[1].x, split_planes[2].x, split_planes[3].x),
-        vec4(split_planes[0].y, split_planes[1].y, split_planes[2].y, split_planes[3].y)
-    );
+    int cascade = shadow_cascade_index(-vvs_pos.z, cascades, num_cascades);
+    if (cascade < 0)
+        return 0.0;
 
     // Get vertex position in light space
-    mat4 view_proj = shadow_cascade_view_projection(cascade_weights, lview_projs);
-    vec4 vertex_light_pos = view_proj * vec4(vws_pos, 1.0);
+    vec4 vertex_light_pos = cascades[cascade].vp_mat * vec4(vws_pos, 1.0);
     // Perform perspective divide
     vec3 coords = vertex_light_pos.xyz / vertex_light_pos.w;
     // Transform to [0,1] range
@@ -74,22 +59,25 @@ float calc_shadow_coef(
     if(!is_vertex_in_shadow_map(coords))
         return 0.0;
 
-    // Fetch the layer index of the current used cascade
-    float layer = weighted_array_value(cascade_weights, float[](0.0, 1.0, 2.0, 3.0));
+    // Map into the cascade's atlas region
+    vec4 rect = cascades[cascade].rect;
+    vec2 uv = rect.xy + coords.xy * rect.zw;
     // Get depth of current fragment from light's perspective
     float current_depth = coords.z;
 
     // Calculate shadow factor
     float shadow = 0.0;
     // No PCF
-    //shadow = texture(shadow_map, vec4(coords.xy, layer, current_depth - bias));
+    //shadow = texture(shadow_map, vec3(uv, current_depth - bias));
 
-    // PCF
-    vec2 texel_size = 1.0 / textureSize(shadow_map, 0).xy;
+    // PCF, taps are kept inside the region so neighbouring cascades never bleed in
+    vec2 texel_size = 1.0 / textureSize(shadow_map, 0);
+    vec2 uv_min = rect.xy + 0.5 * texel_size;
+    vec2 uv_max = rect.xy + rect.zw - 0.5 * texel_size;
     for(int x = -1; x <= 1; ++x) {
         for(int y = -1; y <= 1; ++y) {
-            vec4 tc = vec4(coords.xy + vec2(x, y) * texel_size, layer, current_depth - bias);
-            shadow += texture(shadow_map, tc);
+            vec2 tc = clamp(uv + vec2(x, y) * texel_size, uv_min, uv_max);
+            shadow += texture(shadow_map, vec3(tc, current_depth - bias));
         }
     }
     shadow /= 9.0;
@@ -115,12 +103,9 @@ vec3 get_biased_position(vec3 pos, float slope_bias, float normal_bias, vec3 nor
     return pos;
 }
 
-float shadow_coef(sampler2DArrayShadow shadowmap, shadow_cascade cascades[4], vec3 ws_pos, vec3 normal, vec3 light_dir, mat4 view)
+float shadow_coef(sampler2DShadow shadowmap, shadow_cascade cascades[SHADOW_MAX_CASCADES], int num_cascades,
+                  vec3 ws_pos, vec3 normal, vec3 light_dir, mat4 view)
 {
-    mat4 vp_mats[4]   = mat4[](cascades[0].vp_mat, cascades[1].vp_mat,
-                               cascades[2].vp_mat, cascades[3].vp_mat);
-    vec2 sp_planes[4] = vec2[](cascades[0].plane, cascades[1].plane,
-                               cascades[2].plane, cascades[3].plane);
     // TODO: make this configurable
     // XXX: Scale by resolution (higher resolution needs smaller bias)
     const float slope_bias  = 0.001;
@@ -128,18 +113,12 @@ float shadow_coef(sampler2DArrayShadow shadowmap, shadow_cascade cascades[4], ve
     const float const_bias  = 0.001;
     vec3 biased_pos = get_biased_position(ws_pos, slope_bias, normal_bias, normal, light_dir);
     vec3 vs_pos = (view * vec4(biased_pos, 1.0)).xyz;
-    float shadow = calc_shadow_coef(shadowmap, biased_pos, vs_pos, vp_mats, sp_planes, const_bias);
+    float shadow = calc_shadow_coef(shadowmap, biased_pos, vs_pos, cascades, num_cascades, const_bias);
     return shadow;
 }
 
-vec3 cascades_vis(shadow_cascade cascades[4], mat4 view, vec3 ws_pos)
+vec3 cascades_vis(shadow_cascade cascades[SHADOW_MAX_CASCADES], int num_cascades, mat4 view, vec3 ws_pos)
 {
     vec3 vvs_pos = (view * vec4(ws_pos, 1.0)).xyz;
-    vec2 split_planes[4] = vec2[](cascades[0].plane, cascades[1].plane,
-                                  cascades[2].plane, cascades[3].plane);
-    vec4 cascade_weights = shadow_cascade_weights(-vvs_pos.z,
-        vec4(split_planes[0].x, split_planes[1].x, split_planes[2].x, split_planes[3].x),
-        vec4(split_planes[0].y, split_planes[1].y, split_planes[2].y, split_planes[3].y)
-    );
-    return shadow_cascade_color(cascade_weights);
+    return shadow_cascade_color(shadow_cascade_index(-vvs_pos.z, cascades, num_cascades));
 }
@@ -0,0 +1,40 @@
+#version 430 core
+#include "inc/deferred.glsl"
+#include "inc/light.glsl"
+#include "inc/local_light.glsl"
+out vec4 color;
+
+layout(std430, binding = 3) readonly buffer cluster_buf { uvec2 clusters[]; };
+layout(std430, binding = 4) readonly buffer index_buf { uint light_indices[]; };
+
+uniform uvec3 cluster_grid;
+uniform float cluster_tile_size;
+uniform float cluster_slice_scale;
+uniform float cluster_slice_bias;
+
+uniform vec3 view_pos;
+uniform mat4 view;
+
+uvec2 fetch_cluster(vec3 ws_pos)
+{
+    float depth = max(-(view * vec4(ws_pos, 1.0)).z, 1e-4);
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / cluster_tile_size), cluster_grid.xy - 1u);
+    float slice = clamp(log(depth) * cluster_slice_scale + cluster_slice_bias, 0.0, float(cluster_grid.z - 1u));
+    return clusters[(uint(slice) * cluster_grid.y + tile.y) * cluster_grid.x + tile.x];
+}
+
+void main()
+{
+    // Prologue
+    fetch_gbuffer_data();
+    uvec2 cluster = fetch_cluster(d.ws_pos);
+
+    // Accumulate the lights of the cluster
+    vec3 V = normalize(view_pos - d.ws_pos);
+    vec3 Lo = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; ++i)
+        Lo += local_light_radiance(lights[light_indices[cluster.x + i]], V);
+
+    // Final
+    color = vec4(Lo, 1.0);
+}
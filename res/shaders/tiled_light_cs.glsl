@@ -0,0 +1,118 @@
+#version 430 core
+#define DEFERRED_COMPUTE
+#include "inc/deferred.glsl"
+#include "inc/light.glsl"
+#include "inc/local_light.glsl"
+#include "inc/shadow.glsl"
+#define TILE_SIZE 16
+#define MAX_TILE_LIGHTS 512
+#define MAX_DIR_LIGHTS 4
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE, local_size_z = 1) in;
+layout(rgba16f, binding = 0) uniform writeonly image2D accum;
+
+struct dir_light {
+    vec3 direction;
+    vec3 color;
+    float intensity;
+};
+uniform dir_light dir_lights[MAX_DIR_LIGHTS];
+uniform int num_dir_lights;
+uniform uint num_local_lights;
+
+uniform vec3 view_pos;
+uniform mat4 view;
+uniform mat4 inv_proj;
+
+uniform bool shadows_enabled;
+uniform sampler2DShadow shadowmap;
+uniform shadow_cascade cascades[SHADOW_MAX_CASCADES];
+uniform int num_cascades;
+
+shared uint tile_min_depth;
+shared uint tile_max_depth;
+shared uint tile_num_lights;
+shared uint tile_lights[MAX_TILE_LIGHTS];
+
+// View space direction through a screen position
+vec3 view_ray(vec2 px)
+{
+    vec4 p = inv_proj * vec4(px / u_screen * 2.0 - 1.0, 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+void main()
+{
+    ivec2 px = ivec2(gl_GlobalInvocationID.xy);
+    bool inside = all(lessThan(px, ivec2(u_screen)));
+    if (gl_LocalInvocationIndex == 0u) {
+        tile_min_depth = 0x7f7fffffu;
+        tile_max_depth = 0u;
+        tile_num_lights = 0u;
+    }
+    barrier();
+
+    // Load the gbuffer sample once and reduce tile depth bounds,
+    // positive floats keep their order when compared as integers
+    bool geometry = inside && texelFetch(gbuf.depth, px, 0).r < 1.0;
+    if (geometry) {
+        fetch_gbuffer_data_at(px);
+        float depth = -(view * vec4(d.ws_pos, 1.0)).z;
+        atomicMin(tile_min_depth, floatBitsToUint(max(depth, 0.0)));
+        atomicMax(tile_max_depth, floatBitsToUint(max(depth, 0.0)));
+    }
+    barrier();
+
+    // Side planes of the tile frustum through the eye, facing inwards
+    vec2 tile_min = vec2(gl_WorkGroupID.xy * uint(TILE_SIZE));
+    vec2 tile_max = min(tile_min + vec2(TILE_SIZE), u_screen);
+    vec3 c00 = view_ray(tile_min), c11 = view_ray(tile_max);
+    vec3 c10 = view_ray(vec2(tile_max.x, tile_min.y)), c01 = view_ray(vec2(tile_min.x, tile_max.y));
+    vec3 center = c00 + c11;
+    vec3 planes[4] = vec3[](normalize(cross(c00, c10)), normalize(cross(c10, c11)),
+                            normalize(cross(c11, c01)), normalize(cross(c01, c00)));
+    for (int i = 0; i < 4; ++i)
+        planes[i] *= sign(dot(planes[i], center));
+    float min_depth = uintBitsToFloat(tile_min_depth);
+    float max_depth = uintBitsToFloat(tile_max_depth);
+
+    // Cull local lights against the tile, spread over the group
+    for (uint i = gl_LocalInvocationIndex; i < num_local_lights; i += uint(TILE_SIZE * TILE_SIZE)) {
+        vec4 b = lights[i].bounds;
+        vec3 c = (view * vec4(b.xyz, 1.0)).xyz;
+        bool visible = -c.z + b.w >= min_depth && -c.z - b.w <= max_depth;
+        for (int p = 0; p < 4; ++p)
+            visible = visible && dot(planes[p], c) >= -b.w;
+        if (visible) {
+            uint slot = atomicAdd(tile_num_lights, 1u);
+            if (slot < uint(MAX_TILE_LIGHTS))
+                tile_lights[slot] = i;
+        }
+    }
+    barrier();
+
+    if (!inside)
+        return;
+    if (!geometry) {
+        imageStore(accum, px, vec4(0.0, 0.0, 0.0, 1.0));
+        return;
+    }
+
+    // Accumulate all lights in registers
+    vec3 V = normalize(view_pos - d.ws_pos);
+    vec3 Lo = vec3(0.0);
+    for (int i = 0; i < num_dir_lights; ++i) {
+        vec3 L = normalize(dir_lights[i].direction);
+        float shadow = shadows_enabled
+            ? shadow_coef(shadowmap, cascades, num_cascades, d.ws_pos, d.normal, L, view)
+            : 0.0;
+        Lo += radiance(d.normal, V, L,
+                       dir_lights[i].color * dir_lights[i].intensity, 1.0,
+                       d.albedo, d.metallic, d.roughness) * (1.0 - shadow);
+    }
+    uint num_lights = min(tile_num_lights, uint(MAX_TILE_LIGHTS));
+    for (uint i = 0u; i < num_lights; ++i)
+        Lo += local_light_radiance(lights[tile_lights[i]], V);
+
+    // Single write
+    imageStore(accum, px, vec4(Lo, 1.0));
+}
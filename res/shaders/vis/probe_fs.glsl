@@ -1,4 +1,4 @@
-#version 330 core
+#version 430 core
 #include "../inc/sh.glsl"
 out vec4 color;
 
@@ -12,7 +12,8 @@ in VS_OUT {
 uniform int u_mode;
 uniform vec3 u_view_pos;
 uniform samplerCube u_envmap;
-uniform vec3 sh_coeffs[SH_COEFF_NUM];
+layout(std430, binding = 7) readonly buffer probe_sh_buf { vec4 probe_sh[]; };
+uniform uint u_probe;
 
 void main()
 {
@@ -25,7 +26,10 @@ void main()
         color = vec4(refl_col, 1.0);
     } else if (u_mode == 1) {
         // SH irradiance mode
-        vec3 env_col = sh_irradiance(norm, sh_coeffs);
+        vec3 sh_coeffs[SH_L2_COEFF_NUM];
+        for (int i = 0; i < SH_L2_COEFF_NUM; ++i)
+            sh_coeffs[i] = probe_sh[u_probe * uint(SH_L2_COEFF_NUM) + uint(i)].rgb;
+        vec3 env_col = sh_irradiance_l2(norm, sh_coeffs);
         color = vec4(env_col, 1.0);
     }
 }
@@ -12,6 +12,7 @@
 #include "ktxfile.h"
 #include "ddsfile.h"
 #include "tar.h"
+#include "cmconv.h"
 
 /*-----------------------------------------------------------------
  * Helpers
@@ -186,30 +187,30 @@ struct ktx_header {
 
 #define KTX_MAGIC { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }
 
-unsigned int texture_from_ktx(const char* fpath)
+unsigned int texture_from_ktx_buffer(const void* data_buf, size_t data_buf_sz)
 {
-    /* Read file */
-    void* data_buf; size_t data_buf_sz;
-    read_file_to_mem_buf(&data_buf, &data_buf_sz, fpath);
-
     /* Header read and check */
     const unsigned char magic[12] = KTX_MAGIC;
-    struct ktx_header* h = (struct ktx_header*)data_buf;
-    if (memcmp(h->identifier, magic, sizeof(magic)) != 0) {
-        free(data_buf);
+    const struct ktx_header* h = data_buf;
+    if (data_buf_sz < sizeof(struct ktx_header) || memcmp(h->identifier, magic, sizeof(magic)) != 0)
         return 0;
-    }
 
     /* Texture data iterator */
     const void* ptr = data_buf + sizeof(struct ktx_header) + h->bytes_of_key_value_data;
+    const void* end = data_buf + data_buf_sz;
 
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
 
     for (unsigned int level = 0; level < ((h->number_of_mipmap_levels == 0) ? 1 : h->number_of_mipmap_levels); level++) {
+        /* Stop at truncated levels */
+        if (ptr + sizeof(uint32_t) > end)
+            break;
         uint32_t image_size = *((uint32_t*)ptr);
         ptr += sizeof(uint32_t);
+        if (image_size > (size_t)(end - ptr))
+            break;
 
         const void* data = ptr;
         ptr += image_size;
@@ -245,156 +246,121 @@ unsigned int texture_from_ktx(const char* fpath)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, h->number_of_mipmap_levels);
     }
     glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
 
+unsigned int texture_from_ktx(const char* fpath)
+{
+    void* data_buf; size_t data_buf_sz;
+    read_file_to_mem_buf(&data_buf, &data_buf_sz, fpath);
+    if (!data_buf)
+        return 0;
+    unsigned int texture = texture_from_ktx_buffer(data_buf, data_buf_sz);
     free(data_buf);
     return texture;
 }
 
+/* Decodes straight into a mapped pixel buffer as half floats and uploads from it */
+static GLuint texture_from_hdr_info(const struct hdr_info* hi)
+{
+    GLsizeiptr size = (GLsizeiptr)hi->w * hi->h * 3 * sizeof(unsigned short);
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+    void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    int ok = dst && hdr_image_decode(dst, HDR_OUTPUT_HALF, hi);
+    ok = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) && ok;
+
+    GLuint tex = 0;
+    if (ok) {
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, hi->w, hi->h, 0, GL_RGB, GL_HALF_FLOAT, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);
+    return tex;
+}
+
 unsigned int texture_from_hdr(const char* fpath)
 {
     /* Gather texture data */
     void* fdata; size_t fsize;
     read_file_to_mem_buf(&fdata, &fsize, fpath);
-    float* data; unsigned int width, height;
-    hdr_image_read(&data, &width, &height, fdata);
+    struct hdr_info hi;
+    GLuint tex = 0;
+    if (fdata && hdr_image_info(&hi, fdata, fsize))
+        tex = texture_from_hdr_info(&hi);
     free(fdata);
-
-    /* Upload to GPU */
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    free(data);
     return tex;
 }
 
-/*
- *              +----------+
- *              | +---->+x |
- *              | |        |
- *              | |  +y    |
- *              |+z      2 |
- *   +----------+----------+----------+----------+
- *   | +---->+z | +---->+x | +---->-z | +---->-x |
- *   | |        | |        | |        | |        |
- *   | |  -x    | |  +z    | |  +x    | |  -z    |
- *   |-y      1 |-y      4 |-y      0 |-y      5 |
- *   +----------+----------+----------+----------+
- *              | +---->+x |
- *              | |        |
- *              | |  -y    |
- *              |-z      3 |
- *              +----------+
- */
-static float cm_face_uv_vectors[6][3][3] =
-{
-    { /* +x face */
-        {  0.0f,  0.0f, -1.0f }, /* u -> -z */
-        {  0.0f, -1.0f,  0.0f }, /* v -> -y */
-        {  1.0f,  0.0f,  0.0f }, /* +x face */
-    },
-    { /* -x face */
-        {  0.0f,  0.0f,  1.0f }, /* u -> +z */
-        {  0.0f, -1.0f,  0.0f }, /* v -> -y */
-        { -1.0f,  0.0f,  0.0f }, /* -x face */
-    },
-    { /* +y face */
-        {  1.0f,  0.0f,  0.0f }, /* u -> +x */
-        {  0.0f,  0.0f,  1.0f }, /* v -> +z */
-        {  0.0f,  1.0f,  0.0f }, /* +y face */
-    },
-    { /* -y face */
-        {  1.0f,  0.0f,  0.0f }, /* u -> +x */
-        {  0.0f,  0.0f, -1.0f }, /* v -> -z */
-        {  0.0f, -1.0f,  0.0f }, /* -y face */
-    },
-    { /* +z face */
-        {  1.0f,  0.0f,  0.0f }, /* u -> +x */
-        {  0.0f, -1.0f,  0.0f }, /* v -> -y */
-        {  0.0f,  0.0f,  1.0f }, /* +z face */
-    },
-    { /* -z face */
-        { -1.0f,  0.0f,  0.0f }, /* u -> -x */
-        {  0.0f, -1.0f,  0.0f }, /* v -> -y */
-        {  0.0f,  0.0f, -1.0f }, /* -z face */
-    }
-};
-
-/* u and v should be center adressing and in [-1.0+inv_size..1.0-inv_size] range */
-static void cm_texel_coord_to_vec(float* out3f, float u, float v, uint8_t face_id)
-{
-    /* out = u * face_uv[0] + v * face_uv[1] + face_uv[2]. */
-    out3f[0] = cm_face_uv_vectors[face_id][0][0] * u + cm_face_uv_vectors[face_id][1][0] * v + cm_face_uv_vectors[face_id][2][0];
-    out3f[1] = cm_face_uv_vectors[face_id][0][1] * u + cm_face_uv_vectors[face_id][1][1] * v + cm_face_uv_vectors[face_id][2][1];
-    out3f[2] = cm_face_uv_vectors[face_id][0][2] * u + cm_face_uv_vectors[face_id][1][2] * v + cm_face_uv_vectors[face_id][2][2];
-
-    /* Normalize. */
-    const float inv_len = 1.0f / sqrtf(out3f[0] * out3f[0] + out3f[1] * out3f[1] + out3f[2] * out3f[2]);
-    out3f[0] *= inv_len;
-    out3f[1] *= inv_len;
-    out3f[2] *= inv_len;
-}
-
-static void dir_to_uv_equi(float uv[2], float v[3])
-{
-    uv[0] = atan2(v[2], v[0]) / (2 * M_PI) + 0.5;
-    uv[1] = asin(v[1]) / M_PI + 0.5;
-}
-
-unsigned int texture_cubemap_from_hdr(const char* fpath)
+unsigned int texture_cubemap_from_hdr(const void* fdata, size_t fsize, unsigned int conv_shdr)
 {
     /* Gather texture data */
-    void* fdata; size_t fsize;
-    read_file_to_mem_buf(&fdata, &fsize, fpath);
-    float (*data)[3]; unsigned int width, height;
-    hdr_image_read((float**)&data, &width, &height, fdata);
-    free(fdata);
+    struct hdr_info hi;
+    if (!hdr_image_info(&hi, fdata, fsize))
+        return 0;
 
+    /* Faces span a quarter of the equirect width */
+    unsigned int face_size = hi.w / 4;
+    if (face_size == 0)
+        return 0;
+
+    /* Immutable storage with a full mip chain, image compatible for the GPU conversion */
+    unsigned int levels = 1;
+    while ((face_size >> levels) > 0)
+        ++levels;
     GLuint id;
     glGenTextures(1, &id);
     glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA16F, face_size, face_size);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    unsigned int face_size = width / 4;
-    for (int i = 0; i < 6; ++i) {
-        /* Populate face data */
-        float (*face_data)[3] = calloc(1, face_size * face_size * sizeof(*face_data));
-        for (unsigned int k = 0; k < face_size; ++k) {
-            for (unsigned int l = 0; l < face_size; ++l) {
-                float texel_size = 1.0 / face_size;
-                /* Face, U, V -> Direction */
-                float u = ((k + 0.5) * texel_size) * 2.0 - 1.0;
-                float v = ((l + 0.5) * texel_size) * 2.0 - 1.0;
-                float vec[3];
-                cm_texel_coord_to_vec(vec, u, v, i);
-                /* Direction -> Equirect U, V */
-                float uv_equi[2];
-                dir_to_uv_equi(uv_equi, vec);
-                /* Sample */
-                unsigned int x = (unsigned int)(uv_equi[0] * (width  - 1));
-                unsigned int y = (unsigned int)(uv_equi[1] * (height - 1));
-                float* p = (float*)(data + y * width + x);
-                face_data[l * face_size + k][0] = p[0];
-                face_data[l * face_size + k][1] = p[1];
-                face_data[l * face_size + k][2] = p[2];
+    int ok = 0;
+    if (conv_shdr) {
+        /* Equirect goes through a half float pixel buffer, never held as floats on the CPU */
+        GLuint eq = texture_from_hdr_info(&hi);
+        if (eq) {
+            cmconv_equirect_gpu(id, face_size, eq, conv_shdr);
+            glDeleteTextures(1, &eq);
+            ok = 1;
+        }
+    } else {
+        /* Fallback when the conversion shader is unavailable: convert all faces on the CPU, then upload */
+        float* data = malloc((size_t)hi.w * hi.h * 3 * sizeof(float));
+        size_t face_len = (size_t)face_size * face_size * 3;
+        float* faces = malloc(6 * face_len * sizeof(float));
+        if (data && faces && hdr_image_decode(data, HDR_OUTPUT_FLOAT, &hi)) {
+            cmconv_equirect_faces(faces, face_size, data, hi.w, hi.h);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+            for (int i = 0; i < 6; ++i) {
+                int target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+                glTexSubImage2D(target, 0, 0, 0, face_size, face_size, GL_RGB, GL_FLOAT, faces + i * face_len);
             }
+            ok = 1;
         }
-        /* Upload image data */
-        int target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
-        glTexImage2D(target, 0, GL_RGB16F, face_size, face_size, 0, GL_RGB, GL_FLOAT, face_data);
-        free(face_data);
+        free(faces);
+        free(data);
+    }
+    /* Nothing was written, don't hand out an uninitialized cubemap */
+    if (!ok) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        glDeleteTextures(1, &id);
+        return 0;
     }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, id);
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-    free(data);
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
     return id;
 }
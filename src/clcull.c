@@ -0,0 +1,191 @@
+#include "clcull.h"
+#include <string.h>
+#include "opengl.h"
+#include "frucull.h"
+#include "mshlet.h"
+#include "thrpool.h"
+#include "lodsel.h"
+#include "instbat.h"
+
+/* Shape slots reserved per object, matches render_mesh capacity */
+#define CLCULL_MAX_SHAPES 16
+/* Objects per thread pool task */
+#define CLCULL_GRAIN 8
+
+struct clcull_job {
+    struct clcull_state* st;
+    struct resmgr* rmgr;
+    struct render_object* objs;
+    struct lodsel_state* lodsel;
+    vec4 fru_planes[6];
+    vec3 eye;
+};
+
+void clcull_init(struct clcull_state* st)
+{
+    memset(st, 0, sizeof(*st));
+    glGenBuffers(1, &st->indirect_buf);
+}
+
+/* Largest stretch factor of the transform, used to conservatively scale bounding spheres */
+static float max_axis_scale(mat4 m)
+{
+    vec3 o = mat4_mul_vec3(m, vec3_zero());
+    float sx = vec3_dist(mat4_mul_vec3(m, vec3_new(1.0f, 0.0f, 0.0f)), o);
+    float sy = vec3_dist(mat4_mul_vec3(m, vec3_new(0.0f, 1.0f, 0.0f)), o);
+    float sz = vec3_dist(mat4_mul_vec3(m, vec3_new(0.0f, 0.0f, 1.0f)), o);
+    return sx > sy ? (sx > sz ? sx : sz) : (sy > sz ? sy : sz);
+}
+
+static void cull_objects(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct clcull_job* job = userdata;
+    struct clcull_state* st = job->st;
+    for (size_t i = begin; i < end; ++i) {
+        struct render_object* ro = &job->objs[i];
+        struct render_mesh* rmsh = resmgr_get_mesh(job->rmgr, ro->mesh);
+        /* Objects whose mesh is gone keep their zeroed ranges and draw nothing */
+        if (!rmsh)
+            continue;
+        mat4 model = *(mat4*)ro->model_mat;
+        float scale = max_axis_scale(model);
+        /* Normal cones are tested in mesh space, which stays exact under any affine transform */
+        vec3 eye = mat4_mul_vec3(mat4_inverse(model), job->eye);
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            struct render_shape* rsh = &rmsh->shapes[j];
+            struct clcull_range* rng = &st->ranges[i * CLCULL_MAX_SHAPES + j];
+            struct clcull_cmd* cmds = st->cmds + rng->first_cmd;
+            unsigned int num_cmds = 0, num_visible = 0;
+            unsigned int lvl = job->lodsel ? lodsel_level(job->lodsel, i, j, rsh, 0) : 0;
+            const struct render_lod* lod = &rsh->lods[lvl];
+            for (unsigned int k = 0; k < (rsh->num_lods ? lod->num_meshlets : 0); ++k) {
+                const struct meshlet* m = &lod->meshlets[k];
+                vec3 center = mat4_mul_vec3(model, vec3_new(m->center[0], m->center[1], m->center[2]));
+                if (!sphere_in_frustum(job->fru_planes, center, m->radius * scale)
+                 || mshlet_backfacing(m, eye.xyz))
+                    continue;
+                ++num_visible;
+                /* Extend previous command when contiguous in the element buffer */
+                struct clcull_cmd* last = num_cmds ? &cmds[num_cmds - 1] : 0;
+                if (last && last->first_index + last->count == m->first_index) {
+                    last->count += m->num_indices;
+                } else {
+                    cmds[num_cmds++] = (struct clcull_cmd) {
+                        .count = m->num_indices,
+                        .instance_count = 1,
+                        .first_index = m->first_index,
+                        .base_vertex = 0,
+                        .base_instance = 0
+                    };
+                }
+            }
+            rng->num_cmds = num_cmds;
+            rng->num_visible = num_visible;
+        }
+    }
+}
+
+void clcull_run(struct clcull_state* st, struct resmgr* rmgr, struct render_object* objs, unsigned int num_objs,
+                struct lodsel_state* lodsel, struct instbat* ib, float view[16], float proj[16])
+{
+    /* Reserve one command per meshlet of the densest level for every object shape */
+    size_t num_ranges = num_objs * CLCULL_MAX_SHAPES;
+    if (num_ranges > st->cap_ranges) {
+        st->cap_ranges = num_ranges;
+        st->ranges = realloc(st->ranges, st->cap_ranges * sizeof(*st->ranges));
+    }
+    memset(st->ranges, 0, num_ranges * sizeof(*st->ranges));
+    size_t num_cmds = 0;
+    for (unsigned int i = 0; i < num_objs; ++i) {
+        struct render_mesh* rmsh = resmgr_get_mesh(rmgr, objs[i].mesh);
+        if (!rmsh)
+            continue;
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            struct render_shape* rsh = &rmsh->shapes[j];
+            unsigned int max_meshlets = 0;
+            for (unsigned int l = 0; l < rsh->num_lods; ++l)
+                if (rsh->lods[l].num_meshlets > max_meshlets)
+                    max_meshlets = rsh->lods[l].num_meshlets;
+            st->ranges[i * CLCULL_MAX_SHAPES + j].first_cmd = num_cmds;
+            num_cmds += max_meshlets;
+        }
+    }
+    if (num_cmds > st->cap_cmds) {
+        st->cap_cmds = num_cmds;
+        st->cmds = realloc(st->cmds, st->cap_cmds * sizeof(*st->cmds));
+        st->draw_cmds = realloc(st->draw_cmds, st->cap_cmds * sizeof(*st->draw_cmds));
+    }
+    st->num_total = num_cmds;
+
+    /* Cull */
+    struct clcull_job job = { .st = st, .rmgr = rmgr, .objs = objs, .lodsel = lodsel };
+    vec3 fru_pts[8];
+    frustum_points_planes(fru_pts, job.fru_planes, mat4_mul_mat4(*(mat4*)proj, *(mat4*)view));
+    mat4 inv_view = mat4_inverse(*(mat4*)view);
+    job.eye = vec3_new(inv_view.xw, inv_view.yw, inv_view.zw);
+    thrpool_parallel_for(thrpool_default(), num_objs, CLCULL_GRAIN, cull_objects, &job);
+
+    /* Compact commands, in instance order when batched */
+    size_t num_insts = ib ? ib->num_items : num_ranges;
+    if (ib && num_insts + 1 > st->cap_inst_cmds) {
+        st->cap_inst_cmds = num_insts + 1;
+        st->inst_cmds = realloc(st->inst_cmds, st->cap_inst_cmds * sizeof(*st->inst_cmds));
+    }
+    size_t cursor = 0;
+    st->num_visible = 0;
+    for (size_t k = 0; k < num_insts; ++k) {
+        size_t r = ib ? ib->insts[k].obj * CLCULL_MAX_SHAPES + ib->insts[k].shape : k;
+        struct clcull_range* rng = &st->ranges[r];
+        struct clcull_cmd* dst = st->draw_cmds + cursor;
+        memcpy(dst, st->cmds + rng->first_cmd, rng->num_cmds * sizeof(*st->cmds));
+        if (ib) {
+            for (unsigned int c = 0; c < rng->num_cmds; ++c)
+                dst[c].base_instance = k;
+            st->inst_cmds[k] = cursor;
+        }
+        rng->first_cmd = cursor;
+        cursor += rng->num_cmds;
+        st->num_visible += rng->num_visible;
+    }
+    if (ib)
+        st->inst_cmds[num_insts] = cursor;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, st->indirect_buf);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, cursor * sizeof(*st->draw_cmds), st->draw_cmds, GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+int clcull_shape_visible(struct clcull_state* st, unsigned int obj, unsigned int shape)
+{
+    return st->ranges[obj * CLCULL_MAX_SHAPES + shape].num_cmds > 0;
+}
+
+void clcull_shape_draw(struct clcull_state* st, unsigned int obj, unsigned int shape)
+{
+    struct clcull_range* rng = &st->ranges[obj * CLCULL_MAX_SHAPES + shape];
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, st->indirect_buf);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (void*)(rng->first_cmd * sizeof(*st->draw_cmds)), rng->num_cmds, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void clcull_batch_draw(struct clcull_state* st, const struct instbat_batch* b)
+{
+    unsigned int first = st->inst_cmds[b->first_inst];
+    unsigned int count = st->inst_cmds[b->first_inst + b->num_insts] - first;
+    if (count == 0)
+        return;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, st->indirect_buf);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (void*)(first * sizeof(*st->draw_cmds)), count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void clcull_destroy(struct clcull_state* st)
+{
+    glDeleteBuffers(1, &st->indirect_buf);
+    free(st->inst_cmds);
+    free(st->draw_cmds);
+    free(st->ranges);
+    free(st->cmds);
+}
@@ -0,0 +1,96 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _CLCULL_H_
+#define _CLCULL_H_
+
+#include <energycore/renderer.h>
+
+/*
+ * Cluster culling
+ * Meshlets of every object shape's current level are tested against the view frustum and their
+ * normal cone on the thread pool, surviving meshlets that are adjacent in the
+ * element buffer are merged, and the resulting draw commands of the whole scene
+ * are uploaded in one indirect buffer for per shape multi draws. When instance
+ * batches are given, commands are laid out in instance order and address each
+ * instance's matrix through their base instance, so a batch is one multi draw.
+ */
+
+/* Layout of GL DrawElementsIndirectCommand */
+struct clcull_cmd {
+    unsigned int count;
+    unsigned int instance_count;
+    unsigned int first_index;
+    unsigned int base_vertex;
+    unsigned int base_instance;
+};
+
+/* Commands of an object shape in the command buffer */
+struct clcull_range {
+    unsigned int first_cmd;
+    unsigned int num_cmds;
+    unsigned int num_visible;
+};
+
+struct clcull_state {
+    /* Per object shape results, compacted into the draw commands, both sized cap_cmds */
+    struct clcull_cmd* cmds;
+    struct clcull_cmd* draw_cmds;
+    size_t cap_cmds;
+    /* First draw command of each batched instance, plus end */
+    unsigned int* inst_cmds;
+    size_t cap_inst_cmds;
+    struct clcull_range* ranges;
+    size_t cap_ranges;
+    unsigned int indirect_buf;
+    /* Statistics of last run */
+    unsigned int num_visible;
+    unsigned int num_total;
+};
+
+void clcull_init(struct clcull_state* st);
+struct lodsel_state;
+struct instbat;
+struct instbat_batch;
+
+/* Culls the meshlets of all objects for the given camera and uploads the draw commands.
+ * Meshlets of the level picked by lodsel are used, or of the finest level if null.
+ * Commands follow the instance order of ib if given, which must contain every object shape */
+void clcull_run(struct clcull_state* st, struct resmgr* rmgr, struct render_object* objs, unsigned int num_objs,
+                struct lodsel_state* lodsel, struct instbat* ib, float view[16], float proj[16]);
+/* Checks if any meshlet of the given object shape survived the last run */
+int clcull_shape_visible(struct clcull_state* st, unsigned int obj, unsigned int shape);
+/* Draws the surviving meshlets of the given object shape, its vertex array must be bound */
+void clcull_shape_draw(struct clcull_state* st, unsigned int obj, unsigned int shape);
+/* Draws the surviving meshlets of all instances in the batch, bound with instbat_bind */
+void clcull_batch_draw(struct clcull_state* st, const struct instbat_batch* b);
+void clcull_destroy(struct clcull_state* st);
+
+#endif /* ! _CLCULL_H_ */
@@ -0,0 +1,171 @@
+#include "cmconv.h"
+#include <string.h>
+#include <math.h>
+#include "opengl.h"
+#include "thrpool.h"
+
+/* Face rows per thread pool task */
+#define CMCONV_GRAIN 16
+/* Threads per conversion group side */
+#define CMCONV_GROUP_SIZE 8
+
+#define PI 3.14159265358979323846f
+
+/*-----------------------------------------------------------------
+ * 4 wide float lanes
+ *-----------------------------------------------------------------*/
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+typedef __m128 f4;
+#define f4_set1(x)        _mm_set1_ps(x)
+#define f4_set(a, b, c, d) _mm_setr_ps(a, b, c, d)
+#define f4_store(p, v)    _mm_storeu_ps(p, v)
+#define f4_add(a, b)      _mm_add_ps(a, b)
+#define f4_mul(a, b)      _mm_mul_ps(a, b)
+#define f4_sqrt(a)        _mm_sqrt_ps(a)
+
+/* Polynomial atan2 approximation, absolute error below 1e-5 radians */
+static inline f4 f4_atan2(f4 y, f4 x)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+    __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(0.0208351f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.0851330f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.1801410f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.3302995f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.9998660f));
+    r = _mm_mul_ps(r, a);
+    /* Unfold octants */
+    __m128 m = _mm_cmpgt_ps(ay, ax);
+    r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(0.5f * PI), r)), _mm_andnot_ps(m, r));
+    m = _mm_cmplt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(PI), r)), _mm_andnot_ps(m, r));
+    return _mm_or_ps(r, _mm_and_ps(sign, y));
+}
+#else
+typedef struct { float v[4]; } f4;
+#define F4_OP(name, expr) \
+    static inline f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r; }
+F4_OP(f4_add, a.v[i] + b.v[i])
+F4_OP(f4_mul, a.v[i] * b.v[i])
+F4_OP(f4_atan2, atan2f(a.v[i], b.v[i]))
+static inline f4 f4_set(float a, float b, float c, float d) { f4 r = {{a, b, c, d}}; return r; }
+static inline f4 f4_set1(float x) { return f4_set(x, x, x, x); }
+static inline f4 f4_sqrt(f4 a) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = sqrtf(a.v[i]); return r; }
+static inline void f4_store(float* p, f4 a) { memcpy(p, a.v, sizeof(a.v)); }
+#endif
+
+/*-----------------------------------------------------------------
+ * CPU conversion
+ *-----------------------------------------------------------------*/
+/* Direction of face position (u, v) is u * face_uv[0] + v * face_uv[1] + face_uv[2] */
+static const float cm_face_uv_vectors[6][3][3] = {
+    { {  0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f } }, /* +x */
+    { {  0.0f,  0.0f,  1.0f }, {  0.0f, -1.0f,  0.0f }, { -1.0f,  0.0f,  0.0f } }, /* -x */
+    { {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f,  1.0f }, {  0.0f,  1.0f,  0.0f } }, /* +y */
+    { {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f } }, /* -y */
+    { {  1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } }, /* +z */
+    { { -1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } }  /* -z */
+};
+
+struct cmconv_job {
+    float* faces;
+    unsigned int face_size;
+    const float* data;
+    unsigned int width, height;
+};
+
+static inline unsigned int clampi(int v, unsigned int hi)
+{
+    return v <= 0 ? 0 : ((unsigned int)v >= hi ? hi : (unsigned int)v);
+}
+
+static inline void sample_bilinear(float* out, const struct cmconv_job* job, float u, float v)
+{
+    unsigned int w = job->width, h = job->height;
+    float fx = u * w - 0.5f, fy = v * h - 0.5f;
+    float x0f = floorf(fx), y0f = floorf(fy);
+    float tx = fx - x0f, ty = fy - y0f;
+    int x0 = (int)x0f, y0 = (int)y0f;
+    /* Wrap around horizontally, clamp at the poles */
+    unsigned int xa = x0 < 0 ? w - 1 : (unsigned int)x0 % w;
+    unsigned int xb = (xa + 1) % w;
+    unsigned int ya = clampi(y0, h - 1), yb = clampi(y0 + 1, h - 1);
+    const float* r0 = job->data + (size_t)ya * w * 3;
+    const float* r1 = job->data + (size_t)yb * w * 3;
+    for (unsigned int c = 0; c < 3; ++c) {
+        float top = r0[xa * 3 + c] + (r0[xb * 3 + c] - r0[xa * 3 + c]) * tx;
+        float bot = r1[xa * 3 + c] + (r1[xb * 3 + c] - r1[xa * 3 + c]) * tx;
+        out[c] = top + (bot - top) * ty;
+    }
+}
+
+static void convert_rows(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    const struct cmconv_job* job = userdata;
+    const unsigned int fs = job->face_size;
+    const float scale = 2.0f / fs, bias = 1.0f / fs - 1.0f;
+    for (size_t row = begin; row < end; ++row) {
+        const unsigned int face = row / fs, l = row % fs;
+        const float (*fuv)[3] = cm_face_uv_vectors[face];
+        const float v = l * scale + bias;
+        float* out = job->faces + row * fs * 3;
+        for (unsigned int k = 0; k < fs; k += 4) {
+            f4 u = f4_add(f4_mul(f4_set(k, k + 1, k + 2, k + 3), f4_set1(scale)), f4_set1(bias));
+            f4 d[3];
+            for (unsigned int a = 0; a < 3; ++a)
+                d[a] = f4_add(f4_mul(u, f4_set1(fuv[0][a])), f4_set1(fuv[1][a] * v + fuv[2][a]));
+            /* Longitude and latitude, atan2 needs no normalized direction */
+            f4 lon = f4_atan2(d[2], d[0]);
+            f4 lat = f4_atan2(d[1], f4_sqrt(f4_add(f4_mul(d[0], d[0]), f4_mul(d[2], d[2]))));
+            float eu[4], ev[4];
+            f4_store(eu, f4_add(f4_mul(lon, f4_set1(0.5f / PI)), f4_set1(0.5f)));
+            f4_store(ev, f4_add(f4_mul(lat, f4_set1(1.0f / PI)), f4_set1(0.5f)));
+            unsigned int n = fs - k < 4 ? fs - k : 4;
+            for (unsigned int i = 0; i < n; ++i)
+                sample_bilinear(out + (k + i) * 3, job, eu[i], ev[i]);
+        }
+    }
+}
+
+void cmconv_equirect_faces(float* faces, unsigned int face_size, const float* data, unsigned int width, unsigned int height)
+{
+    struct cmconv_job job = {
+        .faces = faces,
+        .face_size = face_size,
+        .data = data,
+        .width = width,
+        .height = height
+    };
+    thrpool_parallel_for(thrpool_default(), 6 * face_size, CMCONV_GRAIN, convert_rows, &job);
+}
+
+/*-----------------------------------------------------------------
+ * GPU conversion
+ *-----------------------------------------------------------------*/
+void cmconv_equirect_gpu(unsigned int cm, unsigned int face_size, unsigned int equirect, unsigned int shdr)
+{
+    /* Source equirect, filtered by the sampler */
+    glBindTexture(GL_TEXTURE_2D, equirect);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    /* One invocation per face texel, faces as image layers */
+    glUseProgram(shdr);
+    glUniform1i(glGetUniformLocation(shdr, "equirect"), 0);
+    glUniform1i(glGetUniformLocation(shdr, "face_size"), face_size);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, equirect);
+    glBindImageTexture(0, cm, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    unsigned int groups = (face_size + CMCONV_GROUP_SIZE - 1) / CMCONV_GROUP_SIZE;
+    glDispatchCompute(groups, groups, 6);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
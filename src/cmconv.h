@@ -0,0 +1,50 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _CMCONV_H_
+#define _CMCONV_H_
+
+/*
+ * Equirectangular to cubemap conversion
+ * Every face texel maps to a direction and from there to a bilinearly filtered
+ * equirect sample, wrapping around horizontally and clamped at the poles.
+ * Faces follow the +x, -x, +y, -y, +z, -z order and orientation of GL cubemaps.
+ * The GPU path writes straight into a cubemap from a compute shader. The CPU one
+ * makes no GL calls, it backs the loader when the conversion shader is unavailable
+ * and spreads face rows over the default thread pool, resolving the direction to
+ * equirect mapping 4 texels at a time in SIMD lanes.
+ */
+
+/* Fills six RGB float faces packed one after the other */
+void cmconv_equirect_faces(float* faces, unsigned int face_size, const float* data, unsigned int width, unsigned int height);
+/* Fills the base level of a cubemap with RGBA16F storage from an equirect texture using the conversion compute shader */
+void cmconv_equirect_gpu(unsigned int cm, unsigned int face_size, unsigned int equirect, unsigned int shdr);
+
+#endif /* ! _CMCONV_H_ */
@@ -0,0 +1,198 @@
+#include "cslot_map.h"
+#include <string.h>
+#include <assert.h>
+
+#define POISON_POINTER ((void *)(0xDEAD000000000000UL))
+#define GENERATION_MASK ((1u << SLOT_MAP_GENERATION_BITS) - 1)
+#define STATE_LIVE (1u << SLOT_MAP_GENERATION_BITS)
+#define STATE_BUSY (1u << (SLOT_MAP_GENERATION_BITS + 1))
+#define FREE_LIST_TAG(h) ((h) >> 32)
+#define FREE_LIST_IDX(h) ((uint32_t)(h))
+
+struct csm_slot {
+    /* Generation in the low bits, live and publish in progress bits above them */
+    _Atomic uint32_t state;
+    /* Next free slot index + 1 (0 terminates the list) */
+    _Atomic uint32_t free_list_next;
+};
+
+static inline struct csm_slot* page_slot(void* page, uint32_t idx)
+{
+    return (struct csm_slot*)page + (idx & (CSLOT_MAP_PAGE_SIZE - 1));
+}
+
+static inline void* page_data(struct cslot_map* sm, void* page, uint32_t idx)
+{
+    return (unsigned char*)page
+         + CSLOT_MAP_PAGE_SIZE * sizeof(struct csm_slot)
+         + (idx & (CSLOT_MAP_PAGE_SIZE - 1)) * sm->stride;
+}
+
+static inline void* page_load(struct cslot_map* sm, uint32_t idx)
+{
+    return atomic_load_explicit(&sm->pages[idx >> CSLOT_MAP_PAGE_SHIFT], memory_order_acquire);
+}
+
+static void* page_fetch(struct cslot_map* sm, uint32_t idx)
+{
+    _Atomic(void*)* pp = &sm->pages[idx >> CSLOT_MAP_PAGE_SHIFT];
+    void* page = atomic_load_explicit(pp, memory_order_acquire);
+    if (!page) {
+        /* Race to install a new page, loser frees its copy */
+        void* npage = calloc(1, CSLOT_MAP_PAGE_SIZE * (sizeof(struct csm_slot) + sm->stride));
+        if (!npage)
+            return 0;
+        if (atomic_compare_exchange_strong_explicit(pp, &page, npage, memory_order_acq_rel, memory_order_acquire))
+            page = npage;
+        else
+            free(npage);
+    }
+    return page;
+}
+
+void cslot_map_init(struct cslot_map* sm, size_t esz)
+{
+    sm->esz    = esz;
+    /* Keep element data aligned inside pages */
+    sm->stride = (esz + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    sm->pages  = calloc(CSLOT_MAP_MAX_PAGES, sizeof(*sm->pages));
+    atomic_init(&sm->free_list_head, 0);
+    atomic_init(&sm->num_slots, 0);
+}
+
+void cslot_map_destroy(struct cslot_map* sm)
+{
+    for (size_t i = 0; i < CSLOT_MAP_MAX_PAGES; ++i)
+        free(atomic_load_explicit(&sm->pages[i], memory_order_relaxed));
+    free(sm->pages);
+    sm->pages = POISON_POINTER;
+}
+
+static int free_list_pop(struct cslot_map* sm, uint32_t* idx)
+{
+    uint64_t head = atomic_load_explicit(&sm->free_list_head, memory_order_acquire);
+    while (FREE_LIST_IDX(head)) {
+        uint32_t cur = FREE_LIST_IDX(head) - 1;
+        /* Pages are never freed so reading a concurrently popped slot is harmless, the tag catches it */
+        uint32_t next = atomic_load_explicit(&page_slot(page_load(sm, cur), cur)->free_list_next, memory_order_relaxed);
+        uint64_t nhead = ((FREE_LIST_TAG(head) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&sm->free_list_head, &head, nhead,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            *idx = cur;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void free_list_push(struct cslot_map* sm, uint32_t idx)
+{
+    struct csm_slot* s = page_slot(page_load(sm, idx), idx);
+    uint64_t head = atomic_load_explicit(&sm->free_list_head, memory_order_relaxed);
+    uint64_t nhead;
+    do {
+        atomic_store_explicit(&s->free_list_next, FREE_LIST_IDX(head), memory_order_relaxed);
+        nhead = ((FREE_LIST_TAG(head) + 1) << 32) | (idx + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&sm->free_list_head, &head, nhead,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static int slots_grow(struct cslot_map* sm, uint32_t* idx)
+{
+    uint32_t n = atomic_load_explicit(&sm->num_slots, memory_order_relaxed);
+    do {
+        if (n >= CSLOT_MAP_CAPACITY)
+            return 0;
+    } while (!atomic_compare_exchange_weak_explicit(&sm->num_slots, &n, n + 1,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    *idx = n;
+    return 1;
+}
+
+sm_key cslot_map_reserve(struct cslot_map* sm)
+{
+    uint32_t idx;
+    if (!free_list_pop(sm, &idx) && !slots_grow(sm, &idx))
+        return SM_INVALID_KEY;
+    void* page = page_fetch(sm, idx);
+    if (!page) {
+        /* Out of memory, the index is only recycled if another thread installed its page meanwhile */
+        if (page_load(sm, idx))
+            free_list_push(sm, idx);
+        return SM_INVALID_KEY;
+    }
+    uint32_t state = atomic_load_explicit(&page_slot(page, idx)->state, memory_order_relaxed);
+    assert(!(state & STATE_LIVE));
+    return (sm_key){.index = idx, .generation = state & GENERATION_MASK};
+}
+
+int cslot_map_publish(struct cslot_map* sm, sm_key k, void* data)
+{
+    if (k.index >= CSLOT_MAP_CAPACITY)
+        return 0;
+    void* page = page_load(sm, k.index);
+    if (!page)
+        return 0;
+    struct csm_slot* s = page_slot(page, k.index);
+    /* Claim the reservation so concurrent publishers of the same key cannot both write */
+    uint32_t state = k.generation;
+    if (!atomic_compare_exchange_strong_explicit(&s->state, &state, k.generation | STATE_BUSY,
+                                                 memory_order_acquire, memory_order_relaxed))
+        return 0;
+    memcpy(page_data(sm, page, k.index), data, sm->esz);
+    /* Make data visible before the slot becomes resolvable, removes wait while busy so the slot is still ours */
+    atomic_store_explicit(&s->state, k.generation | STATE_LIVE, memory_order_release);
+    return 1;
+}
+
+void* cslot_map_lookup(struct cslot_map* sm, sm_key k)
+{
+    if (k.index >= CSLOT_MAP_CAPACITY)
+        return 0;
+    void* page = page_load(sm, k.index);
+    if (!page)
+        return 0;
+    uint32_t state = atomic_load_explicit(&page_slot(page, k.index)->state, memory_order_acquire);
+    return state == (k.generation | STATE_LIVE) ? page_data(sm, page, k.index) : 0;
+}
+
+int cslot_map_remove(struct cslot_map* sm, sm_key k)
+{
+    if (k.index >= CSLOT_MAP_CAPACITY)
+        return 0;
+    void* page = page_load(sm, k.index);
+    if (!page)
+        return 0;
+    struct csm_slot* s = page_slot(page, k.index);
+    uint32_t state = atomic_load_explicit(&s->state, memory_order_relaxed);
+    uint32_t nstate = (k.generation + 1) & GENERATION_MASK;
+    for (;;) {
+        if ((state & GENERATION_MASK) != k.generation)
+            return 0;
+        if (state & STATE_BUSY) {
+            /* A publish of this key owns the slot until its data is copied, freeing it now would let it come back to life */
+            state = atomic_load_explicit(&s->state, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&s->state, &state, nstate,
+                                                  memory_order_acq_rel, memory_order_relaxed))
+            break;
+    }
+    free_list_push(sm, k.index);
+    return 1;
+}
+
+void* cslot_map_slot_data(struct cslot_map* sm, size_t idx)
+{
+    assert(idx < CSLOT_MAP_CAPACITY);
+    void* page = page_load(sm, idx);
+    if (!page)
+        return 0;
+    uint32_t state = atomic_load_explicit(&page_slot(page, idx)->state, memory_order_acquire);
+    return state & STATE_LIVE ? page_data(sm, page, idx) : 0;
+}
+
+size_t cslot_map_num_slots(struct cslot_map* sm)
+{
+    return atomic_load_explicit(&sm->num_slots, memory_order_acquire);
+}
@@ -0,0 +1,105 @@
+#include "dcache.h"
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Entry file identification, the version is bumped whenever the layout changes */
+#define DCACHE_MAGIC   0x43444345 /* ECDC */
+#define DCACHE_VERSION 1
+#define DCACHE_PRIME   1099511628211ULL
+
+struct dcache_header {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long key;
+    unsigned long long size;
+};
+
+unsigned long long dcache_hash(unsigned long long h, const void* data, size_t size)
+{
+    const unsigned char* p = data;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ w) * DCACHE_PRIME;
+        h ^= h >> 29;
+    }
+    for (; size > 0; --size, ++p)
+        h = (h ^ *p) * DCACHE_PRIME;
+    return h;
+}
+
+int dcache_path(char* buf, size_t buf_sz, const char* dir, const char* name, unsigned long long key)
+{
+    int n = snprintf(buf, buf_sz, "%s/%s-%016llx.bin", dir, name, key);
+    return n > 0 && (size_t)n < buf_sz;
+}
+
+int dcache_store(const char* path, unsigned long long key, const void* data, size_t size)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return 0;
+    struct dcache_header hdr = {
+        .magic = DCACHE_MAGIC,
+        .version = DCACHE_VERSION,
+        .key = key,
+        .size = size
+    };
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(data, size, 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        remove(path);
+    return ok;
+}
+
+/* Opens an entry positioned at its payload, null when missing or stale */
+static FILE* dcache_open(const char* path, unsigned long long key, size_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    struct dcache_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+     || hdr.magic != DCACHE_MAGIC
+     || hdr.version != DCACHE_VERSION
+     || hdr.key != key
+     || hdr.size == 0) {
+        fclose(f);
+        return 0;
+    }
+    *size = hdr.size;
+    return f;
+}
+
+int dcache_fetch(const char* path, unsigned long long key, void* data, size_t size)
+{
+    size_t entry_size;
+    FILE* f = dcache_open(path, key, &entry_size);
+    if (!f)
+        return 0;
+    int ok = entry_size == size && fread(data, size, 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+void* dcache_fetch_alloc(const char* path, unsigned long long key, size_t* size)
+{
+    FILE* f = dcache_open(path, key, size);
+    if (!f)
+        return 0;
+    /* Corrupt headers must not lead to oversized allocations */
+    long start = ftell(f);
+    long end = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (start < 0 || end < start || (unsigned long)(end - start) < *size || fseek(f, start, SEEK_SET) != 0) {
+        fclose(f);
+        return 0;
+    }
+    void* data = malloc(*size);
+    if (data && fread(data, *size, 1, f) != 1) {
+        free(data);
+        data = 0;
+    }
+    fclose(f);
+    return data;
+}
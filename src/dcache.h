@@ -0,0 +1,57 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+#include <stdlib.h>
+
+/*
+ * On disk cache of derived data
+ * Entries are single files named after what they hold and the content key of
+ * their inputs. A small header repeats the key and the payload size, so stale,
+ * truncated or foreign files are rejected and the data is derived again.
+ */
+
+/* Seed of content hashes */
+#define DCACHE_HASH_SEED 14695981039346656037ULL
+
+/* Content hash, consumes 8 bytes per step */
+unsigned long long dcache_hash(unsigned long long h, const void* data, size_t size);
+/* Entry path as dir/name-key.bin, returns zero when it does not fit in buf */
+int dcache_path(char* buf, size_t buf_sz, const char* dir, const char* name, unsigned long long key);
+/* Writes an entry, returns zero on failure */
+int dcache_store(const char* path, unsigned long long key, const void* data, size_t size);
+/* Reads an entry of exactly size bytes into data, returns zero when missing or stale */
+int dcache_fetch(const char* path, unsigned long long key, void* data, size_t size);
+/* Reads an entry of any size into newly allocated memory, returns null when missing or stale */
+void* dcache_fetch_alloc(const char* path, unsigned long long key, size_t* size);
+
+#endif /* ! _DCACHE_H_ */
@@ -0,0 +1,283 @@
+#include "fltparse.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "fltparse_tbl.h"
+
+/*
+ * Decimal significands of up to 19 digits are converted with the
+ * Clinger fast path when exact, or with the Eisel-Lemire algorithm
+ * that is exact for any such significand given the 128bit powers table.
+ * Longer significands, inf and nan take the strtod / strtof slow path.
+ */
+#define MAX_DIGITS 19
+
+struct binary_format {
+    int mantissa_explicit_bits;
+    int minimum_exponent;
+    int infinite_power;
+    int smallest_power_of_ten;
+    int largest_power_of_ten;
+    int min_exponent_round_to_even;
+    int max_exponent_round_to_even;
+};
+
+static const struct binary_format binary64 = { 52, -1023, 0x7FF, -342, 308, -4, 23 };
+static const struct binary_format binary32 = { 23, -127, 0xFF, -65, 38, -17, 10 };
+
+struct decimal {
+    uint64_t w;      /* Significand */
+    int64_t q;       /* Base 10 exponent */
+    int negative;
+    int truncated;   /* More than MAX_DIGITS significant digits */
+};
+
+/*-----------------------------------------------------------------
+ * Scanning
+ *-----------------------------------------------------------------*/
+#define IS_DIGIT(c) ((unsigned)((c) - '0') < 10)
+
+static const char* scan_decimal(const char* str, struct decimal* d)
+{
+    const char* p = str;
+    int ndigits = 0, any = 0;
+    memset(d, 0, sizeof(*d));
+
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '\f' || *p == '\v')
+        ++p;
+    if (*p == '-' || *p == '+')
+        d->negative = *p++ == '-';
+
+    /* Integer part, leading zeros are not significant */
+    for (; IS_DIGIT(*p); ++p) {
+        any = 1;
+        if (d->w == 0 && *p == '0')
+            continue;
+        if (ndigits < MAX_DIGITS) {
+            d->w = d->w * 10 + (*p - '0');
+            ++ndigits;
+        } else {
+            d->truncated |= *p != '0';
+            ++d->q;
+        }
+    }
+    /* Fractional part */
+    if (*p == '.') {
+        ++p;
+        for (; IS_DIGIT(*p); ++p) {
+            any = 1;
+            if (d->w == 0 && *p == '0') {
+                --d->q;
+                continue;
+            }
+            if (ndigits < MAX_DIGITS) {
+                d->w = d->w * 10 + (*p - '0');
+                ++ndigits;
+                --d->q;
+            } else {
+                d->truncated |= *p != '0';
+            }
+        }
+    }
+    if (!any)
+        return str;
+
+    /* Exponent, only consumed if followed by digits */
+    if (*p == 'e' || *p == 'E') {
+        const char* e = p + 1;
+        int eneg = 0;
+        if (*e == '-' || *e == '+')
+            eneg = *e++ == '-';
+        if (IS_DIGIT(*e)) {
+            int64_t ev = 0;
+            for (; IS_DIGIT(*e); ++e)
+                if (ev < 0x10000000)
+                    ev = ev * 10 + (*e - '0');
+            d->q += eneg ? -ev : ev;
+            p = e;
+        }
+    }
+    return p;
+}
+
+/*-----------------------------------------------------------------
+ * Eisel-Lemire
+ *-----------------------------------------------------------------*/
+static inline void full_multiplication(uint64_t a, uint64_t b, uint64_t* hi, uint64_t* lo)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *hi = (uint64_t)(r >> 64);
+    *lo = (uint64_t)r;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+    uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+    *lo = (mid << 32) | (uint32_t)p0;
+    *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+static inline int leading_zeroes(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ull)) {
+        x <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/* Floor of log2(10^q) + 63 */
+static inline int32_t power(int32_t q)
+{
+    return (((152170 + 65536) * q) >> 16) + 63;
+}
+
+/* Computes biased exponent and mantissa (without implicit bit) of w * 10^q */
+static void compute_float(const struct binary_format* bf, int64_t q, uint64_t w, int32_t* power2, uint64_t* mantissa)
+{
+    if (w == 0 || q < bf->smallest_power_of_ten) {
+        *power2 = 0;
+        *mantissa = 0;
+        return;
+    }
+    if (q > bf->largest_power_of_ten) {
+        *power2 = bf->infinite_power;
+        *mantissa = 0;
+        return;
+    }
+
+    /* Product approximation with enough precision for the target format */
+    int lz = leading_zeroes(w);
+    w <<= lz;
+    const uint64_t* p5 = fltparse_pow5_tbl[q - FLTPARSE_SMALLEST_POWER_OF_FIVE];
+    const uint64_t precision_mask = 0xFFFFFFFFFFFFFFFFull >> (bf->mantissa_explicit_bits + 3);
+    uint64_t hi, lo;
+    full_multiplication(w, p5[0], &hi, &lo);
+    if ((hi & precision_mask) == precision_mask) {
+        uint64_t hi2, lo2;
+        full_multiplication(w, p5[1], &hi2, &lo2);
+        lo += hi2;
+        if (hi2 > lo)
+            ++hi;
+    }
+
+    int upperbit = (int)(hi >> 63);
+    int shift = upperbit + 64 - bf->mantissa_explicit_bits - 3;
+    uint64_t m = hi >> shift;
+    int32_t p2 = power((int32_t)q) + upperbit - lz - bf->minimum_exponent;
+
+    /* Subnormal */
+    if (p2 <= 0) {
+        if (-p2 + 1 >= 64) {
+            *power2 = 0;
+            *mantissa = 0;
+            return;
+        }
+        m >>= -p2 + 1;
+        m += m & 1;
+        m >>= 1;
+        *power2 = m < (1ull << bf->mantissa_explicit_bits) ? 0 : 1;
+        *mantissa = m;
+        return;
+    }
+
+    /* Exactly halfway between two floats, round to even */
+    if (lo <= 1 && q >= bf->min_exponent_round_to_even && q <= bf->max_exponent_round_to_even && (m & 3) == 1) {
+        if ((m << shift) == hi)
+            m &= ~1ull;
+    }
+    m += m & 1;
+    m >>= 1;
+    if (m >= (2ull << bf->mantissa_explicit_bits)) {
+        m = 1ull << bf->mantissa_explicit_bits;
+        ++p2;
+    }
+    m &= ~(1ull << bf->mantissa_explicit_bits);
+    if (p2 >= bf->infinite_power) {
+        p2 = bf->infinite_power;
+        m = 0;
+    }
+    *power2 = p2;
+    *mantissa = m;
+}
+
+/*-----------------------------------------------------------------
+ * Public
+ *-----------------------------------------------------------------*/
+static const double exact_pow10_d[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const float exact_pow10_f[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+double fltparse_double(const char* str, const char** end)
+{
+    struct decimal d;
+    const char* p = scan_decimal(str, &d);
+    if (p == str || d.truncated) {
+        /* Slow path: inf, nan, no digits or long significands */
+        char* e;
+        double v = strtod(str, &e);
+        if (end)
+            *end = e;
+        return v;
+    }
+    if (end)
+        *end = p;
+
+    /* Clinger fast path, both operands are exact so the result is correctly rounded */
+    if (d.w <= (1ull << 53) && d.q >= -22 && d.q <= 22) {
+        double v = (double)d.w;
+        v = d.q < 0 ? v / exact_pow10_d[-d.q] : v * exact_pow10_d[d.q];
+        return d.negative ? -v : v;
+    }
+
+    int32_t p2;
+    uint64_t m;
+    compute_float(&binary64, d.q, d.w, &p2, &m);
+    uint64_t bits = m | ((uint64_t)p2 << 52) | ((uint64_t)d.negative << 63);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+float fltparse_float(const char* str, const char** end)
+{
+    struct decimal d;
+    const char* p = scan_decimal(str, &d);
+    if (p == str || d.truncated) {
+        /* Slow path: inf, nan, no digits or long significands */
+        char* e;
+        float v = strtof(str, &e);
+        if (end)
+            *end = e;
+        return v;
+    }
+    if (end)
+        *end = p;
+
+    /* Clinger fast path, both operands are exact so the result is correctly rounded */
+    if (d.w <= (1ull << 24) && d.q >= -10 && d.q <= 10) {
+        float v = (float)d.w;
+        v = d.q < 0 ? v / exact_pow10_f[-d.q] : v * exact_pow10_f[d.q];
+        return d.negative ? -v : v;
+    }
+
+    int32_t p2;
+    uint64_t m;
+    compute_float(&binary32, d.q, d.w, &p2, &m);
+    uint32_t bits = (uint32_t)m | ((uint32_t)p2 << 23) | ((uint32_t)d.negative << 31);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
@@ -1,4 +1,28 @@
 #include "frucull.h"
+#include <string.h>
+
+static inline vec4 plane_from_points(vec3 p1, vec3 p2, vec3 p3)
+{
+    vec3 e1 = vec3_sub(p2, p1);
+    vec3 e2 = vec3_sub(p3, p1);
+    vec3 normal = vec3_normalize(vec3_cross(e1, e2));
+    float constant = -vec3_dot(p1, normal);
+    return vec4_new(normal.x, normal.y, normal.z, constant);
+}
+
+void frustum_points_planes(vec3 fru_pts[8], vec4 fru_planes[6], mat4 m)
+{
+    frustum f = frustum_new_clipbox();
+    f = frustum_transform(f, mat4_inverse(m));
+    memcpy(fru_pts, &f, sizeof(vec3) * 8);
+    /* [0]: ntr, [1]: ntl, [2]: nbr, [3]: nbl, [4]: ftr, [5]: ftl, [6]: fbr, [7]: fbl */
+    fru_planes[0] = plane_from_points(fru_pts[0], fru_pts[4], fru_pts[1]); /* Top */
+    fru_planes[1] = plane_from_points(fru_pts[2], fru_pts[3], fru_pts[6]); /* Bottom */
+    fru_planes[2] = plane_from_points(fru_pts[1], fru_pts[5], fru_pts[3]); /* Left */
+    fru_planes[3] = plane_from_points(fru_pts[0], fru_pts[2], fru_pts[4]); /* Right */
+    fru_planes[4] = plane_from_points(fru_pts[4], fru_pts[6], fru_pts[5]); /* Far */
+    fru_planes[5] = plane_from_points(fru_pts[0], fru_pts[1], fru_pts[2]); /* Near */
+}
 
 /* False if fully outside, True if inside or intersects */
 /* http://www.iquilezles.org/www/articles/frustumcorrect/frustumcorrect.htm */
@@ -30,3 +54,13 @@ int box_in_frustum(vec3 fru_points[8], vec4 fru_planes[6], vec3 box_mm[2])
 
     return 1;
 }
+
+/* False if fully outside any plane, True otherwise */
+int sphere_in_frustum(vec4 fru_planes[6], vec3 center, float radius)
+{
+    vec4 c = vec4_new(center.x, center.y, center.z, 1.0f);
+    for (int i = 0; i < 6; ++i)
+        if (vec4_dot(fru_planes[i], c) < -radius)
+            return 0;
+    return 1;
+}
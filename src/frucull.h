@@ -32,6 +32,9 @@
 #define _FRUCULL_H_
 
 #include <linalgb.h>
+/* Extracts world space corner points and inward facing planes of the view projection's frustum */
+void frustum_points_planes(vec3 fru_points[8], vec4 fru_planes[6], mat4 view_proj);
 int box_in_frustum(vec3 fru_points[8], vec4 fru_planes[6], vec3 box_mm[2]);
+int sphere_in_frustum(vec4 fru_planes[6], vec3 center, float radius);
 
 #endif /* ! _FRUCULL_H_ */
@@ -27,8 +27,8 @@ void gbuffer_init(struct gbuffer* gb, int width, int height)
     } data_texs[] = {
         {
             &gb->accum_buf,
-            GL_RGB16F,
-            GL_RGB,
+            GL_RGBA16F,
+            GL_RGBA,
             GL_FLOAT,
             GL_COLOR_ATTACHMENT0
         },
@@ -1,12 +1,35 @@
 #include "girndr.h"
 #include <stdlib.h>
-#include <string.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "opengl.h"
 #include "probe.h"
 #include "gbuffer.h"
 #include "glutils.h"
+#include "dcache.h"
+#include "shcomp.h"
+
+/* Storage buffer binding points of the probe volume and its resampling inputs */
+#define GI_VOLUME_BINDING   5
+#define GI_TAPS_BINDING     6
+#define GI_PROBE_SH_BINDING 7
+/* Volume nodes per resampling group */
+#define GI_RESAMPLE_GROUP_SIZE 64
+/* Size of the SH coefficients of one probe */
+#define GI_PROBE_SH_SIZE (GI_VOLUME_SH_COEFFS * 4 * sizeof(float))
+/* Fallback probe steps, six sky faces followed by the two filtering passes */
+#define GI_FALLBACK_DIFFUSE  6
+#define GI_FALLBACK_SPECULAR 7
+#define GI_FALLBACK_DONE     8
+/* Probe cache file identification, the version is bumped whenever the layout changes */
+#define GI_CACHE_MAGIC   0x49474345 /* ECGI */
+#define GI_CACHE_VERSION 1
+
+static void gi_volume_build(struct gi_rndr* r);
+static int gi_sky_cache_load(struct gi_rndr* r);
+static void gi_sky_cache_save(struct gi_rndr* r);
+static void gi_sh_check(struct gi_rndr* r, struct probe* p, unsigned int buf, unsigned int slot);
 
 void gi_rndr_init(struct gi_rndr* r)
 {
@@ -18,6 +41,19 @@ void gi_rndr_init(struct gi_rndr* r)
     struct probe* fp = calloc(1, sizeof(struct probe));
     probe_init(fp);
     r->fallback_probe.p = fp;
+    /* Capture probe shared by all local probes */
+    r->capture_probe = calloc(1, sizeof(struct probe));
+    probe_init(r->capture_probe);
+    glGenBuffers(1, &r->vol.sh_buf);
+    glGenBuffers(1, &r->vol.taps_buf);
+    /* Fallback SH slot */
+    glGenBuffers(1, &r->fallback_sh_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->fallback_sh_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, GI_PROBE_SH_SIZE, 0, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    /* Step timers */
+    for (unsigned int i = 0; i < GI_TIMER_SLOTS; ++i)
+        glGenQueries(2, r->sched.timers[i].queries);
     /* Allocate probe array */
     r->pdata = malloc(0);
     /* Create mini gbuffer to update probes */
@@ -31,11 +67,14 @@ void gi_rndr_destroy(struct gi_rndr* r)
     free(r->probe_gbuf);
     probe_destroy(r->fallback_probe.p);
     free(r->fallback_probe.p);
-    for (unsigned int i = 0; i < r->num_probes; ++i) {
-        struct probe* p = r->pdata[i].p;
-        probe_destroy(p);
-        free(p);
-    }
+    probe_destroy(r->capture_probe);
+    free(r->capture_probe);
+    glDeleteBuffers(1, &r->vol.sh_buf);
+    glDeleteBuffers(1, &r->vol.taps_buf);
+    glDeleteBuffers(1, &r->fallback_sh_buf);
+    glDeleteBuffers(1, &r->sh_buf);
+    for (unsigned int i = 0; i < GI_TIMER_SLOTS; ++i)
+        glDeleteQueries(2, r->sched.timers[i].queries);
     free(r->pdata);
     probe_rndr_destroy(r->probe_rndr);
     free(r->probe_rndr);
@@ -46,88 +85,642 @@ void gi_add_probe(struct gi_rndr* r, vec3 pos)
     /* Expand array */
     r->num_probes++;
     r->pdata = realloc(r->pdata, r->num_probes * sizeof(*(r->pdata)));
-    /* Create and append new probe */
-    struct probe* np = calloc(1, sizeof(struct probe));
-    probe_init(np);
-    r->pdata[r->num_probes - 1].p = np;
-    r->pdata[r->num_probes - 1].pos = pos;
+    /* Append new probe, rendered through the shared capture cubemap */
+    struct gi_probe_data* pd = &r->pdata[r->num_probes - 1];
+    memset(pd, 0, sizeof(*pd));
+    pd->p = r->capture_probe;
+    pd->pos = pos;
+    pd->dirty = 1;
+    r->rs.num_dirty++;
+    r->vol.from_grid = 0;
+    r->vol.valid = 0;
 }
 
-void gi_update_begin(struct gi_rndr* r)
+void gi_set_probe_grid(struct gi_rndr* r, vec3 bmin, vec3 bmax, unsigned int dims[3])
 {
-    r->rs.pidx = 0;
+    r->num_probes = 0;
+    r->rs.num_dirty = 0;
     r->rs.side = 0;
-    probe_render_begin(r->probe_rndr);
+    unsigned int d[3];
+    for (unsigned int a = 0; a < 3; ++a)
+        d[a] = dims[a] < 2 ? 2 : dims[a];
+    for (unsigned int z = 0; z < d[2]; ++z) {
+        for (unsigned int y = 0; y < d[1]; ++y) {
+            for (unsigned int x = 0; x < d[0]; ++x) {
+                vec3 t = vec3_new((float)x / (d[0] - 1), (float)y / (d[1] - 1), (float)z / (d[2] - 1));
+                gi_add_probe(r, vec3_new(bmin.x + (bmax.x - bmin.x) * t.x,
+                                         bmin.y + (bmax.y - bmin.y) * t.y,
+                                         bmin.z + (bmax.z - bmin.z) * t.z));
+            }
+        }
+    }
+    /* Probes map one to one to volume nodes */
+    r->vol.bmin = bmin;
+    r->vol.bmax = bmax;
+    memcpy(r->vol.dims, d, sizeof(d));
+    r->vol.from_grid = 1;
+}
+
+void gi_invalidate(struct gi_rndr* r)
+{
+    for (unsigned int i = 0; i < r->num_probes; ++i)
+        r->pdata[i].dirty = 1;
+    r->rs.num_dirty = r->num_probes;
+    /* Restart any probe caught mid capture */
+    r->rs.side = 0;
+}
+
+void gi_set_sky(struct gi_rndr* r, unsigned long long key, int cacheable, const char* cache_dir)
+{
+    r->sky.cacheable = cacheable;
+    r->sky.cache_dir = cache_dir;
+    if (r->sky.known && r->sky.key == key)
+        return;
+    r->sky.key = key;
+    r->sky.known = 1;
+    /* Previously filtered sky, captured and filtered again otherwise */
+    r->rs.fallback_step = gi_sky_cache_load(r) ? GI_FALLBACK_DONE : 0;
+}
+
+/*-----------------------------------------------------------------
+ * Update scheduling
+ *-----------------------------------------------------------------*/
+static enum gi_step gi_next_step(struct gi_rndr* r)
+{
+    if (r->rs.fallback_step < GI_FALLBACK_DIFFUSE)
+        return GI_STEP_SKY_FACE;
+    if (r->rs.fallback_step == GI_FALLBACK_DIFFUSE)
+        return GI_STEP_FILTER_DIFFUSE;
+    if (r->rs.fallback_step == GI_FALLBACK_SPECULAR)
+        return GI_STEP_FILTER_SPECULAR;
+    if (r->rs.side > 0 || r->rs.num_dirty > 0)
+        return GI_STEP_PROBE_FACE;
+    return GI_STEP_NONE;
+}
+
+/* Highest priority dirty probe, near the camera and long since updated */
+static unsigned int gi_pick_probe(struct gi_rndr* r)
+{
+    unsigned int best = 0;
+    float best_score = -1.0f;
+    for (unsigned int i = 0; i < r->num_probes; ++i) {
+        struct gi_probe_data* pd = &r->pdata[i];
+        if (!pd->dirty)
+            continue;
+        float age = (float)(r->rs.frame - pd->updated);
+        float score = (1.0f + age) / (1.0f + vec3_dist(pd->pos, r->sched.eye));
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Grows the probe SH buffer to the probe count, keeping the coefficients of existing probes */
+static void gi_reserve_probe_sh(struct gi_rndr* r)
+{
+    if (r->num_probes <= r->sh_cap)
+        return;
+    size_t cap = r->num_probes > 2 * r->sh_cap ? r->num_probes : 2 * r->sh_cap;
+    GLuint buf;
+    glGenBuffers(1, &buf);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+    glBufferData(GL_COPY_WRITE_BUFFER, cap * GI_PROBE_SH_SIZE, 0, GL_DYNAMIC_COPY);
+    if (r->sh_cap > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, r->sh_buf);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, r->sh_cap * GI_PROBE_SH_SIZE);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &r->sh_buf);
+    r->sh_buf = buf;
+    r->sh_cap = cap;
+}
+
+void gi_update_begin(struct gi_rndr* r, vec3 eye, float budget_msec)
+{
+    gi_reserve_probe_sh(r);
+
+    /* Fold finished step timings into the per step estimates */
+    float max_est = 0.0f;
+    for (unsigned int i = 0; i < GI_TIMER_SLOTS; ++i) {
+        enum gi_step step = r->sched.timers[i].step;
+        if (step == GI_STEP_NONE)
+            continue;
+        GLint avail = 0;
+        glGetQueryObjectiv(r->sched.timers[i].queries[1], GL_QUERY_RESULT_AVAILABLE, &avail);
+        if (!avail)
+            continue;
+        GLuint64 t_begin, t_end;
+        glGetQueryObjectui64v(r->sched.timers[i].queries[0], GL_QUERY_RESULT, &t_begin);
+        glGetQueryObjectui64v(r->sched.timers[i].queries[1], GL_QUERY_RESULT, &t_end);
+        float msec = (t_end - t_begin) / 1000000.0f;
+        float* est = &r->sched.est_msec[step];
+        *est = *est > 0.0f ? *est * 0.8f + msec * 0.2f : msec;
+        r->sched.timers[i].step = GI_STEP_NONE;
+    }
+    for (unsigned int i = 0; i < GI_STEP_MAX; ++i)
+        max_est = fmaxf(max_est, r->sched.est_msec[i]);
+
+    /* Credit only builds up while work is pending, enough to eventually run the costliest step */
+    if (gi_next_step(r) == GI_STEP_NONE)
+        r->sched.credit_msec = 0.0f;
+    else
+        r->sched.credit_msec = fminf(r->sched.credit_msec + budget_msec, fmaxf(budget_msec, max_est));
+    r->sched.eye = eye;
+    r->sched.budget_msec = budget_msec;
+    r->rs.frame++;
+}
+
+enum gi_step gi_update_step_begin(struct gi_rndr* r, mat4* view, mat4* proj)
+{
+    enum gi_step step = gi_next_step(r);
+    if (step == GI_STEP_NONE)
+        return GI_STEP_NONE;
+    /* Steps not yet measured are assumed to take the whole budget */
+    if (r->sched.budget_msec > 0.0f) {
+        float est = r->sched.est_msec[step] > 0.0f ? r->sched.est_msec[step] : r->sched.budget_msec;
+        if (est > r->sched.credit_msec)
+            return GI_STEP_NONE;
+        r->sched.credit_msec -= est;
+    }
+
+    /* Time the step when a timer slot is free */
+    r->sched.cur_timer = GI_TIMER_SLOTS;
+    for (unsigned int i = 0; i < GI_TIMER_SLOTS; ++i) {
+        if (r->sched.timers[i].step == GI_STEP_NONE) {
+            r->sched.cur_timer = i;
+            r->sched.timers[i].step = step;
+            glQueryCounter(r->sched.timers[i].queries[0], GL_TIMESTAMP);
+            break;
+        }
+    }
+
+    r->rs.cur_step = step;
+    switch (step) {
+        case GI_STEP_SKY_FACE: {
+            struct gi_probe_data* pd = &r->fallback_probe;
+            probe_render_begin(r->probe_rndr);
+            probe_render_side_begin(r->probe_rndr, r->rs.fallback_step, pd->p, pd->pos, view, proj);
+            break;
+        }
+        case GI_STEP_PROBE_FACE: {
+            if (r->rs.side == 0)
+                r->rs.pidx = gi_pick_probe(r);
+            struct gi_probe_data* pd = r->pdata + r->rs.pidx;
+            probe_render_begin(r->probe_rndr);
+            probe_render_side_begin(r->probe_rndr, r->rs.side, pd->p, pd->pos, view, proj);
+            break;
+        }
+        default:
+            break;
+    }
+    return step;
+}
+
+void gi_update_step_end(struct gi_rndr* r)
+{
+    switch (r->rs.cur_step) {
+        case GI_STEP_SKY_FACE:
+            probe_render_side_end(r->probe_rndr, r->rs.fallback_step);
+            probe_render_end(r->probe_rndr);
+            r->rs.fallback_step++;
+            break;
+        case GI_STEP_FILTER_DIFFUSE:
+            probe_preprocess_diffuse(r->fallback_probe.p, r->shdrs.irr_conv);
+            r->rs.fallback_step++;
+            break;
+        case GI_STEP_FILTER_SPECULAR:
+            probe_preprocess_specular(r->fallback_probe.p, r->shdrs.prefilter);
+            probe_project_sh(r->probe_rndr, r->fallback_probe.p, r->shdrs.sh_project, r->shdrs.sh_reduce,
+                             r->fallback_sh_buf, 0);
+            gi_sh_check(r, r->fallback_probe.p, r->fallback_sh_buf, 0);
+            r->rs.fallback_step++;
+            gi_sky_cache_save(r);
+            break;
+        case GI_STEP_PROBE_FACE: {
+            probe_render_side_end(r->probe_rndr, r->rs.side);
+            probe_render_end(r->probe_rndr);
+            if (++r->rs.side < 6)
+                break;
+            /* Project to SH before the capture cubemap is reused */
+            struct gi_probe_data* pd = r->pdata + r->rs.pidx;
+            probe_project_sh(r->probe_rndr, pd->p, r->shdrs.sh_project, r->shdrs.sh_reduce,
+                             r->sh_buf, r->rs.pidx);
+            gi_sh_check(r, pd->p, r->sh_buf, r->rs.pidx);
+            pd->dirty = 0;
+            pd->updated = r->rs.frame;
+            r->rs.num_dirty--;
+            r->rs.side = 0;
+            /* Grid volumes read probe coefficients in place, others are resampled when all probes are done */
+            if (r->rs.num_dirty == 0)
+                gi_volume_build(r);
+            break;
+        }
+        default:
+            break;
+    }
+    if (r->sched.cur_timer < GI_TIMER_SLOTS)
+        glQueryCounter(r->sched.timers[r->sched.cur_timer].queries[1], GL_TIMESTAMP);
+    r->rs.cur_step = GI_STEP_NONE;
+}
+
+/*-----------------------------------------------------------------
+ * Probe volume
+ *-----------------------------------------------------------------*/
+/* Uniform bucket grid over the probe positions, used for nearest probe queries */
+struct probe_buckets {
+    vec3 bmin;
+    float cell;
+    unsigned int dims[3];
+    unsigned int* offsets; /* First probe of each bucket, one past the end for the last */
+    unsigned int* indices;
+};
+
+static unsigned int bucket_coord(float v, float origin, float cell, unsigned int dim)
+{
+    float c = (v - origin) / cell;
+    return c <= 0.0f ? 0 : (c >= dim - 1 ? dim - 1 : (unsigned int)c);
+}
+
+static void probe_buckets_build(struct probe_buckets* b, struct gi_probe_data* pdata, size_t num_probes, vec3 bmin, vec3 bmax)
+{
+    /* Cubic cells holding about one probe each */
+    vec3 ext = vec3_sub(bmax, bmin);
+    float volume = fmaxf(ext.x, 1e-3f) * fmaxf(ext.y, 1e-3f) * fmaxf(ext.z, 1e-3f);
+    b->bmin = bmin;
+    b->cell = fmaxf(cbrtf(volume / num_probes), 1e-3f);
+    size_t num_buckets = 1;
+    for (unsigned int a = 0; a < 3; ++a) {
+        b->dims[a] = (unsigned int)ceilf(fmaxf(ext.xyz[a], 0.0f) / b->cell);
+        b->dims[a] = b->dims[a] < 1 ? 1 : (b->dims[a] > 256 ? 256 : b->dims[a]);
+        num_buckets *= b->dims[a];
+    }
+    b->offsets = calloc(num_buckets + 1, sizeof(*b->offsets));
+    b->indices = malloc(num_probes * sizeof(*b->indices));
+    unsigned int* slots = malloc(num_probes * sizeof(*slots));
+    /* Count, prefix sum, scatter */
+    for (size_t i = 0; i < num_probes; ++i) {
+        vec3 p = pdata[i].pos;
+        slots[i] = (bucket_coord(p.z, bmin.z, b->cell, b->dims[2]) * b->dims[1]
+                  + bucket_coord(p.y, bmin.y, b->cell, b->dims[1])) * b->dims[0]
+                  + bucket_coord(p.x, bmin.x, b->cell, b->dims[0]);
+        ++b->offsets[slots[i] + 1];
+    }
+    for (size_t i = 0; i < num_buckets; ++i)
+        b->offsets[i + 1] += b->offsets[i];
+    unsigned int* cursor = malloc(num_buckets * sizeof(*cursor));
+    memcpy(cursor, b->offsets, num_buckets * sizeof(*cursor));
+    for (size_t i = 0; i < num_probes; ++i)
+        b->indices[cursor[slots[i]]++] = i;
+    free(cursor);
+    free(slots);
+}
+
+static void probe_buckets_destroy(struct probe_buckets* b)
+{
+    free(b->indices);
+    free(b->offsets);
+}
+
+/* Finds up to GI_VOLUME_NEAREST probes closest to the point, growing a ring of buckets until the set is settled */
+static unsigned int probe_buckets_nearest(struct probe_buckets* b, struct gi_probe_data* pdata, vec3 p,
+                                          unsigned int out[GI_VOLUME_NEAREST], float dist2[GI_VOLUME_NEAREST])
+{
+    unsigned int n = 0;
+    int c[3] = {
+        bucket_coord(p.x, b->bmin.x, b->cell, b->dims[0]),
+        bucket_coord(p.y, b->bmin.y, b->cell, b->dims[1]),
+        bucket_coord(p.z, b->bmin.z, b->cell, b->dims[2])
+    };
+    int max_ring = b->dims[0] > b->dims[1] ? b->dims[0] : b->dims[1];
+    max_ring = max_ring > (int)b->dims[2] ? max_ring : (int)b->dims[2];
+    for (int ring = 0; ring <= max_ring; ++ring) {
+        for (int z = c[2] - ring; z <= c[2] + ring; ++z) {
+            for (int y = c[1] - ring; y <= c[1] + ring; ++y) {
+                for (int x = c[0] - ring; x <= c[0] + ring; ++x) {
+                    /* Only the shell of the ring */
+                    if (abs(x - c[0]) != ring && abs(y - c[1]) != ring && abs(z - c[2]) != ring)
+                        continue;
+                    if (x < 0 || y < 0 || z < 0
+                     || x >= (int)b->dims[0] || y >= (int)b->dims[1] || z >= (int)b->dims[2])
+                        continue;
+                    unsigned int bk = (z * b->dims[1] + y) * b->dims[0] + x;
+                    for (unsigned int k = b->offsets[bk]; k < b->offsets[bk + 1]; ++k) {
+                        unsigned int pi = b->indices[k];
+                        vec3 dv = vec3_sub(pdata[pi].pos, p);
+                        float d2 = vec3_dot(dv, dv);
+                        /* Insertion into the sorted candidate list */
+                        if (n == GI_VOLUME_NEAREST && d2 >= dist2[n - 1])
+                            continue;
+                        unsigned int j = n < GI_VOLUME_NEAREST ? n++ : n - 1;
+                        for (; j > 0 && dist2[j - 1] > d2; --j) {
+                            dist2[j] = dist2[j - 1];
+                            out[j] = out[j - 1];
+                        }
+                        dist2[j] = d2;
+                        out[j] = pi;
+                    }
+                }
+            }
+        }
+        /* Anything beyond this ring is at least ring cells away */
+        if (n == GI_VOLUME_NEAREST && dist2[n - 1] <= (ring * b->cell) * (ring * b->cell))
+            break;
+    }
+    return n;
+}
+
+static void gi_volume_build(struct gi_rndr* r)
+{
+    r->vol.valid = 0;
+    if (r->num_probes == 0)
+        return;
+
+    /* Volume bounds from the probes when placed by hand, with roughly a node per probe */
+    if (!r->vol.from_grid) {
+        vec3 bmin = r->pdata[0].pos, bmax = r->pdata[0].pos;
+        for (size_t i = 1; i < r->num_probes; ++i) {
+            for (unsigned int a = 0; a < 3; ++a) {
+                bmin.xyz[a] = fminf(bmin.xyz[a], r->pdata[i].pos.xyz[a]);
+                bmax.xyz[a] = fmaxf(bmax.xyz[a], r->pdata[i].pos.xyz[a]);
+            }
+        }
+        vec3 ext = vec3_sub(bmax, bmin);
+        float cell = fmaxf(cbrtf(fmaxf(ext.x, 1.0f) * fmaxf(ext.y, 1.0f) * fmaxf(ext.z, 1.0f) / r->num_probes), 0.5f);
+        for (unsigned int a = 0; a < 3; ++a) {
+            unsigned int d = (unsigned int)(ext.xyz[a] / cell) + 2;
+            r->vol.dims[a] = d > 64 ? 64 : d;
+        }
+        r->vol.bmin = bmin;
+        r->vol.bmax = bmax;
+    }
+
+    /* Probe grids map one to one to volume nodes */
+    if (r->vol.from_grid) {
+        r->vol.valid = 1;
+        return;
+    }
+
+    /* Nearest probes of every volume node, inverse square distance weighted */
+    unsigned int* dims = r->vol.dims;
+    size_t num_nodes = dims[0] * dims[1] * dims[2];
+    struct gi_node_taps {
+        unsigned int probes[GI_VOLUME_NEAREST];
+        float weights[GI_VOLUME_NEAREST];
+    }* taps = calloc(num_nodes, sizeof(*taps));
+    struct probe_buckets b;
+    probe_buckets_build(&b, r->pdata, r->num_probes, r->vol.bmin, r->vol.bmax);
+    vec3 ext = vec3_sub(r->vol.bmax, r->vol.bmin);
+    for (size_t n = 0; n < num_nodes; ++n) {
+        unsigned int x = n % dims[0], y = (n / dims[0]) % dims[1], z = n / (dims[0] * dims[1]);
+        vec3 p = vec3_new(r->vol.bmin.x + ext.x * x / (dims[0] - 1),
+                          r->vol.bmin.y + ext.y * y / (dims[1] - 1),
+                          r->vol.bmin.z + ext.z * z / (dims[2] - 1));
+        float dist2[GI_VOLUME_NEAREST];
+        unsigned int count = probe_buckets_nearest(&b, r->pdata, p, taps[n].probes, dist2);
+        float wsum = 0.0f;
+        for (unsigned int k = 0; k < count; ++k)
+            wsum += (taps[n].weights[k] = 1.0f / fmaxf(dist2[k], 1e-6f));
+        for (unsigned int k = 0; k < count; ++k)
+            taps[n].weights[k] /= wsum;
+    }
+    probe_buckets_destroy(&b);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->vol.taps_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_nodes * sizeof(*taps), taps, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->vol.sh_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_nodes * GI_PROBE_SH_SIZE, 0, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    free(taps);
+
+    /* Blend probe coefficients into the nodes on the GPU */
+    GLuint shdr = r->shdrs.sh_resample;
+    glUseProgram(shdr);
+    glUniform1ui(glGetUniformLocation(shdr, "num_nodes"), num_nodes);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GI_VOLUME_BINDING, r->vol.sh_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GI_TAPS_BINDING, r->vol.taps_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GI_PROBE_SH_BINDING, r->sh_buf);
+    glDispatchCompute((num_nodes + GI_RESAMPLE_GROUP_SIZE - 1) / GI_RESAMPLE_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+    r->vol.valid = 1;
 }
 
-int gi_update_pass_begin(struct gi_rndr* r, mat4* view, mat4* proj)
+int gi_bind_volume(struct gi_rndr* r, unsigned int shdr)
 {
-    /* No more probes */
-    if (r->rs.pidx >= r->num_probes)
+    if (!r->vol.valid)
         return 0;
-    struct gi_probe_data* pd = r->pdata + r->rs.pidx;
-    probe_render_side_begin(r->probe_rndr, r->rs.side, pd->p, pd->pos, view, proj);
+    vec3 bmin = r->vol.bmin, ext = vec3_sub(r->vol.bmax, r->vol.bmin);
+    unsigned int* dims = r->vol.dims;
+    glUniform3f(glGetUniformLocation(shdr, "gi_volume_min"), bmin.x, bmin.y, bmin.z);
+    glUniform3f(glGetUniformLocation(shdr, "gi_volume_cell"),
+                fmaxf(ext.x, 1e-3f) / (dims[0] - 1),
+                fmaxf(ext.y, 1e-3f) / (dims[1] - 1),
+                fmaxf(ext.z, 1e-3f) / (dims[2] - 1));
+    glUniform3i(glGetUniformLocation(shdr, "gi_volume_dims"), dims[0], dims[1], dims[2]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GI_VOLUME_BINDING, r->vol.from_grid ? r->sh_buf : r->vol.sh_buf);
     return 1;
 }
 
-void gi_update_pass_end(struct gi_rndr* r)
+/*-----------------------------------------------------------------
+ * SH projection check
+ *-----------------------------------------------------------------*/
+void gi_sh_check_begin(struct gi_rndr* r)
+{
+    unsigned int fs = probe_radiance_face_size();
+    r->sh_check.table = malloc(sizeof(struct sh_table));
+    sh_table_init(r->sh_check.table, fs);
+    r->sh_check.radiance = malloc(6 * fs * fs * 3 * sizeof(unsigned short));
+    r->sh_check.max_error = 0.0f;
+}
+
+float gi_sh_check_end(struct gi_rndr* r)
+{
+    sh_table_destroy(r->sh_check.table);
+    free(r->sh_check.table);
+    free(r->sh_check.radiance);
+    r->sh_check.table = 0;
+    r->sh_check.radiance = 0;
+    return r->sh_check.max_error;
+}
+
+/* Projects the probe radiance on the CPU and compares with the GPU result in the given slot */
+static void gi_sh_check(struct gi_rndr* r, struct probe* p, unsigned int buf, unsigned int slot)
 {
-    probe_render_side_end(r->probe_rndr, r->rs.side);
-    r->rs.side++;
-    if (r->rs.side >= 6) {
-        /* Advance probe */
-        r->rs.pidx++;
-        r->rs.side = 0;
+    if (!r->sh_check.table)
+        return;
+    double cpu_sh[SH_COEFF_NUM][3];
+    probe_radiance_read(p, r->sh_check.radiance);
+    sh_project(cpu_sh, r->sh_check.table, r->sh_check.radiance, SH_INPUT_HALF);
+    float gpu_sh[GI_VOLUME_SH_COEFFS][4];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * GI_PROBE_SH_SIZE, GI_PROBE_SH_SIZE, gpu_sh);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    double dc = 0.0, diff = 0.0;
+    for (unsigned int c = 0; c < 3; ++c)
+        dc = fmax(dc, fabs(cpu_sh[0][c]));
+    for (unsigned int k = 0; k < GI_VOLUME_SH_COEFFS; ++k)
+        for (unsigned int c = 0; c < 3; ++c)
+            diff = fmax(diff, fabs(gpu_sh[k][c] - cpu_sh[k][c]));
+    /* Black captures are compared in absolute terms */
+    float err = dc > 1e-6 ? diff / dc : diff;
+    if (err > r->sh_check.max_error)
+        r->sh_check.max_error = err;
+}
+
+/*-----------------------------------------------------------------
+ * Cache
+ *-----------------------------------------------------------------*/
+struct gi_cache_header {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long key;
+    unsigned long long num_probes;
+    unsigned long long filtered_size;
+};
+
+int gi_cache_save(struct gi_rndr* r, unsigned long long key, const char* path)
+{
+    if (r->rs.fallback_step != GI_FALLBACK_DONE || r->rs.num_dirty != 0)
+        return 0;
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return 0;
+    struct gi_cache_header hdr = {
+        .magic = GI_CACHE_MAGIC,
+        .version = GI_CACHE_VERSION,
+        .key = key,
+        .num_probes = r->num_probes,
+        .filtered_size = probe_filtered_data_size()
+    };
+    /* Fallback probe filtered mip chains followed by the SH coefficients of every probe */
+    size_t sh_size = (1 + r->num_probes) * GI_PROBE_SH_SIZE;
+    size_t data_size = hdr.filtered_size + sh_size;
+    unsigned char* data = malloc(data_size);
+    probe_filtered_read(r->fallback_probe.p, data);
+    unsigned char* sh = data + hdr.filtered_size;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->fallback_sh_buf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GI_PROBE_SH_SIZE, sh);
+    if (r->num_probes > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->sh_buf);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, r->num_probes * GI_PROBE_SH_SIZE, sh + GI_PROBE_SH_SIZE);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 && fwrite(data, data_size, 1, f) == 1;
+    free(data);
+    ok = fclose(f) == 0 && ok;
+    if (!ok)
+        remove(path);
+    return ok;
+}
+
+int gi_cache_load(struct gi_rndr* r, unsigned long long key, const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    struct gi_cache_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+     || hdr.magic != GI_CACHE_MAGIC
+     || hdr.version != GI_CACHE_VERSION
+     || hdr.key != key
+     || hdr.num_probes != r->num_probes
+     || hdr.filtered_size != probe_filtered_data_size()) {
+        fclose(f);
+        return 0;
+    }
+    size_t data_size = hdr.filtered_size + (1 + r->num_probes) * GI_PROBE_SH_SIZE;
+    unsigned char* data = malloc(data_size);
+    int ok = fread(data, data_size, 1, f) == 1;
+    fclose(f);
+    if (!ok) {
+        free(data);
+        return 0;
+    }
+
+    /* Restore fallback probe and probe coefficients */
+    probe_filtered_load(r->fallback_probe.p, data);
+    unsigned char* sh = data + hdr.filtered_size;
+    gi_reserve_probe_sh(r);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->fallback_sh_buf);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GI_PROBE_SH_SIZE, sh);
+    if (r->num_probes > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->sh_buf);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, r->num_probes * GI_PROBE_SH_SIZE, sh + GI_PROBE_SH_SIZE);
     }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    free(data);
+
+    /* Nothing left to update */
+    r->rs.fallback_step = GI_FALLBACK_DONE;
+    for (unsigned int i = 0; i < r->num_probes; ++i)
+        r->pdata[i].dirty = 0;
+    r->rs.num_dirty = 0;
+    r->rs.side = 0;
+    gi_volume_build(r);
+    return 1;
 }
 
-void gi_update_end(struct gi_rndr* r)
+/* Filtered fallback probe cubemaps and SH coefficients of a sky */
+static int gi_sky_cache_path(struct gi_rndr* r, char* path, size_t path_sz)
 {
-    /* End local cubemap rendering */
-    probe_render_end(r->probe_rndr);
+    return r->sky.cacheable && r->sky.cache_dir
+        && dcache_path(path, path_sz, r->sky.cache_dir, "gi_sky", r->sky.key);
 }
 
-void gi_preprocess(struct gi_rndr* r, unsigned int irr_conv_shdr, unsigned int prefilter_shdr)
+static int gi_sky_cache_load(struct gi_rndr* r)
 {
-    probe_preprocess(r->fallback_probe.p, irr_conv_shdr, prefilter_shdr);
-    probe_extract_shcoeffs(r->fallback_probe.sh_coeffs, r->fallback_probe.p);
-    for (unsigned int i = 0; i < r->num_probes; ++i) {
-        probe_preprocess(r->pdata[i].p, irr_conv_shdr, prefilter_shdr);
-        probe_extract_shcoeffs(r->pdata[i].sh_coeffs, r->pdata[i].p);
+    char path[512];
+    if (!gi_sky_cache_path(r, path, sizeof(path)))
+        return 0;
+    size_t filtered_size = probe_filtered_data_size();
+    unsigned char* data = malloc(filtered_size + GI_PROBE_SH_SIZE);
+    int ok = dcache_fetch(path, r->sky.key, data, filtered_size + GI_PROBE_SH_SIZE);
+    if (ok) {
+        probe_filtered_load(r->fallback_probe.p, data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->fallback_sh_buf);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GI_PROBE_SH_SIZE, data + filtered_size);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
+    free(data);
+    return ok;
+}
+
+static void gi_sky_cache_save(struct gi_rndr* r)
+{
+    char path[512];
+    if (!gi_sky_cache_path(r, path, sizeof(path)))
+        return;
+    size_t filtered_size = probe_filtered_data_size();
+    unsigned char* data = malloc(filtered_size + GI_PROBE_SH_SIZE);
+    probe_filtered_read(r->fallback_probe.p, data);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, r->fallback_sh_buf);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GI_PROBE_SH_SIZE, data + filtered_size);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    dcache_store(path, r->sky.key, data, filtered_size + GI_PROBE_SH_SIZE);
+    free(data);
 }
 
-void gi_upload_sh_coeffs(unsigned int shdr, double sh_coef[25][3])
+static void gi_bind_probe_sh(unsigned int shdr, unsigned int buf, unsigned int slot)
 {
-    const char* uniform_name = "sh_coeffs";
-    size_t uniform_name_len = strlen(uniform_name);
     glUseProgram(shdr);
-    for (unsigned int i = 0; i < 25; ++i) {
-        /* Construct uniform name ("sh_coeffs" + "[" + i + "]" + '\0') */
-        size_t uname_sz = uniform_name_len + 1 + 2 + 1 + 1;
-        char* uname = calloc(uname_sz, 1);
-        strcat(uname, uniform_name);
-        strcat(uname, "[");
-        snprintf(uname + uniform_name_len + 1, 3, "%u", i);
-        strcat(uname, "]");
-        /* Upload */
-        GLuint uloc = glGetUniformLocation(shdr, uname);
-        float c[3] = { (float)sh_coef[i][0], (float)sh_coef[i][1], (float)sh_coef[i][2] };
-        glUniform3f(uloc, c[0], c[1], c[2]);
-        free(uname);
-    }
+    glUniform1ui(glGetUniformLocation(shdr, "u_probe"), slot);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GI_PROBE_SH_BINDING, buf);
     glUseProgram(0);
 }
 
 void gi_vis_probes(struct gi_rndr* r, unsigned int shdr, float view[16], float proj[16], unsigned int mode)
 {
     struct gi_probe_data* pd = &r->fallback_probe;
-    gi_upload_sh_coeffs(shdr, pd->sh_coeffs);
+    gi_bind_probe_sh(shdr, r->fallback_sh_buf, 0);
     probe_vis_render(pd->p, pd->pos, shdr, *(mat4*)view, *(mat4*)proj, mode);
-    for (unsigned int i = 0; i < r->num_probes; ++i) {
+    /* Probes added since the last SH buffer growth have no coefficients to bind yet */
+    size_t num_vis = r->num_probes < r->sh_cap ? r->num_probes : r->sh_cap;
+    for (size_t i = 0; i < num_vis; ++i) {
         struct gi_probe_data* pd = r->pdata + i;
         /* Visualize sample probe */
-        gi_upload_sh_coeffs(shdr, pd->sh_coeffs);
+        gi_bind_probe_sh(shdr, r->sh_buf, i);
         probe_vis_render(pd->p, pd->pos, shdr, *(mat4*)view, *(mat4*)proj, mode);
     }
 }
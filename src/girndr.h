@@ -34,42 +34,130 @@
 #include <stdlib.h>
 #include <linalgb.h>
 
+/* SH coefficients kept per probe volume node, enough for irradiance */
+#define GI_VOLUME_SH_COEFFS 9
+/* Probes blended into each volume node */
+#define GI_VOLUME_NEAREST 4
+/* Timer query slots kept in flight for measuring update steps */
+#define GI_TIMER_SLOTS 8
+/* Largest accepted difference between GPU and CPU SH projections, relative to the DC term */
+#define GI_SH_CHECK_TOLERANCE 0.01f
+
+/* Update steps of the time sliced scheduler */
+enum gi_step {
+    GI_STEP_NONE = 0,
+    GI_STEP_SKY_FACE,        /* Caller renders the sky into a fallback probe face */
+    GI_STEP_PROBE_FACE,      /* Caller renders the scene into a local probe face */
+    GI_STEP_FILTER_DIFFUSE,  /* Fallback probe diffuse convolution, no caller work */
+    GI_STEP_FILTER_SPECULAR, /* Fallback probe specular prefiltering, no caller work */
+    GI_STEP_MAX
+};
+
+struct sh_table;
+
 struct gi_rndr {
     /* Sub renderers */
     struct probe_rndr* probe_rndr;
     /* Mini gbuffer used when updating probes */
     struct gbuffer* probe_gbuf;
-    /* Probes */
+    /* Probes, local ones share a capture cubemap and keep only their SH coefficients on the GPU */
     struct gi_probe_data {
         vec3 pos;
-        double sh_coeffs[25][3];
         struct probe* p;
+        /* Scheduling state */
+        int dirty;
+        unsigned int updated;
     }* pdata, fallback_probe;
     size_t num_probes;
-    /* Running state */
+    struct probe* capture_probe;
+    /* SH coefficients, GI_VOLUME_SH_COEFFS vec4 values per probe */
+    unsigned int sh_buf, fallback_sh_buf;
+    size_t sh_cap;
+    /* Probe volume, a regular grid of SH irradiance resampled from the probes */
+    struct {
+        vec3 bmin, bmax;
+        unsigned int dims[3];
+        /* Set when probes were placed on the volume grid itself, the probe SH buffer is used as is then */
+        int from_grid;
+        unsigned int sh_buf;
+        /* Nearest probes and weights of every node, for resampling hand placed probes */
+        unsigned int taps_buf;
+        int valid;
+    } vol;
+    /* Shaders */
+    struct {
+        unsigned int irr_conv;
+        unsigned int prefilter;
+        unsigned int sh_project;
+        unsigned int sh_reduce;
+        unsigned int sh_resample;
+    } shdrs;
+    /* Sky held by the fallback probe, content keyed ones are cached on disk when a directory is given */
+    struct {
+        unsigned long long key;
+        int known;
+        int cacheable;
+        const char* cache_dir;
+    } sky;
+    /* Running state, probe and side being captured */
     struct {
         unsigned int pidx;
         unsigned int side;
+        /* Fallback probe progress, sky faces then diffuse and specular filtering */
+        unsigned int fallback_step;
+        unsigned int num_dirty;
+        unsigned int frame;
+        enum gi_step cur_step;
     } rs;
+    /* Reprojection of every GPU SH result on the CPU while enabled, tracking the largest difference */
+    struct {
+        struct sh_table* table;
+        void* radiance;
+        float max_error;
+    } sh_check;
+    /* Per frame budget, spent with the measured cost of every step kind */
+    struct {
+        vec3 eye;
+        float budget_msec, credit_msec;
+        float est_msec[GI_STEP_MAX];
+        struct {
+            unsigned int queries[2];
+            enum gi_step step;
+        } timers[GI_TIMER_SLOTS];
+        unsigned int cur_timer;
+    } sched;
 };
 
 /* Global illumination renderer interface */
 void gi_rndr_init(struct gi_rndr* r);
 void gi_rndr_destroy(struct gi_rndr* r);
 void gi_add_probe(struct gi_rndr* r, vec3 pos);
-/* Updates global illumination data */
-void gi_update_begin(struct gi_rndr* r);
-int  gi_update_pass_begin(struct gi_rndr* r, mat4* view, mat4* proj);
-void gi_update_pass_end(struct gi_rndr* r);
-void gi_update_end(struct gi_rndr* r);
-void gi_preprocess(struct gi_rndr* r, unsigned int irr_conv_shdr, unsigned int prefilter_shdr);
-void gi_upload_sh_coeffs(unsigned int shdr, double sh_coef[25][3]);
+/* Clears all probes and places new ones on a grid spanning the given bounds, at least 2 per axis */
+void gi_set_probe_grid(struct gi_rndr* r, vec3 bmin, vec3 bmax, unsigned int dims[3]);
+/* Marks all local probes for update, the fallback probe follows the sky key instead */
+void gi_invalidate(struct gi_rndr* r);
+/* Sets the sky seen by the fallback probe, which is refiltered or fetched from the disk cache only when the key changes.
+ * Cacheable keys must identify the sky content and the shaders filtering it */
+void gi_set_sky(struct gi_rndr* r, unsigned long long key, int cacheable, const char* cache_dir);
+/* Time sliced update, a zero budget runs every pending step at once */
+void gi_update_begin(struct gi_rndr* r, vec3 eye, float budget_msec);
+enum gi_step gi_update_step_begin(struct gi_rndr* r, mat4* view, mat4* proj);
+void gi_update_step_end(struct gi_rndr* r);
+/* Binds the probe volume for per pixel probe blending, returns zero when there is none */
+int gi_bind_volume(struct gi_rndr* r, unsigned int shdr);
+/* Probe cache, filtered fallback cubemaps and all probe SH coefficients, valid only for a matching key.
+ * Saving requires a finished update, loading leaves nothing to update. Both return zero on failure */
+int gi_cache_save(struct gi_rndr* r, unsigned long long key, const char* path);
+int gi_cache_load(struct gi_rndr* r, unsigned long long key, const char* path);
+/* Checks the GPU SH projections of the following updates against the CPU projector, used when baking.
+ * Ending returns the largest difference relative to the DC term, compare with GI_SH_CHECK_TOLERANCE */
+void gi_sh_check_begin(struct gi_rndr* r);
+float gi_sh_check_end(struct gi_rndr* r);
 /* Visualizes light probes, for debugging purposes */
 void gi_vis_probes(struct gi_rndr* r, unsigned int shdr, float view[16], float proj[16], unsigned int mode);
 
 /* Convenience macros */
-#define gi_render_passes(gir, pview, pproj) \
-    for (int _break = (gi_update_begin(gir), 1); _break; gi_update_end(gir), _break = 0) \
-        for (;gi_update_pass_begin(gir, &pview, &pproj); gi_update_pass_end(gir))
+#define gi_update_steps(gir, step, pview, pproj) \
+    for (; (step = gi_update_step_begin(gir, &pview, &pproj)) != GI_STEP_NONE; gi_update_step_end(gir))
 
 #endif /* ! _GIRNDR_H_ */
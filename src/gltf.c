@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <json.h>
 #include <energycore/scene_asset.h>
+#include "fltparse.h"
 
 /*---------------------------------------------------------------------------
  * Parsing Utils
@@ -142,7 +143,7 @@ static float gltf_parse_float(struct json_value_s* j)
         return 0.0;
     }
     struct json_number_s* n = j->payload;
-    return strtod(n->number, 0);
+    return fltparse_float(n->number, 0);
 }
 
 static const char* gltf_parse_string(struct json_value_s* j)
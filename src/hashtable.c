@@ -1,15 +1,20 @@
 #include "hashtable.h"
 #include <string.h>
 #include <assert.h>
-#include <math.h>
 
 #define HASH_TABLE_DEFAULT_INITIAL_CAPACITY 32
-#define HASH_TABLE_UPSIZE_LOAD_FACTOR 0.5
-
-/* MSB set indicates that this hash is deleted */
-#define is_deleted(hash) ((hash >> 31) != 0)
+#define HASH_TABLE_UPSIZE_LOAD_FACTOR 0.8
+
+/*
+ * Robin Hood open addressing:
+ * entries are kept ordered by their probe distance so that a lookup can stop as
+ * soon as it meets an entry closer to its home slot than the probed key would be,
+ * and removals shift the following cluster back instead of leaving tombstones.
+ * A hash of 0 marks an empty slot.
+ */
 #define is_power_of_two(n) (n > 0 && ((n & (n - 1)) == 0))
 #define index_from_hash(hash, capacity) (hash & (capacity - 1))
+#define probe_distance(hash, index, capacity) ((index - index_from_hash(hash, capacity)) & (capacity - 1))
 
 static void hash_table_init(struct hash_table* ht, hash_fn_t hash_fn, eql_fn_t eql_fn, size_t capacity)
 {
@@ -39,88 +44,129 @@ void hash_table_destroy(struct hash_table* ht)
 static uint32_t hash_key(struct hash_table* ht, hash_key_t key)
 {
     uint32_t h = ht->hash_fn(key);
-    /* MSB is used to indicate a deleted elem, so clear it */
-    h &= 0x7fffffff;
     /* Ensure that we never return 0 as a hash,
-     * since we use 0 to indicate that the elem has never
-     * been used at all */
+     * since we use 0 to indicate an empty slot */
     h |= h == 0;
     return h;
 }
 
-static void hash_table_resize(struct hash_table* ht, size_t new_capacity)
+/* Places a key known to be absent, returns the slot the new entry ended up in */
+static size_t insert_new(struct hash_table* ht, uint32_t hash, hash_key_t k, hash_val_t v)
 {
-    struct hash_table* nht = calloc(1, sizeof(*nht));
-    hash_table_init(nht, ht->hash_fn, ht->eql_fn, new_capacity);
-    hash_table_foreach(ht, e)
-        hash_table_insert(nht, e->key, e->val);
-    free(ht->hashes);
-    free(ht->table);
-    *ht = *nht;
-    free(nht);
-}
-
-void hash_table_insert(struct hash_table* ht, hash_key_t k, hash_val_t v)
-{
-    float load_factor = (float)ht->size / ht->capacity;
-    if (load_factor >= HASH_TABLE_UPSIZE_LOAD_FACTOR) {
-        size_t new_cap = ht->capacity * 2;
-        hash_table_resize(ht, new_cap);
-    }
-
-    uint32_t hash = hash_key(ht, k);
-    for (size_t i = 0; ; ++i) {
-        size_t index         = index_from_hash((hash + i), ht->capacity);
-        uint32_t cur_hash    = ht->hashes[index];
-        struct hash_entry* e = ht->table + index;
-
-        /* Found empty or deleted slot, insert */
-        if (cur_hash == 0 || is_deleted(cur_hash)) {
-            e->key = k;
-            e->val = v;
+    size_t mask = ht->capacity - 1;
+    size_t index = index_from_hash(hash, ht->capacity);
+    size_t dist = 0, placed = -1;
+    for (;;) {
+        uint32_t cur_hash = ht->hashes[index];
+        /* Found empty slot, insert */
+        if (cur_hash == 0) {
             ht->hashes[index] = hash;
+            ht->table[index] = (struct hash_entry){ .key = k, .val = v };
             ++ht->size;
-            return;
+            return (ssize_t)placed == -1 ? index : placed;
         }
-
-        /* Found occupied slot with same hash and key, replace value */
-        if (hash == cur_hash && ht->eql_fn(e->key, k)) {
-            e->val = v;
-            return;
+        /* Steal the slot from richer entries and carry them forward */
+        size_t cur_dist = probe_distance(cur_hash, index, ht->capacity);
+        if (cur_dist < dist) {
+            struct hash_entry tmp = ht->table[index];
+            ht->hashes[index] = hash;
+            ht->table[index] = (struct hash_entry){ .key = k, .val = v };
+            if ((ssize_t)placed == -1)
+                placed = index;
+            hash = cur_hash; k = tmp.key; v = tmp.val;
+            dist = cur_dist;
         }
+        index = (index + 1) & mask;
+        ++dist;
     }
 }
 
-static inline size_t lookup_index(struct hash_table* ht, hash_key_t k)
+static void hash_table_resize(struct hash_table* ht, size_t new_capacity)
 {
-    uint32_t hash = hash_key(ht, k);
-    for(size_t i = 0; ; ++i) {
-        size_t index = index_from_hash((hash + i), ht->capacity);
+    struct hash_entry* old_table = ht->table;
+    uint32_t* old_hashes = ht->hashes;
+    size_t old_capacity = ht->capacity;
+    hash_table_init(ht, ht->hash_fn, ht->eql_fn, new_capacity);
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old_hashes[i] != 0)
+            insert_new(ht, old_hashes[i], old_table[i].key, old_table[i].val);
+    free(old_hashes);
+    free(old_table);
+}
+
+void hash_table_reserve(struct hash_table* ht, size_t n)
+{
+    size_t new_cap = ht->capacity;
+    while (n >= new_cap * HASH_TABLE_UPSIZE_LOAD_FACTOR)
+        new_cap *= 2;
+    if (new_cap != ht->capacity)
+        hash_table_resize(ht, new_cap);
+}
+
+static inline size_t lookup_index(struct hash_table* ht, uint32_t hash, hash_key_t k)
+{
+    size_t mask = ht->capacity - 1;
+    size_t index = index_from_hash(hash, ht->capacity);
+    for (size_t dist = 0; ; ++dist) {
         uint32_t cur_hash = ht->hashes[index];
-        if (cur_hash == 0)
+        /* An empty slot or a richer entry means the key is absent */
+        if (cur_hash == 0 || probe_distance(cur_hash, index, ht->capacity) < dist)
             break;
-        if (!is_deleted(cur_hash) && hash == cur_hash && ht->eql_fn(ht->table[index].key, k))
+        if (hash == cur_hash && ht->eql_fn(ht->table[index].key, k))
             return index;
+        index = (index + 1) & mask;
     }
     return -1;
 }
 
+hash_val_t* hash_table_insert_or_get(struct hash_table* ht, hash_key_t k, hash_val_t v, int* inserted)
+{
+    uint32_t hash = hash_key(ht, k);
+    size_t index = lookup_index(ht, hash, k);
+    if ((ssize_t)index != -1) {
+        if (inserted)
+            *inserted = 0;
+        return &ht->table[index].val;
+    }
+    if (ht->size + 1 >= ht->capacity * HASH_TABLE_UPSIZE_LOAD_FACTOR)
+        hash_table_resize(ht, ht->capacity * 2);
+    if (inserted)
+        *inserted = 1;
+    return &ht->table[insert_new(ht, hash, k, v)].val;
+}
+
+void hash_table_insert(struct hash_table* ht, hash_key_t k, hash_val_t v)
+{
+    int inserted;
+    hash_val_t* val = hash_table_insert_or_get(ht, k, v, &inserted);
+    /* Found occupied slot with same key, replace value */
+    if (!inserted)
+        *val = v;
+}
+
 hash_val_t* hash_table_search(struct hash_table* ht, hash_key_t k)
 {
-    size_t index = lookup_index(ht, k);
+    size_t index = lookup_index(ht, hash_key(ht, k), k);
     return (ssize_t)index == -1 ? 0 : &ht->table[index].val;
 }
 
 int hash_table_remove(struct hash_table* ht, hash_key_t k)
 {
-    size_t index = lookup_index(ht, k);
+    size_t index = lookup_index(ht, hash_key(ht, k), k);
     if ((ssize_t)index == -1)
         return 0;
-    else {
-        ht->hashes[index] |= 0x80000000; /* Mark as deleted */
-        --(ht->size);
-        return 1;
+    /* Backward shift the following cluster into the freed slot */
+    size_t mask = ht->capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (ht->hashes[next] != 0 && probe_distance(ht->hashes[next], next, ht->capacity) != 0) {
+        ht->hashes[index] = ht->hashes[next];
+        ht->table[index] = ht->table[next];
+        index = next;
+        next = (next + 1) & mask;
     }
+    ht->hashes[index] = 0;
+    --(ht->size);
+    return 1;
 }
 
 struct hash_entry* hash_table_next_entry(struct hash_table* ht, struct hash_entry* entry)
@@ -129,7 +175,7 @@ struct hash_entry* hash_table_next_entry(struct hash_table* ht, struct hash_entr
     size_t index = !entry ? 0 : ((entry - ht->table) + 1);
     for (; index < ht->capacity; ++index) {
         uint32_t cur_hash = ht->hashes[index];
-        if ((cur_hash != 0 && !is_deleted(cur_hash))) {
+        if (cur_hash != 0) {
             e = ht->table + index;
             break;
         }
@@ -154,9 +200,16 @@ int hash_table_string_eql(hash_key_t k1, hash_key_t k2)
     return strcmp((const char*)k1, (const char*)k2) == 0;
 }
 
+/* Murmur3 64bit finalizer, mixes every input bit into the low bits used for indexing */
 uint32_t hash_table_int_hash(hash_key_t k)
 {
-    return (2166136261ul ^ k) * 0x01000193;
+    uint64_t h = k;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return (uint32_t)h;
 }
 
 int hash_table_int_eql(hash_key_t k1, hash_key_t k2)
@@ -57,7 +57,9 @@ struct hash_table {
 struct hash_table* hash_table_create(hash_fn_t hash_fn, eql_fn_t eql_fn);
 void hash_table_destroy(struct hash_table* ht);
 
+void hash_table_reserve(struct hash_table* ht, size_t n);
 void hash_table_insert(struct hash_table* ht, hash_key_t k, hash_val_t v);
+hash_val_t* hash_table_insert_or_get(struct hash_table* ht, hash_key_t k, hash_val_t v, int* inserted);
 hash_val_t* hash_table_search(struct hash_table* ht, hash_key_t k);
 int hash_table_remove(struct hash_table* ht, hash_key_t k);
 struct hash_entry* hash_table_next_entry(struct hash_table* ht, struct hash_entry* entry);
@@ -67,6 +69,7 @@ int hash_table_string_eql(hash_key_t k1, hash_key_t k2);
 uint32_t hash_table_int_hash(hash_key_t k);
 int hash_table_int_eql(hash_key_t k1, hash_key_t k2);
 
+/* Removing entries while iterating is not supported */
 #define hash_table_foreach(ht, e) \
     for(struct hash_entry* e = hash_table_next_entry(ht, 0); e != 0; e = hash_table_next_entry(ht, e))
 
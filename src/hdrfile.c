@@ -1,119 +1,273 @@
 #include "hdrfile.h"
-#include <assert.h>
-#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
-#include <math.h>
+#include <stdatomic.h>
+#include "thrpool.h"
+
+/* Scanlines per thread pool task */
+#define HDR_GRAIN 8
 
 /*-----------------------------------------------------------------
- * Hdr Loading
+ * Pixel conversion
  *-----------------------------------------------------------------*/
 /* Standard conversion from RGBE to float pixels */
 /* note: Ward uses ldexp(col+0.5,exp-(128+8)).  However we wanted pixels */
 /*       in the range [0,1] to map back into the range [0,1].            */
-static inline void rgbe2float(float* red, float* green, float* blue, unsigned char rgbe[4])
+/* The scale 2^(e-136) is built from float bits, exponents below 2 flush to zero */
+static inline float rgbe_scale(unsigned char e)
+{
+    union { uint32_t u; float f; } s;
+    s.u = e > 1 ? (uint32_t)(e - 1) << 23 : 0;
+    return s.f * (1.0f / 256.0f);
+}
+
+/* Round to nearest even float to half conversion, clamped to the largest finite half */
+static inline unsigned short float_to_half(float v)
 {
-    float f;
-    if (rgbe[3]) { /* nonzero pixel */
-        f = ldexp(1.0, rgbe[3] - (int)(128 + 8));
-        *red   = rgbe[0] * f;
-        *green = rgbe[1] * f;
-        *blue  = rgbe[2] * f;
-    } else
-        *red = *green = *blue = 0.0;
+    union { uint32_t u; float f; } f = { .f = v };
+    uint32_t sign = (f.u >> 16) & 0x8000;
+    f.u &= 0x7fffffff;
+    uint32_t o;
+    if (f.u >= 0x477ff000) {
+        /* Beyond the half range, or nan */
+        o = f.u > 0x7f800000 ? 0x7e00 : 0x7bff;
+    } else if (f.u < 0x38800000) {
+        /* Denormal half, let the float adder round */
+        union { uint32_t u; float f; } magic = { .u = 126 << 23 };
+        f.f += magic.f;
+        o = f.u - magic.u;
+    } else {
+        uint32_t mant_odd = (f.u >> 13) & 1;
+        f.u += 0xc8000fff + mant_odd;
+        o = f.u >> 13;
+    }
+    return o | sign;
 }
 
-static void hdr_read_uncompressed(float* out, unsigned char* in, unsigned int width, unsigned int height)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HDR_SIMD
+
+/* Planar RGBE bytes of 4 pixels to RGB float lanes */
+static inline void rgbe4_to_float(__m128 rgb[3], const unsigned char* planes[4], unsigned int i)
 {
-    unsigned int num_pixels = width * height;
-    while(num_pixels-- > 0) {
-        rgbe2float(&out[0],&out[1], &out[2], in);
-        in += 4; out += 3;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c[4];
+    for (unsigned int k = 0; k < 4; ++k) {
+        uint32_t b;
+        memcpy(&b, planes[k] + i, sizeof(b));
+        c[k] = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(b), zero), zero);
     }
+    /* 2^(e-128) from exponent bits e-1, masked for e < 2 */
+    __m128i keep = _mm_cmpgt_epi32(c[3], _mm_set1_epi32(1));
+    __m128i bits = _mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(c[3], _mm_set1_epi32(1)), 23), keep);
+    __m128 scale = _mm_mul_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f / 256.0f));
+    for (unsigned int k = 0; k < 3; ++k)
+        rgb[k] = _mm_mul_ps(_mm_cvtepi32_ps(c[k]), scale);
+}
+
+/* Vector version of float_to_half for non negative inputs */
+static inline __m128i float4_to_half(__m128 v)
+{
+    __m128i u = _mm_castps_si128(v);
+    /* Normal range */
+    __m128i mant_odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+    __m128i norm = _mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32((int)0xc8000fff)), mant_odd);
+    norm = _mm_srli_epi32(norm, 13);
+    /* Denormal range */
+    __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(126 << 23));
+    __m128i denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(v, magic)), _mm_set1_epi32(126 << 23));
+    __m128i is_denorm = _mm_cmplt_epi32(u, _mm_set1_epi32(0x38800000));
+    __m128i o = _mm_or_si128(_mm_and_si128(is_denorm, denorm), _mm_andnot_si128(is_denorm, norm));
+    /* Overflow */
+    __m128i is_big = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x477fefff));
+    return _mm_or_si128(_mm_and_si128(is_big, _mm_set1_epi32(0x7bff)), _mm_andnot_si128(is_big, o));
 }
+#endif
 
-static void hdr_read_rle(float* out, unsigned char* in, unsigned int width, unsigned int height)
+/* Converts a planar RGBE scanline into interleaved RGB output */
+static void convert_scanline(void* out, enum hdr_output_format fmt, const unsigned char* planes[4], unsigned int width)
 {
-    /* Read in each successive scanline */
-    unsigned char* scanline_buffer = 0;
-    while (height > 0) {
-        /* Read next 4 bytes into memory buffer */
-        unsigned char rgbe[4];
-        memcpy(rgbe, in, sizeof(rgbe)); in += sizeof(rgbe);
-        if ((rgbe[0] != 2) || (rgbe[1] != 2) || (rgbe[2] & 0x80)) {
-            /* This file is not run length encoded */
-            rgbe2float(&out[0], &out[1], &out[2], rgbe);
-            out += 3;
-            free(scanline_buffer);
-            hdr_read_uncompressed(out, in, width, height - 1);
-            return;
+    float* outf = out;
+    unsigned short* outh = out;
+    unsigned int i = 0;
+#ifdef HDR_SIMD
+    for (; i + 4 <= width; i += 4) {
+        __m128 rgb[3];
+        rgbe4_to_float(rgb, planes, i);
+        if (fmt == HDR_OUTPUT_FLOAT) {
+            float c[3][4];
+            for (unsigned int k = 0; k < 3; ++k)
+                _mm_storeu_ps(c[k], rgb[k]);
+            for (unsigned int p = 0; p < 4; ++p)
+                for (unsigned int k = 0; k < 3; ++k)
+                    outf[(i + p) * 3 + k] = c[k][p];
+        } else {
+            uint16_t c[3][8];
+            for (unsigned int k = 0; k < 3; ++k) {
+                __m128i hv = float4_to_half(rgb[k]);
+                _mm_storeu_si128((__m128i*)c[k], _mm_packs_epi32(hv, hv));
+            }
+            for (unsigned int p = 0; p < 4; ++p)
+                for (unsigned int k = 0; k < 3; ++k)
+                    outh[(i + p) * 3 + k] = c[k][p];
+        }
+    }
+#endif
+    for (; i < width; ++i) {
+        float f = rgbe_scale(planes[3][i]);
+        for (unsigned int k = 0; k < 3; ++k) {
+            float v = planes[k][i] * f;
+            if (fmt == HDR_OUTPUT_FLOAT)
+                outf[i * 3 + k] = v;
+            else
+                outh[i * 3 + k] = float_to_half(v);
         }
+    }
+}
 
-        if ((((int)rgbe[2]) << 8 | rgbe[3]) != (int)width) {
-            free(scanline_buffer);
-            assert(0 && "wrong scanline width");
+/*-----------------------------------------------------------------
+ * Scanline decoding
+ *-----------------------------------------------------------------*/
+/* Walks a run length encoded scanline, expanding it into planar dst when given.
+ * Returns the encoded size, or zero when the data is corrupt */
+static size_t rle_scanline(unsigned char* dst, const unsigned char* in, const unsigned char* in_end, unsigned int width)
+{
+    const unsigned char* p = in + 4;
+    for (unsigned int c = 0; c < 4; ++c) {
+        unsigned int x = 0;
+        while (x < width) {
+            if (p + 2 > in_end)
+                return 0;
+            unsigned int count = p[0];
+            if (count > 128) {
+                /* A run of the same value */
+                count -= 128;
+                if (count > width - x)
+                    return 0;
+                if (dst)
+                    memset(dst + c * width + x, p[1], count);
+                p += 2;
+            } else {
+                /* A non-run */
+                if (count == 0 || count > width - x || p + 1 + count > in_end)
+                    return 0;
+                if (dst)
+                    memcpy(dst + c * width + x, p + 1, count);
+                p += 1 + count;
+            }
+            x += count;
         }
+    }
+    return p - in;
+}
+
+static int is_rle_scanline(const unsigned char* p, const unsigned char* end, unsigned int width)
+{
+    return p + 4 <= end && p[0] == 2 && p[1] == 2 && !(p[2] & 0x80) && (unsigned int)(p[2] << 8 | p[3]) == width;
+}
+
+struct hdr_decode_job {
+    const struct hdr_info* hi;
+    void* out;
+    enum hdr_output_format fmt;
+    /* Scanline starts, rows from flat_from on are stored flat */
+    size_t* offsets;
+    unsigned int flat_from;
+    /* Planar scanline buffer of every concurrent runner */
+    unsigned char* scratch;
+    /* Set by any runner hitting corrupt data */
+    _Atomic int failed;
+};
 
-        if (scanline_buffer == 0)
-            scanline_buffer = malloc(width * 4);
-
-        /* Read each of the four channels for the scanline into the buffer */
-        unsigned char* ptr = &scanline_buffer[0];
-        for (unsigned int i = 0; i < 4; ++i) {
-            unsigned char* ptr_end = &scanline_buffer[(i + 1) * width];
-            while (ptr < ptr_end) {
-                unsigned char buf[2];
-                memcpy(buf, in, sizeof(buf)); in += sizeof(buf);
-                if (buf[0] > 128) {
-                    /* A run of the same value */
-                    int count = buf[0] - 128;
-                    if ((count == 0) || (count > ptr_end - ptr)) {
-                        free(scanline_buffer);
-                        assert(0 && "bad scanline data");
-                    }
-                    while (count-- > 0)
-                        *ptr++ = buf[1];
-                } else {
-                    /* A non-run */
-                    int count = buf[0];
-                    if ((count == 0) || (count > ptr_end - ptr)) {
-                        free(scanline_buffer);
-                        assert(0 && "bad scanline data");
-                    }
-                    *ptr++ = buf[1];
-                    if (--count > 0) {
-                        memcpy(ptr, in, count); in += count;
-                        ptr += count;
-                    }
-                }
+static void decode_scanlines(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    struct hdr_decode_job* job = userdata;
+    const struct hdr_info* hi = job->hi;
+    unsigned int width = hi->w;
+    size_t px_size = job->fmt == HDR_OUTPUT_FLOAT ? 3 * sizeof(float) : 3 * sizeof(uint16_t);
+    unsigned char* planar = job->scratch + (size_t)worker * width * 4;
+    const unsigned char* in_end = hi->pixels + hi->pixels_sz;
+    if (atomic_load_explicit(&job->failed, memory_order_relaxed))
+        return;
+    for (size_t y = begin; y < end; ++y) {
+        const unsigned char* in = hi->pixels + job->offsets[y];
+        const unsigned char* planes[4];
+        if (y < job->flat_from) {
+            if (!rle_scanline(planar, in, in_end, width)) {
+                atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+                return;
             }
+            for (unsigned int c = 0; c < 4; ++c)
+                planes[c] = planar + c * width;
+        } else {
+            /* Deinterleave flat pixels */
+            for (unsigned int x = 0; x < width; ++x)
+                for (unsigned int c = 0; c < 4; ++c)
+                    planar[c * width + x] = in[x * 4 + c];
+            for (unsigned int c = 0; c < 4; ++c)
+                planes[c] = planar + c * width;
         }
+        convert_scanline((unsigned char*)job->out + y * width * px_size, job->fmt, planes, width);
+    }
+}
 
-        /* Now convert data from buffer into floats */
-        for (unsigned int i = 0; i < width; ++i) {
-            rgbe[0] = scanline_buffer[i];
-            rgbe[1] = scanline_buffer[i + width];
-            rgbe[2] = scanline_buffer[i + 2 * width];
-            rgbe[3] = scanline_buffer[i + 3 * width];
-            rgbe2float(&out[0], &out[1], &out[2], rgbe);
-            out += 3;
+int hdr_image_decode(void* out, enum hdr_output_format fmt, const struct hdr_info* hi)
+{
+    unsigned int width = hi->w, height = hi->h;
+    const unsigned char* p = hi->pixels;
+    const unsigned char* end = hi->pixels + hi->pixels_sz;
+
+    /* Find scanline starts, run length encoding is not allowed outside this width range */
+    struct hdr_decode_job job = { .hi = hi, .out = out, .fmt = fmt, .flat_from = height };
+    job.offsets = malloc(height * sizeof(*job.offsets));
+    int rle_allowed = width >= 8 && width <= 0x7fff;
+    for (unsigned int y = 0; y < height; ++y) {
+        job.offsets[y] = p - hi->pixels;
+        if (!rle_allowed || !is_rle_scanline(p, end, width)) {
+            /* This file is not run length encoded from here on */
+            job.flat_from = y;
+            for (unsigned int r = y; r < height; ++r)
+                job.offsets[r] = job.offsets[y] + (size_t)(r - y) * width * 4;
+            if (job.offsets[y] + (size_t)(height - y) * width * 4 > hi->pixels_sz)
+                job.failed = 1;
+            break;
         }
-        height--;
+        size_t sz = rle_scanline(0, p, end, width);
+        if (!sz) {
+            job.failed = 1;
+            break;
+        }
+        p += sz;
+    }
+
+    /* Expand and convert */
+    if (!job.failed) {
+        struct thrpool* tp = thrpool_default();
+        job.scratch = malloc((size_t)thrpool_concurrency(tp) * width * 4);
+        thrpool_parallel_for(tp, height, HDR_GRAIN, decode_scanlines, &job);
+        free(job.scratch);
     }
-    free(scanline_buffer);
+    free(job.offsets);
+    return !job.failed;
 }
 
-int hdr_image_read(float** data, unsigned int* w, unsigned int* h, void* fdata)
+/*-----------------------------------------------------------------
+ * Hdr Loading
+ *-----------------------------------------------------------------*/
+int hdr_image_info(struct hdr_info* hi, const void* fdata, size_t fsize)
 {
     /* Cursor */
     const char* p = fdata;
+    const char* end = p + fsize;
 
     /* Check magic */
     const char* magics[] = {"#?RADIANCE\n", "#?RGBE\n"};
     int is_hdr = 0;
     for (unsigned int i = 0; i < 2; ++i) {
         size_t mlen = strlen(magics[i]);
-        if (memcmp(p, magics[i], mlen) == 0) {
+        if (fsize >= mlen && memcmp(p, magics[i], mlen) == 0) {
             p += mlen;
             is_hdr = 1;
             break;
@@ -125,16 +279,18 @@ int hdr_image_read(float** data, unsigned int* w, unsigned int* h, void* fdata)
     /* Parse headers */
     int is_rle_rgbe = 0;
     for (;;) {
+        const char* eol = memchr(p, '\n', end - p);
+        if (!eol)
+            return 0;
         if (p[0] == '#') {
             /* Comment, skip */
-            p = strchr(p, '\n') + 1;
+            p = eol + 1;
         } else {
-            const char* eol = strchr(p, '\n');
             const char* c = p;
             while (*c == ' ' && c < eol) ++c;
             if (c == eol) {
                 /* End of header */
-                ++p;
+                p = eol + 1;
                 break;
             } else {
                 if (strncmp(p, "FORMAT=32-bit_rle_rgbe", eol - p) == 0)
@@ -147,22 +303,15 @@ int hdr_image_read(float** data, unsigned int* w, unsigned int* h, void* fdata)
         return 0;
 
     /* Parse dimensions */
+    const char* eol = memchr(p, '\n', end - p);
     int width = 0, height = 0;
-    sscanf(p, "-Y %d +X %d", &height, &width);
-    p = strchr(p, '\n') + 1;
-
-    /* Gather data */
-    float* img_data = calloc(1, width * height * 3 * sizeof(float));
-    if ((width < 8) || (width > 0x7fff)) {
-        /* Run length encoding is not allowed so read flat */
-        hdr_read_uncompressed(img_data, (unsigned char*)p, width, height);
-    } else {
-        hdr_read_rle(img_data, (unsigned char*)p, width, height);
-    }
+    if (!eol || sscanf(p, "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+        return 0;
+    p = eol + 1;
 
-    /* Return data */
-    *data = img_data;
-    *w = width;
-    *h = height;
+    hi->w = width;
+    hi->h = height;
+    hi->pixels = (const unsigned char*)p;
+    hi->pixels_sz = end - p;
     return 1;
 }
@@ -31,6 +31,33 @@
 #ifndef _HDRFILE_H_
 #define _HDRFILE_H_
 
-int hdr_image_read(float** data, unsigned int* w, unsigned int* h, void* fdata);
+#include <stdlib.h>
+
+/*
+ * Radiance HDR decoding
+ * The header is parsed and a single pass over the run length encoded data
+ * records where each scanline starts, without expanding it. Scanlines are then
+ * expanded and converted in parallel on the default thread pool, with RGBE to
+ * float or half float conversion done 4 pixels at a time in SIMD lanes.
+ * The output may be any writable memory, a mapped pixel buffer object included.
+ */
+
+/* Channel type of the RGB output */
+enum hdr_output_format {
+    HDR_OUTPUT_FLOAT,
+    HDR_OUTPUT_HALF
+};
+
+struct hdr_info {
+    unsigned int w, h;
+    /* Encoded pixel data following the header */
+    const unsigned char* pixels;
+    size_t pixels_sz;
+};
+
+/* Parses the header, returns zero when the data is not a supported hdr file */
+int hdr_image_info(struct hdr_info* hi, const void* fdata, size_t fsize);
+/* Decodes w * h RGB pixels of the given format into out, returns zero on corrupt data */
+int hdr_image_decode(void* out, enum hdr_output_format fmt, const struct hdr_info* hi);
 
 #endif /* ! _HDRFILE_H_ */
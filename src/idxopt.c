@@ -0,0 +1,353 @@
+#include "idxopt.h"
+#include <string.h>
+#include <math.h>
+
+/*-----------------------------------------------------------------
+ * Cache simulation
+ *-----------------------------------------------------------------*/
+/* FIFO cache emulated with per vertex insertion timestamps, a vertex
+ * is resident while fewer than cache_size misses happened after it */
+struct fifo_cache {
+    unsigned int* stamps;
+    unsigned int time;
+    unsigned int size;
+};
+
+static void fifo_cache_init(struct fifo_cache* fc, size_t num_verts, unsigned int size)
+{
+    fc->stamps = calloc(num_verts, sizeof(*fc->stamps));
+    fc->size = size;
+    fc->time = size + 1;
+}
+
+static inline void fifo_cache_flush(struct fifo_cache* fc)
+{
+    fc->time += fc->size + 1;
+}
+
+static inline unsigned int fifo_cache_touch(struct fifo_cache* fc, unsigned int v)
+{
+    if (fc->time - fc->stamps[v] > fc->size) {
+        fc->stamps[v] = fc->time++;
+        return 1;
+    }
+    return 0;
+}
+
+static inline unsigned int fifo_cache_touch_tri(struct fifo_cache* fc, const unsigned int* tri)
+{
+    return fifo_cache_touch(fc, tri[0]) + fifo_cache_touch(fc, tri[1]) + fifo_cache_touch(fc, tri[2]);
+}
+
+void idxopt_analyze(struct idxopt_stats* st, const unsigned int* indices, size_t num_indices,
+                    size_t num_verts, unsigned int cache_size)
+{
+    struct fifo_cache fc;
+    fifo_cache_init(&fc, num_verts, cache_size);
+    size_t misses = 0, unique = 0;
+    for (size_t i = 0; i < num_indices; ++i) {
+        unsigned int v = indices[i];
+        unique += fc.stamps[v] == 0;
+        misses += fifo_cache_touch(&fc, v);
+    }
+    free(fc.stamps);
+
+    size_t num_tris = num_indices / 3;
+    st->misses = misses;
+    st->num_verts = unique;
+    st->acmr = num_tris ? (float)misses / num_tris : 0.0f;
+    st->atvr = unique ? (float)misses / unique : 0.0f;
+}
+
+/*-----------------------------------------------------------------
+ * Tipsify
+ *-----------------------------------------------------------------*/
+/* Vertex to triangle adjacency in compressed rows */
+struct vtx_adjacency {
+    unsigned int* offsets; /* num_verts + 1 */
+    unsigned int* tris;    /* num_indices */
+};
+
+static void vtx_adjacency_build(struct vtx_adjacency* adj, unsigned int* live,
+                                const unsigned int* indices, size_t num_indices, size_t num_verts)
+{
+    adj->offsets = calloc(num_verts + 1, sizeof(*adj->offsets));
+    adj->tris = malloc(num_indices * sizeof(*adj->tris));
+    memset(live, 0, num_verts * sizeof(*live));
+    for (size_t i = 0; i < num_indices; ++i)
+        ++live[indices[i]];
+    unsigned int sum = 0;
+    for (size_t v = 0; v < num_verts; ++v) {
+        adj->offsets[v] = sum;
+        sum += live[v];
+    }
+    adj->offsets[num_verts] = sum;
+    /* Fill using offsets as write cursors, then shift them back in place */
+    for (size_t i = 0; i < num_indices; ++i)
+        adj->tris[adj->offsets[indices[i]]++] = i / 3;
+    for (size_t v = num_verts; v > 0; --v)
+        adj->offsets[v] = adj->offsets[v - 1];
+    adj->offsets[0] = 0;
+}
+
+static void vtx_adjacency_destroy(struct vtx_adjacency* adj)
+{
+    free(adj->tris);
+    free(adj->offsets);
+}
+
+/* Pick the next fanning vertex among the ones touched by the last fan,
+ * preferring the oldest one that will still be in cache once its remaining
+ * triangles are emitted */
+static unsigned int tipsify_next_neighbor(const unsigned int* cands, size_t num_cands, const unsigned int* live,
+                                          const unsigned int* stamps, unsigned int time, unsigned int cache_size)
+{
+    unsigned int best = ~0u;
+    int best_prio = -1;
+    for (size_t i = 0; i < num_cands; ++i) {
+        unsigned int v = cands[i];
+        if (live[v] == 0)
+            continue;
+        int prio = 0;
+        if (time - stamps[v] + 2 * live[v] <= cache_size)
+            prio = time - stamps[v];
+        if (prio > best_prio) {
+            best_prio = prio;
+            best = v;
+        }
+    }
+    return best;
+}
+
+/* Fall back to the most recently touched vertex with live triangles,
+ * or to the next one in input order */
+static unsigned int tipsify_next_dead_end(const unsigned int* dead_end, size_t* dead_end_top, const unsigned int* live,
+                                          size_t* cursor, size_t num_verts)
+{
+    while (*dead_end_top > 0) {
+        unsigned int v = dead_end[--*dead_end_top];
+        if (live[v] > 0)
+            return v;
+    }
+    while (*cursor < num_verts) {
+        unsigned int v = (*cursor)++;
+        if (live[v] > 0)
+            return v;
+    }
+    return ~0u;
+}
+
+size_t idxopt_tipsify(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                      size_t num_verts, unsigned int cache_size, unsigned int* clusters)
+{
+    size_t num_tris = num_indices / 3;
+    if (num_tris == 0) {
+        if (clusters)
+            clusters[0] = 0;
+        return 0;
+    }
+
+    unsigned int* live = malloc(num_verts * sizeof(*live));
+    struct vtx_adjacency adj;
+    vtx_adjacency_build(&adj, live, indices, num_indices, num_verts);
+
+    struct fifo_cache fc;
+    fifo_cache_init(&fc, num_verts, cache_size);
+    unsigned char* emitted = calloc(num_tris, 1);
+    unsigned int* dead_end = calloc(num_indices, sizeof(*dead_end));
+    size_t dead_end_top = 0;
+    size_t cursor = 0;
+    size_t num_clusters = 0;
+    size_t out_tris = 0;
+
+    unsigned int fan = tipsify_next_dead_end(dead_end, &dead_end_top, live, &cursor, num_verts);
+    if (clusters)
+        clusters[num_clusters] = 0;
+    ++num_clusters;
+    while (fan != ~0u) {
+        size_t fan_begin = dead_end_top;
+        for (unsigned int i = adj.offsets[fan]; i < adj.offsets[fan + 1]; ++i) {
+            unsigned int t = adj.tris[i];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            const unsigned int* tri = indices + 3 * t;
+            for (unsigned int j = 0; j < 3; ++j) {
+                unsigned int v = tri[j];
+                out[3 * out_tris + j] = v;
+                dead_end[dead_end_top++] = v;
+                --live[v];
+                fifo_cache_touch(&fc, v);
+            }
+            ++out_tris;
+        }
+
+        unsigned int next = tipsify_next_neighbor(dead_end + fan_begin, dead_end_top - fan_begin,
+                                                  live, fc.stamps, fc.time, cache_size);
+        if (next == ~0u) {
+            next = tipsify_next_dead_end(dead_end, &dead_end_top, live, &cursor, num_verts);
+            /* Locality is lost, what follows is a new cluster */
+            if (next != ~0u) {
+                if (clusters)
+                    clusters[num_clusters] = out_tris;
+                ++num_clusters;
+            }
+        }
+        fan = next;
+    }
+    if (clusters)
+        clusters[num_clusters] = num_tris;
+
+    free(dead_end);
+    free(emitted);
+    free(fc.stamps);
+    vtx_adjacency_destroy(&adj);
+    free(live);
+    return num_clusters;
+}
+
+/*-----------------------------------------------------------------
+ * Overdraw ordering
+ *-----------------------------------------------------------------*/
+/* Splits hard clusters wherever the running ACMR of the current piece
+ * is already within threshold of the whole cluster's ACMR */
+static size_t soft_boundaries(unsigned int* out, const unsigned int* indices, size_t num_verts,
+                              const unsigned int* clusters, size_t num_clusters,
+                              unsigned int cache_size, float threshold)
+{
+    struct fifo_cache fc;
+    fifo_cache_init(&fc, num_verts, cache_size);
+    size_t num_out = 0;
+    for (size_t c = 0; c < num_clusters; ++c) {
+        unsigned int begin = clusters[c], end = clusters[c + 1];
+        if (begin == end)
+            continue;
+        fifo_cache_flush(&fc);
+        size_t cluster_misses = 0;
+        for (unsigned int t = begin; t < end; ++t)
+            cluster_misses += fifo_cache_touch_tri(&fc, indices + 3 * t);
+        float target = threshold * cluster_misses / (end - begin);
+
+        out[num_out++] = begin;
+        fifo_cache_flush(&fc);
+        size_t misses = 0, tris = 0;
+        for (unsigned int t = begin; t < end; ++t) {
+            misses += fifo_cache_touch_tri(&fc, indices + 3 * t);
+            ++tris;
+            if ((float)misses / tris <= target && t + 1 < end) {
+                out[num_out++] = t + 1;
+                fifo_cache_flush(&fc);
+                misses = tris = 0;
+            }
+        }
+    }
+    out[num_out] = clusters[num_clusters];
+    free(fc.stamps);
+    return num_out;
+}
+
+struct cluster_key {
+    float key;
+    unsigned int idx;
+};
+
+static int cluster_key_cmp(const void* a, const void* b)
+{
+    const struct cluster_key* ka = a;
+    const struct cluster_key* kb = b;
+    if (ka->key != kb->key)
+        return ka->key > kb->key ? -1 : 1;
+    return ka->idx < kb->idx ? -1 : (ka->idx > kb->idx);
+}
+
+void idxopt_overdraw(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                     const vec3f* pos, size_t num_verts, const unsigned int* clusters, size_t num_clusters,
+                     unsigned int cache_size, float threshold)
+{
+    size_t num_tris = num_indices / 3;
+    if (num_tris == 0)
+        return;
+
+    /* Each split adds at most one cluster per triangle */
+    unsigned int* soft = malloc((num_tris + num_clusters + 1) * sizeof(*soft));
+    size_t num_soft = soft_boundaries(soft, indices, num_verts, clusters, num_clusters, cache_size, threshold);
+
+    float mc[3] = {0.0f, 0.0f, 0.0f};
+    for (size_t v = 0; v < num_verts; ++v)
+        for (unsigned int k = 0; k < 3; ++k)
+            mc[k] += ((const float*)(pos + v))[k];
+    for (unsigned int k = 0; k < 3; ++k)
+        mc[k] /= num_verts;
+
+    /* Clusters facing away from the mesh center are drawn first, as they are the likeliest occluders */
+    struct cluster_key* keys = malloc(num_soft * sizeof(*keys));
+    for (size_t c = 0; c < num_soft; ++c) {
+        float cc[3] = {0.0f, 0.0f, 0.0f}, cn[3] = {0.0f, 0.0f, 0.0f}, area = 0.0f;
+        for (unsigned int t = soft[c]; t < soft[c + 1]; ++t) {
+            const float* p0 = (const float*)(pos + indices[3 * t + 0]);
+            const float* p1 = (const float*)(pos + indices[3 * t + 1]);
+            const float* p2 = (const float*)(pos + indices[3 * t + 2]);
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (unsigned int k = 0; k < 3; ++k) {
+                cc[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0f;
+                cn[k] += n[k];
+            }
+            area += a;
+        }
+        float key = 0.0f;
+        float nl = sqrtf(cn[0] * cn[0] + cn[1] * cn[1] + cn[2] * cn[2]);
+        if (area > 0.0f && nl > 0.0f) {
+            for (unsigned int k = 0; k < 3; ++k)
+                key += (cc[k] / area - mc[k]) * cn[k];
+            key /= nl;
+        }
+        keys[c] = (struct cluster_key){key, c};
+    }
+    qsort(keys, num_soft, sizeof(*keys), cluster_key_cmp);
+
+    size_t out_idx = 0;
+    for (size_t c = 0; c < num_soft; ++c) {
+        unsigned int begin = soft[keys[c].idx], end = soft[keys[c].idx + 1];
+        memcpy(out + out_idx, indices + 3 * begin, 3 * (end - begin) * sizeof(*out));
+        out_idx += 3 * (end - begin);
+    }
+
+    free(keys);
+    free(soft);
+}
+
+/*-----------------------------------------------------------------
+ * Vertex fetch
+ *-----------------------------------------------------------------*/
+void idxopt_vfetch_remap(unsigned int* remap, unsigned int* indices, size_t num_indices, size_t num_verts)
+{
+    memset(remap, 0xFF, num_verts * sizeof(*remap));
+    unsigned int next = 0;
+    for (size_t i = 0; i < num_indices; ++i) {
+        unsigned int v = indices[i];
+        if (remap[v] == ~0u)
+            remap[v] = next++;
+        indices[i] = remap[v];
+    }
+    for (size_t v = 0; v < num_verts; ++v)
+        if (remap[v] == ~0u)
+            remap[v] = next++;
+}
+
+void idxopt_remap_buffer(void* data, size_t elem_size, const unsigned int* remap, size_t num_verts)
+{
+    if (!data)
+        return;
+    unsigned char* tmp = malloc(num_verts * elem_size);
+    memcpy(tmp, data, num_verts * elem_size);
+    for (size_t v = 0; v < num_verts; ++v)
+        memcpy((unsigned char*)data + remap[v] * elem_size, tmp + v * elem_size, elem_size);
+    free(tmp);
+}
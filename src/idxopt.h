@@ -0,0 +1,83 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _IDXOPT_H_
+#define _IDXOPT_H_
+
+#include <stdlib.h>
+#include <energycore/scene_asset.h>
+
+/*
+ * Index buffer optimization
+ * Triangle lists are reordered for the post transform vertex cache with Tipsify
+ * (Sander, Nehab, Barczak - Fast Triangle Reordering for Vertex Locality and
+ * Reduced Overdraw), the resulting clusters are then sorted front to back from
+ * the mesh centroid to reduce overdraw, and finally vertices are renumbered in
+ * first use order so that vertex fetch walks memory linearly.
+ * Adjacency is stored in flat arrays, so vertex valence is unbounded.
+ */
+
+/* Default simulated FIFO cache size */
+#define IDXOPT_CACHE_SIZE 16
+/* Maximum ACMR increase tolerated when splitting clusters for overdraw ordering */
+#define IDXOPT_OVERDRAW_THRESHOLD 1.05f
+
+/* Vertex cache efficiency of an index buffer */
+struct idxopt_stats {
+    size_t misses;    /* Simulated cache misses (vertex shader invocations) */
+    size_t num_verts; /* Distinct vertices referenced */
+    float acmr;       /* Average cache miss ratio, misses per triangle */
+    float atvr;       /* Average transformed vertex ratio, misses per referenced vertex */
+};
+
+/* Simulates a FIFO cache of the given size over the index buffer */
+void idxopt_analyze(struct idxopt_stats* st, const unsigned int* indices, size_t num_indices,
+                    size_t num_verts, unsigned int cache_size);
+
+/* Reorders triangles for vertex locality. Clusters, if non null, receives the start triangle
+ * of each cluster (up to num_indices / 3 + 1 entries, terminated by the triangle count).
+ * Returns the number of clusters. Output must not alias input. */
+size_t idxopt_tipsify(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                      size_t num_verts, unsigned int cache_size, unsigned int* clusters);
+
+/* Reorders the clusters of a Tipsify output to reduce overdraw, splitting them further where the
+ * cache efficiency loss stays below threshold. Output must not alias input. */
+void idxopt_overdraw(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                     const vec3f* pos, size_t num_verts, const unsigned int* clusters, size_t num_clusters,
+                     unsigned int cache_size, float threshold);
+
+/* Renumbers vertices in order of first use, rewriting indices in place and filling remap with
+ * the new location of each old vertex. Vertices not referenced keep their relative order at the end. */
+void idxopt_vfetch_remap(unsigned int* remap, unsigned int* indices, size_t num_indices, size_t num_verts);
+
+/* Moves elements of a vertex attribute array to the locations given by remap */
+void idxopt_remap_buffer(void* data, size_t elem_size, const unsigned int* remap, size_t num_verts);
+
+#endif /* ! _IDXOPT_H_ */
@@ -0,0 +1,145 @@
+#include "instbat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "opengl.h"
+
+struct instbat_item {
+    struct instbat_inst inst;
+    unsigned int vao;
+    rid mat;
+    unsigned int lod;
+    int mirrored;
+    unsigned int tag;
+    /* Insertion order, keeps sorting deterministic */
+    unsigned int seq;
+};
+
+void instbat_init(struct instbat* ib)
+{
+    memset(ib, 0, sizeof(*ib));
+    glGenBuffers(1, &ib->inst_buf);
+}
+
+void instbat_begin(struct instbat* ib)
+{
+    ib->num_items = 0;
+    ib->num_batches = 0;
+}
+
+void instbat_add(struct instbat* ib, unsigned int obj, unsigned int shape, const struct render_shape* rsh,
+                 rid mat, unsigned int lod, int mirrored, unsigned int tag)
+{
+    if (ib->num_items == ib->cap_items) {
+        ib->cap_items = ib->cap_items ? ib->cap_items * 2 : 256;
+        ib->items = realloc(ib->items, ib->cap_items * sizeof(*ib->items));
+    }
+    struct instbat_item* it = &ib->items[ib->num_items];
+    it->inst = (struct instbat_inst){ .obj = obj, .shape = shape };
+    it->vao = rsh->vao;
+    it->mat = mat;
+    it->lod = lod;
+    it->mirrored = !!mirrored;
+    it->tag = tag;
+    it->seq = ib->num_items++;
+}
+
+/* Orders by everything that forces a separate draw */
+static int item_state_cmp(const struct instbat_item* a, const struct instbat_item* b)
+{
+    if (a->vao != b->vao)
+        return a->vao < b->vao ? -1 : 1;
+    if (a->mat.index != b->mat.index)
+        return a->mat.index < b->mat.index ? -1 : 1;
+    if (a->mat.generation != b->mat.generation)
+        return a->mat.generation < b->mat.generation ? -1 : 1;
+    if (a->lod != b->lod)
+        return a->lod < b->lod ? -1 : 1;
+    if (a->mirrored != b->mirrored)
+        return a->mirrored < b->mirrored ? -1 : 1;
+    return 0;
+}
+
+static int item_cmp(const void* l, const void* r)
+{
+    const struct instbat_item* a = l, *b = r;
+    int c = item_state_cmp(a, b);
+    return c ? c : (a->seq < b->seq ? -1 : 1);
+}
+
+void instbat_end(struct instbat* ib, struct render_object* objs, int merge)
+{
+    if (ib->num_items > ib->cap_insts) {
+        ib->cap_insts = ib->cap_items;
+        ib->insts = realloc(ib->insts, ib->cap_insts * sizeof(*ib->insts));
+        ib->data = realloc(ib->data, ib->cap_insts * sizeof(*ib->data));
+    }
+    if (merge)
+        qsort(ib->items, ib->num_items, sizeof(*ib->items), item_cmp);
+
+    /* Split sorted items into runs of equal state */
+    for (size_t i = 0; i < ib->num_items; ++i) {
+        struct instbat_item* it = &ib->items[i];
+        ib->insts[i] = it->inst;
+        memcpy(ib->data[i].model, objs[it->inst.obj].model_mat, sizeof(ib->data[i].model));
+        ib->data[i].tag = it->tag;
+        if (merge && i > 0 && item_state_cmp(it, it - 1) == 0) {
+            ++ib->batches[ib->num_batches - 1].num_insts;
+            continue;
+        }
+        if (ib->num_batches == ib->cap_batches) {
+            ib->cap_batches = ib->cap_batches ? ib->cap_batches * 2 : 64;
+            ib->batches = realloc(ib->batches, ib->cap_batches * sizeof(*ib->batches));
+        }
+        ib->batches[ib->num_batches++] = (struct instbat_batch) {
+            .obj = it->inst.obj,
+            .shape = it->inst.shape,
+            .lod = it->lod,
+            .mirrored = it->mirrored,
+            .first_inst = i,
+            .num_insts = 1
+        };
+    }
+
+    /* Orphan previous contents, earlier passes may still read them */
+    glBindBuffer(GL_ARRAY_BUFFER, ib->inst_buf);
+    glBufferData(GL_ARRAY_BUFFER, ib->num_items * sizeof(*ib->data), ib->data, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instbat_bind(struct instbat* ib, const struct render_shape* rsh)
+{
+    glBindVertexArray(rsh->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, ib->inst_buf);
+    /* A mat4 attribute takes four consecutive vec4 locations */
+    for (unsigned int c = 0; c < 4; ++c) {
+        GLuint loc = INSTBAT_MODEL_ATTRIB + c;
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(*ib->data),
+                              (GLvoid*)(offsetof(struct instbat_data, model) + c * 4 * sizeof(float)));
+        glVertexAttribDivisor(loc, 1);
+    }
+    glEnableVertexAttribArray(INSTBAT_TAG_ATTRIB);
+    glVertexAttribIPointer(INSTBAT_TAG_ATTRIB, 1, GL_UNSIGNED_INT, sizeof(*ib->data),
+                           (GLvoid*)offsetof(struct instbat_data, tag));
+    glVertexAttribDivisor(INSTBAT_TAG_ATTRIB, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instbat_draw(struct instbat* ib, const struct instbat_batch* b, const struct render_shape* rsh)
+{
+    (void) ib;
+    const struct render_lod* lod = &rsh->lods[b->lod];
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, lod->num_indices, GL_UNSIGNED_INT,
+                                        (void*)(lod->first_index * sizeof(unsigned int)),
+                                        b->num_insts, b->first_inst);
+}
+
+void instbat_destroy(struct instbat* ib)
+{
+    glDeleteBuffers(1, &ib->inst_buf);
+    free(ib->batches);
+    free(ib->data);
+    free(ib->insts);
+    free(ib->items);
+}
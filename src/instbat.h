@@ -0,0 +1,96 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _INSTBAT_H_
+#define _INSTBAT_H_
+
+#include <energycore/renderer.h>
+
+/*
+ * Instance batching
+ * Object shapes are collected each pass with the state their draw depends on,
+ * sorted so that equal vertex array, material, level and winding end up adjacent,
+ * and merged into batches. The model matrices of all instances are uploaded in
+ * batch order into one instance buffer, read as per instance vertex attributes,
+ * so every batch is drawn with a single instanced call.
+ */
+#define INSTBAT_MODEL_ATTRIB 4
+#define INSTBAT_TAG_ATTRIB 8
+
+/* Object shape drawn by an instance */
+struct instbat_inst {
+    unsigned int obj, shape;
+};
+
+/* Per instance vertex data, the tag is free for passes to use */
+struct instbat_data {
+    float model[16];
+    unsigned int tag;
+};
+
+/* Run of instances sharing the same draw state */
+struct instbat_batch {
+    /* First member, for shape and material lookup */
+    unsigned int obj, shape;
+    unsigned int lod;
+    int mirrored;
+    unsigned int first_inst;
+    unsigned int num_insts;
+};
+
+struct instbat {
+    /* Sort records of the current pass */
+    struct instbat_item* items;
+    size_t num_items, cap_items;
+    /* Instances in batch order and their vertex data */
+    struct instbat_inst* insts;
+    struct instbat_data* data;
+    size_t cap_insts;
+    struct instbat_batch* batches;
+    size_t num_batches, cap_batches;
+    unsigned int inst_buf;
+};
+
+void instbat_init(struct instbat* ib);
+/* Clears the instances of the previous pass */
+void instbat_begin(struct instbat* ib);
+/* Adds an object shape with the given draw state, material can be left null when unused */
+void instbat_add(struct instbat* ib, unsigned int obj, unsigned int shape, const struct render_shape* rsh,
+                 rid mat, unsigned int lod, int mirrored, unsigned int tag);
+/* Forms the batches and uploads the instance data.
+ * When merge is unset every object shape keeps its own batch in insertion order */
+void instbat_end(struct instbat* ib, struct render_object* objs, int merge);
+/* Binds the shape's vertex array with the instance buffer attached */
+void instbat_bind(struct instbat* ib, const struct render_shape* rsh);
+/* Draws all instances of the batch with its level's element range */
+void instbat_draw(struct instbat* ib, const struct instbat_batch* b, const struct render_shape* rsh);
+void instbat_destroy(struct instbat* ib);
+
+#endif /* ! _INSTBAT_H_ */
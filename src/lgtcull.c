@@ -0,0 +1,246 @@
+#include "lgtcull.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "opengl.h"
+#include "thrpool.h"
+
+/* Slices per thread pool task */
+#define LGTCULL_GRAIN 1
+/* Storage buffer binding points of the resolve shader */
+#define LGTCULL_LIGHTS_BINDING   2
+#define LGTCULL_CLUSTERS_BINDING 3
+#define LGTCULL_INDICES_BINDING  4
+/* Outer cone cosine marking point lights */
+#define LGTCULL_POINT_OUTER -2.0f
+
+struct lgtcull_job {
+    struct lgtcull_state* st;
+    /* Counting pass when zero, index writing pass otherwise */
+    int fill;
+};
+
+void lgtcull_init(struct lgtcull_state* st)
+{
+    memset(st, 0, sizeof(*st));
+    GLuint bufs[3];
+    glGenBuffers(3, bufs);
+    st->glh.lights_buf   = bufs[0];
+    st->glh.clusters_buf = bufs[1];
+    st->glh.indices_buf  = bufs[2];
+}
+
+/* Near and far distances from the inverse projection of two NDC points */
+static void near_far_from_projection(mat4 proj, float* near_z, float* far_z)
+{
+    mat4 inv_proj = mat4_inverse(proj);
+    vec4 pn = mat4_mul_vec4(inv_proj, vec4_new(0, 0, -1, 1));
+    vec4 pf = mat4_mul_vec4(inv_proj, vec4_new(0, 0,  1, 1));
+    *near_z = -pn.z / pn.w;
+    *far_z  = -pf.z / pf.w;
+}
+
+/* Packs a point or spot light and its world space bounding sphere, zero for lights that cannot contribute */
+static int pack_light(const struct render_light* l, struct lgtcull_light* out)
+{
+    vec3 pos, c; float r, cr;
+    vec3 dir = vec3_zero();
+    float cos_outer = LGTCULL_POINT_OUTER, cos_inner = LGTCULL_POINT_OUTER;
+    switch (l->type) {
+        case LT_POINT:
+            pos = l->type_data.pt.position;
+            r = l->type_data.pt.radius;
+            c = pos;
+            cr = r;
+            break;
+        case LT_SPOT: {
+            pos = l->type_data.spt.position;
+            r = l->type_data.spt.radius;
+            dir = vec3_normalize(l->type_data.spt.direction);
+            float outer = l->type_data.spt.outer_cone;
+            cos_outer = cosf(outer);
+            cos_inner = cosf(fminf(l->type_data.spt.inner_cone, outer));
+            if (outer >= (float)M_PI * 0.5f) {
+                /* Wider than a hemisphere, bounded like a point light */
+                c = pos;
+                cr = r;
+            } else if (outer >= (float)M_PI * 0.25f) {
+                /* Sphere around the cone base */
+                c = vec3_add(pos, vec3_mul(dir, r * cos_outer));
+                cr = r * sinf(outer);
+            } else {
+                /* Sphere through the apex and the base rim */
+                cr = r / (2.0f * cos_outer);
+                c = vec3_add(pos, vec3_mul(dir, cr));
+            }
+            break;
+        }
+        case LT_DIRECTIONAL:
+        default:
+            return 0;
+    }
+    if (r <= 0.0f || l->intensity <= 0.0f)
+        return 0;
+    *out = (struct lgtcull_light) {
+        .pos_radius  = { pos.x, pos.y, pos.z, r },
+        .color_inner = { l->color.x * l->intensity, l->color.y * l->intensity, l->color.z * l->intensity, cos_inner },
+        .dir_outer   = { dir.x, dir.y, dir.z, cos_outer },
+        .bounds      = { c.x, c.y, c.z, cr }
+    };
+    return 1;
+}
+
+static unsigned int clampu(float v, unsigned int hi)
+{
+    return v <= 0.0f ? 0 : (v >= hi ? hi : (unsigned int)v);
+}
+
+static void bin_slices(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct lgtcull_job* job = userdata;
+    struct lgtcull_state* st = job->st;
+    unsigned int gx = st->grid[0], gy = st->grid[1];
+    for (size_t z = begin; z < end; ++z) {
+        unsigned int* clusters = st->clusters + 2 * z * gx * gy;
+        for (size_t l = 0; l < st->num_lights; ++l) {
+            const unsigned int* r = st->ranges[l];
+            if (z < r[4] || z > r[5])
+                continue;
+            for (unsigned int y = r[2]; y <= r[3]; ++y) {
+                for (unsigned int x = r[0]; x <= r[1]; ++x) {
+                    unsigned int* c = clusters + 2 * (y * gx + x);
+                    if (job->fill)
+                        st->indices[c[0] + c[1]] = l;
+                    ++c[1];
+                }
+            }
+        }
+    }
+}
+
+void lgtcull_gather(struct lgtcull_state* st, struct render_light* lights, unsigned int num_lights,
+                    float view[16], float proj[16], unsigned int width, unsigned int height)
+{
+    /* Grid and exponential depth slicing over the camera range */
+    st->grid[0] = (width + LGTCULL_TILE_SIZE - 1) / LGTCULL_TILE_SIZE;
+    st->grid[1] = (height + LGTCULL_TILE_SIZE - 1) / LGTCULL_TILE_SIZE;
+    st->grid[2] = LGTCULL_SLICES;
+    float near_z, far_z;
+    near_far_from_projection(*(mat4*)proj, &near_z, &far_z);
+    st->slice_scale = LGTCULL_SLICES / logf(far_z / near_z);
+    st->slice_bias = -logf(near_z) * st->slice_scale;
+
+    if (num_lights > st->cap_lights) {
+        st->cap_lights = num_lights;
+        st->lights = realloc(st->lights, st->cap_lights * sizeof(*st->lights));
+        st->ranges = realloc(st->ranges, st->cap_lights * sizeof(*st->ranges));
+    }
+
+    /* Find the cluster range of every light from its view space sphere */
+    mat4 vm = *(mat4*)view, pm = *(mat4*)proj;
+    st->num_lights = 0;
+    for (unsigned int i = 0; i < num_lights; ++i) {
+        struct lgtcull_light* pl = &st->lights[st->num_lights];
+        if (!pack_light(&lights[i], pl))
+            continue;
+        float radius = pl->bounds[3];
+        vec3 c = mat4_mul_vec3(vm, vec3_new(pl->bounds[0], pl->bounds[1], pl->bounds[2]));
+        float zmin = -c.z - radius, zmax = -c.z + radius;
+        if (zmax < near_z || zmin > far_z)
+            continue;
+        unsigned int* r = st->ranges[st->num_lights];
+        if (zmin <= near_z) {
+            /* Camera inside or close to the sphere, the whole screen may be covered */
+            r[0] = 0; r[1] = st->grid[0] - 1;
+            r[2] = 0; r[3] = st->grid[1] - 1;
+        } else {
+            /* Screen rectangle of the sphere's view space bounding box */
+            float bmin[2] = { INFINITY, INFINITY }, bmax[2] = { -INFINITY, -INFINITY };
+            for (unsigned int k = 0; k < 8; ++k) {
+                vec4 p = vec4_new(c.x + (k & 1 ? radius : -radius),
+                                  c.y + (k & 2 ? radius : -radius),
+                                  c.z + (k & 4 ? radius : -radius), 1.0f);
+                p = mat4_mul_vec4(pm, p);
+                for (unsigned int a = 0; a < 2; ++a) {
+                    float ndc = (a ? p.y : p.x) / p.w;
+                    bmin[a] = fminf(bmin[a], ndc);
+                    bmax[a] = fmaxf(bmax[a], ndc);
+                }
+            }
+            if (bmax[0] < -1.0f || bmin[0] > 1.0f || bmax[1] < -1.0f || bmin[1] > 1.0f)
+                continue;
+            float tiles[2] = { (float)width / LGTCULL_TILE_SIZE, (float)height / LGTCULL_TILE_SIZE };
+            for (unsigned int a = 0; a < 2; ++a) {
+                r[2 * a + 0] = clampu((bmin[a] * 0.5f + 0.5f) * tiles[a], st->grid[a] - 1);
+                r[2 * a + 1] = clampu((bmax[a] * 0.5f + 0.5f) * tiles[a], st->grid[a] - 1);
+            }
+        }
+        r[4] = clampu(logf(fmaxf(zmin, near_z)) * st->slice_scale + st->slice_bias, LGTCULL_SLICES - 1);
+        r[5] = clampu(logf(fminf(zmax, far_z)) * st->slice_scale + st->slice_bias, LGTCULL_SLICES - 1);
+        ++st->num_lights;
+    }
+
+    /* Upload packed lights */
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st->glh.lights_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, st->num_lights * sizeof(*st->lights), st->lights, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void lgtcull_bin(struct lgtcull_state* st)
+{
+    size_t num_clusters = st->grid[0] * st->grid[1] * st->grid[2];
+    if (num_clusters > st->cap_clusters) {
+        st->cap_clusters = num_clusters;
+        st->clusters = realloc(st->clusters, st->cap_clusters * 2 * sizeof(*st->clusters));
+    }
+
+    /* Count lights per cluster, allocate list ranges, then write indices */
+    memset(st->clusters, 0, num_clusters * 2 * sizeof(*st->clusters));
+    struct lgtcull_job job = { .st = st, .fill = 0 };
+    if (st->num_lights > 0)
+        thrpool_parallel_for(thrpool_default(), LGTCULL_SLICES, LGTCULL_GRAIN, bin_slices, &job);
+    size_t num_indices = 0;
+    for (size_t i = 0; i < num_clusters; ++i) {
+        st->clusters[2 * i + 0] = num_indices;
+        num_indices += st->clusters[2 * i + 1];
+        st->clusters[2 * i + 1] = 0;
+    }
+    if (num_indices > st->cap_indices) {
+        st->cap_indices = num_indices;
+        st->indices = realloc(st->indices, st->cap_indices * sizeof(*st->indices));
+    }
+    st->num_indices = num_indices;
+    job.fill = 1;
+    if (st->num_lights > 0)
+        thrpool_parallel_for(thrpool_default(), LGTCULL_SLICES, LGTCULL_GRAIN, bin_slices, &job);
+
+    /* Upload */
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st->glh.clusters_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, num_clusters * 2 * sizeof(*st->clusters), st->clusters, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, st->glh.indices_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, st->num_indices * sizeof(*st->indices), st->indices, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void lgtcull_bind(struct lgtcull_state* st, unsigned int shdr)
+{
+    glUniform1ui(glGetUniformLocation(shdr, "num_local_lights"), st->num_lights);
+    glUniform3ui(glGetUniformLocation(shdr, "cluster_grid"), st->grid[0], st->grid[1], st->grid[2]);
+    glUniform1f(glGetUniformLocation(shdr, "cluster_tile_size"), LGTCULL_TILE_SIZE);
+    glUniform1f(glGetUniformLocation(shdr, "cluster_slice_scale"), st->slice_scale);
+    glUniform1f(glGetUniformLocation(shdr, "cluster_slice_bias"), st->slice_bias);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LGTCULL_LIGHTS_BINDING, st->glh.lights_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LGTCULL_CLUSTERS_BINDING, st->glh.clusters_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LGTCULL_INDICES_BINDING, st->glh.indices_buf);
+}
+
+void lgtcull_destroy(struct lgtcull_state* st)
+{
+    GLuint bufs[3] = { st->glh.lights_buf, st->glh.clusters_buf, st->glh.indices_buf };
+    glDeleteBuffers(3, bufs);
+    free(st->indices);
+    free(st->clusters);
+    free(st->ranges);
+    free(st->lights);
+}
@@ -0,0 +1,94 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _LGTCULL_H_
+#define _LGTCULL_H_
+
+#include <energycore/renderer.h>
+
+/*
+ * Clustered light culling
+ * The view frustum is divided into screen tiles and exponentially spaced depth
+ * slices. Point and spot lights are bounded by view space spheres whose screen
+ * rectangle and depth range select the clusters they may touch. Per cluster
+ * light index lists are built on the CPU, slices in parallel, and uploaded with
+ * the packed lights into storage buffers that the deferred resolve shader walks,
+ * so shading cost follows the local light density instead of the light count.
+ */
+#define LGTCULL_TILE_SIZE 64
+#define LGTCULL_SLICES 16
+
+/* Matches the std430 layout of the resolve shader */
+struct lgtcull_light {
+    /* View independent position and radius */
+    float pos_radius[4];
+    /* Color premultiplied by intensity and spot inner cone cosine */
+    float color_inner[4];
+    /* Spot direction and outer cone cosine, below -1 for point lights */
+    float dir_outer[4];
+    /* World space bounding sphere */
+    float bounds[4];
+};
+
+struct lgtcull_state {
+    /* Cluster grid dimensions and depth slicing */
+    unsigned int grid[3];
+    float slice_scale, slice_bias;
+    /* Packed local lights */
+    struct lgtcull_light* lights;
+    size_t num_lights, cap_lights;
+    /* Cluster ranges of each light, tile min/max and slice min/max */
+    unsigned int (*ranges)[6];
+    /* Offset and count pairs per cluster */
+    unsigned int* clusters;
+    size_t cap_clusters;
+    /* Light indices of all clusters */
+    unsigned int* indices;
+    size_t num_indices, cap_indices;
+    /* GL buffers */
+    struct {
+        unsigned int lights_buf;
+        unsigned int clusters_buf;
+        unsigned int indices_buf;
+    } glh;
+};
+
+void lgtcull_init(struct lgtcull_state* st);
+/* Packs and uploads the point and spot lights of the scene that intersect the view
+ * and finds their cluster ranges, lights are then ready for tiled shading */
+void lgtcull_gather(struct lgtcull_state* st, struct render_light* lights, unsigned int num_lights,
+                    float view[16], float proj[16], unsigned int width, unsigned int height);
+/* Bins the gathered lights into clusters and uploads the per cluster lists */
+void lgtcull_bin(struct lgtcull_state* st);
+/* Binds light and cluster buffers and grid parameters for the resolve shaders */
+void lgtcull_bind(struct lgtcull_state* st, unsigned int shdr);
+void lgtcull_destroy(struct lgtcull_state* st);
+
+#endif /* ! _LGTCULL_H_ */
@@ -0,0 +1,84 @@
+#include "lodsel.h"
+#include <string.h>
+
+/* Shape slots reserved per object, matches render_mesh capacity */
+#define LODSEL_MAX_SHAPES 16
+
+void lodsel_init(struct lodsel_state* st)
+{
+    memset(st, 0, sizeof(*st));
+}
+
+static unsigned int select_level(const struct render_shape* rsh, unsigned int cur, float px_scale)
+{
+    /* Coarsest level within threshold */
+    unsigned int ideal = 0;
+    for (unsigned int l = 1; l < rsh->num_lods; ++l)
+        if (rsh->lods[l].error * px_scale <= LODSEL_PIXEL_ERROR)
+            ideal = l;
+    if (ideal <= cur || cur >= rsh->num_lods)
+        return ideal;
+    /* Coarsen only as far as the hysteresis band allows */
+    unsigned int next = cur;
+    for (unsigned int l = cur + 1; l <= ideal; ++l)
+        if (rsh->lods[l].error * px_scale <= LODSEL_PIXEL_ERROR * LODSEL_HYSTERESIS)
+            next = l;
+    return next;
+}
+
+void lodsel_update(struct lodsel_state* st, struct resmgr* rmgr, struct render_object* objs, unsigned int num_objs,
+                   float view[16], float proj[16], float viewport_height)
+{
+    size_t num_levels = num_objs * LODSEL_MAX_SHAPES;
+    if (num_levels > st->cap_levels) {
+        st->levels = realloc(st->levels, num_levels);
+        memset(st->levels + st->cap_levels, 0, num_levels - st->cap_levels);
+        st->cap_levels = num_levels;
+    }
+
+    mat4 inv_view = mat4_inverse(*(mat4*)view);
+    vec3 eye = vec3_new(inv_view.xw, inv_view.yw, inv_view.zw);
+    /* Pixels per world unit at unit distance */
+    float px_per_unit = ((mat4*)proj)->yy * viewport_height * 0.5f;
+
+    for (unsigned int i = 0; i < num_objs; ++i) {
+        struct render_object* ro = &objs[i];
+        struct render_mesh* rmsh = resmgr_get_mesh(rmgr, ro->mesh);
+        if (!rmsh)
+            continue;
+        mat4 model = *(mat4*)ro->model_mat;
+        vec3 o = mat4_mul_vec3(model, vec3_zero());
+        float sx = vec3_dist(mat4_mul_vec3(model, vec3_new(1.0f, 0.0f, 0.0f)), o);
+        float sy = vec3_dist(mat4_mul_vec3(model, vec3_new(0.0f, 1.0f, 0.0f)), o);
+        float sz = vec3_dist(mat4_mul_vec3(model, vec3_new(0.0f, 0.0f, 1.0f)), o);
+        float scale = sx > sy ? (sx > sz ? sx : sz) : (sy > sz ? sy : sz);
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            struct render_shape* rsh = &rmsh->shapes[j];
+            unsigned char* lvl = &st->levels[i * LODSEL_MAX_SHAPES + j];
+            /* Bounding sphere of the shape's box in world space */
+            vec3 bmin = *(vec3*)rsh->bb_min, bmax = *(vec3*)rsh->bb_max;
+            vec3 center = mat4_mul_vec3(model, vec3_mul(vec3_add(bmin, bmax), 0.5f));
+            float radius = vec3_dist(bmin, bmax) * 0.5f * scale;
+            float dist = vec3_dist(center, eye) - radius;
+            if (dist <= 0.0f) {
+                *lvl = 0;
+                continue;
+            }
+            *lvl = select_level(rsh, *lvl, scale * px_per_unit / dist);
+        }
+    }
+}
+
+unsigned int lodsel_level(struct lodsel_state* st, unsigned int obj, unsigned int shape,
+                          const struct render_shape* rsh, unsigned int bias)
+{
+    size_t idx = obj * LODSEL_MAX_SHAPES + shape;
+    unsigned int lvl = idx < st->cap_levels ? st->levels[idx] : 0;
+    lvl += bias;
+    return rsh->num_lods == 0 ? 0 : (lvl < rsh->num_lods ? lvl : rsh->num_lods - 1);
+}
+
+void lodsel_destroy(struct lodsel_state* st)
+{
+    free(st->levels);
+}
@@ -0,0 +1,64 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _LODSEL_H_
+#define _LODSEL_H_
+
+#include <energycore/renderer.h>
+
+/*
+ * Level of detail selection
+ * Each shape's bounding sphere is projected on screen and scaled by the relative
+ * simplification error of its levels, giving the error of each level in pixels.
+ * The coarsest level within the pixel threshold is used. Moving to a coarser level
+ * additionally requires its error to be within the hysteresis fraction of the
+ * threshold, so that levels do not flicker around the switch distance.
+ */
+#define LODSEL_PIXEL_ERROR 1.0f
+#define LODSEL_HYSTERESIS 0.75f
+/* Extra levels for shadow cascades, none for the nearest one and coarser for the wider far cascades */
+#define lodsel_shadow_bias(cascade) (((cascade) + 1) / 2)
+
+struct lodsel_state {
+    /* Current level per object shape */
+    unsigned char* levels;
+    size_t cap_levels;
+};
+
+void lodsel_init(struct lodsel_state* st);
+/* Updates current levels of all objects for the given camera */
+void lodsel_update(struct lodsel_state* st, struct resmgr* rmgr, struct render_object* objs, unsigned int num_objs,
+                   float view[16], float proj[16], float viewport_height);
+/* Level to use for the given object shape, biased towards coarser levels */
+unsigned int lodsel_level(struct lodsel_state* st, unsigned int obj, unsigned int shape,
+                          const struct render_shape* rsh, unsigned int bias);
+void lodsel_destroy(struct lodsel_state* st);
+
+#endif /* ! _LODSEL_H_ */
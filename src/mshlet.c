@@ -0,0 +1,170 @@
+#include "mshlet.h"
+#include <string.h>
+#include <math.h>
+
+/* Smallest number of triangles a full meshlet may hold, all with unique vertices */
+#define MSHLET_MIN_TRIS (MSHLET_MAX_VERTS / 3)
+
+/* Cones wider than this (minimum normal dot axis) are not worth testing */
+#define MSHLET_CONE_MIN_DOT 0.1f
+
+static inline float dot3(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline float dist3(const float a[3], const float b[3])
+{
+    float d[3] = {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+    return sqrtf(dot3(d, d));
+}
+
+size_t mshlet_max_count(size_t num_indices)
+{
+    size_t num_tris = num_indices / 3;
+    return (num_tris + MSHLET_MIN_TRIS - 1) / MSHLET_MIN_TRIS;
+}
+
+/* Ritter's bounding sphere, seeded by the most distant pair of axis extremes */
+static void meshlet_sphere(struct meshlet* m, const unsigned int* verts, size_t num_verts, const vec3f* pos)
+{
+    const float* p0 = (const float*)(pos + verts[0]);
+    const float* pmin[3] = {p0, p0, p0};
+    const float* pmax[3] = {p0, p0, p0};
+    for (size_t i = 1; i < num_verts; ++i) {
+        const float* p = (const float*)(pos + verts[i]);
+        for (unsigned int k = 0; k < 3; ++k) {
+            if (p[k] < pmin[k][k]) pmin[k] = p;
+            if (p[k] > pmax[k][k]) pmax[k] = p;
+        }
+    }
+    unsigned int axis = 0;
+    float span = 0.0f;
+    for (unsigned int k = 0; k < 3; ++k) {
+        float d = dist3(pmin[k], pmax[k]);
+        if (d > span) {
+            span = d;
+            axis = k;
+        }
+    }
+
+    float c[3], r = span * 0.5f;
+    for (unsigned int k = 0; k < 3; ++k)
+        c[k] = (pmin[axis][k] + pmax[axis][k]) * 0.5f;
+    for (size_t i = 0; i < num_verts; ++i) {
+        const float* p = (const float*)(pos + verts[i]);
+        float d = dist3(p, c);
+        if (d > r) {
+            /* Grow sphere to enclose the point, keeping the opposite side fixed */
+            float nr = (r + d) * 0.5f;
+            float t = (nr - r) / d;
+            for (unsigned int k = 0; k < 3; ++k)
+                c[k] += (p[k] - c[k]) * t;
+            r = nr;
+        }
+    }
+    memcpy(m->center, c, sizeof(c));
+    m->radius = r;
+}
+
+static void meshlet_cone(struct meshlet* m, const unsigned int* indices, const vec3f* pos)
+{
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    size_t num_tris = m->num_indices / 3;
+    float* nrms = malloc(num_tris * 3 * sizeof(*nrms));
+    size_t num_nrms = 0;
+    for (size_t t = 0; t < num_tris; ++t) {
+        const unsigned int* tri = indices + m->first_index + 3 * t;
+        const float* p0 = (const float*)(pos + tri[0]);
+        const float* p1 = (const float*)(pos + tri[1]);
+        const float* p2 = (const float*)(pos + tri[2]);
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0]
+        };
+        float l = sqrtf(dot3(n, n));
+        /* Degenerate triangles are never rasterized */
+        if (l == 0.0f)
+            continue;
+        float* dn = nrms + 3 * num_nrms++;
+        for (unsigned int k = 0; k < 3; ++k) {
+            dn[k] = n[k] / l;
+            axis[k] += dn[k];
+        }
+    }
+
+    float al = sqrtf(dot3(axis, axis));
+    float min_dot = 1.0f;
+    if (al > 0.0f) {
+        for (unsigned int k = 0; k < 3; ++k)
+            axis[k] /= al;
+        for (size_t i = 0; i < num_nrms; ++i) {
+            float d = dot3(axis, nrms + 3 * i);
+            if (d < min_dot)
+                min_dot = d;
+        }
+    }
+    free(nrms);
+
+    if (al == 0.0f || min_dot <= MSHLET_CONE_MIN_DOT) {
+        /* Null axis with unit cutoff never passes the backface test */
+        memset(m->cone_axis, 0, sizeof(m->cone_axis));
+        m->cone_cutoff = 1.0f;
+        return;
+    }
+    memcpy(m->cone_axis, axis, sizeof(axis));
+    /* Sine of the cone half angle */
+    m->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+size_t mshlet_build(struct meshlet* out, const unsigned int* indices, size_t num_indices,
+                    const vec3f* pos, size_t num_verts)
+{
+    size_t num_tris = num_indices / 3;
+    if (num_tris == 0)
+        return 0;
+
+    /* Per vertex tag of the last meshlet that referenced it, offset by one */
+    unsigned int* tag = calloc(num_verts, sizeof(*tag));
+    unsigned int verts[MSHLET_MAX_VERTS];
+    size_t num_meshlets = 0, mverts = 0, mtris = 0, first = 0;
+    for (size_t t = 0; t <= num_tris; ++t) {
+        const unsigned int* tri = indices + 3 * t;
+        unsigned int new_verts = 0;
+        if (t < num_tris) {
+            new_verts += tag[tri[0]] != num_meshlets + 1;
+            new_verts += tag[tri[1]] != num_meshlets + 1 && tri[1] != tri[0];
+            new_verts += tag[tri[2]] != num_meshlets + 1 && tri[2] != tri[0] && tri[2] != tri[1];
+        }
+        if (t == num_tris || mverts + new_verts > MSHLET_MAX_VERTS || mtris == MSHLET_MAX_TRIS) {
+            struct meshlet* m = out + num_meshlets++;
+            m->first_index = 3 * first;
+            m->num_indices = 3 * mtris;
+            meshlet_sphere(m, verts, mverts, pos);
+            meshlet_cone(m, indices, pos);
+            first = t;
+            mverts = mtris = 0;
+            if (t == num_tris)
+                break;
+        }
+        for (unsigned int j = 0; j < 3; ++j) {
+            unsigned int v = tri[j];
+            if (tag[v] != num_meshlets + 1) {
+                tag[v] = num_meshlets + 1;
+                verts[mverts++] = v;
+            }
+        }
+        ++mtris;
+    }
+    free(tag);
+    return num_meshlets;
+}
+
+int mshlet_backfacing(const struct meshlet* m, const float eye[3])
+{
+    float d[3] = {m->center[0] - eye[0], m->center[1] - eye[1], m->center[2] - eye[2]};
+    return dot3(d, m->cone_axis) >= m->cone_cutoff * sqrtf(dot3(d, d)) + m->radius;
+}
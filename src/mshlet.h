@@ -0,0 +1,68 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _MSHLET_H_
+#define _MSHLET_H_
+
+#include <stdlib.h>
+#include <energycore/scene_asset.h>
+
+/*
+ * Meshlets
+ * Triangle lists are split in order into contiguous runs that reference at most
+ * MSHLET_MAX_VERTS distinct vertices and MSHLET_MAX_TRIS triangles, so each
+ * meshlet is a plain index range of the shape's element buffer. Index buffers
+ * optimized for vertex locality beforehand give spatially compact meshlets.
+ */
+#define MSHLET_MAX_VERTS 64
+#define MSHLET_MAX_TRIS 124
+
+struct meshlet {
+    /* Bounding sphere */
+    float center[3];
+    float radius;
+    /* Normal cone, the meshlet is backfacing from every viewpoint where
+     * dot(center - eye, cone_axis) >= cone_cutoff * |center - eye| + radius */
+    float cone_axis[3];
+    float cone_cutoff;
+    /* Index range */
+    unsigned int first_index;
+    unsigned int num_indices;
+};
+
+/* Upper bound of meshlets built from an index buffer */
+size_t mshlet_max_count(size_t num_indices);
+/* Splits index buffer into meshlets and computes their bounds, returns number of meshlets written */
+size_t mshlet_build(struct meshlet* out, const unsigned int* indices, size_t num_indices,
+                    const vec3f* pos, size_t num_verts);
+/* Checks if a meshlet faces away from given eye position, both in the meshlet's space */
+int mshlet_backfacing(const struct meshlet* m, const float eye[3]);
+
+#endif /* ! _MSHLET_H_ */
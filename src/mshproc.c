@@ -0,0 +1,414 @@
+#include "mshproc.h"
+#include <string.h>
+#include <math.h>
+#include "thrpool.h"
+
+#define MSHPROC_GRAIN 4096
+
+/*-----------------------------------------------------------------
+ * 4 wide float lanes
+ *-----------------------------------------------------------------*/
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+typedef __m128 f4;
+#define f4_zero()         _mm_setzero_ps()
+#define f4_set1(x)        _mm_set1_ps(x)
+#define f4_load(p)        _mm_loadu_ps(p)
+#define f4_store(p, v)    _mm_storeu_ps(p, v)
+#define f4_add(a, b)      _mm_add_ps(a, b)
+#define f4_sub(a, b)      _mm_sub_ps(a, b)
+#define f4_mul(a, b)      _mm_mul_ps(a, b)
+#define f4_div(a, b)      _mm_div_ps(a, b)
+#define f4_sqrt(a)        _mm_sqrt_ps(a)
+#define f4_gt(a, b)       _mm_cmpgt_ps(a, b)
+#define f4_neq(a, b)      _mm_cmpneq_ps(a, b)
+#define f4_sel(m, a, b)   _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#else
+typedef struct { float v[4]; } f4;
+#define F4_OP(name, expr) \
+    static inline f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r; }
+F4_OP(f4_add, a.v[i] + b.v[i])
+F4_OP(f4_sub, a.v[i] - b.v[i])
+F4_OP(f4_mul, a.v[i] * b.v[i])
+F4_OP(f4_div, a.v[i] / b.v[i])
+F4_OP(f4_gt,  a.v[i] > b.v[i] ? 1.0f : 0.0f)
+F4_OP(f4_neq, a.v[i] != b.v[i] ? 1.0f : 0.0f)
+static inline f4 f4_set1(float x) { f4 r = {{x, x, x, x}}; return r; }
+static inline f4 f4_zero() { return f4_set1(0.0f); }
+static inline f4 f4_load(const float* p) { f4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void f4_store(float* p, f4 a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline f4 f4_sqrt(f4 a) { for (int i = 0; i < 4; ++i) a.v[i] = sqrtf(a.v[i]); return a; }
+static inline f4 f4_sel(f4 m, f4 a, f4 b) { for (int i = 0; i < 4; ++i) a.v[i] = m.v[i] != 0.0f ? a.v[i] : b.v[i]; return a; }
+#endif
+
+/* Four vec3 in SoA layout */
+struct v3x4 { f4 x, y, z; };
+
+static inline struct v3x4 v3x4_sub(struct v3x4 a, struct v3x4 b)
+{
+    return (struct v3x4){f4_sub(a.x, b.x), f4_sub(a.y, b.y), f4_sub(a.z, b.z)};
+}
+
+static inline struct v3x4 v3x4_scale(struct v3x4 a, f4 s)
+{
+    return (struct v3x4){f4_mul(a.x, s), f4_mul(a.y, s), f4_mul(a.z, s)};
+}
+
+static inline f4 v3x4_dot(struct v3x4 a, struct v3x4 b)
+{
+    return f4_add(f4_add(f4_mul(a.x, b.x), f4_mul(a.y, b.y)), f4_mul(a.z, b.z));
+}
+
+static inline struct v3x4 v3x4_cross(struct v3x4 a, struct v3x4 b)
+{
+    return (struct v3x4){
+        f4_sub(f4_mul(a.y, b.z), f4_mul(a.z, b.y)),
+        f4_sub(f4_mul(a.z, b.x), f4_mul(a.x, b.z)),
+        f4_sub(f4_mul(a.x, b.y), f4_mul(a.y, b.x))
+    };
+}
+
+static inline f4 v3x4_length(struct v3x4 a)
+{
+    return f4_sqrt(v3x4_dot(a, a));
+}
+
+/* Normalizes, zero length vectors become zero */
+static inline struct v3x4 v3x4_normalize(struct v3x4 a)
+{
+    f4 len = v3x4_length(a);
+    f4 nz = f4_gt(len, f4_zero());
+    f4 den = f4_sel(nz, len, f4_set1(1.0f));
+    return (struct v3x4){
+        f4_sel(nz, f4_div(a.x, den), f4_zero()),
+        f4_sel(nz, f4_div(a.y, den), f4_zero()),
+        f4_sel(nz, f4_div(a.z, den), f4_zero())
+    };
+}
+
+static inline struct v3x4 v3x4_gather(const vec3f* v, const int idx[4])
+{
+    float x[4], y[4], z[4];
+    for (int i = 0; i < 4; ++i) {
+        x[i] = v[idx[i]].x;
+        y[i] = v[idx[i]].y;
+        z[i] = v[idx[i]].z;
+    }
+    return (struct v3x4){f4_load(x), f4_load(y), f4_load(z)};
+}
+
+static inline void v3x4_scatter(vec3f* v, size_t stride, struct v3x4 a, size_t n)
+{
+    float x[4], y[4], z[4];
+    f4_store(x, a.x); f4_store(y, a.y); f4_store(z, a.z);
+    for (size_t i = 0; i < n; ++i)
+        v[i * stride] = (vec3f){x[i], y[i], z[i]};
+}
+
+/* Angle between vectors given their dot product and lengths, polynomial acos (max error 7e-5 rad) */
+static inline f4 angle_between(f4 dot, f4 len_a, f4 len_b)
+{
+    f4 den = f4_mul(len_a, len_b);
+    f4 nz = f4_gt(den, f4_zero());
+    f4 c = f4_sel(nz, f4_div(dot, f4_sel(nz, den, f4_set1(1.0f))), f4_zero());
+    f4 neg = f4_gt(f4_zero(), c);
+    f4 x = f4_sel(neg, f4_sub(f4_zero(), c), c);
+    x = f4_sel(f4_gt(x, f4_set1(1.0f)), f4_set1(1.0f), x);
+    f4 p = f4_set1(-0.0187293f);
+    p = f4_add(f4_mul(p, x), f4_set1(0.0742610f));
+    p = f4_add(f4_mul(p, x), f4_set1(-0.2121144f));
+    p = f4_add(f4_mul(p, x), f4_set1(1.5707288f));
+    f4 r = f4_mul(p, f4_sqrt(f4_sub(f4_set1(1.0f), x)));
+    return f4_sel(neg, f4_sub(f4_set1(3.14159265f), r), r);
+}
+
+/* Loads triangle block corner indices, padding past the end with the last triangle */
+static inline size_t tri_block(const vec3i* tris, size_t t, size_t end, int i0[4], int i1[4], int i2[4])
+{
+    size_t n = end - t < 4 ? end - t : 4;
+    for (size_t l = 0; l < 4; ++l) {
+        vec3i tr = tris[t + (l < n ? l : n - 1)];
+        i0[l] = tr.x; i1[l] = tr.y; i2[l] = tr.z;
+    }
+    return n;
+}
+
+/*-----------------------------------------------------------------
+ * Partitioned accumulation
+ *-----------------------------------------------------------------*/
+#define MSHPROC_MAX_PARTS 8
+
+/* Number of contiguous triangle ranges accumulated into separate buffers,
+ * depends only on the triangle count so sums are grouped the same on every machine */
+static size_t num_partitions(size_t num_tris)
+{
+    size_t n = MSHPROC_MAX_PARTS;
+    while (n > 1 && num_tris / n < MSHPROC_GRAIN)
+        --n;
+    return n;
+}
+
+static inline void partition_range(size_t part, size_t num_parts, size_t count, size_t* begin, size_t* end)
+{
+    *begin = count * part / num_parts;
+    *end = count * (part + 1) / num_parts;
+}
+
+/* Adds the n lanes of each triangle's corner values to its vertices, in triangle order */
+static inline void tri_scatter_add(vec3f* v, const int* idx[3], const struct v3x4 c[3], size_t n)
+{
+    float x[3][4], y[3][4], z[3][4];
+    for (int k = 0; k < 3; ++k) {
+        f4_store(x[k], c[k].x);
+        f4_store(y[k], c[k].y);
+        f4_store(z[k], c[k].z);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            vec3f* d = v + idx[k][i];
+            d->x += x[k][i]; d->y += y[k][i]; d->z += z[k][i];
+        }
+    }
+}
+
+/* Sums the partition buffers into the first one, in partition order */
+static inline vec3f partition_sum(vec3f** accum, size_t num_parts, size_t v)
+{
+    vec3f s = accum[0][v];
+    for (size_t p = 1; p < num_parts; ++p) {
+        s.x += accum[p][v].x;
+        s.y += accum[p][v].y;
+        s.z += accum[p][v].z;
+    }
+    return s;
+}
+
+/*-----------------------------------------------------------------
+ * Normals
+ *-----------------------------------------------------------------*/
+struct normals_job {
+    vec3f* norm;
+    const vec3f* pos;
+    const vec3i* tris;
+    size_t num_tris;
+    enum mshproc_weight weight;
+    vec3f* accum[MSHPROC_MAX_PARTS];
+    size_t num_parts;
+};
+
+static void normals_tris(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct normals_job* job = userdata;
+    int i0[4], i1[4], i2[4];
+    const int* idx[3] = {i0, i1, i2};
+    for (size_t part = begin; part < end; ++part) {
+        vec3f* accum = job->accum[part];
+        size_t tbegin, tend;
+        partition_range(part, job->num_parts, job->num_tris, &tbegin, &tend);
+        for (size_t t = tbegin; t < tend; t += 4) {
+            size_t n = tri_block(job->tris, t, tend, i0, i1, i2);
+            struct v3x4 p0 = v3x4_gather(job->pos, i0);
+            struct v3x4 p1 = v3x4_gather(job->pos, i1);
+            struct v3x4 p2 = v3x4_gather(job->pos, i2);
+            struct v3x4 e1 = v3x4_sub(p1, p0);
+            struct v3x4 e2 = v3x4_sub(p2, p0);
+            struct v3x4 nm = v3x4_cross(e1, e2);
+            struct v3x4 c[3];
+            if (job->weight == MSHPROC_WEIGHT_AREA) {
+                c[0] = c[1] = c[2] = nm;
+            } else if (job->weight == MSHPROC_WEIGHT_ANGLE) {
+                struct v3x4 un = v3x4_normalize(nm);
+                struct v3x4 e3 = v3x4_sub(p2, p1);
+                f4 l1 = v3x4_length(e1), l2 = v3x4_length(e2), l3 = v3x4_length(e3);
+                c[0] = v3x4_scale(un, angle_between(v3x4_dot(e1, e2), l1, l2));
+                c[1] = v3x4_scale(un, angle_between(f4_sub(f4_zero(), v3x4_dot(e1, e3)), l1, l3));
+                c[2] = v3x4_scale(un, angle_between(v3x4_dot(e2, e3), l2, l3));
+            } else {
+                c[0] = c[1] = c[2] = v3x4_normalize(nm);
+            }
+            tri_scatter_add(accum, idx, c, n);
+        }
+    }
+}
+
+static void normals_verts(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct normals_job* job = userdata;
+    for (size_t v = begin; v < end; v += 4) {
+        size_t n = end - v < 4 ? end - v : 4;
+        float x[4] = {0}, y[4] = {0}, z[4] = {0};
+        for (size_t l = 0; l < n; ++l) {
+            vec3f s = partition_sum(job->accum, job->num_parts, v + l);
+            x[l] = s.x; y[l] = s.y; z[l] = s.z;
+        }
+        struct v3x4 nm = v3x4_normalize((struct v3x4){f4_load(x), f4_load(y), f4_load(z)});
+        v3x4_scatter(job->norm + v, 1, nm, n);
+    }
+}
+
+void mshproc_normals(vec3f* norm, const vec3f* pos, size_t num_verts,
+                     const vec3i* tris, size_t num_tris, enum mshproc_weight weight)
+{
+    struct thrpool* tp = thrpool_default();
+    struct normals_job job = {
+        .norm = norm,
+        .pos = pos,
+        .tris = tris,
+        .num_tris = num_tris,
+        .weight = weight,
+        .num_parts = num_partitions(num_tris)
+    };
+    /* First partition accumulates in place */
+    memset(norm, 0, num_verts * sizeof(*norm));
+    job.accum[0] = norm;
+    for (size_t p = 1; p < job.num_parts; ++p)
+        job.accum[p] = calloc(num_verts, sizeof(vec3f));
+    thrpool_parallel_for(tp, job.num_parts, 1, normals_tris, &job);
+    thrpool_parallel_for(tp, num_verts, MSHPROC_GRAIN, normals_verts, &job);
+    for (size_t p = 1; p < job.num_parts; ++p)
+        free(job.accum[p]);
+}
+
+/*-----------------------------------------------------------------
+ * Tangents
+ *-----------------------------------------------------------------*/
+struct tangents_job {
+    vec4f* tangsp;
+    const vec3f* pos;
+    const vec3f* norm;
+    const vec2f* uv;
+    const vec3i* tris;
+    size_t num_tris;
+    vec3f* accum_tu[MSHPROC_MAX_PARTS];
+    vec3f* accum_tv[MSHPROC_MAX_PARTS];
+    size_t num_parts;
+};
+
+static inline void uv_gather(const vec2f* uv, const int idx[4], f4* u, f4* v)
+{
+    float x[4], y[4];
+    for (int i = 0; i < 4; ++i) {
+        x[i] = uv[idx[i]].x;
+        y[i] = uv[idx[i]].y;
+    }
+    *u = f4_load(x);
+    *v = f4_load(y);
+}
+
+/* Projects a on the plane of unit normal n and normalizes */
+static inline struct v3x4 project_normalize(struct v3x4 a, struct v3x4 n)
+{
+    return v3x4_normalize(v3x4_sub(a, v3x4_scale(n, v3x4_dot(n, a))));
+}
+
+static void tangents_tris(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct tangents_job* job = userdata;
+    int i[3][4];
+    const int* idx[3] = {i[0], i[1], i[2]};
+    for (size_t part = begin; part < end; ++part) {
+        size_t tbegin, tend;
+        partition_range(part, job->num_parts, job->num_tris, &tbegin, &tend);
+        for (size_t t = tbegin; t < tend; t += 4) {
+            size_t n = tri_block(job->tris, t, tend, i[0], i[1], i[2]);
+            struct v3x4 p0 = v3x4_gather(job->pos, i[0]);
+            struct v3x4 p1 = v3x4_gather(job->pos, i[1]);
+            struct v3x4 p2 = v3x4_gather(job->pos, i[2]);
+            f4 u0, v0, u1, v1, u2, v2;
+            uv_gather(job->uv, i[0], &u0, &v0);
+            uv_gather(job->uv, i[1], &u1, &v1);
+            uv_gather(job->uv, i[2], &u2, &v2);
+
+            /* Triangle tangents from uv gradients */
+            struct v3x4 p = v3x4_sub(p1, p0), q = v3x4_sub(p2, p0);
+            f4 sx = f4_sub(u1, u0), sy = f4_sub(u2, u0);
+            f4 tx = f4_sub(v1, v0), ty = f4_sub(v2, v0);
+            f4 d = f4_sub(f4_mul(sx, ty), f4_mul(sy, tx));
+            f4 nz = f4_neq(d, f4_zero());
+            f4 den = f4_sel(nz, d, f4_set1(1.0f));
+            struct v3x4 tu = v3x4_sub(v3x4_scale(p, ty), v3x4_scale(q, tx));
+            struct v3x4 tv = v3x4_sub(v3x4_scale(q, sx), v3x4_scale(p, sy));
+            tu = (struct v3x4){
+                f4_sel(nz, f4_div(tu.x, den), f4_set1(1.0f)),
+                f4_sel(nz, f4_div(tu.y, den), f4_zero()),
+                f4_sel(nz, f4_div(tu.z, den), f4_zero())
+            };
+            tv = (struct v3x4){
+                f4_sel(nz, f4_div(tv.x, den), f4_zero()),
+                f4_sel(nz, f4_div(tv.y, den), f4_set1(1.0f)),
+                f4_sel(nz, f4_div(tv.z, den), f4_zero())
+            };
+
+            /* Corner angles */
+            struct v3x4 e3 = v3x4_sub(p2, p1);
+            f4 lp = v3x4_length(p), lq = v3x4_length(q), l3 = v3x4_length(e3);
+            f4 angle[3] = {
+                angle_between(v3x4_dot(p, q), lp, lq),
+                angle_between(f4_sub(f4_zero(), v3x4_dot(p, e3)), lp, l3),
+                angle_between(v3x4_dot(q, e3), lq, l3)
+            };
+
+            /* Per corner tangents projected on the vertex normal plane */
+            struct v3x4 ctu[3], ctv[3];
+            for (int k = 0; k < 3; ++k) {
+                struct v3x4 nm = v3x4_gather(job->norm, i[k]);
+                ctu[k] = v3x4_scale(project_normalize(tu, nm), angle[k]);
+                ctv[k] = v3x4_scale(project_normalize(tv, nm), angle[k]);
+            }
+            tri_scatter_add(job->accum_tu[part], idx, ctu, n);
+            tri_scatter_add(job->accum_tv[part], idx, ctv, n);
+        }
+    }
+}
+
+static void tangents_verts(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct tangents_job* job = userdata;
+    for (size_t v = begin; v < end; ++v) {
+        vec3f tu = partition_sum(job->accum_tu, job->num_parts, v);
+        vec3f tv = partition_sum(job->accum_tv, job->num_parts, v);
+        vec3f nm = job->norm[v];
+        /* Orthonormalize against normal */
+        float dot = nm.x * tu.x + nm.y * tu.y + nm.z * tu.z;
+        tu = (vec3f){tu.x - nm.x * dot, tu.y - nm.y * dot, tu.z - nm.z * dot};
+        float len = sqrtf(tu.x * tu.x + tu.y * tu.y + tu.z * tu.z);
+        tu = len == 0.0f ? (vec3f){0.0f, 0.0f, 0.0f} : (vec3f){tu.x / len, tu.y / len, tu.z / len};
+        /* Bitangent sign, reconstructed as sign * cross(n, t) */
+        vec3f b = {
+            nm.y * tu.z - nm.z * tu.y,
+            nm.z * tu.x - nm.x * tu.z,
+            nm.x * tu.y - nm.y * tu.x
+        };
+        float s = (b.x * tv.x + b.y * tv.y + b.z * tv.z) < 0.0f ? -1.0f : 1.0f;
+        job->tangsp[v] = (vec4f){tu.x, tu.y, tu.z, s};
+    }
+}
+
+void mshproc_tangents(vec4f* tangsp, const vec3f* pos, const vec3f* norm, const vec2f* uv, size_t num_verts,
+                      const vec3i* tris, size_t num_tris)
+{
+    struct thrpool* tp = thrpool_default();
+    struct tangents_job job = {
+        .tangsp = tangsp,
+        .pos = pos,
+        .norm = norm,
+        .uv = uv,
+        .tris = tris,
+        .num_tris = num_tris,
+        .num_parts = num_partitions(num_tris)
+    };
+    for (size_t p = 0; p < job.num_parts; ++p) {
+        job.accum_tu[p] = calloc(num_verts, sizeof(vec3f));
+        job.accum_tv[p] = calloc(num_verts, sizeof(vec3f));
+    }
+    thrpool_parallel_for(tp, job.num_parts, 1, tangents_tris, &job);
+    thrpool_parallel_for(tp, num_verts, MSHPROC_GRAIN, tangents_verts, &job);
+    for (size_t p = 0; p < job.num_parts; ++p) {
+        free(job.accum_tu[p]);
+        free(job.accum_tv[p]);
+    }
+}
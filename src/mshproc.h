@@ -0,0 +1,62 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _MSHPROC_H_
+#define _MSHPROC_H_
+
+#include <stdlib.h>
+#include <energycore/scene_asset.h>
+
+/*
+ * Mesh processing kernels
+ * Triangles are split in a fixed number of contiguous ranges that are processed
+ * in parallel on the default thread pool, 4 at a time in SIMD lanes, each range
+ * accumulating into its own vertex buffer. Buffers are then reduced per vertex in
+ * range order. The number of ranges depends only on the triangle count, so results
+ * do not depend on thread scheduling or on the machine's core count.
+ */
+
+/* Contribution of each triangle to its vertices' normals */
+enum mshproc_weight {
+    MSHPROC_WEIGHT_UNIFORM, /* Unit face normal */
+    MSHPROC_WEIGHT_AREA,    /* Face normal scaled by triangle area */
+    MSHPROC_WEIGHT_ANGLE    /* Unit face normal scaled by corner angle */
+};
+
+/* Computes per vertex normals */
+void mshproc_normals(vec3f* norm, const vec3f* pos, size_t num_verts,
+                     const vec3i* tris, size_t num_tris, enum mshproc_weight weight);
+
+/* Computes per vertex tangent frames (MikkTSpace convention: xyz tangent, w bitangent sign)
+ * by summing per triangle tangents projected on each corner's normal plane, weighted by corner angle */
+void mshproc_tangents(vec4f* tangsp, const vec3f* pos, const vec3f* norm, const vec2f* uv, size_t num_verts,
+                      const vec3i* tris, size_t num_tris);
+
+#endif /* ! _MSHPROC_H_ */
@@ -0,0 +1,341 @@
+#include "mshsimp.h"
+#include <string.h>
+#include <math.h>
+#include "hashtable.h"
+
+/* Reject collapses that rotate a surviving triangle's normal by more than ~75 degrees */
+#define MSHSIMP_FLIP_COS 0.25
+
+/*-----------------------------------------------------------------
+ * Quadrics
+ *-----------------------------------------------------------------*/
+/* Area weighted sum of squared plane distances, symmetric 4x4 in compact form */
+struct quadric {
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+static void quadric_add_plane(struct quadric* q, const double n[3], double d, double w)
+{
+    q->a00 += w * n[0] * n[0];
+    q->a11 += w * n[1] * n[1];
+    q->a22 += w * n[2] * n[2];
+    q->a01 += w * n[0] * n[1];
+    q->a02 += w * n[0] * n[2];
+    q->a12 += w * n[1] * n[2];
+    q->b0  += w * n[0] * d;
+    q->b1  += w * n[1] * d;
+    q->b2  += w * n[2] * d;
+    q->c   += w * d * d;
+    q->w   += w;
+}
+
+static void quadric_add(struct quadric* q, const struct quadric* o)
+{
+    q->a00 += o->a00; q->a11 += o->a11; q->a22 += o->a22;
+    q->a01 += o->a01; q->a02 += o->a02; q->a12 += o->a12;
+    q->b0  += o->b0;  q->b1  += o->b1;  q->b2  += o->b2;
+    q->c   += o->c;
+    q->w   += o->w;
+}
+
+/* Mean squared distance of p to the accumulated planes */
+static double quadric_error(const struct quadric* q, const double p[3])
+{
+    double x = p[0], y = p[1], z = p[2];
+    double e = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z
+             + 2.0 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z)
+             + 2.0 * (q->b0 * x + q->b1 * y + q->b2 * z)
+             + q->c;
+    return q->w > 0.0 ? fabs(e) / q->w : 0.0;
+}
+
+/*-----------------------------------------------------------------
+ * Helpers
+ *-----------------------------------------------------------------*/
+static inline void sub3(double r[3], const double a[3], const double b[3])
+{
+    r[0] = a[0] - b[0]; r[1] = a[1] - b[1]; r[2] = a[2] - b[2];
+}
+
+static inline void cross3(double r[3], const double a[3], const double b[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double dot3(const double a[3], const double b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static uint32_t pos_hash(hash_key_t k)
+{
+    const uint32_t* p = (const uint32_t*)k;
+    uint32_t h = 2166136261u;
+    for (unsigned int i = 0; i < 3; ++i)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static int pos_eql(hash_key_t a, hash_key_t b)
+{
+    return memcmp((const void*)a, (const void*)b, sizeof(vec3f)) == 0;
+}
+
+/* Vertex to triangle adjacency in compressed rows */
+struct tri_adjacency {
+    unsigned int* offsets;
+    unsigned int* tris;
+};
+
+static void tri_adjacency_build(struct tri_adjacency* adj, const unsigned int* indices, size_t num_indices, size_t num_verts)
+{
+    memset(adj->offsets, 0, (num_verts + 1) * sizeof(*adj->offsets));
+    for (size_t i = 0; i < num_indices; ++i)
+        ++adj->offsets[indices[i] + 1];
+    for (size_t v = 0; v < num_verts; ++v)
+        adj->offsets[v + 1] += adj->offsets[v];
+    for (size_t i = 0; i < num_indices; ++i)
+        adj->tris[adj->offsets[indices[i]]++] = i / 3;
+    for (size_t v = num_verts; v > 0; --v)
+        adj->offsets[v] = adj->offsets[v - 1];
+    adj->offsets[0] = 0;
+}
+
+/* Locks vertices of edges that are not shared by exactly two oppositely wound triangles */
+static void lock_open_edges(unsigned char* locked, const unsigned int* indices, size_t num_indices,
+                            const struct tri_adjacency* adj)
+{
+    for (size_t i = 0; i < num_indices; ++i) {
+        unsigned int a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+        unsigned int same = 0, opposite = 0;
+        for (unsigned int k = adj->offsets[a]; k < adj->offsets[a + 1]; ++k) {
+            const unsigned int* tri = indices + 3 * adj->tris[k];
+            for (unsigned int j = 0; j < 3; ++j) {
+                same += tri[j] == a && tri[(j + 1) % 3] == b;
+                opposite += tri[j] == b && tri[(j + 1) % 3] == a;
+            }
+        }
+        if (same != 1 || opposite != 1)
+            locked[a] = locked[b] = 1;
+    }
+}
+
+struct collapse {
+    unsigned int v, t;
+    double err;
+};
+
+static int collapse_cmp(const void* a, const void* b)
+{
+    const struct collapse* ca = a;
+    const struct collapse* cb = b;
+    return ca->err < cb->err ? -1 : (ca->err > cb->err);
+}
+
+/* Tests that v and t share exactly the two vertices opposite to their edge */
+static int link_condition(const unsigned int* indices, const struct tri_adjacency* adj,
+                          unsigned int v, unsigned int t, unsigned int* marks, unsigned int stamp)
+{
+    for (unsigned int k = adj->offsets[v]; k < adj->offsets[v + 1]; ++k) {
+        const unsigned int* tri = indices + 3 * adj->tris[k];
+        for (unsigned int j = 0; j < 3; ++j)
+            marks[tri[j]] = stamp;
+    }
+    unsigned int shared = 0;
+    for (unsigned int k = adj->offsets[t]; k < adj->offsets[t + 1]; ++k) {
+        const unsigned int* tri = indices + 3 * adj->tris[k];
+        for (unsigned int j = 0; j < 3; ++j) {
+            unsigned int u = tri[j];
+            if (u != v && u != t && marks[u] == stamp) {
+                marks[u] = stamp - 1;
+                ++shared;
+            }
+        }
+    }
+    return shared == 2;
+}
+
+/* Tests that moving v onto t does not fold any of the triangles kept around v */
+static int collapse_flips(const unsigned int* indices, const struct tri_adjacency* adj,
+                          const double (*pos)[3], unsigned int v, unsigned int t)
+{
+    for (unsigned int k = adj->offsets[v]; k < adj->offsets[v + 1]; ++k) {
+        const unsigned int* tri = indices + 3 * adj->tris[k];
+        unsigned int j = tri[0] == v ? 0 : (tri[1] == v ? 1 : 2);
+        unsigned int a = tri[(j + 1) % 3], b = tri[(j + 2) % 3];
+        if (a == t || b == t)
+            continue;
+        double ea[3], eb[3], n0[3], n1[3];
+        sub3(ea, pos[a], pos[v]); sub3(eb, pos[b], pos[v]); cross3(n0, ea, eb);
+        sub3(ea, pos[a], pos[t]); sub3(eb, pos[b], pos[t]); cross3(n1, ea, eb);
+        double d = dot3(n0, n1);
+        if (d <= 0.0 || d * d <= MSHSIMP_FLIP_COS * MSHSIMP_FLIP_COS * dot3(n0, n0) * dot3(n1, n1))
+            return 1;
+    }
+    return 0;
+}
+
+/*-----------------------------------------------------------------
+ * Simplification
+ *-----------------------------------------------------------------*/
+size_t mshsimp_simplify(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                        const vec3f* pos, size_t num_verts,
+                        size_t target_indices, float target_error, float* result_error)
+{
+    /* Copy input dropping degenerate triangles */
+    size_t count = 0;
+    for (size_t i = 0; i + 2 < num_indices; i += 3) {
+        unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a == b || b == c || a == c)
+            continue;
+        out[count++] = a; out[count++] = b; out[count++] = c;
+    }
+    if (result_error)
+        *result_error = 0.0f;
+    if (count <= target_indices || num_verts == 0)
+        return count;
+
+    /* Work in unit extents for numerical stability */
+    float bmin[3], bmax[3];
+    memcpy(bmin, pos, sizeof(bmin));
+    memcpy(bmax, pos, sizeof(bmax));
+    for (size_t v = 1; v < num_verts; ++v) {
+        const float* p = (const float*)(pos + v);
+        for (unsigned int k = 0; k < 3; ++k) {
+            bmin[k] = p[k] < bmin[k] ? p[k] : bmin[k];
+            bmax[k] = p[k] > bmax[k] ? p[k] : bmax[k];
+        }
+    }
+    double extent = fmax(bmax[0] - bmin[0], fmax(bmax[1] - bmin[1], bmax[2] - bmin[2]));
+    if (extent == 0.0)
+        return count;
+    double (*npos)[3] = malloc(num_verts * sizeof(*npos));
+    for (size_t v = 0; v < num_verts; ++v)
+        for (unsigned int k = 0; k < 3; ++k)
+            npos[v][k] = (((const float*)(pos + v))[k] - bmin[k]) / extent;
+    double max_err = (double)target_error / extent;
+    max_err *= max_err;
+
+    /* Lock attribute seams */
+    unsigned char* seam = calloc(num_verts, 1);
+    struct hash_table* ht = hash_table_create(pos_hash, pos_eql);
+    hash_table_reserve(ht, num_verts);
+    for (size_t v = 0; v < num_verts; ++v) {
+        int inserted;
+        hash_val_t* first = hash_table_insert_or_get(ht, (hash_key_t)(pos + v), v, &inserted);
+        if (!inserted)
+            seam[v] = seam[*first] = 1;
+    }
+    hash_table_destroy(ht);
+
+    /* Per vertex quadrics of incident triangle planes */
+    struct quadric* quadrics = calloc(num_verts, sizeof(*quadrics));
+    for (size_t i = 0; i < count; i += 3) {
+        const double* p0 = npos[out[i]];
+        double e1[3], e2[3], n[3];
+        sub3(e1, npos[out[i + 1]], p0);
+        sub3(e2, npos[out[i + 2]], p0);
+        cross3(n, e1, e2);
+        double l = sqrt(dot3(n, n));
+        if (l == 0.0)
+            continue;
+        for (unsigned int k = 0; k < 3; ++k)
+            n[k] /= l;
+        double d = -dot3(n, p0);
+        for (unsigned int j = 0; j < 3; ++j)
+            quadric_add_plane(&quadrics[out[i + j]], n, d, 0.5 * l);
+    }
+
+    struct tri_adjacency adj;
+    adj.offsets = malloc((num_verts + 1) * sizeof(*adj.offsets));
+    adj.tris = malloc(count * sizeof(*adj.tris));
+    unsigned char* locked = malloc(num_verts);
+    unsigned char* touched = malloc(num_verts);
+    unsigned int* remap = malloc(num_verts * sizeof(*remap));
+    unsigned int* marks = calloc(num_verts, sizeof(*marks));
+    unsigned int stamp = 0;
+    struct collapse* cands = malloc(count * sizeof(*cands));
+    double worst = 0.0;
+
+    /* Collapse independent edge sets in increasing error order until target is reached */
+    while (count > target_indices) {
+        tri_adjacency_build(&adj, out, count, num_verts);
+        memcpy(locked, seam, num_verts);
+        lock_open_edges(locked, out, count, &adj);
+
+        size_t num_cands = 0;
+        for (size_t i = 0; i < count; ++i) {
+            unsigned int a = out[i], b = out[i - i % 3 + (i + 1) % 3];
+            /* Manifold edges appear once per direction, keep one */
+            if (a > b)
+                continue;
+            for (unsigned int dir = 0; dir < 2; ++dir) {
+                unsigned int v = dir ? b : a, t = dir ? a : b;
+                if (locked[v])
+                    continue;
+                struct quadric q = quadrics[v];
+                quadric_add(&q, &quadrics[t]);
+                cands[num_cands++] = (struct collapse){v, t, quadric_error(&q, npos[t])};
+            }
+        }
+        if (num_cands == 0)
+            break;
+        qsort(cands, num_cands, sizeof(*cands), collapse_cmp);
+
+        memset(touched, 0, num_verts);
+        for (size_t v = 0; v < num_verts; ++v)
+            remap[v] = v;
+        size_t goal = (count - target_indices) / 3, removed = 0, collapses = 0;
+        for (size_t c = 0; c < num_cands && removed < goal; ++c) {
+            unsigned int v = cands[c].v, t = cands[c].t;
+            if (cands[c].err > max_err)
+                break;
+            if (touched[v] || touched[t])
+                continue;
+            stamp += 2;
+            if (!link_condition(out, &adj, v, t, marks, stamp) || collapse_flips(out, &adj, npos, v, t))
+                continue;
+            /* Commit, freezing the neighbourhood for the rest of the pass */
+            remap[v] = t;
+            quadric_add(&quadrics[t], &quadrics[v]);
+            for (unsigned int k = adj.offsets[v]; k < adj.offsets[v + 1]; ++k) {
+                const unsigned int* tri = out + 3 * adj.tris[k];
+                removed += tri[0] == t || tri[1] == t || tri[2] == t;
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+            }
+            worst = cands[c].err > worst ? cands[c].err : worst;
+            ++collapses;
+        }
+        if (collapses == 0)
+            break;
+
+        /* Apply collapses and drop the triangles that became degenerate */
+        size_t ncount = 0;
+        for (size_t i = 0; i < count; i += 3) {
+            unsigned int a = remap[out[i]], b = remap[out[i + 1]], c = remap[out[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            out[ncount++] = a; out[ncount++] = b; out[ncount++] = c;
+        }
+        count = ncount;
+    }
+
+    free(cands);
+    free(marks);
+    free(remap);
+    free(touched);
+    free(locked);
+    free(adj.tris);
+    free(adj.offsets);
+    free(quadrics);
+    free(seam);
+    free(npos);
+    if (result_error)
+        *result_error = (float)(sqrt(worst) * extent);
+    return count;
+}
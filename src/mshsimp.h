@@ -0,0 +1,54 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _MSHSIMP_H_
+#define _MSHSIMP_H_
+
+#include <stdlib.h>
+#include <energycore/scene_asset.h>
+
+/*
+ * Mesh simplification
+ * Garland-Heckbert quadric error metric driven edge collapses, where a vertex
+ * always collapses onto one of its neighbours. No vertices are created, so the
+ * output indexes the same vertex buffer as the input and simplified levels can
+ * share it. Vertices on open borders, non manifold edges and attribute seams
+ * (positions shared by several vertices) are locked, keeping the silhouette
+ * and preventing cracks between split vertices.
+ */
+
+/* Simplifies index buffer towards target_indices, not exceeding target_error (in position units).
+ * Returns the number of indices written to out, which must hold num_indices.
+ * The largest error introduced is stored in result_error, if non null. */
+size_t mshsimp_simplify(unsigned int* out, const unsigned int* indices, size_t num_indices,
+                        const vec3f* pos, size_t num_verts,
+                        size_t target_indices, float target_error, float* result_error);
+
+#endif /* ! _MSHSIMP_H_ */
@@ -4,12 +4,21 @@
 #include <math.h>
 #include "opengl.h"
 #include "glutils.h"
-#include "shcomp.h"
 
 /*-----------------------------------------------------------------
  * Probe
  *-----------------------------------------------------------------*/
 #define PROBE_CUBEMAP_SIZE 128
+/* Texels per side of the area each SH projection group covers */
+#define PROBE_SH_BLOCK_SIZE 32
+/* Filtered cubemap sizes, the prefiltered one has a roughness level per mip */
+#define PROBE_IRRADIANCE_SIZE 32
+#define PROBE_PREFILTER_SIZE 128
+/* Rendered and stored prefilter mips, env lighting samples up to lod PROBE_PREFILTER_LEVELS - 1 */
+#define PROBE_PREFILTER_LEVELS 5
+/* Storage buffer binding points of the SH projection shaders */
+#define PROBE_SH_PARTIAL_BINDING 6
+#define PROBE_SH_OUT_BINDING     7
 
 void probe_init(struct probe* p)
 {
@@ -90,9 +99,17 @@ void probe_rndr_init(struct probe_rndr* pr)
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
     glBindRenderbuffer(GL_RENDERBUFFER, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    /* Per group partial sums of the SH projection */
+    const unsigned int groups = (side + PROBE_SH_BLOCK_SIZE - 1) / PROBE_SH_BLOCK_SIZE;
+    GLuint sh_partial_buf;
+    glGenBuffers(1, &sh_partial_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sh_partial_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, groups * groups * 6 * PROBE_SH_COEFFS * 4 * sizeof(float), 0, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     /* Save handles */
     pr->glh.fb = fb;
     pr->glh.depth_rb = depth_rb;
+    pr->glh.sh_partial_buf = sh_partial_buf;
 }
 
 void probe_rndr_destroy(struct probe_rndr* pr)
@@ -103,6 +120,7 @@ void probe_rndr_destroy(struct probe_rndr* pr)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glDeleteRenderbuffers(1, &pr->glh.depth_rb);
     glDeleteFramebuffers(1, &pr->glh.fb);
+    glDeleteBuffers(1, &pr->glh.sh_partial_buf);
 }
 
 void probe_render_begin(struct probe_rndr* pr)
@@ -155,43 +173,55 @@ void probe_render_end(struct probe_rndr* pr)
 /*-----------------------------------------------------------------
  * Probe Processing
  *-----------------------------------------------------------------*/
-void probe_extract_shcoeffs(double sh_coef[25][3], struct probe* p)
+void probe_project_sh(struct probe_rndr* pr, struct probe* p, unsigned int proj_shdr, unsigned int reduce_shdr,
+                      unsigned int dst_buf, unsigned int dst_slot)
 {
-    const int side = PROBE_CUBEMAP_SIZE;
-    /* Allocate memory buffer for cubemap pixels */
-    const size_t img_sz = side * side * 3;
-    uint8_t* cm_buf = malloc(img_sz * 6);
-    memset(cm_buf, 0, sizeof(img_sz * 6));
-
-    /* Fetch cubemap pixel data */
+    const unsigned int groups = (PROBE_CUBEMAP_SIZE + PROBE_SH_BLOCK_SIZE - 1) / PROBE_SH_BLOCK_SIZE;
+    /* Partial sums per group of face texels */
+    glUseProgram(proj_shdr);
+    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, p->cm);
-    for (unsigned int i = 0; i < 6; ++i) {
-        GLuint target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
-        /* Read texture back */
-        glGetTexImage(target, 0, GL_RGB, GL_UNSIGNED_BYTE, cm_buf + i * img_sz);
-    }
-
-    /* Calc sh coeffs */
-    sh_coeffs(sh_coef, cm_buf, side);
-
-    /* Free temporary pixel buffer */
-    free(cm_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PROBE_SH_PARTIAL_BINDING, pr->glh.sh_partial_buf);
+    glDispatchCompute(groups, groups, 6);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    /* Final sum written to the destination slot */
+    glUseProgram(reduce_shdr);
+    glUniform1ui(glGetUniformLocation(reduce_shdr, "num_partials"), groups * groups * 6);
+    glUniform1ui(glGetUniformLocation(reduce_shdr, "out_slot"), dst_slot);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PROBE_SH_OUT_BINDING, dst_buf);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
 }
 
-unsigned int probe_convolute_irradiance_diff(struct probe* p, unsigned int irr_conv_shdr)
+/* Empty RGB16F cubemap for filtered results */
+static GLuint filtered_cubemap(unsigned int res, int mipmapped)
 {
-    /* Create an irradiance cubemap, and re-scale capture fbo to irradiance scale */
-    const unsigned int res = 32;
-    GLuint irradiance_map;
-    glGenTextures(1, &irradiance_map);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradiance_map);
+    GLuint cm;
+    glGenTextures(1, &cm);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cm);
     for (unsigned int i = 0; i < 6; ++i)
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, res, res, 0, GL_RGB, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR); /* Important! */
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    /* Generate mipmaps for the cubemap so OpenGL automatically allocates the required memory,
+     * sampling stops at the last prefiltered level */
+    if (mipmapped) {
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PROBE_PREFILTER_LEVELS - 1);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    }
+    return cm;
+}
+
+unsigned int probe_convolute_irradiance_diff(struct probe* p, unsigned int irr_conv_shdr)
+{
+    /* Create an irradiance cubemap, and re-scale capture fbo to irradiance scale */
+    const unsigned int res = PROBE_IRRADIANCE_SIZE;
+    GLuint irradiance_map = filtered_cubemap(res, 0);
 
     /* Temporary framebuffer */
     GLuint capture_fbo;
@@ -238,19 +268,8 @@ unsigned int probe_convolute_irradiance_diff(struct probe* p, unsigned int irr_c
 unsigned int probe_convolute_irradiance_spec(struct probe* p, unsigned int prefilter_shdr)
 {
     /* Create a pre-filter cubemap, and re-scale capture fbo to prefilter scale */
-    const unsigned int res = 128;
-    GLuint prefilter_map;
-    glGenTextures(1, &prefilter_map);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilter_map);
-    for (unsigned int i = 0; i < 6; ++i)
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, res, res, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); /* Important! */
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    /* Generate mipmaps for the cubemap so OpenGL automatically allocates the required memory */
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    const unsigned int res = PROBE_PREFILTER_SIZE;
+    GLuint prefilter_map = filtered_cubemap(res, 1);
 
     /* Temporary framebuffer */
     GLuint capture_fbo;
@@ -271,14 +290,13 @@ unsigned int probe_convolute_irradiance_spec(struct probe* p, unsigned int prefi
 
     GLint prev_vp[4];
     glGetIntegerv(GL_VIEWPORT, prev_vp);
-    const unsigned int max_mip_levels = 5;
-    for (unsigned int mip = 0; mip < max_mip_levels; ++mip) {
+    for (unsigned int mip = 0; mip < PROBE_PREFILTER_LEVELS; ++mip) {
         /* Resize framebuffer according to mip-level size. */
         unsigned int mip_res = res * pow(0.5, mip);
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mip_res, mip_res);
         glViewport(0, 0, mip_res, mip_res);
 
-        float roughness = (float)mip/(float)(max_mip_levels - 1);
+        float roughness = (float)mip/(float)(PROBE_PREFILTER_LEVELS - 1);
         glUniform1f(glGetUniformLocation(prefilter_shdr, "roughness"), roughness);
         glUniform1f(glGetUniformLocation(prefilter_shdr, "map_res"), mip_res);
         for (unsigned int i = 0; i < 6; ++i) {
@@ -303,16 +321,107 @@ unsigned int probe_convolute_irradiance_spec(struct probe* p, unsigned int prefi
     return prefilter_map;
 }
 
-void probe_preprocess(struct probe* p, unsigned int irr_conv_shdr, unsigned int prefilt_shdr)
+void probe_preprocess_diffuse(struct probe* p, unsigned int irr_conv_shdr)
 {
     if (p->irr_diffuse_cm)
         glDeleteTextures(1, &p->irr_diffuse_cm);
+    p->irr_diffuse_cm = probe_convolute_irradiance_diff(p, irr_conv_shdr);
+}
+
+void probe_preprocess_specular(struct probe* p, unsigned int prefilt_shdr)
+{
     if (p->prefiltered_cm)
         glDeleteTextures(1, &p->prefiltered_cm);
-    p->irr_diffuse_cm = probe_convolute_irradiance_diff(p, irr_conv_shdr);
     p->prefiltered_cm = probe_convolute_irradiance_spec(p, prefilt_shdr);
 }
 
+void probe_preprocess(struct probe* p, unsigned int irr_conv_shdr, unsigned int prefilt_shdr)
+{
+    probe_preprocess_diffuse(p, irr_conv_shdr);
+    probe_preprocess_specular(p, prefilt_shdr);
+}
+
+/*-----------------------------------------------------------------
+ * Data transfer
+ *-----------------------------------------------------------------*/
+/* Half float RGB texel size */
+#define PROBE_TEXEL_SIZE (3 * sizeof(unsigned short))
+
+unsigned int probe_radiance_face_size()
+{
+    return PROBE_CUBEMAP_SIZE;
+}
+
+void probe_radiance_read(struct probe* p, void* data)
+{
+    GLint prev_pack;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prev_pack);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, p->cm);
+    for (unsigned int i = 0; i < 6; ++i) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, GL_HALF_FLOAT, data);
+        data = (unsigned char*)data + PROBE_CUBEMAP_SIZE * PROBE_CUBEMAP_SIZE * PROBE_TEXEL_SIZE;
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, prev_pack);
+}
+
+size_t probe_filtered_data_size()
+{
+    size_t sz = PROBE_IRRADIANCE_SIZE * PROBE_IRRADIANCE_SIZE;
+    for (unsigned int l = 0; l < PROBE_PREFILTER_LEVELS; ++l) {
+        size_t res = PROBE_PREFILTER_SIZE >> l;
+        sz += res * res;
+    }
+    return 6 * sz * PROBE_TEXEL_SIZE;
+}
+
+/* Visits every face of every level in storage order, reading into or uploading from data */
+static void filtered_transfer(struct probe* p, unsigned char* data, int upload)
+{
+    GLint prev_pack, prev_unpack;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &prev_pack);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &prev_unpack);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLuint cms[2] = { p->irr_diffuse_cm, p->prefiltered_cm };
+    unsigned int levels[2] = { 1, PROBE_PREFILTER_LEVELS };
+    unsigned int sizes[2] = { PROBE_IRRADIANCE_SIZE, PROBE_PREFILTER_SIZE };
+    for (unsigned int c = 0; c < 2; ++c) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cms[c]);
+        for (unsigned int l = 0; l < levels[c]; ++l) {
+            unsigned int res = sizes[c] >> l;
+            for (unsigned int i = 0; i < 6; ++i) {
+                GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+                if (upload)
+                    glTexSubImage2D(target, l, 0, 0, res, res, GL_RGB, GL_HALF_FLOAT, data);
+                else
+                    glGetTexImage(target, l, GL_RGB, GL_HALF_FLOAT, data);
+                data += res * res * PROBE_TEXEL_SIZE;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, prev_pack);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, prev_unpack);
+}
+
+void probe_filtered_read(struct probe* p, void* data)
+{
+    filtered_transfer(p, data, 0);
+}
+
+void probe_filtered_load(struct probe* p, const void* data)
+{
+    if (p->irr_diffuse_cm)
+        glDeleteTextures(1, &p->irr_diffuse_cm);
+    if (p->prefiltered_cm)
+        glDeleteTextures(1, &p->prefiltered_cm);
+    p->irr_diffuse_cm = filtered_cubemap(PROBE_IRRADIANCE_SIZE, 0);
+    p->prefiltered_cm = filtered_cubemap(PROBE_PREFILTER_SIZE, 1);
+    filtered_transfer(p, (unsigned char*)data, 1);
+}
+
 /*-----------------------------------------------------------------
  * Probe Visualization
  *-----------------------------------------------------------------*/
@@ -344,18 +453,31 @@ void probe_vis_render(struct probe* p, vec3 probe_pos, unsigned int shdr, mat4 v
 /*-----------------------------------------------------------------
  * Misc
  *-----------------------------------------------------------------*/
-unsigned int brdf_lut_generate(unsigned int brdf_lut_shdr)
+/* Brdf lut resolution and texel size, two half floats */
+#define BRDF_LUT_SIZE 512
+#define BRDF_LUT_TEXEL_SIZE (2 * sizeof(unsigned short))
+
+static GLuint brdf_lut_texture(GLenum type, const void* data)
 {
-    /* Setup lut texture */
-    const int res = 512;
+    const int res = BRDF_LUT_SIZE;
     GLuint brdf_lut_tex;
     glGenTextures(1, &brdf_lut_tex);
     glBindTexture(GL_TEXTURE_2D, brdf_lut_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, res, res, 0, GL_RG, GL_FLOAT, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, res, res, 0, GL_RG, type, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return brdf_lut_tex;
+}
+
+unsigned int brdf_lut_generate(unsigned int brdf_lut_shdr)
+{
+    /* Setup lut texture */
+    const int res = BRDF_LUT_SIZE;
+    GLuint brdf_lut_tex = brdf_lut_texture(GL_FLOAT, 0);
 
     /* Temporary framebuffer */
     GLuint capture_fbo;
@@ -386,3 +508,24 @@ unsigned int brdf_lut_generate(unsigned int brdf_lut_shdr)
     glDeleteFramebuffers(1, &capture_fbo);
     return brdf_lut_tex;
 }
+
+size_t brdf_lut_data_size()
+{
+    return BRDF_LUT_SIZE * BRDF_LUT_SIZE * BRDF_LUT_TEXEL_SIZE;
+}
+
+void brdf_lut_read(unsigned int brdf_lut_tex, void* data)
+{
+    glBindTexture(GL_TEXTURE_2D, brdf_lut_tex);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, data);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+unsigned int brdf_lut_load(const void* data)
+{
+    GLuint brdf_lut_tex = brdf_lut_texture(GL_HALF_FLOAT, data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return brdf_lut_tex;
+}
@@ -31,8 +31,12 @@
 #ifndef _PROBE_H_
 #define _PROBE_H_
 
+#include <stdlib.h>
 #include <linalgb.h>
 
+/* SH coefficients produced by the GPU projection, enough for irradiance */
+#define PROBE_SH_COEFFS 9
+
 struct probe {
     unsigned int cm;
     unsigned int irr_diffuse_cm;
@@ -43,6 +47,7 @@ struct probe_rndr {
     struct {
         unsigned int fb;
         unsigned int depth_rb;
+        unsigned int sh_partial_buf;
     } glh;
     mat4 fproj;
     struct {
@@ -70,14 +75,30 @@ void probe_render_side_end(struct probe_rndr* pr, unsigned int side);
 void probe_render_end(struct probe_rndr* pr);
 
 /* Probe processing interface */
-void probe_extract_shcoeffs(double sh_coef[25][3], struct probe* p);
+/* Projects the cubemap onto SH on the GPU, writing PROBE_SH_COEFFS vec4 values at the given slot of the buffer */
+void probe_project_sh(struct probe_rndr* pr, struct probe* p, unsigned int proj_shdr, unsigned int reduce_shdr,
+                      unsigned int dst_buf, unsigned int dst_slot);
 void probe_preprocess(struct probe* p, unsigned int irr_conv_shdr, unsigned int prefilt_shdr);
+/* Separate halves of preprocessing, so they can be spread over frames */
+void probe_preprocess_diffuse(struct probe* p, unsigned int irr_conv_shdr);
+void probe_preprocess_specular(struct probe* p, unsigned int prefilt_shdr);
+/* Captured radiance as half float RGB faces in +x, -x, +y, -y, +z, -z order, for CPU side processing */
+unsigned int probe_radiance_face_size();
+void probe_radiance_read(struct probe* p, void* data);
+/* Filtered cubemaps as half float RGB, the diffuse one followed by the specular mip chain, used for caching */
+size_t probe_filtered_data_size();
+void probe_filtered_read(struct probe* p, void* data);
+void probe_filtered_load(struct probe* p, const void* data);
 
 /* Probe visualize */
 void probe_vis_render(struct probe*, vec3 probe_pos, unsigned int vis_shdr, mat4 view, mat4 proj, int mode);
 
 /* Misc */
 unsigned int brdf_lut_generate(unsigned int brdf_lut_shdr);
+/* Lut contents as half float RG, used for caching */
+size_t brdf_lut_data_size();
+void brdf_lut_read(unsigned int brdf_lut_tex, void* data);
+unsigned int brdf_lut_load(const void* data);
 
 /* Convenience macros */
 #define probe_render_faces(pr, p, pos, fview, fproj) \
@@ -13,8 +13,12 @@
 #include "bbrndr.h"
 #include "gbuffer.h"
 #include "occull.h"
-#include "frucull.h"
+#include "clcull.h"
+#include "lodsel.h"
+#include "instbat.h"
 #include "shdwmap.h"
+#include "shdwcull.h"
+#include "lgtcull.h"
 #include "glutils.h"
 #include "frprof.h"
 #include "dbgtxt.h"
@@ -24,6 +28,7 @@
 #include "eyeadapt.h"
 #include "resint.h"
 #include "panicscr.h"
+#include "dcache.h"
 
 /*-----------------------------------------------------------------
  * Internal state
@@ -37,12 +42,15 @@ struct renderer_internal_state {
     struct gi_rndr gi_rndr;
     struct bbox_rndr bbox_rs;
     struct shadowmap shdwmap;
+    struct shdwcull_state shdwcull_st;
     struct postfx postfx;
     struct panicscr_rndr ps_rndr;
     /* Shaders */
     struct {
         unsigned int geom_pass;
         unsigned int dir_light;
+        unsigned int local_light;
+        unsigned int tiled_light;
         unsigned int env_light;
         struct {
             unsigned int bloom_bright;
@@ -73,6 +81,15 @@ struct renderer_internal_state {
     struct gbuffer* gbuf; /* Active */
     /* Occlusion culling */
     struct occull_state occl_st;
+    /* Cluster culling */
+    struct clcull_state clcull_st;
+    /* Level of detail selection, probe renders keep their own so the main view hysteresis is not disturbed */
+    struct lodsel_state lodsel_st;
+    struct lodsel_state probe_lodsel_st;
+    /* Instance batching */
+    struct instbat instbat;
+    /* Clustered light culling */
+    struct lgtcull_state lgtcull_st;
     /* SSAO */
     struct ssao ssao;
     /* Eye adaptation */
@@ -86,6 +103,7 @@ struct renderer_internal_state {
     struct {
         unsigned int num_visible_objs;
         unsigned int num_total_objs;
+        unsigned int num_draws;
         float gpass_msec;
         float lpass_msec;
         float ppass_msec;
@@ -98,15 +116,15 @@ static void pnkscr_err_cb(void* ud, const char* msg);
 /*-----------------------------------------------------------------
  * Initialization
  *-----------------------------------------------------------------*/
-void renderer_init(struct renderer_state* rs)
+void renderer_init(struct renderer_state* rs, const char* cache_dir)
 {
     /* Populate renderer state according to init params */
     memset(rs, 0, sizeof(*rs));
     rs->internal = calloc(1, sizeof(*rs->internal));
     struct renderer_internal_state* is = rs->internal;
 
-    /* Initialize resource manager */
-    resmgr_init(&rs->rmgr);
+    /* Initialize resource manager, thread-safe so loaders can reserve ids from the pool */
+    resmgr_init_concurrent(&rs->rmgr);
     /* Initial dimensions */
     int width = 1280, height = 720;
     is->viewport.x = width; is->viewport.y = height;
@@ -122,7 +140,7 @@ void renderer_init(struct renderer_state* rs)
     panicscr_init(&is->ps_rndr);
     register_gl_error_handler(pnkscr_err_cb, &is->ps_rndr);
     /* Initialize embedded resources */
-    resint_init();
+    resint_init(cache_dir);
     /* Initialize SSAO state */
     ssao_init(&is->ssao, width, height);
     /* Initialize internal eye adaptation state */
@@ -137,9 +155,18 @@ void renderer_init(struct renderer_state* rs)
     bbox_rndr_init(&is->bbox_rs);
     /* Initialize internal occlusion state */
     occull_init(&is->occl_st);
+    /* Initialize internal cluster culling state */
+    clcull_init(&is->clcull_st);
+    /* Initialize internal level of detail state */
+    lodsel_init(&is->lodsel_st);
+    lodsel_init(&is->probe_lodsel_st);
+    /* Initialize internal instance batching state */
+    instbat_init(&is->instbat);
+    /* Initialize internal light clustering state */
+    lgtcull_init(&is->lgtcull_st);
     /* Initialize internal shadowmap state */
-    const GLuint shmap_res = 2048;
-    shadowmap_init(&is->shdwmap, shmap_res, shmap_res);
+    shadowmap_init(&is->shdwmap);
+    shdwcull_init(&is->shdwcull_st);
     /* Fetch shaders */
     renderer_shdr_fetch(rs);
     /* Initialize frame profiler */
@@ -171,11 +198,13 @@ void renderer_init(struct renderer_state* rs)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     free(im.data);
     glBindTexture(GL_TEXTURE_2D, 0);
-    /* Setup IBL */
-    is->textures.brdf_lut = brdf_lut_generate(is->shdrs.ibl.brdf_lut);
-
     /* Default options */
     rs->options.use_occlusion_culling = 0;
+    rs->options.use_cluster_culling = 1;
+    rs->options.use_lods = 1;
+    rs->options.use_instancing = 1;
+    rs->options.use_layered_shadows = 1;
+    rs->options.use_tiled_lighting = 1;
     rs->options.use_rough_met_maps = 1;
     rs->options.use_detail_maps = 1;
     rs->options.use_shadows = 0;
@@ -189,6 +218,16 @@ void renderer_init(struct renderer_state* rs)
     rs->options.show_fprof = 1;
     rs->options.show_gbuf_textures = 0;
     rs->options.show_gidata = 0;
+    rs->options.shadow_cascades = RENDERER_MAX_SHADOW_CASCADES;
+    for (unsigned int i = 0; i < RENDERER_MAX_SHADOW_CASCADES; ++i)
+        rs->options.shadow_resolution[i] = 2048;
+    rs->options.shadow_split_lambda = 0.8f;
+    rs->options.shadow_distance = 100.0f;
+    rs->options.gi_budget_msec = 2.0f;
+    rs->options.cache_dir = cache_dir;
+    /* Allocate shadow atlas for the default cascade setup */
+    shadowmap_configure(&is->shdwmap, rs->options.shadow_cascades, rs->options.shadow_resolution,
+                        rs->options.shadow_split_lambda, rs->options.shadow_distance);
 }
 
 static void renderer_shdr_fetch(struct renderer_state* rs)
@@ -196,6 +235,8 @@ static void renderer_shdr_fetch(struct renderer_state* rs)
     struct renderer_internal_state* is = rs->internal;
     is->shdrs.geom_pass        = resint_shdr_fetch("geom_pass");
     is->shdrs.dir_light        = resint_shdr_fetch("dir_light");
+    is->shdrs.local_light      = resint_shdr_fetch("local_light");
+    is->shdrs.tiled_light      = resint_shdr_fetch("tiled_light");
     is->shdrs.env_light        = resint_shdr_fetch("env_light");
     is->shdrs.fx.bloom_bright  = resint_shdr_fetch("bloom_bright");
     is->shdrs.fx.bloom_blur    = resint_shdr_fetch("bloom_blur");
@@ -209,6 +250,11 @@ static void renderer_shdr_fetch(struct renderer_state* rs)
     is->shdrs.ibl.brdf_lut     = resint_shdr_fetch("brdf_lut");
     is->shdrs.ibl.prefilter    = resint_shdr_fetch("prefilter");
     is->sky_rndr.preeth.shdr   = resint_shdr_fetch("sky_prth");
+    is->gi_rndr.shdrs.irr_conv    = is->shdrs.ibl.irr_gen;
+    is->gi_rndr.shdrs.prefilter   = is->shdrs.ibl.prefilter;
+    is->gi_rndr.shdrs.sh_project  = resint_shdr_fetch("sh_project");
+    is->gi_rndr.shdrs.sh_reduce   = resint_shdr_fetch("sh_reduce");
+    is->gi_rndr.shdrs.sh_resample = resint_shdr_fetch("sh_resample");
     is->ssao.gl.ao_shdr        = resint_shdr_fetch("ssao");
     is->ssao.gl.blur_shdr      = resint_shdr_fetch("ssao_blur");
     is->eyeadpt.gl.shdr_clr    = resint_shdr_fetch("eyeadapt_clr");
@@ -355,7 +401,6 @@ static void geometry_pass(struct renderer_state* rs, struct render_scene* rscn,
     /* Setup matrices */
     GLuint proj_mat_loc = glGetUniformLocation(shdr, "proj");
     GLuint view_mat_loc = glGetUniformLocation(shdr, "view");
-    GLuint modl_mat_loc = glGetUniformLocation(shdr, "model");
     glUniformMatrix4fv(proj_mat_loc, 1, GL_FALSE, proj);
     glUniformMatrix4fv(view_mat_loc, 1, GL_FALSE, (GLfloat*)view);
 
@@ -367,55 +412,87 @@ static void geometry_pass(struct renderer_state* rs, struct render_scene* rscn,
     glUniform1i(glGetUniformLocation(shdr, "mat.detail_albedo_map.tex"), 4);
     glUniform1i(glGetUniformLocation(shdr, "mat.detail_normal_map.tex"), 5);
 
-    /* Loop through meshes */
-    is->dbginfo.num_visible_objs = is->dbginfo.num_total_objs = 0;
+    /* Pick levels of detail */
+    struct lodsel_state* lodsel = 0;
+    if (rs->options.use_lods) {
+        lodsel = is->gbuf == &is->main_gbuf ? &is->lodsel_st : &is->probe_lodsel_st;
+        lodsel_update(lodsel, &rs->rmgr, rscn->objects, rscn->num_objects, view, proj, is->gbuf->height);
+    }
+
+    /* Group object shapes into instance batches, occlusion queries need one per object shape */
+    struct instbat* ib = &is->instbat;
+    instbat_begin(ib);
     for (unsigned int i = 0; i < rscn->num_objects; ++i) {
-        /* Setup mesh to be rendered */
         struct render_object* ro = &rscn->objects[i];
-
-        /* Upload model matrix */
-        glUniformMatrix4fv(modl_mat_loc, 1, GL_FALSE, ro->model_mat);
-
-        /* Set front face */
-        float model_det = mat4_det(*(mat4*)ro->model_mat);
-        glFrontFace(model_det < 0 ? GL_CW : GL_CCW);
-
-        /* Loop through mesh shapes */
         struct render_mesh* rmsh = resmgr_get_mesh(&rs->rmgr, ro->mesh);
+        if (!rmsh)
+            continue;
+        int mirrored = mat4_det(*(mat4*)ro->model_mat) < 0;
         for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
-            /* Count total objects */
-            is->dbginfo.num_total_objs++;
-
-            /* Current shape and its material */
             struct render_shape* rsh = &rmsh->shapes[j];
-            rid mid = ro->materials[rsh->mat_idx];
-            struct render_material* rmat = rid_null(mid) ? unset_render_material() : resmgr_get_material(&rs->rmgr, mid);
-
-            /* Determine object visibility using occlusion culling */
-            unsigned int visible = 1;
-            if (rs->options.use_occlusion_culling) {
-                /* Begin occlusion query, use current index as handle */
-                occull_object_begin(&is->occl_st, is->dbginfo.num_total_objs);
-                visible = occull_should_render(&is->occl_st, rsh->bb_min, rsh->bb_max);
-                if (!visible) {
-                    occull_object_end(&is->occl_st);
-                    continue;
-                }
-            }
-            if (visible)
-                is->dbginfo.num_visible_objs++;
+            unsigned int lod = lodsel ? lodsel_level(lodsel, i, j, rsh, 0) : 0;
+            instbat_add(ib, i, j, rsh, ro->materials[rsh->mat_idx], lod, mirrored, 0);
+        }
+    }
+    instbat_end(ib, rscn->objects, rs->options.use_instancing && !rs->options.use_occlusion_culling);
 
-            /* Material parameters */
-            material_setup(rs, rmat, shdr);
+    /* Cull clusters of the picked levels against the view */
+    if (rs->options.use_cluster_culling)
+        clcull_run(&is->clcull_st, &rs->rmgr, rscn->objects, rscn->num_objects, lodsel, ib, view, proj);
 
-            /* Render mesh */
-            glBindVertexArray(rsh->vao);
-            glDrawElements(GL_TRIANGLES, rsh->num_elems, GL_UNSIGNED_INT, (void*)0);
+    /* Loop through batches */
+    is->dbginfo.num_visible_objs = is->dbginfo.num_total_objs = is->dbginfo.num_draws = 0;
+    for (size_t b = 0; b < ib->num_batches; ++b) {
+        struct instbat_batch* batch = &ib->batches[b];
+        struct render_object* ro = &rscn->objects[batch->obj];
+        struct render_shape* rsh = &resmgr_get_mesh(&rs->rmgr, ro->mesh)->shapes[batch->shape];
+
+        /* Count total and visible objects */
+        unsigned int num_visible = batch->num_insts;
+        if (rs->options.use_cluster_culling) {
+            num_visible = 0;
+            for (unsigned int k = batch->first_inst; k < batch->first_inst + batch->num_insts; ++k)
+                num_visible += clcull_shape_visible(&is->clcull_st, ib->insts[k].obj, ib->insts[k].shape);
+        }
+        is->dbginfo.num_total_objs += batch->num_insts;
+
+        /* Skip batches without any visible cluster */
+        if (num_visible == 0)
+            continue;
 
-            /* End occlusion query for current object */
-            if (rs->options.use_occlusion_culling)
+        /* Determine object visibility using occlusion culling, batches hold single object shapes then */
+        if (rs->options.use_occlusion_culling) {
+            /* Begin occlusion query, use current index as handle */
+            occull_object_begin(&is->occl_st, b + 1);
+            /* The box proxy has no instance buffer, feed the model matrix as the attribute's current value */
+            for (unsigned int c = 0; c < 4; ++c)
+                glVertexAttrib4fv(INSTBAT_MODEL_ATTRIB + c, ro->model_mat + 4 * c);
+            if (!occull_should_render(&is->occl_st, rsh->bb_min, rsh->bb_max)) {
                 occull_object_end(&is->occl_st);
+                continue;
+            }
         }
+        is->dbginfo.num_visible_objs += num_visible;
+
+        /* Set front face */
+        glFrontFace(batch->mirrored ? GL_CW : GL_CCW);
+
+        /* Material parameters */
+        rid mid = ro->materials[rsh->mat_idx];
+        struct render_material* rmat = rid_null(mid) ? unset_render_material() : resmgr_get_material(&rs->rmgr, mid);
+        material_setup(rs, rmat, shdr);
+
+        /* Render instances */
+        instbat_bind(ib, rsh);
+        if (rs->options.use_cluster_culling)
+            clcull_batch_draw(&is->clcull_st, batch);
+        else
+            instbat_draw(ib, batch, rsh);
+        is->dbginfo.num_draws++;
+
+        /* End occlusion query for current object */
+        if (rs->options.use_occlusion_culling)
+            occull_object_end(&is->occl_st);
     }
 
     /* Reset bindings */
@@ -454,42 +531,34 @@ static void render_sky(struct renderer_state* rs, struct render_scene* rscn, flo
     }
 }
 
-static void light_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj, int direct_only)
+static void bind_shadowmap_inputs(struct renderer_state* rs, GLuint shdr)
 {
-    /* Bind gbuffer input textures and target fbo */
     struct renderer_internal_state* is = rs->internal;
-    gbuffer_bind_for_light_pass(is->gbuf);
-
-    /* Clear */
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    /* Disable writting to depth buffer for screen space renders */
-    glDepthMask(GL_FALSE);
-
-    /* Enable blend for additive lighting */
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_ONE, GL_ONE);
+    glActiveTexture(GL_TEXTURE7);
+    glUniform1i(glGetUniformLocation(shdr, "shadowmap"), 7);
+    glUniform1i(glGetUniformLocation(shdr, "shadows_enabled"), rs->options.use_shadows);
+    if (rs->options.use_shadows) {
+        glBindTexture(GL_TEXTURE_2D, is->shdwmap.glh.tex_id);
+        shadowmap_bind(&is->shdwmap, shdr);
+    } else
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
 
+/* One additive screen pass per directional light and one for the clustered local lights */
+static void blended_light_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj, vec3 view_pos)
+{
+    struct renderer_internal_state* is = rs->internal;
+    /* Screen passes cover the bound gbuffer, probe renders use a smaller one than the viewport */
+    float screen[2] = {is->gbuf->width, is->gbuf->height};
     /* Setup common uniforms */
     GLuint shdr = is->shdrs.dir_light;
     glUseProgram(shdr);
-    upload_gbuffer_uniforms(shdr, is->viewport.xy, view, proj);
-
-    mat4 inverse_view = mat4_inverse(*(mat4*)view);
-    vec3 view_pos = vec3_new(inverse_view.xw, inverse_view.yw, inverse_view.zw);
+    upload_gbuffer_uniforms(shdr, screen, view, proj);
     glUniform3f(glGetUniformLocation(shdr, "view_pos"), view_pos.x, view_pos.y, view_pos.z);
     glUniformMatrix4fv(glGetUniformLocation(shdr, "view"), 1, GL_FALSE, view->m);
 
     /* Setup shadowmap inputs */
-    glActiveTexture(GL_TEXTURE7);
-    glUniform1i(glGetUniformLocation(shdr, "shadowmap"), 7);
-    glUniform1i(glGetUniformLocation(shdr, "shadows_enabled"), rs->options.use_shadows);
-    if (rs->options.use_shadows) {
-        glBindTexture(GL_TEXTURE_2D_ARRAY, is->shdwmap.glh.tex_id);
-        shadowmap_bind(&is->shdwmap, shdr);
-    } else
-        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    bind_shadowmap_inputs(rs, shdr);
 
     /* Iterate through lights */
     for (size_t i = 0; i < rscn->num_lights; ++i) {
@@ -505,11 +574,111 @@ static void light_pass(struct renderer_state* rs, struct render_scene* rscn, mat
             }
             case LT_POINT:
             case LT_SPOT:
-                /* Unimplemented */
+                /* Clustered below */
                 break;
         }
     }
 
+    /* Point and spot lights, binned into clusters and resolved in a single screen pass */
+    if (is->lgtcull_st.num_lights > 0) {
+        lgtcull_bin(&is->lgtcull_st);
+        shdr = is->shdrs.local_light;
+        glUseProgram(shdr);
+        upload_gbuffer_uniforms(shdr, screen, view, proj);
+        glUniform3f(glGetUniformLocation(shdr, "view_pos"), view_pos.x, view_pos.y, view_pos.z);
+        glUniformMatrix4fv(glGetUniformLocation(shdr, "view"), 1, GL_FALSE, view->m);
+        lgtcull_bind(&is->lgtcull_st, shdr);
+        render_quad();
+    }
+}
+
+/* Match the tiled lighting compute shader */
+#define TILED_TILE_SIZE 16
+#define TILED_MAX_DIR_LIGHTS 4
+#define TILED_MAX_TILE_LIGHTS 512
+
+/* Whether the tiled pass can hold every light, tiles never list more local lights than survived culling */
+static int tiled_light_fits(struct render_scene* rscn, struct lgtcull_state* lc)
+{
+    unsigned int num_dir_lights = 0;
+    for (size_t i = 0; i < rscn->num_lights; ++i)
+        num_dir_lights += rscn->lights[i].type == LT_DIRECTIONAL;
+    return num_dir_lights <= TILED_MAX_DIR_LIGHTS && lc->num_lights <= TILED_MAX_TILE_LIGHTS;
+}
+
+/* All direct lights in one compute dispatch, each 16x16 tile reads its gbuffer samples once,
+ * culls local lights against its depth bounds and writes the accumulated result */
+static void tiled_light_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj, vec3 view_pos)
+{
+    struct renderer_internal_state* is = rs->internal;
+    GLuint shdr = is->shdrs.tiled_light;
+    glUseProgram(shdr);
+    /* Resolve covers the bound gbuffer, probe renders use a smaller one than the viewport */
+    unsigned int width = is->gbuf->width, height = is->gbuf->height;
+    upload_gbuffer_uniforms(shdr, (float[]){width, height}, view, proj);
+    glUniform3f(glGetUniformLocation(shdr, "view_pos"), view_pos.x, view_pos.y, view_pos.z);
+    glUniformMatrix4fv(glGetUniformLocation(shdr, "view"), 1, GL_FALSE, view->m);
+    mat4 inv_proj = mat4_inverse(*proj);
+    glUniformMatrix4fv(glGetUniformLocation(shdr, "inv_proj"), 1, GL_FALSE, inv_proj.m);
+    bind_shadowmap_inputs(rs, shdr);
+
+    /* Directional lights */
+    unsigned int num_dir_lights = 0;
+    for (size_t i = 0; i < rscn->num_lights && num_dir_lights < TILED_MAX_DIR_LIGHTS; ++i) {
+        struct render_light* light = rscn->lights + i;
+        if (light->type != LT_DIRECTIONAL)
+            continue;
+        char uname_buf[64];
+        snprintf(uname_buf, sizeof(uname_buf), "dir_lights[%u].direction", num_dir_lights);
+        glUniform3fv(glGetUniformLocation(shdr, uname_buf), 1, light->type_data.dir.direction.xyz);
+        snprintf(uname_buf, sizeof(uname_buf), "dir_lights[%u].color", num_dir_lights);
+        glUniform3fv(glGetUniformLocation(shdr, uname_buf), 1, light->color.xyz);
+        snprintf(uname_buf, sizeof(uname_buf), "dir_lights[%u].intensity", num_dir_lights);
+        glUniform1f(glGetUniformLocation(shdr, uname_buf), light->intensity);
+        ++num_dir_lights;
+    }
+    glUniform1i(glGetUniformLocation(shdr, "num_dir_lights"), num_dir_lights);
+
+    /* Point and spot lights */
+    lgtcull_bind(&is->lgtcull_st, shdr);
+
+    /* Resolve into the accumulation buffer */
+    glBindImageTexture(0, is->gbuf->accum_buf, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((width + TILED_TILE_SIZE - 1) / TILED_TILE_SIZE,
+                      (height + TILED_TILE_SIZE - 1) / TILED_TILE_SIZE, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+}
+
+static void light_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj, int direct_only)
+{
+    /* Bind gbuffer input textures and target fbo */
+    struct renderer_internal_state* is = rs->internal;
+    gbuffer_bind_for_light_pass(is->gbuf);
+
+    /* Clear */
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    /* Disable writting to depth buffer for screen space renders */
+    glDepthMask(GL_FALSE);
+
+    /* Enable blend for additive lighting */
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_FUNC_ADD);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    /* Camera position */
+    mat4 inverse_view = mat4_inverse(*(mat4*)view);
+    vec3 view_pos = vec3_new(inverse_view.xw, inverse_view.yw, inverse_view.zw);
+
+    /* Direct lighting, clusters cover the bound gbuffer which is smaller than the viewport for probe renders */
+    lgtcull_gather(&is->lgtcull_st, rscn->lights, rscn->num_lights, view->m, proj->m, is->gbuf->width, is->gbuf->height);
+    /* Lights past the compute pass limits would be dropped, blend instead */
+    if (rs->options.use_tiled_lighting && tiled_light_fits(rscn, &is->lgtcull_st))
+        tiled_light_pass(rs, rscn, view, proj, view_pos);
+    else
+        blended_light_pass(rs, rscn, view, proj, view_pos);
+
     /* Ambient Occlussion */
     if (rs->options.use_ssao) {
         ssao_ao_pass(&is->ssao, is->viewport.xy, view->m, proj->m);
@@ -542,6 +711,8 @@ static void light_pass(struct renderer_state* rs, struct render_scene* rscn, mat
         glUniform1i(glGetUniformLocation(shdr, "use_occlussion"), rs->options.use_ssao);
         glActiveTexture(GL_TEXTURE8);
         glBindTexture(GL_TEXTURE_2D, is->ssao.gl.blur_ctex);
+        /* Probe volume */
+        glUniform1i(glGetUniformLocation(shdr, "gi_volume_enabled"), gi_bind_volume(&is->gi_rndr, shdr));
         /* Screen pass */
         render_quad();
     }
@@ -631,6 +802,97 @@ static void postprocess_pass(struct renderer_state* rs, unsigned int cur_fb)
     postfx_blit_read_to_fb(&is->postfx, cur_fb);
 }
 
+/*-----------------------------------------------------------------
+ * Shadow pass
+ *-----------------------------------------------------------------*/
+static void render_shadow_batches(struct renderer_state* rs, struct render_scene* rscn)
+{
+    struct instbat* ib = &rs->internal->instbat;
+    for (size_t b = 0; b < ib->num_batches; ++b) {
+        struct instbat_batch* batch = &ib->batches[b];
+        struct render_mesh* rmsh = resmgr_get_mesh(&rs->rmgr, rscn->objects[batch->obj].mesh);
+        struct render_shape* rsh = &rmsh->shapes[batch->shape];
+        instbat_bind(ib, rsh);
+        instbat_draw(ib, batch, rsh);
+    }
+    glBindVertexArray(0);
+}
+
+/* Renders the static or dynamic casters of the splits in mask into the given target */
+static void render_shadow_casters(struct renderer_state* rs, struct render_scene* rscn,
+                                  enum shadowmap_target target, unsigned int mask, unsigned int dynamic)
+{
+    struct renderer_internal_state* is = rs->internal;
+    struct instbat* ib = &is->instbat;
+    /* Cached layers start over, final layers already hold the composited cache */
+    unsigned int clear_mask = target == SHADOWMAP_TARGET_STATIC ? mask : 0;
+    if (rs->options.use_layered_shadows) {
+        /* Every caster drawn once, routed to the layers of its cascade mask */
+        shadowmap_render_layered_begin(&is->shdwmap, target, clear_mask);
+        const struct shdwcull_caster* casters = is->shdwcull_st.all_casters;
+        instbat_begin(ib);
+        for (size_t c = 0; c < is->shdwcull_st.num_all_casters; ++c) {
+            unsigned int cmask = casters[c].mask & mask;
+            if (!cmask || casters[c].dynamic != dynamic)
+                continue;
+            unsigned int i = casters[c].obj, j = casters[c].shape;
+            struct render_shape* rsh = &resmgr_get_mesh(&rs->rmgr, rscn->objects[i].mesh)->shapes[j];
+            /* Level fit for the finest cascade it casts into */
+            unsigned int finest = 0;
+            while (!(cmask & (1 << finest)))
+                ++finest;
+            unsigned int lvl = rs->options.use_lods
+                ? lodsel_level(&is->lodsel_st, i, j, rsh, lodsel_shadow_bias(finest)) : 0;
+            instbat_add(ib, i, j, rsh, (rid){0}, lvl, 0, cmask);
+        }
+        instbat_end(ib, rscn->objects, rs->options.use_instancing);
+        render_shadow_batches(rs, rscn);
+        shadowmap_render_end(&is->shdwmap);
+    } else {
+        shadowmap_render((&is->shdwmap), target, clear_mask) {
+            (void) shdr;
+            if (!(mask & (1 << _split)))
+                continue;
+            /* Batch the casters of the split, materials do not matter for depth */
+            const struct shdwcull_caster* casters = is->shdwcull_st.casters[_split];
+            size_t num_casters = is->shdwcull_st.num_casters[_split];
+            instbat_begin(ib);
+            for (size_t c = 0; c < num_casters; ++c) {
+                if (casters[c].dynamic != dynamic)
+                    continue;
+                unsigned int i = casters[c].obj, j = casters[c].shape;
+                struct render_shape* rsh = &resmgr_get_mesh(&rs->rmgr, rscn->objects[i].mesh)->shapes[j];
+                unsigned int lvl = rs->options.use_lods
+                    ? lodsel_level(&is->lodsel_st, i, j, rsh, lodsel_shadow_bias(_split)) : 0;
+                instbat_add(ib, i, j, rsh, (rid){0}, lvl, 0, 1 << _split);
+            }
+            instbat_end(ib, rscn->objects, rs->options.use_instancing);
+            render_shadow_batches(rs, rscn);
+        }
+    }
+}
+
+static void shadow_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj)
+{
+    struct renderer_internal_state* is = rs->internal;
+    float* light_dir = rscn->lights[0].type_data.dir.direction.xyz;
+    shadowmap_configure(&is->shdwmap, rs->options.shadow_cascades, rs->options.shadow_resolution,
+                        rs->options.shadow_split_lambda, rs->options.shadow_distance);
+    shadowmap_update(&is->shdwmap, light_dir, view->m, proj->m);
+    shdwcull_run(&is->shdwcull_st, &is->shdwmap, &rs->rmgr, rscn->objects, rscn->num_objects);
+
+    /* Refresh cached static layers whose split moved or whose casters changed */
+    unsigned int stale = shadowmap_cache_refresh(&is->shdwmap, is->shdwcull_st.static_sigs);
+    if (stale)
+        render_shadow_casters(rs, rscn, SHADOWMAP_TARGET_STATIC, stale, 0);
+
+    /* Put dynamic casters over the cached static ones */
+    unsigned int dynamic_mask = is->shdwcull_st.dynamic_mask;
+    shadowmap_composite(&is->shdwmap, dynamic_mask);
+    if (dynamic_mask)
+        render_shadow_casters(rs, rscn, SHADOWMAP_TARGET_MAIN, dynamic_mask, 1);
+}
+
 static void render_scene(struct renderer_state* rs, struct render_scene* rscn, mat4* view, mat4* proj, int direct_only)
 {
     struct renderer_internal_state* is = rs->internal;
@@ -646,29 +908,8 @@ static void render_scene(struct renderer_state* rs, struct render_scene* rscn, m
     /* Copy depth to fb */
     gbuffer_blit_depth_to_fb(is->gbuf, cur_fb);
     /* Shadowmap pass*/
-    if (rs->options.use_shadows && !direct_only) {
-        float* light_dir = rscn->lights[0].type_data.dir.direction.xyz;
-        vec3 fru_pts[8]; vec4 fru_plns[6];
-        shadowmap_render((&is->shdwmap), light_dir, view->m, proj->m, fru_pts, fru_plns) {
-            for (size_t i = 0; i < rscn->num_objects; ++i) {
-                struct render_object* ro = &rscn->objects[i];
-                struct render_mesh* rmsh = resmgr_get_mesh(&rs->rmgr, ro->mesh);
-                glUniformMatrix4fv(glGetUniformLocation(shdr, "model"), 1, GL_FALSE, ro->model_mat);
-                for (size_t j = 0; j < rmsh->num_shapes; ++j) {
-                    struct render_shape* rsh = &rmsh->shapes[j];
-                    vec3 box_mm[2] = {
-                        mat4_mul_vec3(*(mat4*)ro->model_mat, *(vec3*)rsh->bb_min),
-                        mat4_mul_vec3(*(mat4*)ro->model_mat, *(vec3*)rsh->bb_max)
-                    };
-                    if (box_in_frustum(fru_pts, fru_plns, box_mm)){
-                        glBindVertexArray(rsh->vao);
-                        glDrawElements(GL_TRIANGLES, rsh->num_elems, GL_UNSIGNED_INT, 0);
-                    }
-                }
-            }
-            glBindVertexArray(0);
-        }
-    }
+    if (rs->options.use_shadows && !direct_only)
+        shadow_pass(rs, rscn, view, proj);
     /* Light pass */
     frame_prof_timepoint(is->fprof)
         light_pass(rs, rscn, (mat4*)view, (mat4*)proj, direct_only);
@@ -719,25 +960,186 @@ static void visualize_normals(struct renderer_state* rs, struct render_scene* rs
     glUseProgram(0);
 }
 
-void renderer_gi_update(struct renderer_state* rs, struct render_scene* rscn)
+/* Brdf lut from the disk cache, keyed by the sources of the shader generating it */
+static GLuint brdf_lut_fetch(struct renderer_state* rs)
 {
-    /* Update fallback probe */
-    struct gi_rndr* gir = &rs->internal->gi_rndr;
-    mat4 pass_view, pass_proj;
-    probe_render_faces(gir->probe_rndr, gir->fallback_probe.p, vec3_zero(), pass_view, pass_proj)
-        render_sky(rs, rscn, pass_view.m, pass_proj.m);
+    struct renderer_internal_state* is = rs->internal;
+    unsigned long long key = resint_shdr_hash("brdf_lut");
+    char path[512];
+    int cached = rs->options.cache_dir && dcache_path(path, sizeof(path), rs->options.cache_dir, "brdf_lut", key);
+    size_t size = brdf_lut_data_size();
+    void* data = malloc(size);
+    GLuint lut;
+    if (cached && dcache_fetch(path, key, data, size)) {
+        lut = brdf_lut_load(data);
+    } else {
+        lut = brdf_lut_generate(is->shdrs.ibl.brdf_lut);
+        if (cached) {
+            brdf_lut_read(lut, data);
+            dcache_store(path, key, data, size);
+        }
+    }
+    free(data);
+    return lut;
+}
+
+/* Key of the sky as seen by the fallback probe, cacheable when it identifies the sky content */
+static unsigned long long gi_sky_key(struct renderer_state* rs, struct render_scene* rscn, int* cacheable)
+{
+    unsigned long long h = DCACHE_HASH_SEED;
+    const char* filters[] = { "irr_conv", "prefilter", "sh_project", "sh_reduce" };
+    for (unsigned int i = 0; i < sizeof(filters) / sizeof(filters[0]); ++i) {
+        unsigned long long sh = resint_shdr_hash(filters[i]);
+        h = dcache_hash(h, &sh, sizeof(sh));
+    }
+    h = dcache_hash(h, &rscn->sky_type, sizeof(rscn->sky_type));
+    *cacheable = 1;
+    if (rscn->sky_type == RST_TEXTURE) {
+        struct render_texture* rt = resmgr_get_texture(&rs->rmgr, rscn->sky_tex);
+        if (rt && rt->hash) {
+            h = dcache_hash(h, &rt->hash, sizeof(rt->hash));
+        } else {
+            /* Content unknown, only the texture identity holds within this run */
+            unsigned long long id[3] = { rscn->sky_tex.index, rscn->sky_tex.generation, rt ? rt->id : 0 };
+            h = dcache_hash(h, id, sizeof(id));
+            *cacheable = 0;
+        }
+    } else if (rscn->sky_type == RST_PREETHAM) {
+        h = dcache_hash(h, &rscn->sky_pp, sizeof(rscn->sky_pp));
+    }
+    return h;
+}
+
+static void gi_update_pass(struct renderer_state* rs, struct render_scene* rscn, mat4* view)
+{
+    struct renderer_internal_state* is = rs->internal;
+    struct gi_rndr* gir = &is->gi_rndr;
+    /* Unchanged skies keep their filtered fallback probe */
+    int cacheable;
+    unsigned long long sky_key = gi_sky_key(rs, rscn, &cacheable);
+    gi_set_sky(gir, sky_key, cacheable, rs->options.cache_dir);
+    mat4 inv_view = mat4_inverse(*view);
+    vec3 eye = vec3_new(inv_view.xw, inv_view.yw, inv_view.zw);
+    gi_update_begin(gir, eye, rs->options.gi_budget_msec);
 
     /* HACK: Temporarily replace gbuffer reference in renderer state */
-    struct gbuffer* old_gbuf = rs->internal->gbuf;
-    rs->internal->gbuf = gir->probe_gbuf;
-    /* Update probes */
-    gi_render_passes(gir, pass_view, pass_proj)
-        render_scene(rs, rscn, &pass_view, &pass_proj, 1);
-    /* Restore original gbuffer reference */
-    rs->internal->gbuf = old_gbuf;
+    struct gbuffer* old_gbuf = is->gbuf;
+    mat4 pass_view, pass_proj;
+    enum gi_step step;
+    gi_update_steps(gir, step, pass_view, pass_proj) {
+        switch (step) {
+            case GI_STEP_SKY_FACE:
+                render_sky(rs, rscn, pass_view.m, pass_proj.m);
+                break;
+            case GI_STEP_PROBE_FACE:
+                is->gbuf = gir->probe_gbuf;
+                render_scene(rs, rscn, &pass_view, &pass_proj, 1);
+                is->gbuf = old_gbuf;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Content hash of the texture source data, zero when it is missing or unknown */
+static unsigned long long texture_hash(struct renderer_state* rs, rid id)
+{
+    struct render_texture* rt = rid_null(id) ? 0 : resmgr_get_texture(&rs->rmgr, id);
+    return rt ? rt->hash : 0;
+}
+
+/* Content hash of everything that ends up in the GI probes, resources are resolved through the resource manager */
+static unsigned long long gi_scene_key(struct renderer_state* rs, struct render_scene* rscn)
+{
+    struct gi_rndr* gir = &rs->internal->gi_rndr;
+    unsigned long long h = DCACHE_HASH_SEED;
+    for (unsigned int i = 0; i < rscn->num_objects; ++i) {
+        struct render_object* ro = &rscn->objects[i];
+        h = dcache_hash(h, ro->model_mat, sizeof(ro->model_mat));
+        struct render_mesh* rmsh = resmgr_get_mesh(&rs->rmgr, ro->mesh);
+        if (!rmsh)
+            continue;
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            struct render_shape* rsh = &rmsh->shapes[j];
+            h = dcache_hash(h, &rsh->hash, sizeof(rsh->hash));
+            rid mid = ro->materials[rsh->mat_idx];
+            struct render_material* rmat = rid_null(mid) ? 0 : resmgr_get_material(&rs->rmgr, mid);
+            if (!rmat)
+                continue;
+            h = dcache_hash(h, &rmat->type, sizeof(rmat->type));
+            vec3f cols[5] = { rmat->ke, rmat->kd, rmat->ks, rmat->kr, rmat->kt };
+            h = dcache_hash(h, cols, sizeof(cols));
+            h = dcache_hash(h, &rmat->rs, sizeof(rmat->rs));
+            h = dcache_hash(h, &rmat->op, sizeof(rmat->op));
+            unsigned long long txts[4] = {
+                texture_hash(rs, rmat->kd_txt),
+                texture_hash(rs, rmat->ke_txt),
+                texture_hash(rs, rmat->rs_txt),
+                texture_hash(rs, rmat->norm_txt)
+            };
+            h = dcache_hash(h, txts, sizeof(txts));
+        }
+    }
+    for (unsigned int i = 0; i < rscn->num_lights; ++i) {
+        struct render_light* l = &rscn->lights[i];
+        h = dcache_hash(h, &l->type, sizeof(l->type));
+        h = dcache_hash(h, &l->color, sizeof(l->color));
+        h = dcache_hash(h, &l->intensity, sizeof(l->intensity));
+        h = dcache_hash(h, &l->type_data, sizeof(l->type_data));
+    }
+    int sky_cacheable;
+    unsigned long long sky_key = gi_sky_key(rs, rscn, &sky_cacheable);
+    h = dcache_hash(h, &sky_key, sizeof(sky_key));
+    for (unsigned int i = 0; i < gir->num_probes; ++i)
+        h = dcache_hash(h, &gir->pdata[i].pos, sizeof(gir->pdata[i].pos));
+    return h;
+}
+
+int renderer_gi_load(struct renderer_state* rs, struct render_scene* rscn, const char* path)
+{
+    struct gi_rndr* gir = &rs->internal->gi_rndr;
+    int sky_cacheable;
+    unsigned long long sky_key = gi_sky_key(rs, rscn, &sky_cacheable);
+    gi_set_sky(gir, sky_key, sky_cacheable, rs->options.cache_dir);
+    return gi_cache_load(gir, gi_scene_key(rs, rscn), path);
+}
 
-    /* Preprocess probes */
-    gi_preprocess(gir, rs->internal->shdrs.ibl.irr_gen, rs->internal->shdrs.ibl.prefilter);
+int renderer_gi_bake(struct renderer_state* rs, struct render_scene* rscn, const char* path)
+{
+    /* Run every update step at once, nothing is presented */
+    struct gi_rndr* gir = &rs->internal->gi_rndr;
+    float budget = rs->options.gi_budget_msec;
+    rs->options.gi_budget_msec = 0.0f;
+    mat4 view = mat4_id();
+    gi_invalidate(gir);
+    /* Every GPU projection is checked against the CPU projector, a mismatch fails the bake */
+    gi_sh_check_begin(gir);
+    gi_update_pass(rs, rscn, &view);
+    float sh_error = gi_sh_check_end(gir);
+    rs->options.gi_budget_msec = budget;
+    if (sh_error > GI_SH_CHECK_TOLERANCE)
+        return 0;
+    return gi_cache_save(gir, gi_scene_key(rs, rscn), path);
+}
+
+void renderer_gi_update(struct renderer_state* rs, struct render_scene* rscn)
+{
+    /* Probes are refreshed over the next frames within the GI budget */
+    (void) rscn;
+    gi_invalidate(&rs->internal->gi_rndr);
+}
+
+void renderer_gi_probe_grid(struct renderer_state* rs, float bmin[3], float bmax[3], unsigned int dims[3])
+{
+    gi_set_probe_grid(&rs->internal->gi_rndr,
+                      vec3_new(bmin[0], bmin[1], bmin[2]),
+                      vec3_new(bmax[0], bmax[1], bmax[2]), dims);
+}
+
+void renderer_gi_add_probe(struct renderer_state* rs, float pos[3])
+{
+    gi_add_probe(&rs->internal->gi_rndr, vec3_new(pos[0], pos[1], pos[2]));
 }
 
 /*-----------------------------------------------------------------
@@ -752,6 +1154,13 @@ void renderer_render(struct renderer_state* rs, struct render_scene* rscn, float
         return;
     }
 
+    /* Split sum lut, generated on first use so the cache directory option applies */
+    if (!is->textures.brdf_lut)
+        is->textures.brdf_lut = brdf_lut_fetch(rs);
+
+    /* Refresh pending GI probes */
+    gi_update_pass(rs, rscn, (mat4*)view);
+
     /* Render main scene */
     with_fprof(is->fprof, 1)
         render_scene(rs, rscn, (mat4*)view, &is->proj, 0);
@@ -801,10 +1210,11 @@ void renderer_render(struct renderer_state* rs, struct render_scene* rscn, float
 
     /* Show debug info */
     if (rs->options.show_fprof) {
-        char buf[128];
-        snprintf(buf, sizeof(buf), "GPass: %.3f\nLPass: %.3f\nPPass: %.3f\nVis/Tot: %u/%u",
+        char buf[192];
+        snprintf(buf, sizeof(buf), "GPass: %.3f\nLPass: %.3f\nPPass: %.3f\nVis/Tot: %u/%u\nDraws: %u\nClusters: %u/%u",
                  is->dbginfo.gpass_msec, is->dbginfo.lpass_msec, is->dbginfo.ppass_msec,
-                 is->dbginfo.num_visible_objs, is->dbginfo.num_total_objs);
+                 is->dbginfo.num_visible_objs, is->dbginfo.num_total_objs, is->dbginfo.num_draws,
+                 is->clcull_st.num_visible, is->clcull_st.num_total);
         dbgtxt_setfnt(FNT_GOHU);
         dbgtxt_prnt(buf, 5, 15);
         dbgtxt_setfnt(FNT_SLKSCR);
@@ -842,7 +1252,13 @@ void renderer_destroy(struct renderer_state* rs)
     dbgtxt_destroy();
     frame_prof_destroy(is->fprof);
     shadowmap_destroy(&is->shdwmap);
+    shdwcull_destroy(&is->shdwcull_st);
     occull_destroy(&is->occl_st);
+    clcull_destroy(&is->clcull_st);
+    lodsel_destroy(&is->lodsel_st);
+    lodsel_destroy(&is->probe_lodsel_st);
+    instbat_destroy(&is->instbat);
+    lgtcull_destroy(&is->lgtcull_st);
     bbox_rndr_destroy(&is->bbox_rs);
     gi_rndr_destroy(&is->gi_rndr);
     sky_preetham_destroy(&is->sky_rndr.preeth);
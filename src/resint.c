@@ -4,6 +4,7 @@
 #include <energycore/asset.h>
 #include "opengl.h"
 #include "txtpp.h"
+#include "dcache.h"
 
 static const struct shdr_info {
     const char* name;
@@ -14,7 +15,7 @@ static const struct shdr_info {
 } shdr_infos[] = {
     {
         .name = "geom_pass",
-        .vs_loc = "static_vs.glsl",
+        .vs_loc = "instanced_vs.glsl",
         .fs_loc = "geom_pass_fs.glsl"
     },
     {
@@ -22,6 +23,15 @@ static const struct shdr_info {
         .vs_loc = "passthrough_vs.glsl",
         .fs_loc = "dir_light_fs.glsl"
     },
+    {
+        .name = "local_light",
+        .vs_loc = "passthrough_vs.glsl",
+        .fs_loc = "local_light_fs.glsl"
+    },
+    {
+        .name = "tiled_light",
+        .cs_loc = "tiled_light_cs.glsl"
+    },
     {
         .name = "env_light",
         .vs_loc = "passthrough_vs.glsl",
@@ -47,6 +57,22 @@ static const struct shdr_info {
         .vs_loc = "ibl/cubemap_vs.glsl",
         .fs_loc = "ibl/prefilter_fs.glsl"
     },
+    {
+        .name = "equirect_cm",
+        .cs_loc = "ibl/equirect_cs.glsl"
+    },
+    {
+        .name = "sh_project",
+        .cs_loc = "ibl/sh_project_cs.glsl"
+    },
+    {
+        .name = "sh_reduce",
+        .cs_loc = "ibl/sh_reduce_cs.glsl"
+    },
+    {
+        .name = "sh_resample",
+        .cs_loc = "ibl/sh_resample_cs.glsl"
+    },
     {
         .name = "probe_vis",
         .vs_loc = "static_vs.glsl",
@@ -113,6 +139,7 @@ static const struct shdr_info {
 };
 
 static unsigned int shdrs[sizeof(shdr_infos)] = {};
+static unsigned long long shdr_hashes[sizeof(shdr_infos)] = {};
 
 static int txtpp_custom_load(void* ud, const char* fpath, unsigned char** buf)
 {
@@ -159,9 +186,11 @@ struct shader_attachment {
     const char* src;
 };
 
-static unsigned int shader_build(struct shader_attachment* attachments, size_t num_attachments)
+static unsigned int shader_build(struct shader_attachment* attachments, size_t num_attachments, int retrievable)
 {
     GLuint prog = glCreateProgram();
+    if (retrievable)
+        glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     for (size_t i = 0; i < num_attachments; ++i) {
         struct shader_attachment* sa = &attachments[i];
         if (sa->src) {
@@ -176,24 +205,117 @@ static unsigned int shader_build(struct shader_attachment* attachments, size_t n
     return prog;
 }
 
-void resint_init()
+/* Driver identity, program binaries only load on the driver that produced them */
+static unsigned long long driver_hash()
+{
+    unsigned long long h = DCACHE_HASH_SEED;
+    GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        const char* s = (const char*)glGetString(names[i]);
+        h = s ? dcache_hash(h, s, strlen(s) + 1) : dcache_hash(h, "", 1);
+    }
+    return h;
+}
+
+/* Whether the driver lists fmt among its program binary formats */
+static int binary_format_supported(GLenum fmt, const GLint* formats, GLint num_formats)
+{
+    for (GLint i = 0; i < num_formats; ++i)
+        if ((GLenum)formats[i] == fmt)
+            return 1;
+    return 0;
+}
+
+/* Program from a cached binary, zero when missing or rejected by the driver */
+static unsigned int shader_binary_load(const char* path, unsigned long long key, const GLint* formats, GLint num_formats)
+{
+    size_t size;
+    unsigned char* data = dcache_fetch_alloc(path, key, &size);
+    if (!data)
+        return 0;
+    GLuint prog = 0;
+    GLenum fmt = 0;
+    if (size > sizeof(fmt))
+        memcpy(&fmt, data, sizeof(fmt));
+    /* Unsupported formats would raise a GL error, such programs are rebuilt from source instead */
+    if (binary_format_supported(fmt, formats, num_formats)) {
+        prog = glCreateProgram();
+        glProgramBinary(prog, fmt, data + sizeof(fmt), size - sizeof(fmt));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(prog);
+            prog = 0;
+        }
+    }
+    free(data);
+    return prog;
+}
+
+/* Stores a linked program binary prefixed by its format */
+static void shader_binary_store(const char* path, unsigned long long key, unsigned int prog)
 {
+    GLint linked = GL_FALSE, len = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (!linked || len <= 0)
+        return;
+    GLenum fmt;
+    unsigned char* data = malloc(sizeof(fmt) + len);
+    GLsizei written = 0;
+    glGetProgramBinary(prog, len, &written, &fmt, data + sizeof(fmt));
+    memcpy(data, &fmt, sizeof(fmt));
+    if (written > 0)
+        dcache_store(path, key, data, sizeof(fmt) + written);
+    free(data);
+}
+
+void resint_init(const char* cache_dir)
+{
+    /* Program binaries need driver support */
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    int use_cache = cache_dir && num_formats > 0;
+    unsigned long long drv_hash = use_cache ? driver_hash() : 0;
+    GLint* formats = 0;
+    if (use_cache) {
+        formats = malloc(num_formats * sizeof(*formats));
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
+    }
+
     for (unsigned int i = 0; i < sizeof(shdr_infos)/sizeof(shdr_infos[0]); ++i) {
         const struct shdr_info* si = shdr_infos + i;
         const char* vs_src = shader_load(si->vs_loc);
         const char* gs_src = shader_load(si->gs_loc);
         const char* fs_src = shader_load(si->fs_loc);
         const char* cs_src = shader_load(si->cs_loc);
-        shdrs[i] = shader_build((struct shader_attachment[]){
-                {GL_VERTEX_SHADER,   vs_src},
-                {GL_GEOMETRY_SHADER, gs_src},
-                {GL_FRAGMENT_SHADER, fs_src},
-                {GL_COMPUTE_SHADER,  cs_src}}, 4);
+        /* Hash of the preprocessed sources, identifies data the program derives */
+        unsigned long long h = DCACHE_HASH_SEED;
+        const char* srcs[4] = { vs_src, gs_src, fs_src, cs_src };
+        for (unsigned int j = 0; j < 4; ++j)
+            h = srcs[j] ? dcache_hash(h, srcs[j], strlen(srcs[j]) + 1) : dcache_hash(h, "", 1);
+        shdr_hashes[i] = h;
+
+        /* Cached binary of the same sources on the same driver, compiled from source otherwise */
+        char path[512];
+        unsigned long long key = dcache_hash(h, &drv_hash, sizeof(drv_hash));
+        int cached = use_cache && dcache_path(path, sizeof(path), cache_dir, si->name, key);
+        shdrs[i] = cached ? shader_binary_load(path, key, formats, num_formats) : 0;
+        if (!shdrs[i]) {
+            shdrs[i] = shader_build((struct shader_attachment[]){
+                    {GL_VERTEX_SHADER,   vs_src},
+                    {GL_GEOMETRY_SHADER, gs_src},
+                    {GL_FRAGMENT_SHADER, fs_src},
+                    {GL_COMPUTE_SHADER,  cs_src}}, 4, cached);
+            if (cached)
+                shader_binary_store(path, key, shdrs[i]);
+        }
         free((void*)vs_src);
         free((void*)gs_src);
         free((void*)fs_src);
         free((void*)cs_src);
     }
+    free(formats);
 }
 
 unsigned int resint_shdr_fetch(const char* shdr_name)
@@ -206,6 +328,16 @@ unsigned int resint_shdr_fetch(const char* shdr_name)
     return 0;
 }
 
+unsigned long long resint_shdr_hash(const char* shdr_name)
+{
+    for (unsigned int i = 0; i < sizeof(shdr_infos)/sizeof(shdr_infos[0]); ++i) {
+        const struct shdr_info* si = shdr_infos + i;
+        if (strcmp(shdr_name, si->name) == 0)
+            return shdr_hashes[i];
+    }
+    return 0;
+}
+
 void resint_destroy()
 {
     for (unsigned int i = 0; i < sizeof(shdr_infos)/sizeof(shdr_infos[0]); ++i) {
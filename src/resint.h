@@ -31,8 +31,11 @@
 #ifndef _RESINT_H_
 #define _RESINT_H_
 
-void resint_init();
+/* Builds all internal programs, reusing binaries cached in cache_dir when not null */
+void resint_init(const char* cache_dir);
 unsigned int resint_shdr_fetch(const char* shdr_name);
+/* Content hash of the shader sources, for keying cached data they produce */
+unsigned long long resint_shdr_hash(const char* shdr_name);
 void resint_destroy();
 
 #endif /* ! _RESINT_H_ */
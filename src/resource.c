@@ -1,9 +1,15 @@
 #include "resource.h"
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include "opengl.h"
 #include "asset.h"
-#include "vcopt.h"
+#include "thrpool.h"
+#include "mshlet.h"
+#include "mshsimp.h"
+#include "idxopt.h"
+#include "resint.h"
+#include "dcache.h"
 
 int rid_null(rid id)
 {
@@ -15,6 +21,17 @@ void resmgr_init(struct resmgr* rmgr)
     slot_map_init(&rmgr->textures, sizeof(struct render_texture));
     slot_map_init(&rmgr->materials, sizeof(struct render_material));
     slot_map_init(&rmgr->meshes, sizeof(struct render_mesh));
+    rmgr->concurrent = 0;
+    memset(&rmgr->vcache_stats, 0, sizeof(rmgr->vcache_stats));
+}
+
+void resmgr_init_concurrent(struct resmgr* rmgr)
+{
+    cslot_map_init(&rmgr->ts.textures, sizeof(struct render_texture));
+    cslot_map_init(&rmgr->ts.materials, sizeof(struct render_material));
+    cslot_map_init(&rmgr->ts.meshes, sizeof(struct render_mesh));
+    rmgr->concurrent = 1;
+    memset(&rmgr->vcache_stats, 0, sizeof(rmgr->vcache_stats));
 }
 
 static void render_texture_destroy(struct render_texture* rt)
@@ -29,11 +46,29 @@ static void render_mesh_destroy(struct render_mesh* rm)
         glDeleteBuffers(1, &s->ebo);
         glDeleteBuffers(1, &s->vbo);
         glDeleteVertexArrays(1, &s->vao);
+        for (unsigned int j = 0; j < s->num_lods; ++j)
+            free(s->lods[j].meshlets);
     }
 }
 
 void resmgr_destroy(struct resmgr* rmgr)
 {
+    if (rmgr->concurrent) {
+        void* d;
+        for (size_t i = 0; i < cslot_map_num_slots(&rmgr->ts.textures); ++i)
+            if ((d = cslot_map_slot_data(&rmgr->ts.textures, i)))
+                render_texture_destroy(d);
+        cslot_map_destroy(&rmgr->ts.textures);
+
+        cslot_map_destroy(&rmgr->ts.materials);
+
+        for (size_t i = 0; i < cslot_map_num_slots(&rmgr->ts.meshes); ++i)
+            if ((d = cslot_map_slot_data(&rmgr->ts.meshes, i)))
+                render_mesh_destroy(d);
+        cslot_map_destroy(&rmgr->ts.meshes);
+        return;
+    }
+
     for (size_t i = 0; i < rmgr->textures.size; ++i)
         render_texture_destroy(slot_map_data(&rmgr->textures, i));
     slot_map_destroy(&rmgr->textures);
@@ -45,6 +80,24 @@ void resmgr_destroy(struct resmgr* rmgr)
     slot_map_destroy(&rmgr->meshes);
 }
 
+/* Reserve and publish in one step when in concurrent mode */
+static rid store_insert(struct resmgr* rmgr, struct slot_map* sm, struct cslot_map* csm, void* data)
+{
+    if (!rmgr->concurrent)
+        return slot_map_insert(sm, data);
+    rid id = cslot_map_reserve(csm);
+    if (slot_map_key_valid(id))
+        cslot_map_publish(csm, id, data);
+    return id;
+}
+
+static void* store_lookup(struct resmgr* rmgr, struct slot_map* sm, struct cslot_map* csm, rid id)
+{
+    if (!slot_map_key_valid(id))
+        return 0;
+    return rmgr->concurrent ? cslot_map_lookup(csm, id) : slot_map_lookup(sm, id);
+}
+
 static GLint wrap_mode(enum texture_wrap w)
 {
     switch (w) {
@@ -228,13 +281,22 @@ static unsigned int tex_env_from_hcross(void* data, unsigned int width, unsigned
     return id;
 }
 
+/* Content hash of the image data, decoders may leave the size of uncompressed data unset */
+static unsigned long long image_hash(image im)
+{
+    size_t sz = im.sz ? im.sz : (size_t)im.w * im.h * im.channels * (im.bit_depth / 8);
+    unsigned long long h = dcache_hash(DCACHE_HASH_SEED, &im.compression_type, sizeof(im.compression_type));
+    return dcache_hash(h, im.data, sz);
+}
+
 rid resmgr_add_texture(struct resmgr* rmgr, struct texture* tex)
 {
     struct render_texture rt = {
         .id = upload_texture_img(tex->img),
+        .hash = image_hash(tex->img),
     };
     setup_default_texture_parameters();
-    return slot_map_insert(&rmgr->textures, &rt);
+    return store_insert(rmgr, &rmgr->textures, &rmgr->ts.textures, &rt);
 }
 
 rid resmgr_add_texture_env(struct resmgr* rmgr, struct texture* tex, int hcross)
@@ -242,26 +304,99 @@ rid resmgr_add_texture_env(struct resmgr* rmgr, struct texture* tex, int hcross)
     (void) hcross;
     struct render_texture rt = {
         .id = tex_env_from_hcross(tex->img.data, tex->img.w, tex->img.h, tex->img.channels),
+        .hash = image_hash(tex->img),
     };
     setup_default_texture_parameters();
-    return slot_map_insert(&rmgr->textures, &rt);
+    return store_insert(rmgr, &rmgr->textures, &rmgr->ts.textures, &rt);
 }
 
 rid resmgr_add_texture_file(struct resmgr* rmgr, const char* filepath)
 {
     const char* ext = strrchr(filepath, '.');
     GLuint id = 0;
-    if (strcmp(ext, ".hdr") == 0)
-        id = texture_cubemap_from_hdr(filepath);
-    else if (strcmp(ext, ".ktx") == 0)
-        id = texture_from_ktx(filepath);
-    else
+    unsigned long long hash = 0;
+    if (strcmp(ext, ".hdr") == 0) {
+        void* fdata; size_t fsize;
+        read_file_to_mem_buf(&fdata, &fsize, filepath);
+        if (!fdata)
+            return INVALID_RID;
+        hash = dcache_hash(DCACHE_HASH_SEED, fdata, fsize);
+        id = texture_cubemap_from_hdr(fdata, fsize, resint_shdr_fetch("equirect_cm"));
+        free(fdata);
+    } else if (strcmp(ext, ".ktx") == 0) {
+        void* fdata; size_t fsize;
+        read_file_to_mem_buf(&fdata, &fsize, filepath);
+        if (!fdata)
+            return INVALID_RID;
+        /* Hash and upload the same read */
+        hash = dcache_hash(DCACHE_HASH_SEED, fdata, fsize);
+        id = texture_from_ktx_buffer(fdata, fsize);
+        free(fdata);
+    } else
+        return INVALID_RID;
+    if (!id)
         return INVALID_RID;
     struct render_texture rt = {
         .id = id,
+        .hash = hash,
     };
     setup_default_texture_parameters();
-    return slot_map_insert(&rmgr->textures, &rt);
+    return store_insert(rmgr, &rmgr->textures, &rmgr->ts.textures, &rt);
+}
+
+struct load_textures_job {
+    struct resmgr* rmgr;
+    const char** paths;
+    resmgr_image_load_fn load;
+    image* imgs;
+    rid* ids;
+};
+
+/* Decodes on the thread pool, ids are reserved as soon as their image is ready */
+static void load_textures(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct load_textures_job* job = userdata;
+    for (size_t i = begin; i < end; ++i) {
+        job->imgs[i] = job->load(job->paths[i]);
+        job->ids[i] = INVALID_RID;
+        if (job->imgs[i].data && job->rmgr->concurrent)
+            job->ids[i] = resmgr_reserve_texture(job->rmgr);
+    }
+}
+
+void resmgr_add_textures(struct resmgr* rmgr, const char** paths, size_t count, resmgr_image_load_fn load, rid* ids)
+{
+    image* imgs = calloc(count, sizeof(*imgs));
+    struct load_textures_job job = {
+        .rmgr  = rmgr,
+        .paths = paths,
+        .load  = load ? load : image_from_file,
+        .imgs  = imgs,
+        .ids   = ids
+    };
+    thrpool_parallel_for(thrpool_default(), count, 1, load_textures, &job);
+
+    /* Uploads stay on the calling GL thread, each id resolves once its texture is published */
+    for (size_t i = 0; i < count; ++i) {
+        image im = imgs[i];
+        if (im.data && (!rmgr->concurrent || !rid_null(ids[i]))) {
+            struct render_texture rt = {
+                .id = upload_texture_img(im),
+                .hash = image_hash(im),
+            };
+            setup_default_texture_parameters();
+            if (rmgr->concurrent) {
+                if (!resmgr_publish_texture(rmgr, ids[i], &rt)) {
+                    render_texture_destroy(&rt);
+                    ids[i] = INVALID_RID;
+                }
+            } else
+                ids[i] = slot_map_insert(&rmgr->textures, &rt);
+        }
+        free(im.data);
+    }
+    free(imgs);
 }
 
 struct render_texture_info resmgr_texture_info_populate(struct texture_info* ti)
@@ -320,7 +455,7 @@ void resmgr_default_rmat(struct render_material* rmat)
 
 rid resmgr_add_material(struct resmgr* rmgr, struct render_material* rmat)
 {
-    return slot_map_insert(&rmgr->materials, rmat);
+    return store_insert(rmgr, &rmgr->materials, &rmgr->ts.materials, rmat);
 }
 
 static void mesh_calc_aabb(struct shape* s, float min[3], float max[3])
@@ -338,15 +473,71 @@ static void mesh_calc_aabb(struct shape* s, float min[3], float max[3])
     }
 }
 
-static void optimize_indices(unsigned int* indices, size_t num_indices, size_t num_verts)
+/* Stop the LOD chain once a level keeps more than this fraction of the previous one */
+#define LOD_MIN_REDUCTION 0.8f
+/* Maximum simplification error per level, relative to the shape's bounding box diagonal */
+#define LOD_MAX_ERROR 0.02f
+
+/* Shape data produced off the GL thread */
+struct prepared_shape {
+    struct shape_vcache_stats vcache;
+    unsigned long long hash;
+    /* Index lists of all levels back to back */
+    unsigned int* indices;
+    size_t num_indices;
+    struct render_lod lods[RENDER_SHAPE_MAX_LODS];
+    unsigned int num_lods;
+};
+
+/* Builds progressively simplified levels over the shape's vertex buffer, each cache optimized */
+static void build_lods(struct prepared_shape* ps, struct shape* sh)
 {
-    unsigned int* optimized_indices = calloc(num_indices, sizeof(*optimized_indices));
-    forsyth_reorder_indices(optimized_indices, indices, num_indices / 3, num_verts);
-    memcpy(indices, optimized_indices, num_indices * sizeof(*indices));
-    free(optimized_indices);
+    size_t num_indices = sh->num_triangles * 3;
+    ps->indices = malloc(RENDER_SHAPE_MAX_LODS * num_indices * sizeof(*ps->indices));
+    memcpy(ps->indices, sh->triangles, num_indices * sizeof(*ps->indices));
+    ps->lods[0] = (struct render_lod) { .first_index = 0, .num_indices = num_indices };
+    ps->num_lods = 1;
+
+    float bmin[3], bmax[3];
+    mesh_calc_aabb(sh, bmin, bmax);
+    float diag = sqrtf((bmax[0] - bmin[0]) * (bmax[0] - bmin[0])
+                     + (bmax[1] - bmin[1]) * (bmax[1] - bmin[1])
+                     + (bmax[2] - bmin[2]) * (bmax[2] - bmin[2]));
+    unsigned int* simplified = malloc(num_indices * sizeof(*simplified));
+    while (ps->num_lods < RENDER_SHAPE_MAX_LODS) {
+        struct render_lod* prev = &ps->lods[ps->num_lods - 1];
+        float err = 0.0f;
+        size_t n = mshsimp_simplify(simplified, ps->indices + prev->first_index, prev->num_indices,
+                                    sh->pos, sh->num_pos, prev->num_indices / 2, LOD_MAX_ERROR * diag, &err);
+        if (n == 0 || n > prev->num_indices * LOD_MIN_REDUCTION)
+            break;
+        unsigned int first = prev->first_index + prev->num_indices;
+        idxopt_tipsify(ps->indices + first, simplified, n, sh->num_pos, IDXOPT_CACHE_SIZE, 0);
+        ps->lods[ps->num_lods++] = (struct render_lod) {
+            .first_index = first,
+            .num_indices = n,
+            .error = prev->error + err
+        };
+    }
+    free(simplified);
+
+    struct render_lod* last = &ps->lods[ps->num_lods - 1];
+    ps->num_indices = last->first_index + last->num_indices;
+    ps->indices = realloc(ps->indices, ps->num_indices * sizeof(*ps->indices));
+
+    /* Cluster every level */
+    for (unsigned int l = 0; l < ps->num_lods; ++l) {
+        struct render_lod* lod = &ps->lods[l];
+        struct meshlet* ml = malloc(mshlet_max_count(lod->num_indices) * sizeof(*ml));
+        size_t num_ml = mshlet_build(ml, ps->indices + lod->first_index, lod->num_indices, sh->pos, sh->num_pos);
+        for (size_t k = 0; k < num_ml; ++k)
+            ml[k].first_index += lod->first_index;
+        lod->meshlets = realloc(ml, num_ml * sizeof(*ml));
+        lod->num_meshlets = num_ml;
+    }
 }
 
-void add_shape(struct render_shape* rsh, struct shape* sh)
+void add_shape(struct render_shape* rsh, struct shape* sh, struct prepared_shape* ps)
 {
     GLuint vao;
     glGenVertexArrays(1, &vao);
@@ -390,48 +581,124 @@ void add_shape(struct render_shape* rsh, struct shape* sh)
     offset += sizeof(*sh->tangsp) * num_verts;
     glUnmapBuffer(GL_ARRAY_BUFFER);
 
-    optimize_indices((unsigned int*)sh->triangles, sh->num_triangles * 3, sh->num_pos);
     GLuint ebo;
     glGenBuffers(1, &ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sh->num_triangles * sizeof(*sh->triangles), sh->triangles, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ps->num_indices * sizeof(*ps->indices), ps->indices, GL_STATIC_DRAW);
     size_t num_elems = sh->num_triangles * 3;
 
     *rsh = (struct render_shape) {
         .vao = vao,
         .vbo = vbo,
         .ebo = ebo,
-        .num_elems = num_elems
+        .num_elems = num_elems,
+        .hash = ps->hash,
+        .num_lods = ps->num_lods
     };
+    memcpy(rsh->lods, ps->lods, sizeof(ps->lods));
     mesh_calc_aabb(sh, rsh->bb_min, rsh->bb_max);
 }
 
+/* Content hash of the vertex attributes and index lists that get uploaded, tangents follow from them */
+static unsigned long long shape_hash(struct shape* sh, struct prepared_shape* ps)
+{
+    unsigned long long h = DCACHE_HASH_SEED;
+    h = dcache_hash(h, sh->pos, sh->num_pos * sizeof(*sh->pos));
+    h = dcache_hash(h, sh->texcoord, sh->num_texcoord * sizeof(*sh->texcoord));
+    h = dcache_hash(h, sh->norm, sh->num_norm * sizeof(*sh->norm));
+    return dcache_hash(h, ps->indices, ps->num_indices * sizeof(*ps->indices));
+}
+
+struct prepare_shapes_job {
+    struct mesh* m;
+    struct prepared_shape* out;
+};
+
+/* CPU side shape processing, runs on the thread pool ahead of upload */
+static void prepare_shapes(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct prepare_shapes_job* job = userdata;
+    for (size_t i = begin; i < end; ++i) {
+        struct shape* shp = job->m->shapes[i];
+        shape_optimize_indices(shp, &job->out[i].vcache);
+        shape_compute_normals(shp);
+        shape_compute_tangent_frame(shp);
+        build_lods(&job->out[i], shp);
+        job->out[i].hash = shape_hash(shp, &job->out[i]);
+    }
+}
+
 rid resmgr_add_mesh(struct resmgr* rmgr, struct mesh* m)
 {
     assert(m->num_shapes < 16 && "Unsupported number of shapes");
+    struct prepared_shape prepared[16];
+    memset(prepared, 0, sizeof(prepared));
+    struct prepare_shapes_job job = { .m = m, .out = prepared };
+    thrpool_parallel_for(thrpool_default(), m->num_shapes, 1, prepare_shapes, &job);
+
     struct render_mesh rm;
     memset(&rm, 0, sizeof(rm));
     rm.num_shapes = m->num_shapes;
     for (size_t i = 0; i < m->num_shapes; ++i) {
-        struct shape* shp = m->shapes[i];
-        shape_compute_normals(shp);
-        shape_compute_tangent_frame(shp);
-        add_shape(&rm.shapes[i], shp);
+        add_shape(&rm.shapes[i], m->shapes[i], &prepared[i]);
+        free(prepared[i].indices);
+        struct shape_vcache_stats* vs = &rmgr->vcache_stats;
+        vs->num_tris += prepared[i].vcache.num_tris;
+        vs->num_verts += prepared[i].vcache.num_verts;
+        vs->misses_before += prepared[i].vcache.misses_before;
+        vs->misses_after += prepared[i].vcache.misses_after;
     }
-    return slot_map_insert(&rmgr->meshes, &rm);
+    return store_insert(rmgr, &rmgr->meshes, &rmgr->ts.meshes, &rm);
 }
 
 struct render_texture* resmgr_get_texture(struct resmgr* rmgr, rid id)
 {
-    return slot_map_key_valid(id) ? slot_map_lookup(&rmgr->textures, id) : 0;
+    return store_lookup(rmgr, &rmgr->textures, &rmgr->ts.textures, id);
 }
 
 struct render_material* resmgr_get_material(struct resmgr* rmgr, rid id)
 {
-    return slot_map_key_valid(id) ? slot_map_lookup(&rmgr->materials, id) : 0;
+    return store_lookup(rmgr, &rmgr->materials, &rmgr->ts.materials, id);
 }
 
 struct render_mesh* resmgr_get_mesh(struct resmgr* rmgr, rid id)
 {
-    return slot_map_key_valid(id) ? slot_map_lookup(&rmgr->meshes, id) : 0;
+    return store_lookup(rmgr, &rmgr->meshes, &rmgr->ts.meshes, id);
+}
+
+rid resmgr_reserve_texture(struct resmgr* rmgr)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_reserve(&rmgr->ts.textures);
+}
+
+rid resmgr_reserve_material(struct resmgr* rmgr)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_reserve(&rmgr->ts.materials);
+}
+
+rid resmgr_reserve_mesh(struct resmgr* rmgr)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_reserve(&rmgr->ts.meshes);
+}
+
+int resmgr_publish_texture(struct resmgr* rmgr, rid id, struct render_texture* rt)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_publish(&rmgr->ts.textures, id, rt);
+}
+
+int resmgr_publish_material(struct resmgr* rmgr, rid id, struct render_material* rmat)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_publish(&rmgr->ts.materials, id, rmat);
+}
+
+int resmgr_publish_mesh(struct resmgr* rmgr, rid id, struct render_mesh* rm)
+{
+    assert(rmgr->concurrent);
+    return cslot_map_publish(&rmgr->ts.meshes, id, rm);
 }
@@ -1,6 +1,8 @@
 #include <energycore/scene_asset.h>
 #include <string.h>
 #include <math.h>
+#include "mshproc.h"
+#include "idxopt.h"
 
 const quat4f identity_quat4f = {0, 0, 0, 1};
 const frame3f identity_frame3f = {{1,0,0}, {0,1,0}, {0,0,1}, {0,0,0}};
@@ -404,37 +406,6 @@ void scene_destroy(struct scene* s)
     free(s);
 }
 
-static vec3f vec3f_add(vec3f v1, vec3f v2){ return (vec3f){v1.x + v2.x, v1.y + v2.y, v1.z + v2.z}; }
-static vec3f vec3f_sub(vec3f v1, vec3f v2){ return (vec3f){v1.x - v2.x, v1.y - v2.y, v1.z - v2.z}; }
-static float vec3f_dot(vec3f a, vec3f b){ return a.x * b.x + a.y * b.y + a.z * b.z; }
-
-static vec3f vec3f_cross(vec3f v1, vec3f v2)
-{
-    return (vec3f){
-        (v1.y * v2.z) - (v1.z * v2.y),
-        (v1.z * v2.x) - (v1.x * v2.z),
-        (v1.x * v2.y) - (v1.y * v2.x)
-    };
-}
-
-static vec3f vec3f_normalize(vec3f v)
-{
-    float len = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-    return len == 0.f
-        ? (vec3f){0.f, 0.f, 0.f}
-        : (vec3f){v.x/len, v.y/len, v.z/len};
-}
-
-static vec3f vec3f_orthonormalize(vec3f a, vec3f b)
-{
-    float dot = vec3f_dot(a, b);
-    return vec3f_normalize((vec3f){
-        a.x - b.x * dot,
-        a.y - b.y * dot,
-        a.z - b.z * dot
-    });
-}
-
 void shape_compute_normals(struct shape* shp)
 {
     if (shp->norm)
@@ -442,39 +413,7 @@ void shape_compute_normals(struct shape* shp)
 
     shp->num_norm = shp->num_pos;
     shp->norm = calloc(shp->num_norm, sizeof(*shp->norm));
-    for (size_t i = 0; i < shp->num_triangles; ++i) {
-        vec3i tr = shp->triangles[i];
-        vec3f e1 = vec3f_sub(shp->pos[tr.y], shp->pos[tr.x]);
-        vec3f e2 = vec3f_sub(shp->pos[tr.z], shp->pos[tr.x]);
-        vec3f nm = vec3f_cross(e1, e2);
-        nm = vec3f_normalize(nm);
-        shp->norm[tr.x] = vec3f_add(shp->norm[tr.x], nm);
-        shp->norm[tr.y] = vec3f_add(shp->norm[tr.y], nm);
-        shp->norm[tr.z] = vec3f_add(shp->norm[tr.z], nm);
-    }
-
-    for (size_t i = 0; i < shp->num_norm; ++i)
-        shp->norm[i] = vec3f_normalize(shp->norm[i]);
-}
-
-static void triangle_tangents_from_uv(vec3f* tu, vec3f* tv, vec3f v[3], vec2f uv[3])
-{
-    vec3f p = vec3f_sub(v[1], v[0]);
-    vec3f q = vec3f_sub(v[2], v[0]);
-    vec2f s = {uv[1].x - uv[0].x, uv[2].x - uv[0].x};
-    vec2f t = {uv[1].y - uv[0].y, uv[2].y - uv[0].y};
-    float d = s.x * t.y - s.y * t.x;
-    if (d != 0.0) {
-        *tu = (vec3f){(t.y * p.x - t.x * q.x) / d,
-                      (t.y * p.y - t.x * q.y) / d,
-                      (t.y * p.z - t.x * q.z) / d};
-        *tv = (vec3f){(s.x * q.x - s.y * p.x) / d,
-                      (s.x * q.y - s.y * p.y) / d,
-                      (s.x * q.z - s.y * p.z) / d};
-    } else {
-        *tu = (vec3f){1, 0, 0};
-        *tv = (vec3f){0, 1, 0};
-    }
+    mshproc_normals(shp->norm, shp->pos, shp->num_pos, shp->triangles, shp->num_triangles, MSHPROC_WEIGHT_ANGLE);
 }
 
 /* Compute per-vertex tangent frame for triangle meshes.
@@ -484,46 +423,90 @@ static void triangle_tangents_from_uv(vec3f* tu, vec3f* tv, vec3f v[3], vec2f uv
  * Tangent frame is useful in normal mapping. */
 void shape_compute_tangent_frame(struct shape* shp)
 {
-    if (shp->tangsp)
+    if (shp->tangsp || !shp->texcoord || !shp->norm)
         return;
 
-    vec3f* tngu = calloc(shp->num_pos, sizeof(*tngu));
-    vec3f* tngv = calloc(shp->num_pos, sizeof(*tngv));
-    for (size_t i = 0; i < shp->num_triangles; ++i) {
-        vec3i tr = shp->triangles[i];
-        vec3f tu, tv;
-        triangle_tangents_from_uv(&tu, &tv,
-            (vec3f[]){shp->pos[tr.x],
-                      shp->pos[tr.y],
-                      shp->pos[tr.z]},
-            (vec2f[]){shp->texcoord[tr.x],
-                      shp->texcoord[tr.y],
-                      shp->texcoord[tr.z]});
-        tu = vec3f_normalize(tu);
-        tv = vec3f_normalize(tv);
-
-        tngu[tr.x] = vec3f_add(tngu[tr.x], tu);
-        tngu[tr.y] = vec3f_add(tngu[tr.y], tu);
-        tngu[tr.z] = vec3f_add(tngu[tr.z], tu);
-
-        tngv[tr.x] = vec3f_add(tngv[tr.x], tv);
-        tngv[tr.y] = vec3f_add(tngv[tr.y], tv);
-        tngv[tr.z] = vec3f_add(tngv[tr.z], tv);
-    }
-    for (size_t i = 0; i < shp->num_pos; ++i) {
-        tngu[i] = vec3f_normalize(tngu[i]);
-        tngv[i] = vec3f_normalize(tngv[i]);
-    }
-
     shp->num_tangsp = shp->num_pos;
     shp->tangsp = calloc(shp->num_tangsp, sizeof(*shp->tangsp));
-    for (size_t i = 0; i < shp->num_norm; ++i) {
-        vec3f nm = shp->norm[i], tu = tngu[i], tv = tngv[i];
-        tu = vec3f_orthonormalize(tu, nm);
-        float s = (vec3f_dot(vec3f_cross(nm, tu), tv) < 0) ? -1.0f : 1.0f;
-        shp->tangsp[i] = (vec4f){tu.x, tu.y, tu.z, s};
+    mshproc_tangents(shp->tangsp, shp->pos, shp->norm, shp->texcoord, shp->num_pos, shp->triangles, shp->num_triangles);
+}
+
+#define shape_remap_attrib(shp, attr, remap)                                               \
+    do {                                                                                   \
+        if ((shp)->num_##attr)                                                             \
+            idxopt_remap_buffer((shp)->attr, sizeof(*(shp)->attr), remap, (shp)->num_pos); \
+    } while (0)
+
+/* Attributes are either absent or indexed like positions */
+#define shape_attrib_per_vertex(shp, attr) ((shp)->num_##attr == 0 || (shp)->num_##attr == (shp)->num_pos)
+
+static int shape_attribs_per_vertex(const struct shape* shp)
+{
+    return shape_attrib_per_vertex(shp, norm)
+        && shape_attrib_per_vertex(shp, texcoord)
+        && shape_attrib_per_vertex(shp, texcoord1)
+        && shape_attrib_per_vertex(shp, color)
+        && shape_attrib_per_vertex(shp, radius)
+        && shape_attrib_per_vertex(shp, tangsp)
+        && shape_attrib_per_vertex(shp, skin_weights)
+        && shape_attrib_per_vertex(shp, skin_joints);
+}
+
+static void shape_remap_indices(int* idx, size_t num_idx, const unsigned int* remap)
+{
+    for (size_t i = 0; i < num_idx; ++i)
+        idx[i] = remap[idx[i]];
+}
+
+/* Reorder triangles for post transform cache locality and overdraw,
+ * then renumber vertices in first use order. The renumbering is skipped
+ * when an attribute is not indexed like positions, since it could not be
+ * permuted along. Records the simulated cache behavior before and after
+ * in stats, if given. */
+void shape_optimize_indices(struct shape* shp, struct shape_vcache_stats* stats)
+{
+    if (stats)
+        memset(stats, 0, sizeof(*stats));
+    if (shp->num_triangles == 0 || shp->num_quads_pos || shp->num_quads_norm || shp->num_quads_texcoord)
+        return;
+
+    size_t num_indices = shp->num_triangles * 3, num_verts = shp->num_pos;
+    unsigned int* indices = (unsigned int*)shp->triangles;
+    struct idxopt_stats before, after;
+    idxopt_analyze(&before, indices, num_indices, num_verts, IDXOPT_CACHE_SIZE);
+
+    unsigned int* tipsified = malloc(num_indices * sizeof(*tipsified));
+    unsigned int* clusters = malloc((shp->num_triangles + 1) * sizeof(*clusters));
+    size_t num_clusters = idxopt_tipsify(tipsified, indices, num_indices, num_verts, IDXOPT_CACHE_SIZE, clusters);
+    idxopt_overdraw(indices, tipsified, num_indices, shp->pos, num_verts, clusters, num_clusters,
+                    IDXOPT_CACHE_SIZE, IDXOPT_OVERDRAW_THRESHOLD);
+    free(clusters);
+    free(tipsified);
+
+    if (shape_attribs_per_vertex(shp)) {
+        unsigned int* remap = malloc(num_verts * sizeof(*remap));
+        idxopt_vfetch_remap(remap, indices, num_indices, num_verts);
+        shape_remap_attrib(shp, pos, remap);
+        shape_remap_attrib(shp, norm, remap);
+        shape_remap_attrib(shp, texcoord, remap);
+        shape_remap_attrib(shp, texcoord1, remap);
+        shape_remap_attrib(shp, color, remap);
+        shape_remap_attrib(shp, radius, remap);
+        shape_remap_attrib(shp, tangsp, remap);
+        shape_remap_attrib(shp, skin_weights, remap);
+        shape_remap_attrib(shp, skin_joints, remap);
+        shape_remap_indices(shp->points, shp->num_points, remap);
+        shape_remap_indices((int*)shp->lines, shp->num_lines * 2, remap);
+        shape_remap_indices((int*)shp->quads, shp->num_quads * 4, remap);
+        shape_remap_indices((int*)shp->beziers, shp->num_beziers * 4, remap);
+        free(remap);
     }
 
-    free(tngu);
-    free(tngv);
+    idxopt_analyze(&after, indices, num_indices, num_verts, IDXOPT_CACHE_SIZE);
+    if (stats) {
+        stats->num_tris = shp->num_triangles;
+        stats->num_verts = before.num_verts;
+        stats->misses_before = before.misses;
+        stats->misses_after = after.misses;
+    }
 }
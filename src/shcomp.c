@@ -2,6 +2,36 @@
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include "thrpool.h"
+
+/* Coefficients per texel in the basis table, padded to whole SIMD lanes */
+#define SH_TABLE_STRIDE 28
+/* Separately accumulated row ranges, fixed so sums are grouped the same on every machine */
+#define SH_NUM_PARTS 16
+
+/*-----------------------------------------------------------------
+ * 4 wide float lanes
+ *-----------------------------------------------------------------*/
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+typedef __m128 f4;
+#define f4_zero()         _mm_setzero_ps()
+#define f4_set1(x)        _mm_set1_ps(x)
+#define f4_load(p)        _mm_loadu_ps(p)
+#define f4_store(p, v)    _mm_storeu_ps(p, v)
+#define f4_add(a, b)      _mm_add_ps(a, b)
+#define f4_mul(a, b)      _mm_mul_ps(a, b)
+#else
+typedef struct { float v[4]; } f4;
+#define F4_OP(name, expr) \
+    static inline f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r; }
+F4_OP(f4_add, a.v[i] + b.v[i])
+F4_OP(f4_mul, a.v[i] * b.v[i])
+static inline f4 f4_set1(float x) { f4 r = {{x, x, x, x}}; return r; }
+static inline f4 f4_zero() { return f4_set1(0.0f); }
+static inline f4 f4_load(const float* p) { f4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void f4_store(float* p, f4 a) { memcpy(p, a.v, sizeof(a.v)); }
+#endif
 
 #define PI      3.1415926535897932384626433832795028841971693993751058
 #define PI4     12.566370614359172953850573533118011536788677597500423
@@ -48,7 +78,7 @@
 /* 3.0 * sqrt(35.0 / (4.0 * PI64)) */
 #define K18     0.62583573544
 
-void sh_eval_basis5(double* sh_basis, const float* dir)
+static void sh_eval_basis5(double* sh_basis, const float* dir)
 {
     const double x = (double)dir[0];
     const double y = (double)dir[1];
@@ -96,18 +126,6 @@ void sh_eval_basis5(double* sh_basis, const float* dir)
     sh_basis[24] = K18 * (x4 - 6.0 * y2 * x2 + y4);
 }
 
-/* Notice: faceSize should not be equal to one! */
-static float warp_fixup_factor(float face_size)
-{
-    /* Edge fixup. */
-    /* Based on Nvtt : http://code.google.com/p/nvidia-texture-tools/source/browse/trunk/src/nvtt/cube_surface.cpp */
-    if (face_size == 1.0f)
-        return 1.0f;
-    const float fs = face_size;
-    const float fsmo = fs - 1.0f;
-    return (fs * fs) / (fsmo * fsmo * fsmo);
-}
-
 /* http://www.mpia-hd.mpg.de/~mathar/public/mathar20051002.pdf */
 /* http://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/ */
 static float area_element(float x, float y) { return atan2f(x * y, sqrtf(x * x + y * y + 1.0f)); }
@@ -196,61 +214,169 @@ static void cm_texel_coord_to_vec(float* out3f, float u, float v, uint8_t face_i
     out3f[2] *= inv_len;
 }
 
-/* U and V should be center adressing and in [-1.0+invSize..1.0-invSize] range. */
-static void texel_coord_to_vec_warp(float* out3f, float u, float v, uint8_t face_id, float warp_fixup)
+/*-----------------------------------------------------------------
+ * Input decoding
+ *-----------------------------------------------------------------*/
+static inline float half_to_float(uint16_t h)
 {
-    u = (warp_fixup * u*u*u) + u;
-    v = (warp_fixup * v*v*v) + v;
-    cm_texel_coord_to_vec(out3f, u, v, face_id);
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t expo = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+    if (expo == 0x1F) {
+        /* Inf or NaN */
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else if (expo != 0) {
+        bits = sign | ((expo + 112) << 23) | (mant << 13);
+    } else {
+        /* Zero or subnormal, value is mant * 2^-24 */
+        float f = mant * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
 }
 
-void sh_coeffs(double sh_coeffs[SH_COEFF_NUM][3], void* data, size_t face_sz)
+static inline void fetch_rgb(float rgb[3], const void* data, size_t texel, enum sh_input_format fmt)
 {
-    const float texel_size = 1.0f / (float)face_sz;
-    const float warp = warp_fixup_factor(face_sz);
+    switch (fmt) {
+        case SH_INPUT_U8: {
+            const uint8_t* p = (const uint8_t*)data + texel * 3;
+            for (int c = 0; c < 3; ++c)
+                rgb[c] = p[c] * (1.0f / 255.0f);
+            break;
+        }
+        case SH_INPUT_HALF: {
+            const uint16_t* p = (const uint16_t*)data + texel * 3;
+            for (int c = 0; c < 3; ++c)
+                rgb[c] = half_to_float(p[c]);
+            break;
+        }
+        case SH_INPUT_FLOAT:
+        default:
+            memcpy(rgb, (const float*)data + texel * 3, 3 * sizeof(float));
+            break;
+    }
+}
 
-    memset(sh_coeffs, 0, SH_COEFF_NUM * 3 * sizeof(double));
+/*-----------------------------------------------------------------
+ * Basis table
+ *-----------------------------------------------------------------*/
+static void table_rows(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct sh_table* t = userdata;
+    const size_t fs = t->face_sz;
+    const float texel_size = 1.0f / (float)fs;
+    for (size_t row = begin; row < end; ++row) {
+        uint8_t face = row / fs;
+        size_t y = row % fs;
+        for (size_t x = 0; x < fs; ++x) {
+            /* Texel center mapped to [-1, 1] */
+            const float v = 2.0f * ((y + 0.5f) * texel_size) - 1.0f;
+            const float u = 2.0f * ((x + 0.5f) * texel_size) - 1.0f;
+            float dir[3];
+            cm_texel_coord_to_vec(dir, u, v, face);
+            const double weight = texel_solid_angle(u, v, texel_size);
+            double sh_basis[SH_COEFF_NUM];
+            sh_eval_basis5(sh_basis, dir);
+            float* dst = t->basis + (row * fs + x) * SH_TABLE_STRIDE;
+            for (unsigned int k = 0; k < SH_TABLE_STRIDE; ++k)
+                dst[k] = k < SH_COEFF_NUM ? (float)(sh_basis[k] * weight) : 0.0f;
+        }
+    }
+}
+
+void sh_table_init(struct sh_table* t, size_t face_sz)
+{
+    t->face_sz = face_sz;
+    t->basis = malloc(6 * face_sz * face_sz * SH_TABLE_STRIDE * sizeof(float));
+    thrpool_parallel_for(thrpool_default(), 6 * face_sz, 16, table_rows, t);
+    /* Normalization, usually 4 * PI - weight sum is ~0.000003 so it hardly changes anything */
     double weight_accum = 0.0;
-    for (int face = 0; face < 6; ++face) {
-        for (size_t ydst = 0; ydst < face_sz; ++ydst) {
-            for (size_t xdst = 0; xdst < face_sz; ++xdst) {
-                /* Current destination pixel location */
-                /* Map value to [-1, 1], offset by 0.5 to point to texel center */
-                const float v = 2.0f * ((ydst + 0.5f) * texel_size) - 1.0f;
-                const float u = 2.0f * ((xdst + 0.5f) * texel_size) - 1.0f;
-                /* Get sampling vector for the above u, v set */
-                float dir[3];
-                texel_coord_to_vec_warp(dir, u, v, face, warp);
-                /* Get solid angle for u, v set */
-                float solid_angle = texel_solid_angle(u, v, texel_size);
-                /* Current pixel values */
-                uint8_t* src_ptr = data + (face * face_sz * face_sz + ydst * face_sz + xdst) * 3;
-                const double rr = (double)src_ptr[0] / 255.0;
-                const double gg = (double)src_ptr[1] / 255.0;
-                const double bb = (double)src_ptr[2] / 255.0;
-                /* Calculate SH Basis */
-                double sh_basis[SH_COEFF_NUM];
-                sh_eval_basis5(sh_basis, dir);
-                const double weight = (double)solid_angle;
-                for (uint8_t ii = 0; ii < SH_COEFF_NUM; ++ii) {
-                    sh_coeffs[ii][0] += rr * sh_basis[ii] * weight;
-                    sh_coeffs[ii][1] += gg * sh_basis[ii] * weight;
-                    sh_coeffs[ii][2] += bb * sh_basis[ii] * weight;
-                }
-                weight_accum += weight;
-            }
+    const float texel_size = 1.0f / (float)face_sz;
+    for (size_t y = 0; y < face_sz; ++y) {
+        for (size_t x = 0; x < face_sz; ++x) {
+            const float v = 2.0f * ((y + 0.5f) * texel_size) - 1.0f;
+            const float u = 2.0f * ((x + 0.5f) * texel_size) - 1.0f;
+            weight_accum += texel_solid_angle(u, v, texel_size);
         }
     }
+    t->norm = PI4 / (6.0 * weight_accum);
+}
+
+void sh_table_destroy(struct sh_table* t)
+{
+    free(t->basis);
+    t->basis = 0;
+}
+
+/*-----------------------------------------------------------------
+ * Projection
+ *-----------------------------------------------------------------*/
+struct project_job {
+    const struct sh_table* t;
+    const void* data;
+    enum sh_input_format fmt;
+    size_t num_rows, num_parts;
+    double sums[SH_NUM_PARTS][SH_COEFF_NUM][3];
+};
 
-    /*
-     * Normalization.
-     * This is not really necesarry because usually PI*4 - weightAccum ~= 0.000003
-     * so it doesn't change almost anything, but it doesn't cost much be more correct.
-     */
-    const double norm = PI4 / weight_accum;
-    for (uint8_t ii = 0; ii < SH_COEFF_NUM; ++ii) {
-        sh_coeffs[ii][0] *= norm;
-        sh_coeffs[ii][1] *= norm;
-        sh_coeffs[ii][2] *= norm;
+static void project_parts(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct project_job* job = userdata;
+    const size_t fs = job->t->face_sz;
+    for (size_t part = begin; part < end; ++part) {
+        size_t row_begin = job->num_rows * part / job->num_parts;
+        size_t row_end = job->num_rows * (part + 1) / job->num_parts;
+        /* Every texel adds its color times the weighted basis row, 4 coefficients per lane */
+        f4 acc[3][SH_TABLE_STRIDE / 4];
+        for (int c = 0; c < 3; ++c)
+            for (int k = 0; k < SH_TABLE_STRIDE / 4; ++k)
+                acc[c][k] = f4_zero();
+        for (size_t texel = row_begin * fs; texel < row_end * fs; ++texel) {
+            float rgb[3];
+            fetch_rgb(rgb, job->data, texel, job->fmt);
+            const float* basis = job->t->basis + texel * SH_TABLE_STRIDE;
+            f4 r = f4_set1(rgb[0]), g = f4_set1(rgb[1]), b = f4_set1(rgb[2]);
+            for (int k = 0; k < SH_TABLE_STRIDE / 4; ++k) {
+                f4 w = f4_load(basis + 4 * k);
+                acc[0][k] = f4_add(acc[0][k], f4_mul(r, w));
+                acc[1][k] = f4_add(acc[1][k], f4_mul(g, w));
+                acc[2][k] = f4_add(acc[2][k], f4_mul(b, w));
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            float lanes[SH_TABLE_STRIDE];
+            for (int k = 0; k < SH_TABLE_STRIDE / 4; ++k)
+                f4_store(lanes + 4 * k, acc[c][k]);
+            for (int k = 0; k < SH_COEFF_NUM; ++k)
+                job->sums[part][k][c] = lanes[k];
+        }
     }
 }
+
+void sh_project(double sh_coeffs[SH_COEFF_NUM][3], const struct sh_table* t, const void* data, enum sh_input_format fmt)
+{
+    struct project_job* job = malloc(sizeof(*job));
+    job->t = t;
+    job->data = data;
+    job->fmt = fmt;
+    job->num_rows = 6 * t->face_sz;
+    /* Row ranges short enough for float accumulation, independent of the pool size */
+    job->num_parts = job->num_rows < SH_NUM_PARTS ? job->num_rows : SH_NUM_PARTS;
+    thrpool_parallel_for(thrpool_default(), job->num_parts, 1, project_parts, job);
+
+    /* Sum ranges in order and normalize */
+    memset(sh_coeffs, 0, SH_COEFF_NUM * 3 * sizeof(double));
+    for (size_t p = 0; p < job->num_parts; ++p)
+        for (unsigned int k = 0; k < SH_COEFF_NUM; ++k)
+            for (unsigned int c = 0; c < 3; ++c)
+                sh_coeffs[k][c] += job->sums[p][k][c];
+    for (unsigned int k = 0; k < SH_COEFF_NUM; ++k)
+        for (unsigned int c = 0; c < 3; ++c)
+            sh_coeffs[k][c] *= t->norm;
+    free(job);
+}
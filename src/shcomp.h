@@ -33,7 +33,36 @@
 
 #include <stdlib.h>
 
+/*
+ * CPU spherical harmonics projection
+ * Texel directions, solid angles and basis values depend only on the face size,
+ * so they are computed once into a table shared by every projection. Texel rows
+ * are split in a fixed number of contiguous ranges processed in parallel on the
+ * default thread pool, each accumulating 4 coefficients at a time in SIMD lanes.
+ * Ranges are then summed in order, and their number depends only on the face size,
+ * so results do not depend on thread scheduling or on the machine's core count.
+ */
+
 #define SH_COEFF_NUM 25
-void sh_coeffs(double sh_coeffs[SH_COEFF_NUM][3], void* data, size_t face_sz);
+
+/* Channel type of the RGB cubemap input, faces are packed in +x, -x, +y, -y, +z, -z order */
+enum sh_input_format {
+    SH_INPUT_U8,
+    SH_INPUT_HALF,
+    SH_INPUT_FLOAT
+};
+
+/* Solid angle weighted basis values of every texel of a cubemap with the given face size */
+struct sh_table {
+    size_t face_sz;
+    float* basis;
+    /* Scale bringing the summed texel solid angles to the full sphere */
+    double norm;
+};
+
+void sh_table_init(struct sh_table* t, size_t face_sz);
+void sh_table_destroy(struct sh_table* t);
+/* Projects a cubemap of the table's face size onto SH */
+void sh_project(double sh_coeffs[SH_COEFF_NUM][3], const struct sh_table* t, const void* data, enum sh_input_format fmt);
 
 #endif /* ! _SHCOMP_H_ */
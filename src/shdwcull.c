@@ -0,0 +1,138 @@
+#include "shdwcull.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "thrpool.h"
+#include "dcache.h"
+
+/* Shape slots reserved per object, matches render_mesh capacity */
+#define SHDWCULL_MAX_SHAPES 16
+/* Objects per thread pool task */
+#define SHDWCULL_GRAIN 16
+
+struct shdwcull_job {
+    struct shdwcull_state* st;
+    struct shadowmap* sm;
+    struct resmgr* rmgr;
+    struct render_object* objs;
+};
+
+
+void shdwcull_init(struct shdwcull_state* st)
+{
+    memset(st, 0, sizeof(*st));
+}
+
+/* Tight axis aligned bounds of a transformed box, from its center and half extents */
+static void transform_box(mat4 m, vec3 c, vec3 e, vec3* out_min, vec3* out_max)
+{
+    vec3 tc = mat4_mul_vec3(m, c);
+    vec3 te = vec3_new(
+        fabsf(m.xx) * e.x + fabsf(m.xy) * e.y + fabsf(m.xz) * e.z,
+        fabsf(m.yx) * e.x + fabsf(m.yy) * e.y + fabsf(m.yz) * e.z,
+        fabsf(m.zx) * e.x + fabsf(m.zy) * e.y + fabsf(m.zz) * e.z);
+    *out_min = vec3_sub(tc, te);
+    *out_max = vec3_add(tc, te);
+}
+
+static void classify_objects(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct shdwcull_job* job = userdata;
+    struct shadowmap* sm = job->sm;
+    for (size_t i = begin; i < end; ++i) {
+        struct render_object* ro = &job->objs[i];
+        struct render_mesh* rmsh = resmgr_get_mesh(job->rmgr, ro->mesh);
+        unsigned char* masks = job->st->masks + i * SHDWCULL_MAX_SHAPES;
+        /* Objects whose mesh is gone cast nothing */
+        if (!rmsh)
+            continue;
+        mat4 light_model[SHADOWMAP_MAX_SPLITS];
+        for (unsigned int s = 0; s < sm->num_splits; ++s)
+            light_model[s] = mat4_mul_mat4(sm->sd[s].view_mat, *(mat4*)ro->model_mat);
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            struct render_shape* rsh = &rmsh->shapes[j];
+            vec3 bmin = *(vec3*)rsh->bb_min, bmax = *(vec3*)rsh->bb_max;
+            vec3 c = vec3_mul(vec3_add(bmin, bmax), 0.5f);
+            vec3 e = vec3_mul(vec3_sub(bmax, bmin), 0.5f);
+            unsigned char mask = 0;
+            for (unsigned int s = 0; s < sm->num_splits; ++s) {
+                vec3 lmin, lmax;
+                transform_box(light_model[s], c, e, &lmin, &lmax);
+                vec3 rmin = sm->sd[s].recv_min, rmax = sm->sd[s].recv_max;
+                /* Light looks down -z, so larger z is closer to the light */
+                if (lmax.x < rmin.x || lmin.x > rmax.x
+                 || lmax.y < rmin.y || lmin.y > rmax.y
+                 || lmax.z < rmin.z)
+                    continue;
+                float size = fmaxf(lmax.x - lmin.x, lmax.y - lmin.y) * sm->sd[s].texels_per_unit;
+                if (size < SHDWCULL_MIN_TEXELS)
+                    continue;
+                mask |= 1 << s;
+            }
+            masks[j] = mask;
+        }
+    }
+}
+
+void shdwcull_run(struct shdwcull_state* st, struct shadowmap* sm, struct resmgr* rmgr,
+                  struct render_object* objs, unsigned int num_objs)
+{
+    size_t num_masks = num_objs * SHDWCULL_MAX_SHAPES;
+    if (num_masks > st->cap_masks) {
+        st->cap_masks = num_masks;
+        st->masks = realloc(st->masks, st->cap_masks);
+    }
+    if (num_masks > st->cap_casters) {
+        st->cap_casters = num_masks;
+        for (unsigned int s = 0; s < SHADOWMAP_MAX_SPLITS; ++s)
+            st->casters[s] = realloc(st->casters[s], st->cap_casters * sizeof(*st->casters[s]));
+        st->all_casters = realloc(st->all_casters, st->cap_casters * sizeof(*st->all_casters));
+    }
+
+    /* Classify */
+    struct shdwcull_job job = { .st = st, .sm = sm, .rmgr = rmgr, .objs = objs };
+    thrpool_parallel_for(thrpool_default(), num_objs, SHDWCULL_GRAIN, classify_objects, &job);
+
+    /* Gather lists */
+    memset(st->num_casters, 0, sizeof(st->num_casters));
+    st->num_all_casters = 0;
+    st->dynamic_mask = 0;
+    for (unsigned int s = 0; s < sm->num_splits; ++s)
+        st->static_sigs[s] = DCACHE_HASH_SEED;
+    for (unsigned int i = 0; i < num_objs; ++i) {
+        struct render_object* ro = &objs[i];
+        struct render_mesh* rmsh = resmgr_get_mesh(rmgr, ro->mesh);
+        if (!rmsh)
+            continue;
+        const unsigned char* masks = st->masks + i * SHDWCULL_MAX_SHAPES;
+        for (unsigned int j = 0; j < rmsh->num_shapes; ++j) {
+            if (!masks[j])
+                continue;
+            struct shdwcull_caster c = { .obj = i, .shape = j, .mask = masks[j], .dynamic = !!ro->dynamic };
+            st->all_casters[st->num_all_casters++] = c;
+            if (c.dynamic)
+                st->dynamic_mask |= c.mask;
+            for (unsigned int s = 0; s < sm->num_splits; ++s) {
+                if (!(masks[j] & (1 << s)))
+                    continue;
+                st->casters[s][st->num_casters[s]++] = c;
+                if (!c.dynamic) {
+                    unsigned long long h = st->static_sigs[s];
+                    unsigned long long key[3] = { ro->mesh.index, ro->mesh.generation, j };
+                    h = dcache_hash(h, key, sizeof(key));
+                    h = dcache_hash(h, ro->model_mat, sizeof(ro->model_mat));
+                    st->static_sigs[s] = h;
+                }
+            }
+        }
+    }
+}
+
+void shdwcull_destroy(struct shdwcull_state* st)
+{
+    for (unsigned int s = 0; s < SHADOWMAP_MAX_SPLITS; ++s)
+        free(st->casters[s]);
+    free(st->all_casters);
+    free(st->masks);
+}
@@ -0,0 +1,79 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _SHDWCULL_H_
+#define _SHDWCULL_H_
+
+#include <energycore/renderer.h>
+#include "shdwmap.h"
+
+/*
+ * Shadow caster culling
+ * Every object shape is classified against all cascades in a single parallel
+ * pass. Shape boxes are taken to each cascade's light space and kept when they
+ * overlap the receivers laterally and are not entirely behind them, which is the
+ * cascade frustum extruded towards the light. Casters smaller than a texel of the
+ * cascade are dropped. Survivors are gathered into per cascade caster lists, and
+ * into one list tagged with cascade masks for single pass layered rendering.
+ * Static casters of each cascade are hashed, so that cached shadows can tell
+ * when the set of static casters or their placement changed.
+ */
+#define SHDWCULL_MIN_TEXELS 1.0f
+
+struct shdwcull_caster {
+    unsigned int obj, shape;
+    /* Cascades the caster is kept in */
+    unsigned int mask;
+    unsigned int dynamic;
+};
+
+struct shdwcull_state {
+    /* Cascade bit mask per object shape */
+    unsigned char* masks;
+    size_t cap_masks;
+    /* Caster lists per cascade */
+    struct shdwcull_caster* casters[SHADOWMAP_MAX_SPLITS];
+    size_t num_casters[SHADOWMAP_MAX_SPLITS];
+    /* Casters of any cascade, for single pass rendering */
+    struct shdwcull_caster* all_casters;
+    size_t num_all_casters;
+    size_t cap_casters;
+    /* Hash of the static casters per cascade, and cascades with dynamic casters */
+    unsigned long long static_sigs[SHADOWMAP_MAX_SPLITS];
+    unsigned int dynamic_mask;
+};
+
+void shdwcull_init(struct shdwcull_state* st);
+/* Builds the caster lists of all cascades, split data of the shadowmap must be up to date */
+void shdwcull_run(struct shdwcull_state* st, struct shadowmap* sm, struct resmgr* rmgr,
+                  struct render_object* objs, unsigned int num_objs);
+void shdwcull_destroy(struct shdwcull_state* st);
+
+#endif /* ! _SHDWCULL_H_ */
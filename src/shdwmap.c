@@ -9,12 +9,13 @@
 #define GLSRCEXT(src) "#version 330 core\n" \
                       "#extension GL_ARB_gpu_shader5 : enable\n" \
                       #src
+#define GLSRCBODY(src) #src
 
 static const char* vs_src = GLSRCEXT(
 layout (location = 0) in vec3 position;
+layout (location = 4) in mat4 model;
 
 uniform mat4 light_vp_mats[4];
-uniform mat4 model;
 uniform int layer;
 
 void main()
@@ -23,42 +24,154 @@ void main()
 }
 );
 
-void shadowmap_init(struct shadowmap* sm, int width, int height)
+/* Single pass variant, each instance carries the mask of the cascades it casts into
+ * and geometry shader invocations route its triangles to the matching atlas viewports */
+static const char* layered_vs_src = GLSRCEXT(
+layout (location = 0) in vec3 position;
+layout (location = 4) in mat4 model;
+layout (location = 8) in uint cascade_mask;
+
+out VS_OUT {
+    flat uint cascade_mask;
+} vs_out;
+
+void main()
 {
-    memset(sm, 0, sizeof(*sm));
-    sm->width = width;
-    sm->height = height;
-    sm->glh.shdr = shader_from_srcs(vs_src, 0, 0);
+    vs_out.cascade_mask = cascade_mask;
+    gl_Position = model * vec4(position, 1.0f);
+}
+);
+
+/* Compiled once per split count, so the invocation count matches the configured cascades */
+static const char* layered_gs_src = GLSRCBODY(
+layout (triangles, invocations = NUM_SPLITS) in;
+layout (triangle_strip, max_vertices = 3) out;
 
-    /* Create texture array that will hold the shadow maps */
-    GLuint depth_tex;
-    glGenTextures(1, &depth_tex);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, depth_tex);
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, width, height, SHADOWMAP_NSPLITS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_GEQUAL);
+in VS_OUT {
+    flat uint cascade_mask;
+} gs_in[];
+
+uniform mat4 light_vp_mats[NUM_SPLITS];
+
+void main()
+{
+    if ((gs_in[0].cascade_mask & (1u << uint(gl_InvocationID))) == 0u)
+        return;
+    for (int i = 0; i < 3; ++i) {
+        gl_ViewportIndex = gl_InvocationID;
+        gl_Position = light_vp_mats[gl_InvocationID] * gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+);
+
+static unsigned int layered_shader(unsigned int num_splits)
+{
+    char gs_buf[1024];
+    snprintf(gs_buf, sizeof(gs_buf), "#version 410 core\n#define NUM_SPLITS %u\n%s", num_splits, layered_gs_src);
+    return shader_from_srcs(layered_vs_src, gs_buf, 0);
+}
+
+static unsigned int atlas_texture(unsigned int width, unsigned int height)
+{
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_GEQUAL);
     GLfloat border_col[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_col);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_col);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+}
+
+void shadowmap_init(struct shadowmap* sm)
+{
+    memset(sm, 0, sizeof(*sm));
+    sm->glh.shdr = shader_from_srcs(vs_src, 0, 0);
 
-    /* Prepare framebuffer */
+    /* Prepare framebuffer, atlas textures are attached when rendering */
     GLuint fbo;
     glGenFramebuffers(1, &fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_tex, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    /* Store handles */
-    sm->glh.tex_id = depth_tex;
     sm->glh.fbo_id = fbo;
 }
 
+/* Shelf packs the splits largest first into rows as wide as the two largest ones */
+static void shadowmap_pack_atlas(struct shadowmap* sm)
+{
+    unsigned int order[SHADOWMAP_MAX_SPLITS];
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        unsigned int j = i;
+        for (; j > 0 && sm->split_res[order[j - 1]] < sm->split_res[i]; --j)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    unsigned int width = sm->split_res[order[0]];
+    if (sm->num_splits > 1)
+        width += sm->split_res[order[1]];
+    unsigned int x = 0, y = 0, row_height = 0;
+    for (unsigned int k = 0; k < sm->num_splits; ++k) {
+        unsigned int i = order[k], size = sm->split_res[i];
+        if (x + size > width) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+        sm->sd[i].x = x;
+        sm->sd[i].y = y;
+        sm->sd[i].size = size;
+        x += size;
+        row_height = row_height > size ? row_height : size;
+    }
+    sm->width = width;
+    sm->height = y + row_height;
+}
+
+void shadowmap_configure(struct shadowmap* sm, unsigned int num_splits, const unsigned int split_res[],
+                         float split_lambda, float distance)
+{
+    /* Split placement follows from the scheme every update */
+    sm->split_lambda = split_lambda;
+    sm->distance = distance;
+
+    num_splits = num_splits < 1 ? 1 : (num_splits > SHADOWMAP_MAX_SPLITS ? SHADOWMAP_MAX_SPLITS : num_splits);
+    unsigned int res[SHADOWMAP_MAX_SPLITS] = {0};
+    for (unsigned int i = 0; i < num_splits; ++i)
+        res[i] = split_res[i] < 16 ? 16 : split_res[i];
+    if (num_splits == sm->num_splits && memcmp(res, sm->split_res, sizeof(res)) == 0)
+        return;
+
+    /* Specialize the single pass program to the split count */
+    if (num_splits != sm->num_splits) {
+        if (sm->glh.layered_shdr)
+            glDeleteProgram(sm->glh.layered_shdr);
+        sm->glh.layered_shdr = layered_shader(num_splits);
+    }
+    sm->num_splits = num_splits;
+    memcpy(sm->split_res, res, sizeof(res));
+
+    /* Repack and reallocate the atlas that holds the shadow maps and the one for cached static casters */
+    unsigned int prev_width = sm->width, prev_height = sm->height;
+    shadowmap_pack_atlas(sm);
+    if (sm->width != prev_width || sm->height != prev_height) {
+        glDeleteTextures(1, &sm->glh.static_tex_id);
+        glDeleteTextures(1, &sm->glh.tex_id);
+        sm->glh.tex_id = atlas_texture(sm->width, sm->height);
+        sm->glh.static_tex_id = atlas_texture(sm->width, sm->height);
+    }
+    shadowmap_cache_invalidate(sm);
+}
+
 /* From the source code it is:
  * const float tan_half_fovy = tan(fovy / 2.0f);
  * result[1][1] = 1.0f / tan_half_fovy; */
@@ -99,7 +212,7 @@ static void extract_near_far_from_projection(float proj[4][4], float* near_z, fl
 /* Lerp */
 static float mix(float x, float y, float a) { return x * (1.0 - a) + y * a; }
 
-static void shadowmap_setup_splits(struct shadowmap* sm, float light_pos[3], float view[16], float proj[16])
+void shadowmap_update(struct shadowmap* sm, float light_pos[3], float view[16], float proj[16])
 {
     /* Get projection properties */
     const float camera_fov    = extract_fov_from_projection((float(*)[4])proj);
@@ -108,14 +221,12 @@ static void shadowmap_setup_splits(struct shadowmap* sm, float light_pos[3], flo
     extract_near_far_from_projection((float(*)[4])proj, &camera_near, &camera_far);
     /* Calculate inverse view matrix */
     mat4 inv_view = mat4_inverse(*(mat4*)view);
-    /* Override camera far value */
-    camera_far = 100.0f; /* TODO */
+    /* Shadows end at the configured distance */
+    camera_far = fminf(camera_far, sm->distance);
 
-    /* Clear previous split values */
-    memset(&sm->sd, 0, sizeof(sm->sd));
     /* Calculate split data */
-    const float split_lambda = 0.8f;
-    const unsigned int split_num = SHADOWMAP_NSPLITS;
+    const float split_lambda = sm->split_lambda;
+    const unsigned int split_num = sm->num_splits;
     for (unsigned int i = 0; i < split_num; ++i) {
         /* Find the split planes using GPU Gem 3. Chap 10 "Practical Split Scheme". */
         float split_near = i > 0
@@ -140,7 +251,7 @@ static void shadowmap_setup_splits(struct shadowmap* sm, float light_pos[3], flo
         /* Calculate frustum bounding sphere, light direction and texels per unit values */
         sphere fbsh = sphere_of_frustum(f);
         vec3 light_dir = vec3_neg(vec3_normalize(*(vec3*)light_pos));
-        float texels_per_unit = sm->width / (fbsh.radius * 2.0f);
+        float texels_per_unit = sm->sd[i].size / (fbsh.radius * 2.0f);
 
         /* - Texel snapping -
          * Create a helper view matrix that will move
@@ -166,6 +277,15 @@ static void shadowmap_setup_splits(struct shadowmap* sm, float light_pos[3], flo
         float far_z = -radius * 4.0f;
         mat4 proj_mat = mat4_orthographic(-radius, radius, -radius, radius, near_z, far_z);
 
+        /* Bound receivers in light space, casters may lie anywhere towards the light from them */
+        vec3 recv_min = vec3_new( INFINITY,  INFINITY,  INFINITY);
+        vec3 recv_max = vec3_new(-INFINITY, -INFINITY, -INFINITY);
+        for (unsigned int k = 0; k < 8; ++k) {
+            vec3 p = mat4_mul_vec3(view_mat, ((vec3*)&f)[k]);
+            recv_min = vec3_min(recv_min, p);
+            recv_max = vec3_max(recv_max, p);
+        }
+
         /* Save matrices and planes */
         sm->sd[i].proj_mat = proj_mat;
         sm->sd[i].view_mat = view_mat;
@@ -173,75 +293,125 @@ static void shadowmap_setup_splits(struct shadowmap* sm, float light_pos[3], flo
         sm->sd[i].plane = vec2_new(split_near, split_far);
         sm->sd[i].near_plane = near_z;
         sm->sd[i].far_plane = far_z;
+        sm->sd[i].recv_min = recv_min;
+        sm->sd[i].recv_max = recv_max;
+        sm->sd[i].texels_per_unit = texels_per_unit;
     }
 }
 
-void shadowmap_render_begin(struct shadowmap* sm, float light_pos[3], float view[16], float proj[16])
+static void shadowmap_upload_vp_mats(struct shadowmap* sm, unsigned int shdr)
 {
-    /* Calculate split data */
-    shadowmap_setup_splits(sm, light_pos, view, proj);
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        GLint uloc = 0;
+        char* uname_buf[64];
+        /* Light view projection matrix */
+        snprintf((char*)uname_buf, sizeof(uname_buf), "light_vp_mats[%u]", i);
+        uloc = glGetUniformLocation(shdr, (const char*)uname_buf);
+        mat4 lvp = mat4_mul_mat4(sm->sd[i].proj_mat, sm->sd[i].view_mat);
+        glUniformMatrix4fv(uloc, 1, GL_FALSE, lvp.m);
+    }
+}
+
+unsigned int shadowmap_cache_refresh(struct shadowmap* sm, const unsigned long long static_sigs[SHADOWMAP_MAX_SPLITS])
+{
+    unsigned int stale = 0;
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        /* Light direction and snapped center changes both show up in the shadow matrix */
+        int valid = (sm->cache.valid & (1 << i))
+                 && memcmp(&sm->cache.shdw_mat[i], &sm->sd[i].shdw_mat, sizeof(mat4)) == 0
+                 && sm->cache.static_sigs[i] == static_sigs[i];
+        if (valid)
+            continue;
+        stale |= 1 << i;
+        sm->cache.shdw_mat[i] = sm->sd[i].shdw_mat;
+        sm->cache.static_sigs[i] = static_sigs[i];
+    }
+    sm->cache.valid = (1 << sm->num_splits) - 1;
+    sm->cache.composited &= ~stale;
+    return stale;
+}
+
+void shadowmap_cache_invalidate(struct shadowmap* sm)
+{
+    sm->cache.valid = 0;
+    sm->cache.composited = 0;
+}
+
+void shadowmap_composite(struct shadowmap* sm, unsigned int dynamic_mask)
+{
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        if (sm->cache.composited & (1 << i))
+            continue;
+        unsigned int x = sm->sd[i].x, y = sm->sd[i].y, size = sm->sd[i].size;
+        glCopyImageSubData(sm->glh.static_tex_id, GL_TEXTURE_2D, 0, x, y, 0,
+                           sm->glh.tex_id, GL_TEXTURE_2D, 0, x, y, 0,
+                           size, size, 1);
+    }
+    /* Regions that receive dynamic casters no longer match the cache */
+    sm->cache.composited = ((1 << sm->num_splits) - 1) & ~dynamic_mask;
+}
 
+void shadowmap_render_begin(struct shadowmap* sm, enum shadowmap_target target, unsigned int clear_mask)
+{
     /* Enable depth testing (duh!) */
     glEnable(GL_DEPTH_TEST);
+    /* Casters in front of the near plane are flattened onto it instead of clipped */
+    glEnable(GL_DEPTH_CLAMP);
 
     /* Store previous viewport and set the new one */
     GLint* viewport = sm->rs.prev_vp;
     glGetIntegerv(GL_VIEWPORT, viewport);
     glViewport(0, 0, sm->width, sm->height);
+    /* Splits share the atlas, keep clears and rasterization inside their regions */
+    glEnable(GL_SCISSOR_TEST);
 
-    /* Store previous fbo and bind shadow map fbo */
+    /* Store previous fbo and bind shadow map fbo with the target atlas */
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*)&sm->rs.prev_fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, sm->glh.fbo_id);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    sm->rs.target_tex = target == SHADOWMAP_TARGET_STATIC ? sm->glh.static_tex_id : sm->glh.tex_id;
+    sm->rs.clear_mask = clear_mask;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sm->rs.target_tex, 0);
 
     /* Setup uniforms */
     GLuint shdr = sm->glh.shdr;
     glUseProgram(shdr);
-    for (int i = 0; i < SHADOWMAP_NSPLITS; ++i) {
-        GLint uloc = 0;
-        char* uname_buf[64];
-        /* Light view projection matrix */
-        snprintf((char*)uname_buf, sizeof(uname_buf), "light_vp_mats[%u]", i);
-        uloc = glGetUniformLocation(shdr, (const char*)uname_buf);
-        mat4 lvp = mat4_mul_mat4(sm->sd[i].proj_mat, sm->sd[i].view_mat);
-        glUniformMatrix4fv(uloc, 1, GL_FALSE, lvp.m);
-    }
+    shadowmap_upload_vp_mats(sm, shdr);
 
     /* Set cull face mode to front
      * in order to improve peter panning issues on solid objects */
     glCullFace(GL_FRONT);
 }
 
-static inline vec4 plane_from_points(vec3 p1, vec3 p2, vec3 p3)
-{
-    vec3 e1 = vec3_sub(p2, p1);
-    vec3 e2 = vec3_sub(p3, p1);
-    vec3 normal = vec3_normalize(vec3_cross(e1, e2));
-    float constant = -vec3_dot(p1, normal);
-    return vec4_new(normal.x, normal.y, normal.z, constant);
-}
-
-static inline void points_planes_from_mat(vec3 fru_pts[8], vec4 fru_planes[6], mat4 m)
+void shadowmap_render_layered_begin(struct shadowmap* sm, enum shadowmap_target target, unsigned int clear_mask)
 {
-    frustum f = frustum_new_clipbox();
-    f = frustum_transform(f, mat4_inverse(m));
-    memcpy(fru_pts, &f, sizeof(vec3) * 8);
-    /* [0]: ntr, [1]: ntl, [2]: nbr, [3]: nbl, [4]: ftr, [5]: ftl, [6]: fbr, [7]: fbl */
-    fru_planes[0] = plane_from_points(fru_pts[0], fru_pts[4], fru_pts[1]); /* Top */
-    fru_planes[1] = plane_from_points(fru_pts[2], fru_pts[3], fru_pts[6]); /* Bottom */
-    fru_planes[2] = plane_from_points(fru_pts[1], fru_pts[5], fru_pts[3]); /* Left */
-    fru_planes[3] = plane_from_points(fru_pts[0], fru_pts[2], fru_pts[4]); /* Right */
-    fru_planes[4] = plane_from_points(fru_pts[4], fru_pts[6], fru_pts[5]); /* Far */
-    fru_planes[5] = plane_from_points(fru_pts[0], fru_pts[1], fru_pts[2]); /* Near */
+    shadowmap_render_begin(sm, target, clear_mask);
+    /* Clear requested regions, then give every split its own viewport and scissor box */
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        unsigned int x = sm->sd[i].x, y = sm->sd[i].y, size = sm->sd[i].size;
+        if (clear_mask & (1 << i)) {
+            glScissor(x, y, size, size);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    }
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
+        unsigned int x = sm->sd[i].x, y = sm->sd[i].y, size = sm->sd[i].size;
+        glViewportIndexedf(i, x, y, size, size);
+        glScissorIndexed(i, x, y, size, size);
+    }
+    GLuint shdr = sm->glh.layered_shdr;
+    glUseProgram(shdr);
+    shadowmap_upload_vp_mats(sm, shdr);
 }
 
-void shadowmap_render_split_begin(struct shadowmap* sm, unsigned int split, vec3 fru_pts[8], vec4 fru_planes[6])
+void shadowmap_render_split_begin(struct shadowmap* sm, unsigned int split)
 {
-    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, sm->glh.tex_id, 0, split);
-    glClear(GL_DEPTH_BUFFER_BIT);
+    unsigned int x = sm->sd[split].x, y = sm->sd[split].y, size = sm->sd[split].size;
+    glViewport(x, y, size, size);
+    glScissor(x, y, size, size);
+    if (sm->rs.clear_mask & (1 << split))
+        glClear(GL_DEPTH_BUFFER_BIT);
     GLuint shdr = sm->glh.shdr;
     glUniform1i(glGetUniformLocation(shdr, "layer"), split);
-    points_planes_from_mat(fru_pts, fru_planes, sm->sd[split].shdw_mat);
 }
 
 void shadowmap_render_split_end(struct shadowmap* sm)
@@ -251,8 +421,10 @@ void shadowmap_render_split_end(struct shadowmap* sm)
 
 void shadowmap_render_end(struct shadowmap* sm)
 {
-    /* Revert cull face mode */
+    /* Revert cull face mode, depth clamping and scissoring */
     glCullFace(GL_BACK);
+    glDisable(GL_DEPTH_CLAMP);
+    glDisable(GL_SCISSOR_TEST);
 
     /* Unbind shader */
     glUseProgram(0);
@@ -267,7 +439,8 @@ void shadowmap_render_end(struct shadowmap* sm)
 
 void shadowmap_bind(struct shadowmap* sm, unsigned int shdr)
 {
-    for (int i = 0; i < SHADOWMAP_NSPLITS; ++i) {
+    glUniform1i(glGetUniformLocation(shdr, "num_cascades"), sm->num_splits);
+    for (unsigned int i = 0; i < sm->num_splits; ++i) {
         GLint uloc = 0;
         char* uname_buf[64];
         /* Pair of split's near and far values */
@@ -278,12 +451,19 @@ void shadowmap_bind(struct shadowmap* sm, unsigned int shdr)
         snprintf((char*)uname_buf, sizeof(uname_buf), "cascades[%u].vp_mat", i);
         uloc = glGetUniformLocation(shdr, (const char*)uname_buf);
         glUniformMatrix4fv(uloc, 1, GL_FALSE, sm->sd[i].shdw_mat.m);
+        /* Atlas region offset and scale in texture coordinates */
+        snprintf((char*)uname_buf, sizeof(uname_buf), "cascades[%u].rect", i);
+        uloc = glGetUniformLocation(shdr, (const char*)uname_buf);
+        glUniform4f(uloc, (float)sm->sd[i].x / sm->width, (float)sm->sd[i].y / sm->height,
+                          (float)sm->sd[i].size / sm->width, (float)sm->sd[i].size / sm->height);
     }
 }
 
 void shadowmap_destroy(struct shadowmap* sm)
 {
+    glDeleteTextures(1, &sm->glh.static_tex_id);
     glDeleteTextures(1, &sm->glh.tex_id);
     glDeleteFramebuffers(1, &sm->glh.fbo_id);
+    glDeleteProgram(sm->glh.layered_shdr);
     glDeleteProgram(sm->glh.shdr);
 }
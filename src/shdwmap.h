@@ -33,15 +33,29 @@
 
 #include <linalgb.h>
 
-#define SHADOWMAP_NSPLITS 4
+#define SHADOWMAP_MAX_SPLITS 4
+
+/* Static casters are rendered into a cached layer set, which is
+ * copied under the dynamic casters of the final shadow maps */
+enum shadowmap_target {
+    SHADOWMAP_TARGET_MAIN,
+    SHADOWMAP_TARGET_STATIC
+};
 
 struct shadowmap {
-    /* Resolution */
+    /* Atlas resolution */
     unsigned int width, height;
+    /* Configuration */
+    unsigned int num_splits;
+    unsigned int split_res[SHADOWMAP_MAX_SPLITS];
+    float split_lambda;
+    float distance;
     /* GL handles */
     struct {
         unsigned int tex_id, fbo_id;
+        unsigned int static_tex_id;
         unsigned int shdr;
+        unsigned int layered_shdr;
     } glh;
     /* Split data */
     struct {
@@ -50,27 +64,60 @@ struct shadowmap {
         mat4 shdw_mat;
         vec2 plane;
         float near_plane, far_plane;
-    } sd[SHADOWMAP_NSPLITS];
+        /* Light view space bounds of the split's receivers */
+        vec3 recv_min, recv_max;
+        float texels_per_unit;
+        /* Atlas region */
+        unsigned int x, y, size;
+    } sd[SHADOWMAP_MAX_SPLITS];
+    /* Static cache state, keyed per split by its shadow matrix and static caster signature */
+    struct {
+        mat4 shdw_mat[SHADOWMAP_MAX_SPLITS];
+        unsigned long long static_sigs[SHADOWMAP_MAX_SPLITS];
+        unsigned int valid;
+        /* Splits whose final region holds exactly the cached one */
+        unsigned int composited;
+    } cache;
     /* Render state */
     struct {
         int prev_vp[4];
         unsigned int prev_fbo;
+        unsigned int target_tex;
+        unsigned int clear_mask;
     } rs;
 };
 
-void shadowmap_init(struct shadowmap* sm, int width, int height);
-void shadowmap_render_begin(struct shadowmap* sm, float light_pos[3], float view[16], float proj[16]);
-void shadowmap_render_split_begin(struct shadowmap* sm, unsigned int split, vec3 fru_pts[8], vec4 fru_planes[6]);
+void shadowmap_init(struct shadowmap* sm);
+/* Sets split count, per split resolutions, split scheme blend and shadow distance.
+ * Repacks the atlas and drops the static cache only when the layout changes */
+void shadowmap_configure(struct shadowmap* sm, unsigned int num_splits, const unsigned int split_res[],
+                         float split_lambda, float distance);
+/* Calculates split data for the given light and camera, needed before culling and rendering */
+void shadowmap_update(struct shadowmap* sm, float light_pos[3], float view[16], float proj[16]);
+/* Compares current split data and static caster signatures against the cache,
+ * returns the mask of splits whose static layer must be rendered again */
+unsigned int shadowmap_cache_refresh(struct shadowmap* sm, const unsigned long long static_sigs[SHADOWMAP_MAX_SPLITS]);
+void shadowmap_cache_invalidate(struct shadowmap* sm);
+/* Copies the cached static regions into the final ones where needed,
+ * before dynamic casters are rendered into the splits of dynamic_mask */
+void shadowmap_composite(struct shadowmap* sm, unsigned int dynamic_mask);
+/* Begins rendering into the target, regions in clear_mask are cleared when first entered */
+void shadowmap_render_begin(struct shadowmap* sm, enum shadowmap_target target, unsigned int clear_mask);
+void shadowmap_render_split_begin(struct shadowmap* sm, unsigned int split);
+/* Begins rendering all splits in a single pass, with instance tags holding cascade masks
+ * and one viewport per split.
+ * Finished with shadowmap_render_end */
+void shadowmap_render_layered_begin(struct shadowmap* sm, enum shadowmap_target target, unsigned int clear_mask);
 void shadowmap_render_split_end(struct shadowmap* sm);
 void shadowmap_render_end(struct shadowmap* sm);
 void shadowmap_bind(struct shadowmap* sm, unsigned int shdr);
 void shadowmap_destroy(struct shadowmap* sm);
 
 /* Convenience macros */
-#define shadowmap_render(sm, light_pos, view, proj, fru_pts, fru_plns) \
-    for (int _break = (shadowmap_render_begin(sm, light_pos, view, proj), 1), shdr = sm->glh.shdr; \
+#define shadowmap_render(sm, target, clear_mask) \
+    for (int _break = (shadowmap_render_begin(sm, target, clear_mask), 1), shdr = sm->glh.shdr; \
             (_break || (shadowmap_render_end(sm), 0)); _break = 0) \
-        for (unsigned int _split = 0; (_split < 4 && (shadowmap_render_split_begin(sm, _split, fru_pts, fru_plns), 1)); \
+        for (unsigned int _split = 0; (_split < sm->num_splits && (shadowmap_render_split_begin(sm, _split), 1)); \
                 (shadowmap_render_split_end(sm), ++_split))
 
 #endif /* ! _SHDWMAP_H_ */
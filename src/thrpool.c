@@ -0,0 +1,238 @@
+#include "thrpool.h"
+#include <stdatomic.h>
+
+/*-----------------------------------------------------------------
+ * Platform threading primitives
+ *-----------------------------------------------------------------*/
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define thread_local_ __declspec(thread)
+#define mutex_init(m)      InitializeCriticalSection(m)
+#define mutex_destroy(m)   DeleteCriticalSection(m)
+#define mutex_lock(m)      EnterCriticalSection(m)
+#define mutex_unlock(m)    LeaveCriticalSection(m)
+#define cond_init(c)       InitializeConditionVariable(c)
+#define cond_destroy(c)    ((void)(c))
+#define cond_wait(c, m)    SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c)  WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define thread_local_ __thread
+#define mutex_init(m)      pthread_mutex_init(m, 0)
+#define mutex_destroy(m)   pthread_mutex_destroy(m)
+#define mutex_lock(m)      pthread_mutex_lock(m)
+#define mutex_unlock(m)    pthread_mutex_unlock(m)
+#define cond_init(c)       pthread_cond_init(c, 0)
+#define cond_destroy(c)    pthread_cond_destroy(c)
+#define cond_wait(c, m)    pthread_cond_wait(c, m)
+#define cond_broadcast(c)  pthread_cond_broadcast(c)
+#endif
+
+static unsigned int hardware_concurrency()
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    long n = si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+/*-----------------------------------------------------------------
+ * Pool
+ *-----------------------------------------------------------------*/
+struct thrpool_job {
+    thrpool_range_fn fn;
+    void* userdata;
+    size_t count, grain;
+    size_t num_chunks, next_chunk, done_chunks;
+    struct thrpool_job* next;
+};
+
+struct thrpool {
+    thread_t* threads;
+    unsigned int num_threads;
+    mutex_t lock;
+    cond_t work_cv;
+    cond_t done_cv;
+    /* Jobs with unclaimed chunks, jobs live on their submitter's stack */
+    struct thrpool_job* jobs;
+    int quit;
+};
+
+struct worker_args {
+    struct thrpool* tp;
+    unsigned int idx;
+};
+
+/* Pool and worker index of the current thread, null for threads outside any pool */
+static thread_local_ struct thrpool* cur_pool = 0;
+static thread_local_ unsigned int cur_worker = 0;
+
+static void job_unlink(struct thrpool* tp, struct thrpool_job* job)
+{
+    for (struct thrpool_job** j = &tp->jobs; *j; j = &(*j)->next) {
+        if (*j == job) {
+            *j = job->next;
+            break;
+        }
+    }
+}
+
+/* Claims next chunk of job, must hold the pool lock */
+static int job_claim(struct thrpool* tp, struct thrpool_job* job, size_t* chunk)
+{
+    if (job->next_chunk >= job->num_chunks)
+        return 0;
+    *chunk = job->next_chunk++;
+    if (job->next_chunk == job->num_chunks)
+        job_unlink(tp, job);
+    return 1;
+}
+
+/* Runs chunk unlocked and marks it done, must hold the pool lock */
+static void job_run(struct thrpool* tp, struct thrpool_job* job, size_t chunk, unsigned int worker)
+{
+    thrpool_range_fn fn = job->fn;
+    void* userdata = job->userdata;
+    size_t begin = chunk * job->grain;
+    size_t end = begin + job->grain < job->count ? begin + job->grain : job->count;
+    mutex_unlock(&tp->lock);
+    fn(userdata, begin, end, worker);
+    mutex_lock(&tp->lock);
+    /* Job may be freed by its submitter as soon as the last chunk is done */
+    if (++job->done_chunks == job->num_chunks)
+        cond_broadcast(&tp->done_cv);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg)
+#else
+static void* worker_main(void* arg)
+#endif
+{
+    struct worker_args* wa = arg;
+    struct thrpool* tp = wa->tp;
+    cur_pool = tp;
+    cur_worker = wa->idx;
+    free(wa);
+
+    mutex_lock(&tp->lock);
+    for (;;) {
+        while (!tp->quit && !tp->jobs)
+            cond_wait(&tp->work_cv, &tp->lock);
+        if (tp->quit)
+            break;
+        struct thrpool_job* job = tp->jobs;
+        size_t chunk;
+        if (job_claim(tp, job, &chunk))
+            job_run(tp, job, chunk, cur_worker);
+    }
+    mutex_unlock(&tp->lock);
+    return 0;
+}
+
+struct thrpool* thrpool_create(unsigned int num_threads)
+{
+    if (num_threads == 0)
+        num_threads = hardware_concurrency() - 1;
+    struct thrpool* tp = calloc(1, sizeof(*tp));
+    tp->num_threads = num_threads;
+    tp->threads = calloc(num_threads, sizeof(*tp->threads));
+    mutex_init(&tp->lock);
+    cond_init(&tp->work_cv);
+    cond_init(&tp->done_cv);
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        struct worker_args* wa = malloc(sizeof(*wa));
+        wa->tp = tp;
+        wa->idx = i;
+#ifdef _WIN32
+        tp->threads[i] = CreateThread(0, 0, worker_main, wa, 0, 0);
+#else
+        pthread_create(&tp->threads[i], 0, worker_main, wa);
+#endif
+    }
+    return tp;
+}
+
+void thrpool_destroy(struct thrpool* tp)
+{
+    mutex_lock(&tp->lock);
+    tp->quit = 1;
+    cond_broadcast(&tp->work_cv);
+    mutex_unlock(&tp->lock);
+    for (unsigned int i = 0; i < tp->num_threads; ++i) {
+#ifdef _WIN32
+        WaitForSingleObject(tp->threads[i], INFINITE);
+        CloseHandle(tp->threads[i]);
+#else
+        pthread_join(tp->threads[i], 0);
+#endif
+    }
+    cond_destroy(&tp->done_cv);
+    cond_destroy(&tp->work_cv);
+    mutex_destroy(&tp->lock);
+    free(tp->threads);
+    free(tp);
+}
+
+struct thrpool* thrpool_default()
+{
+    static _Atomic(struct thrpool*) default_pool = 0;
+    struct thrpool* tp = atomic_load_explicit(&default_pool, memory_order_acquire);
+    if (!tp) {
+        struct thrpool* ntp = thrpool_create(0);
+        if (atomic_compare_exchange_strong_explicit(&default_pool, &tp, ntp, memory_order_acq_rel, memory_order_acquire))
+            tp = ntp;
+        else
+            thrpool_destroy(ntp);
+    }
+    return tp;
+}
+
+unsigned int thrpool_concurrency(struct thrpool* tp)
+{
+    return tp->num_threads + 1;
+}
+
+void thrpool_parallel_for(struct thrpool* tp, size_t count, size_t grain, thrpool_range_fn fn, void* userdata)
+{
+    if (count == 0)
+        return;
+    grain = grain ? grain : 1;
+    /* Calling thread takes the slot after the pool's workers, unless it is one of them */
+    unsigned int worker = cur_pool == tp ? cur_worker : tp->num_threads;
+    if (tp->num_threads == 0 || count <= grain) {
+        fn(userdata, 0, count, worker);
+        return;
+    }
+
+    struct thrpool_job job = {
+        .fn = fn,
+        .userdata = userdata,
+        .count = count,
+        .grain = grain,
+        .num_chunks = (count + grain - 1) / grain,
+    };
+    mutex_lock(&tp->lock);
+    job.next = tp->jobs;
+    tp->jobs = &job;
+    cond_broadcast(&tp->work_cv);
+    /* Help with own job, then wait for chunks still in flight on workers */
+    size_t chunk;
+    while (job_claim(tp, &job, &chunk))
+        job_run(tp, &job, chunk, worker);
+    while (job.done_chunks != job.num_chunks)
+        cond_wait(&tp->done_cv, &tp->lock);
+    mutex_unlock(&tp->lock);
+}
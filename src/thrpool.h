@@ -0,0 +1,52 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#ifndef _THRPOOL_H_
+#define _THRPOOL_H_
+
+#include <stdlib.h>
+
+/* Callback invoked for a [begin, end) range, worker is unique among the job's concurrent runners */
+typedef void(*thrpool_range_fn)(void* userdata, size_t begin, size_t end, unsigned int worker);
+
+struct thrpool;
+
+/* Init/deinit, 0 threads picks one per hardware thread minus the caller */
+struct thrpool* thrpool_create(unsigned int num_threads);
+void thrpool_destroy(struct thrpool* tp);
+/* Lazily created process wide pool */
+struct thrpool* thrpool_default();
+/* Maximum number of concurrent runners of a job (workers + calling thread) */
+unsigned int thrpool_concurrency(struct thrpool* tp);
+/* Splits [0, count) in ranges of grain elements and runs them on the pool and the calling thread.
+ * Blocks until every range is processed, may be called recursively from inside a range callback */
+void thrpool_parallel_for(struct thrpool* tp, size_t count, size_t grain, thrpool_range_fn fn, void* userdata);
+
+#endif /* ! _THRPOOL_H_ */
@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <scene_asset.h>
 #include "hashtable.h"
+#include "fltparse.h"
+#include "thrpool.h"
 
 #define OBJ_FLAG_TRIANGULATE (1 << 0)
+#define OBJ_FLAG_PARALLEL    (1 << 1)
 #define OBJ_MAX_FACES_PER_F_LINE (64)
 
 /*----------------------------------------------------------------------
@@ -122,10 +125,8 @@ static float parse_float(const char** token)
 {
     const char* end;
     skip_space(token);
+    float f = fltparse_float((*token), 0);
     end = (*token) + until_space((*token));
-    double val = strtod((*token), 0); /* */
-    end = (*token) + until_space((*token));
-    float f = (float)(val);
     (*token) = end;
     return f;
 }
@@ -336,11 +337,188 @@ static int parse_line(struct command* command, const char* p, size_t p_len, int
     return 0;
 }
 
-struct line_info {
-    size_t pos;
-    size_t len;
+/*
+ * The buffer is split in newline aligned chunks that are processed in two parallel passes:
+ *  - The first counts each chunk's attributes and faces
+ *  - A prefix sum over the counts gives each chunk its global output offsets
+ *  - The second parses each chunk directly into the final attribute arrays
+ * Knowing the global attribute counts before each chunk keeps relative
+ * face indices correct across chunk boundaries.
+ */
+#define OBJ_MIN_CHUNK_SIZE (1 << 20)
+#define OBJ_CHUNKS_PER_THREAD 4
+
+struct obj_shape_event {
+    const char* name;
+    size_t name_len;
+    size_t face_offset;
+};
+
+struct obj_chunk {
+    /* Buffer range */
+    size_t begin, end;
+    /* Local counts */
+    size_t num_v, num_vn, num_vt, num_f, num_faces;
+    /* Global offsets */
+    size_t base_v, base_vn, base_vt, base_f, base_faces;
+    /* Last material selected inside the chunk */
+    const char* last_material_name;
+    size_t last_material_name_len;
+    /* Material active when the chunk starts */
+    int start_material_id;
+    /* Object and group lines */
+    struct obj_shape_event* events;
+    size_t num_events, cap_events;
+};
+
+struct obj_parse_job {
+    const char* buf;
+    size_t end_idx;
+    unsigned int flags;
+    struct obj_chunk* chunks;
+    obj_attrib_t* attrib;
+    struct hash_table* material_table;
 };
 
+static size_t chunk_split_point(const char* buf, size_t pos, size_t end_idx)
+{
+    /* Advance until right after a line ending */
+    if (pos >= end_idx)
+        return end_idx;
+    while (pos < end_idx && !(buf[pos - 1] == '\n' || (buf[pos - 1] == '\r' && buf[pos] != '\n')))
+        pos++;
+    return pos;
+}
+
+/* Fetches next line of chunk, returns 0 when the chunk is exhausted */
+static int chunk_next_line(const char* buf, size_t* pos, size_t end, size_t end_idx, size_t* lpos, size_t* llen)
+{
+    size_t i = *pos;
+    if (i >= end)
+        return 0;
+    while (i < end && !is_line_ending(buf, i, end_idx))
+        i++;
+    *lpos = *pos;
+    *llen = i - *pos;
+    *pos  = i + 1;
+    return 1;
+}
+
+static int lookup_material(struct hash_table* material_table, const char* name, size_t name_len)
+{
+    /* Create a null terminated string */
+    char* material_name_null_term = malloc(name_len + 1);
+    memcpy(material_name_null_term, name, name_len);
+    material_name_null_term[name_len - 1] = 0;
+    hash_val_t* v = hash_table_search(material_table, (hash_key_t)material_name_null_term);
+    free(material_name_null_term);
+    return v ? (int)*v : -1;
+}
+
+static void obj_count_chunks(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct obj_parse_job* job = userdata;
+    struct command cmd;
+    for (size_t ci = begin; ci < end; ++ci) {
+        struct obj_chunk* c = &job->chunks[ci];
+        size_t pos = c->begin, lpos, llen;
+        while (chunk_next_line(job->buf, &pos, c->end, job->end_idx, &lpos, &llen)) {
+            const char* token = job->buf + lpos;
+            while (token < job->buf + lpos + llen && IS_SPACE(token[0]))
+                token++;
+            size_t rem = job->buf + lpos + llen - token;
+            if (rem < 2)
+                continue;
+            if (token[0] == 'v' && IS_SPACE(token[1])) {
+                c->num_v++;
+            } else if (token[0] == 'v' && token[1] == 'n' && rem > 2 && IS_SPACE(token[2])) {
+                c->num_vn++;
+            } else if (token[0] == 'v' && token[1] == 't' && rem > 2 && IS_SPACE(token[2])) {
+                c->num_vt++;
+            } else if ((token[0] == 'f' && IS_SPACE(token[1]))
+                    || (rem > 6 && strncmp(token, "usemtl", 6) == 0 && IS_SPACE(token[6]))) {
+                /* Faces and materials go through the regular parser for exact counts */
+                parse_line(&cmd, job->buf + lpos, llen, job->flags & OBJ_FLAG_TRIANGULATE);
+                if (cmd.type == COMMAND_F) {
+                    c->num_f += cmd.num_f;
+                    c->num_faces += cmd.num_f_num_verts;
+                } else if (cmd.type == COMMAND_USEMTL && cmd.material_name && cmd.material_name_len > 0) {
+                    c->last_material_name = cmd.material_name;
+                    c->last_material_name_len = cmd.material_name_len;
+                }
+            }
+        }
+    }
+}
+
+static void shape_event_push(struct obj_chunk* c, const char* name, size_t name_len, size_t face_offset)
+{
+    if (c->num_events == c->cap_events) {
+        c->cap_events = c->cap_events ? c->cap_events * 2 : 8;
+        c->events = realloc(c->events, c->cap_events * sizeof(*c->events));
+    }
+    c->events[c->num_events++] = (struct obj_shape_event) {
+        .name = name,
+        .name_len = name_len,
+        .face_offset = face_offset
+    };
+}
+
+static void obj_parse_chunks(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct obj_parse_job* job = userdata;
+    obj_attrib_t* attrib = job->attrib;
+    struct command cmd;
+    for (size_t ci = begin; ci < end; ++ci) {
+        struct obj_chunk* c = &job->chunks[ci];
+        int material_id = c->start_material_id;
+        size_t v_count = c->base_v, n_count = c->base_vn, t_count = c->base_vt;
+        size_t f_count = c->base_f, face_count = c->base_faces;
+        size_t pos = c->begin, lpos, llen;
+        while (chunk_next_line(job->buf, &pos, c->end, job->end_idx, &lpos, &llen)) {
+            if (!parse_line(&cmd, job->buf + lpos, llen, job->flags & OBJ_FLAG_TRIANGULATE))
+                continue;
+            if (cmd.type == COMMAND_USEMTL) {
+                if (cmd.material_name && cmd.material_name_len > 0)
+                    material_id = lookup_material(job->material_table, cmd.material_name, cmd.material_name_len);
+            } else if (cmd.type == COMMAND_V) {
+                attrib->vertices[3 * v_count + 0] = cmd.vx;
+                attrib->vertices[3 * v_count + 1] = cmd.vy;
+                attrib->vertices[3 * v_count + 2] = cmd.vz;
+                v_count++;
+            } else if (cmd.type == COMMAND_VN) {
+                attrib->normals[3 * n_count + 0] = cmd.nx;
+                attrib->normals[3 * n_count + 1] = cmd.ny;
+                attrib->normals[3 * n_count + 2] = cmd.nz;
+                n_count++;
+            } else if (cmd.type == COMMAND_VT) {
+                attrib->texcoords[2 * t_count + 0] = cmd.tx;
+                attrib->texcoords[2 * t_count + 1] = cmd.ty;
+                t_count++;
+            } else if (cmd.type == COMMAND_F) {
+                for (size_t k = 0; k < cmd.num_f; k++) {
+                    obj_vertex_index_t vi = cmd.f[k];
+                    attrib->faces[f_count + k].v_idx  = fix_index(vi.v_idx,  v_count);
+                    attrib->faces[f_count + k].vn_idx = fix_index(vi.vn_idx, n_count);
+                    attrib->faces[f_count + k].vt_idx = fix_index(vi.vt_idx, t_count);
+                }
+                for (size_t k = 0; k < cmd.num_f_num_verts; k++) {
+                    attrib->material_ids[face_count + k] = material_id;
+                    attrib->face_num_verts[face_count + k] = cmd.f_num_verts[k];
+                }
+                f_count    += cmd.num_f;
+                face_count += cmd.num_f_num_verts;
+            } else if (cmd.type == COMMAND_O) {
+                shape_event_push(c, cmd.object_name, cmd.object_name_len, face_count);
+            } else if (cmd.type == COMMAND_G) {
+                shape_event_push(c, cmd.group_name, cmd.group_name_len, face_count);
+            }
+        }
+    }
+}
+
 static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num_shapes, const char* buf, size_t len, unsigned int flags)
 {
     assert(len >= 1);
@@ -349,49 +527,55 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
     assert(num_shapes);
     assert(buf);
 
-    /* Find '\n' and create line data */
+    /* Assume last char is '\0' */
     size_t end_idx = len - 1;
-    /* Count # of lines. */
-    size_t num_lines = 0;
-    for (size_t i = 0; i < end_idx; i++) { /* Assume last char is '\0' */
-        if (is_line_ending(buf, i, end_idx) || (i == end_idx - 1))
-            num_lines++;
-    }
-    if (num_lines == 0)
+    if (end_idx == 0)
         return -1;
 
-    /* Fill line infos */
-    size_t prev_pos = 0, line_no  = 0;
-    struct line_info* line_infos = malloc(sizeof(*line_infos) * num_lines);
-    for (size_t i = 0; i < end_idx; i++) {
-        if (is_line_ending(buf, i, end_idx) || (i == end_idx - 1)) {
-            line_infos[line_no].pos = prev_pos;
-            line_infos[line_no].len = i - prev_pos;
-            prev_pos = i + 1;
-            line_no++;
-        }
+    /* Split in newline aligned chunks */
+    struct thrpool* tp = thrpool_default();
+    size_t num_chunks = 1;
+    if (flags & OBJ_FLAG_PARALLEL) {
+        size_t max_chunks = thrpool_concurrency(tp) * OBJ_CHUNKS_PER_THREAD;
+        num_chunks = end_idx / OBJ_MIN_CHUNK_SIZE;
+        num_chunks = num_chunks < 1 ? 1 : num_chunks > max_chunks ? max_chunks : num_chunks;
+    }
+    struct obj_chunk* chunks = calloc(num_chunks, sizeof(*chunks));
+    size_t chunk_size = end_idx / num_chunks, nchunks = 0;
+    for (size_t pos = 0; pos < end_idx; ++nchunks) {
+        size_t next = nchunks + 1 == num_chunks ? end_idx : chunk_split_point(buf, pos + chunk_size, end_idx);
+        chunks[nchunks].begin = pos;
+        chunks[nchunks].end = next;
+        pos = next;
     }
+    num_chunks = nchunks;
 
-    /* Parse each line */
+    /* Count attributes per chunk */
     struct hash_table* material_table = hash_table_create(hash_table_string_hash, hash_table_string_eql);
+    struct obj_parse_job job = {
+        .buf = buf,
+        .end_idx = end_idx,
+        .flags = flags,
+        .chunks = chunks,
+        .attrib = attrib,
+        .material_table = material_table
+    };
+    thrpool_parallel_for(tp, num_chunks, 1, obj_count_chunks, &job);
+
+    /* Prefix sum counts into chunk offsets, and carry active material across chunks */
     size_t num_v = 0, num_vn = 0, num_vt = 0, num_f = 0, num_faces = 0;
-    struct command* commands = malloc(sizeof(*commands) * num_lines);
-    for (size_t i = 0; i < num_lines; i++) {
-        int ret = parse_line(&commands[i], &buf[line_infos[i].pos], line_infos[i].len, flags & OBJ_FLAG_TRIANGULATE);
-        if (ret) {
-            if (commands[i].type == COMMAND_V) {
-                num_v++;
-            } else if (commands[i].type == COMMAND_VN) {
-                num_vn++;
-            } else if (commands[i].type == COMMAND_VT) {
-                num_vt++;
-            } else if (commands[i].type == COMMAND_F) {
-                num_f += commands[i].num_f;
-                num_faces += commands[i].num_f_num_verts;
-            }
-        }
+    int material_id = -1; /* -1 = default unknown material. */
+    for (size_t i = 0; i < num_chunks; ++i) {
+        struct obj_chunk* c = &chunks[i];
+        c->base_v = num_v;  num_v += c->num_v;
+        c->base_vn = num_vn; num_vn += c->num_vn;
+        c->base_vt = num_vt; num_vt += c->num_vt;
+        c->base_f = num_f; num_f += c->num_f;
+        c->base_faces = num_faces; num_faces += c->num_faces;
+        c->start_material_id = material_id;
+        if (c->last_material_name)
+            material_id = lookup_material(material_table, c->last_material_name, c->last_material_name_len);
     }
-    free(line_infos);
 
     /* Construct attributes */
     memset(attrib, 0, sizeof(*attrib));
@@ -406,64 +590,12 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
     attrib->face_num_verts     = malloc(num_faces * sizeof(*attrib->face_num_verts));
     attrib->material_ids       = malloc(num_faces * sizeof(*attrib->material_ids));
     attrib->num_face_num_verts = num_faces;
-
-    int material_id = -1; /* -1 = default unknown material. */
-    size_t v_count = 0, n_count = 0, t_count = 0, f_count = 0, face_count = 0;
-    for (size_t i = 0; i < num_lines; i++) {
-        if (commands[i].type == COMMAND_EMPTY) {
-            continue;
-        } else if (commands[i].type == COMMAND_USEMTL) {
-            if (commands[i].material_name && commands[i].material_name_len > 0) {
-                /* Create a null terminated string */
-                char* material_name_null_term = malloc(commands[i].material_name_len + 1);
-                memcpy(material_name_null_term, commands[i].material_name, commands[i].material_name_len);
-                material_name_null_term[commands[i].material_name_len - 1] = 0;
-                hash_val_t* v = hash_table_search(material_table, (hash_key_t)material_name_null_term);
-                if (v)
-                    material_id = *v;
-                else
-                    material_id = -1;
-                free(material_name_null_term);
-            }
-        } else if (commands[i].type == COMMAND_V) {
-            attrib->vertices[3 * v_count + 0] = commands[i].vx;
-            attrib->vertices[3 * v_count + 1] = commands[i].vy;
-            attrib->vertices[3 * v_count + 2] = commands[i].vz;
-            v_count++;
-        } else if (commands[i].type == COMMAND_VN) {
-            attrib->normals[3 * n_count + 0] = commands[i].nx;
-            attrib->normals[3 * n_count + 1] = commands[i].ny;
-            attrib->normals[3 * n_count + 2] = commands[i].nz;
-            n_count++;
-        } else if (commands[i].type == COMMAND_VT) {
-            attrib->texcoords[2 * t_count + 0] = commands[i].tx;
-            attrib->texcoords[2 * t_count + 1] = commands[i].ty;
-            t_count++;
-        } else if (commands[i].type == COMMAND_F) {
-            for (size_t k = 0; k < commands[i].num_f; k++) {
-                obj_vertex_index_t vi = commands[i].f[k];
-                int v_idx  = fix_index(vi.v_idx,  v_count);
-                int vn_idx = fix_index(vi.vn_idx, n_count);
-                int vt_idx = fix_index(vi.vt_idx, t_count);
-                attrib->faces[f_count + k].v_idx  = v_idx;
-                attrib->faces[f_count + k].vn_idx = vn_idx;
-                attrib->faces[f_count + k].vt_idx = vt_idx;
-            }
-            for (size_t k = 0; k < commands[i].num_f_num_verts; k++) {
-                attrib->material_ids[face_count + k] = material_id;
-                attrib->face_num_verts[face_count + k] = commands[i].f_num_verts[k];
-            }
-            f_count    += commands[i].num_f;
-            face_count += commands[i].num_f_num_verts;
-        }
-    }
+    thrpool_parallel_for(tp, num_chunks, 1, obj_parse_chunks, &job);
 
     /* Find the number of shapes in .obj */
     size_t n = 0;
-    for (size_t i = 0; i < num_lines; i++) {
-        if (commands[i].type == COMMAND_O || commands[i].type == COMMAND_G)
-            n++;
-    }
+    for (size_t i = 0; i < num_chunks; ++i)
+        n += chunks[i].num_events;
 
     /* Allocate array of shapes with maximum possible size (+1 for unnamed group/object).
      * Actual # of shapes found in .obj is determined in the later */
@@ -473,18 +605,14 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
     obj_shape_t prev_shape = {0, 0, 0};
 
     /* Construct shape information. */
-    size_t shape_idx = 0;
+    size_t shape_idx = 0, face_count = 0;
     *shapes = malloc((n + 1) * sizeof(**shapes));
-    face_count = 0;
-    for (size_t i = 0; i < num_lines; i++) {
-        if (commands[i].type == COMMAND_O || commands[i].type == COMMAND_G) {
-            if (commands[i].type == COMMAND_O) {
-                shape_name = commands[i].object_name;
-                shape_name_len = commands[i].object_name_len;
-            } else {
-                shape_name = commands[i].group_name;
-                shape_name_len = commands[i].group_name_len;
-            }
+    for (size_t ci = 0; ci < num_chunks; ++ci) {
+        for (size_t i = 0; i < chunks[ci].num_events; ++i) {
+            struct obj_shape_event* ev = &chunks[ci].events[i];
+            shape_name = ev->name;
+            shape_name_len = ev->name_len;
+            face_count = ev->face_offset;
 
             if (face_count == 0) {
                 /* 'o' or 'g' appears before any 'f' */
@@ -515,9 +643,9 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
                 prev_shape_face_offset = face_count;
             }
         }
-        if (commands[i].type == COMMAND_F)
-            face_count++;
+        free(chunks[ci].events);
     }
+    face_count = num_faces;
 
     if ((face_count - prev_face_offset) > 0) {
         size_t length = face_count - prev_shape_face_offset;
@@ -533,7 +661,7 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
     }
     *num_shapes = shape_idx;
 
-    free(commands);
+    free(chunks);
     hash_table_destroy(material_table);
     return 0;
 }
@@ -541,7 +669,7 @@ static int obj_parse_obj(obj_attrib_t* attrib, obj_shape_t** shapes, size_t* num
 obj_model_t* obj_model_parse(const char* buf, size_t len)
 {
     obj_model_t* obj = calloc(1, sizeof(*obj));
-    int r = obj_parse_obj(&obj->attrib, &obj->shapes, &obj->num_shapes, buf, len, OBJ_FLAG_TRIANGULATE);
+    int r = obj_parse_obj(&obj->attrib, &obj->shapes, &obj->num_shapes, buf, len, OBJ_FLAG_TRIANGULATE | OBJ_FLAG_PARALLEL);
     if (r == -1) {
         obj_model_free(obj);
         return 0;
@@ -575,57 +703,93 @@ void obj_model_free(obj_model_t* obj)
  *----------------------------------------------------------------------*/
 static uint32_t face_hash(hash_key_t k)
 {
+    /* Mix the whole triple, so vertices sharing a position with different uv/normal don't collide */
     obj_vertex_index_t* vi = (obj_vertex_index_t*)k;
-    uint32_t h = vi->v_idx;
-    return (0x811C9DC5 ^ h) * 0x01000193;
+    uint64_t h = (uint64_t)(uint32_t)vi->v_idx;
+    h = h * 0x9e3779b97f4a7c15ull ^ (uint32_t)vi->vt_idx;
+    h = h * 0x9e3779b97f4a7c15ull ^ (uint32_t)vi->vn_idx;
+    return hash_table_int_hash(h);
 }
 
 static int face_eql(hash_key_t k1, hash_key_t k2)
 {
     obj_vertex_index_t* vi1 = (obj_vertex_index_t*)k1;
     obj_vertex_index_t* vi2 = (obj_vertex_index_t*)k2;
-    return memcmp(vi1, vi2, sizeof(obj_vertex_index_t)) == 0;
+    return vi1->v_idx  == vi2->v_idx
+        && vi1->vt_idx == vi2->vt_idx
+        && vi1->vn_idx == vi2->vn_idx;
+}
+
+/* Copies attribute n-tuple, or zeros for missing/out of range references */
+static void copy_attrib(float* dst, const float* src, int idx, size_t num, size_t n)
+{
+    if (idx >= 0 && (size_t)idx < num)
+        memcpy(dst, src + idx * n, n * sizeof(float));
+    else
+        memset(dst, 0, n * sizeof(float));
 }
 
-static void obj_flatten_shape(obj_model_t* obj,
-                              size_t sidx,
-                              float** positions,
-                              float** normals,
-                              float** texcoords,
-                              size_t* num_vertices,
-                              uint32_t** indices,
-                              size_t* num_indices)
+struct obj_flat_shape {
+    float* positions;
+    float* normals;
+    float* texcoords;
+    size_t num_vertices;
+    uint32_t* indices;
+    size_t num_indices;
+};
+
+static void obj_flatten_shape(obj_model_t* obj, size_t sidx, struct obj_flat_shape* fs)
 {
-    size_t off_faces = obj->shapes[sidx].face_offset * 3;
+    obj_attrib_t* attrib = &obj->attrib;
+    obj_vertex_index_t* faces = attrib->faces + obj->shapes[sidx].face_offset * 3;
     size_t num_indcs = obj->shapes[sidx].length * 3;
     size_t num_verts = 0;
-    uint32_t* ind = calloc(num_indcs, sizeof(*ind));
-    float* pos    = calloc(num_indcs, 3 * sizeof(float));
-    float* nrm    = calloc(num_indcs, 3 * sizeof(float));
-    float* tco    = calloc(num_indcs, 2 * sizeof(float));
+
+    /* Map each index to its first occurrence, keeping the unique ones in order */
+    uint32_t* ind   = malloc(num_indcs * sizeof(*ind));
+    uint32_t* first = malloc(num_indcs * sizeof(*first));
     struct hash_table* face_table = hash_table_create(face_hash, face_eql);
+    hash_table_reserve(face_table, num_indcs / 4);
     for (size_t i = 0; i < num_indcs; ++i) {
-        obj_vertex_index_t* vi = &obj->attrib.faces[off_faces + i];
-        hash_val_t* e = hash_table_search(face_table, (hash_key_t)vi);
-        uint32_t vidx;
-        if (e) {
-            vidx = (uint32_t)*e;
-        } else {
-            memcpy(pos + num_verts * 3, obj->attrib.vertices  + vi->v_idx  * 3, 3 * sizeof(float));
-            memcpy(nrm + num_verts * 3, obj->attrib.normals   + vi->vn_idx * 3, 3 * sizeof(float));
-            memcpy(tco + num_verts * 2, obj->attrib.texcoords + vi->vt_idx * 2, 2 * sizeof(float));
-            vidx = num_verts++;
-            hash_table_insert(face_table, (hash_key_t)vi, (hash_val_t)vidx);
-        }
-        ind[i] = vidx;
+        int inserted;
+        hash_val_t* v = hash_table_insert_or_get(face_table, (hash_key_t)&faces[i], num_verts, &inserted);
+        if (inserted)
+            first[num_verts++] = i;
+        ind[i] = (uint32_t)*v;
     }
     hash_table_destroy(face_table);
-    *positions    = pos;
-    *normals      = nrm;
-    *texcoords    = tco;
-    *indices      = ind;
-    *num_vertices = num_verts;
-    *num_indices  = num_indcs;
+
+    /* Gather attributes into exactly sized outputs */
+    float* pos = malloc(num_verts * 3 * sizeof(float));
+    float* nrm = malloc(num_verts * 3 * sizeof(float));
+    float* tco = malloc(num_verts * 2 * sizeof(float));
+    for (size_t i = 0; i < num_verts; ++i) {
+        obj_vertex_index_t* vi = &faces[first[i]];
+        copy_attrib(pos + i * 3, attrib->vertices,  vi->v_idx,  attrib->num_vertices,  3);
+        copy_attrib(nrm + i * 3, attrib->normals,   vi->vn_idx, attrib->num_normals,   3);
+        copy_attrib(tco + i * 2, attrib->texcoords, vi->vt_idx, attrib->num_texcoords, 2);
+    }
+    free(first);
+
+    fs->positions    = pos;
+    fs->normals      = nrm;
+    fs->texcoords    = tco;
+    fs->indices      = ind;
+    fs->num_vertices = num_verts;
+    fs->num_indices  = num_indcs;
+}
+
+struct obj_flatten_job {
+    obj_model_t* obj;
+    struct obj_flat_shape* out;
+};
+
+static void obj_flatten_shapes(void* userdata, size_t begin, size_t end, unsigned int worker)
+{
+    (void) worker;
+    struct obj_flatten_job* job = userdata;
+    for (size_t i = begin; i < end; ++i)
+        obj_flatten_shape(job->obj, i, &job->out[i]);
 }
 
 struct scene* obj_to_scene(obj_model_t* obj)
@@ -639,6 +803,13 @@ struct scene* obj_to_scene(obj_model_t* obj)
     scn->num_nodes = obj->num_shapes;
     scn->nodes = calloc(scn->num_nodes, sizeof(*scn->nodes));
 
+    /* Flatten shapes in parallel */
+    struct obj_flatten_job job = {
+        .obj = obj,
+        .out = calloc(obj->num_shapes, sizeof(*job.out))
+    };
+    thrpool_parallel_for(thrpool_default(), obj->num_shapes, 1, obj_flatten_shapes, &job);
+
     for (size_t k = 0; k < obj->num_shapes; ++k) {
         obj_shape_t* obj_shp = &obj->shapes[k];
         struct node* node         = calloc(1, sizeof(*node));
@@ -657,20 +828,19 @@ struct scene* obj_to_scene(obj_model_t* obj)
         node->ist       = ist;
         node->name      = strdup(obj_shp->name);
 
-        float *positions, *normals, *texcoords; uint32_t* indices; size_t num_verts, num_indcs;
-        obj_flatten_shape(obj, k, &positions, &normals, &texcoords, &num_verts, &indices, &num_indcs);
-
-        shp->num_pos       = shp->num_norm = shp->num_texcoord = num_verts;
-        shp->pos           = (vec3f*)positions;
-        shp->norm          = (vec3f*)normals;
-        shp->texcoord      = (vec2f*)texcoords;
-        shp->num_triangles = num_indcs / 3;
-        shp->triangles     = (vec3i*)indices;
+        struct obj_flat_shape* fs = &job.out[k];
+        shp->num_pos       = shp->num_norm = shp->num_texcoord = fs->num_vertices;
+        shp->pos           = (vec3f*)fs->positions;
+        shp->norm          = (vec3f*)fs->normals;
+        shp->texcoord      = (vec2f*)fs->texcoords;
+        shp->num_triangles = fs->num_indices / 3;
+        shp->triangles     = (vec3i*)fs->indices;
 
         scn->nodes[k]     = node;
         scn->instances[k] = ist;
         scn->meshes[k]    = msh;
     }
+    free(job.out);
 
     return scn;
 }
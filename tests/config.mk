@@ -0,0 +1,8 @@
+PRJTYPE = Executable
+LIBS = energycore macu m
+ifneq ($(TARGET_OS), Windows)
+	LIBS += pthread
+endif
+ADDINCS = ../src
+EXTDEPS = macu::0.0.2dev
+MOREDEPS = ..
@@ -0,0 +1,204 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <energycore/fltparse.h>
+#include "test.h"
+
+/*----------------------------------------------------------------------
+ * Helpers
+ *----------------------------------------------------------------------*/
+static uint64_t rng_next(uint64_t* s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dull;
+}
+
+static uint64_t double_bits(double v) { uint64_t b; memcpy(&b, &v, sizeof(b)); return b; }
+static uint32_t float_bits(float v) { uint32_t b; memcpy(&b, &v, sizeof(b)); return b; }
+
+/* Compares both conversions with strtod / strtof, bit for bit and in consumed length */
+static int check_string(const char* s)
+{
+    char* ref_end;
+    const char* end;
+    double rd = strtod(s, &ref_end);
+    double d = fltparse_double(s, &end);
+    int ok = 1;
+    if (end != ref_end || (double_bits(d) != double_bits(rd) && !(isnan(d) && isnan(rd)))) {
+        test_check(0, "double '%s': %.17g (%zu chars), expected %.17g (%zu chars)",
+                   s, d, (size_t)(end - s), rd, (size_t)(ref_end - s));
+        ok = 0;
+    }
+    float rf = strtof(s, &ref_end);
+    float f = fltparse_float(s, &end);
+    if (end != ref_end || (float_bits(f) != float_bits(rf) && !(isnan(f) && isnan(rf)))) {
+        test_check(0, "float '%s': %.9g (%zu chars), expected %.9g (%zu chars)",
+                   s, f, (size_t)(end - s), rf, (size_t)(ref_end - s));
+        ok = 0;
+    }
+    return ok;
+}
+
+/*----------------------------------------------------------------------
+ * Checks
+ *----------------------------------------------------------------------*/
+static void check_special()
+{
+    static const char* cases[] = {
+        "0", "-0", "+0", "0.0", "00000.00000e5", "1", "-1", "1.5", ".5", "5.", "  \t42",
+        "3.14159265358979323846264338327950288", "1e0", "1E+2", "1e-2", "1e", "1e+", "1.5e-",
+        "1.5abc", "abc", "", ".", "-", "+.e1", "inf", "-inf", "infinity", "nan", "-nan",
+        "1e308", "1.7976931348623157e308", "1.7976931348623158e308", "1e309", "1e400",
+        "2.2250738585072011e-308", "2.2250738585072014e-308", "4.9406564584124654e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+        "3.4028234663852886e38", "3.4028235677973366e38", "1.17549435e-38", "1.4012984643e-45",
+        "7.006492321624085e-46", "7.006492321624086e-46",
+        "9007199254740993", "9007199254740992.5", "16777217", "16777216.5",
+        "1844674407370955161", "18446744073709551615", "18446744073709551616",
+        "0.000000000000000000000000000000000000000001",
+        "123456789012345678901234567890e-30", "1e99999999999", "1e-99999999999",
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+        check_string(cases[i]);
+}
+
+static void check_round_trip()
+{
+    /* Shortest round trip representations of random finite values must come back unchanged */
+    char buf[64];
+    uint64_t s = 0x1234567887654321ull;
+    for (size_t i = 0; i < 200000; ++i) {
+        uint64_t b = rng_next(&s);
+        double d;
+        memcpy(&d, &b, sizeof(d));
+        if (!isfinite(d))
+            continue;
+        snprintf(buf, sizeof(buf), "%.17g", d);
+        double pd = fltparse_double(buf, 0);
+        test_check(double_bits(pd) == double_bits(d), "double round trip '%s'", buf);
+
+        uint32_t fb = (uint32_t)(b >> 32);
+        float f;
+        memcpy(&f, &fb, sizeof(f));
+        if (!isfinite(f))
+            continue;
+        snprintf(buf, sizeof(buf), "%.9g", f);
+        float pf = fltparse_float(buf, 0);
+        test_check(float_bits(pf) == float_bits(f), "float round trip '%s'", buf);
+        if (test_failures)
+            break;
+    }
+}
+
+static void check_random_decimals()
+{
+    /* Random significands of up to 24 digits, so both the fast and the slow paths are hit */
+    char buf[96];
+    uint64_t s = 0xdeadbeefcafef00dull;
+    for (size_t i = 0; i < 200000 && !test_failures; ++i) {
+        uint64_t r = rng_next(&s);
+        int ndigits = 1 + r % 24;
+        int dot = (r >> 8) % (ndigits + 1);
+        int exp = (int)((r >> 16) % 700) - 350;
+        char* p = buf;
+        if ((r >> 32) & 1)
+            *p++ = '-';
+        for (int j = 0; j < ndigits; ++j) {
+            if (j == dot)
+                *p++ = '.';
+            *p++ = '0' + rng_next(&s) % 10;
+        }
+        snprintf(p, sizeof(buf) - (p - buf), "e%d", exp);
+        check_string(buf);
+    }
+}
+
+static void check_halfway()
+{
+    /* Exact decimal expansions of float midpoints, and the same truncated to 19 digits */
+    char buf[128];
+    uint64_t s = 0x0f1e2d3c4b5a6978ull;
+    for (size_t i = 0; i < 100000 && !test_failures; ++i) {
+        uint32_t b = (uint32_t)rng_next(&s) & 0x7f7fffff;
+        float lo, hi;
+        uint32_t b1 = b + 1;
+        memcpy(&lo, &b, sizeof(lo));
+        memcpy(&hi, &b1, sizeof(hi));
+        double mid = ((double)lo + (double)hi) * 0.5;
+        snprintf(buf, sizeof(buf), "%.60e", mid);
+        check_string(buf);
+        snprintf(buf, sizeof(buf), "%.18e", mid);
+        check_string(buf);
+    }
+}
+
+/*----------------------------------------------------------------------
+ * Benchmarks
+ *----------------------------------------------------------------------*/
+static void bench_obj_coords()
+{
+    /* Vertex coordinates the way exporters write them */
+    const size_t count = 1000000;
+    char* text = malloc(count * 16);
+    char* p = text;
+    uint64_t s = 0x5eed5eed5eed5eedull;
+    for (size_t i = 0; i < count; ++i) {
+        double v = ((double)(rng_next(&s) >> 11) / (1ull << 53) - 0.5) * 200.0;
+        p += sprintf(p, "%.6f ", v);
+    }
+
+    double t0 = test_time(), sum_fast = 0.0, sum_libc = 0.0;
+    for (const char* c = text; *c; ++c)
+        sum_fast += fltparse_float(c, &c);
+    double t1 = test_time();
+    for (char* c = text; *c; ++c)
+        sum_libc += strtof(c, &c);
+    double t2 = test_time();
+    test_check(sum_fast == sum_libc, "benchmark sums differ");
+    printf("  obj coords: fltparse_float %.1f ns, strtof %.1f ns per value (%.2fx)\n",
+           (t1 - t0) * 1e9 / count, (t2 - t1) * 1e9 / count, (t2 - t1) / (t1 - t0));
+    free(text);
+}
+
+void fltparse_test()
+{
+    check_special();
+    check_round_trip();
+    check_random_decimals();
+    check_halfway();
+    if (test_bench)
+        bench_obj_coords();
+}
@@ -0,0 +1,262 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hashtable.h"
+#include "test.h"
+
+/*----------------------------------------------------------------------
+ * Helpers
+ *----------------------------------------------------------------------*/
+static uint64_t rng_next(uint64_t* s)
+{
+    /* xorshift64*, fixed seeds keep runs reproducible */
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dull;
+}
+
+/* Every occupied slot is at most one step further from home than its predecessor */
+static int robin_hood_ordered(struct hash_table* ht)
+{
+    size_t mask = ht->capacity - 1;
+    for (size_t i = 0; i < ht->capacity; ++i) {
+        size_t next = (i + 1) & mask;
+        if (ht->hashes[next] == 0)
+            continue;
+        size_t next_dist = (next - (ht->hashes[next] & mask)) & mask;
+        size_t dist = ht->hashes[i] == 0 ? 0 : ((i - (ht->hashes[i] & mask)) & mask) + 1;
+        if (next_dist > dist)
+            return 0;
+    }
+    return 1;
+}
+
+/*----------------------------------------------------------------------
+ * Checks
+ *----------------------------------------------------------------------*/
+#define REF_KEYS 4096
+
+static void check_against_reference()
+{
+    /* Random mix of operations over a small key space, mirrored in a plain array */
+    hash_val_t ref_val[REF_KEYS];
+    int ref_has[REF_KEYS];
+    size_t ref_size = 0;
+    memset(ref_has, 0, sizeof(ref_has));
+
+    struct hash_table* ht = hash_table_create(hash_table_int_hash, hash_table_int_eql);
+    uint64_t s = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < 400000; ++i) {
+        uint64_t r = rng_next(&s);
+        hash_key_t k = r % REF_KEYS;
+        hash_val_t v = r >> 32;
+        switch ((r >> 16) % 4) {
+            case 0: {
+                hash_table_insert(ht, k, v);
+                ref_size += !ref_has[k];
+                ref_has[k] = 1;
+                ref_val[k] = v;
+                break;
+            }
+            case 1: {
+                int inserted;
+                hash_val_t* hv = hash_table_insert_or_get(ht, k, v, &inserted);
+                test_check(inserted == !ref_has[k], "insert_or_get(%zu) inserted %d", (size_t)k, inserted);
+                if (!ref_has[k]) {
+                    ref_has[k] = 1;
+                    ref_val[k] = v;
+                    ++ref_size;
+                }
+                test_check(*hv == ref_val[k], "insert_or_get(%zu) value mismatch", (size_t)k);
+                break;
+            }
+            case 2: {
+                int removed = hash_table_remove(ht, k);
+                test_check(removed == ref_has[k], "remove(%zu) returned %d", (size_t)k, removed);
+                ref_size -= ref_has[k];
+                ref_has[k] = 0;
+                break;
+            }
+            case 3: {
+                hash_val_t* hv = hash_table_search(ht, k);
+                test_check((hv != 0) == ref_has[k], "search(%zu) presence mismatch", (size_t)k);
+                if (hv && ref_has[k])
+                    test_check(*hv == ref_val[k], "search(%zu) value mismatch", (size_t)k);
+                break;
+            }
+        }
+        if (test_failures)
+            break;
+    }
+    test_check(ht->size == ref_size, "size %zu, expected %zu", ht->size, ref_size);
+    test_check(robin_hood_ordered(ht), "probe distances out of order");
+
+    size_t iterated = 0;
+    hash_table_foreach(ht, e) {
+        test_check(e->key < REF_KEYS && ref_has[e->key] && ref_val[e->key] == e->val,
+                   "iterated stale entry %zu", (size_t)e->key);
+        ++iterated;
+    }
+    test_check(iterated == ref_size, "iterated %zu entries, expected %zu", iterated, ref_size);
+    hash_table_destroy(ht);
+}
+
+static void check_reserve()
+{
+    /* Presizing must not lose entries, and must not grow again while filling up to the reserved count */
+    struct hash_table* ht = hash_table_create(hash_table_int_hash, hash_table_int_eql);
+    for (hash_key_t k = 0; k < 100; ++k)
+        hash_table_insert(ht, k, k * 3);
+    hash_table_reserve(ht, 100000);
+    size_t cap = ht->capacity;
+    for (hash_key_t k = 100; k < 100000; ++k)
+        hash_table_insert(ht, k, k * 3);
+    test_check(ht->capacity == cap, "grew from %zu to %zu after reserve", cap, ht->capacity);
+    for (hash_key_t k = 0; k < 100000; ++k) {
+        hash_val_t* v = hash_table_search(ht, k);
+        test_check(v && *v == k * 3, "lost key %zu", (size_t)k);
+        if (!v)
+            break;
+    }
+    hash_table_destroy(ht);
+}
+
+static void check_strings()
+{
+    const char* names[] = { "default", "wood", "metal", "glass", "stone", "brick", "" };
+    size_t num_names = sizeof(names) / sizeof(names[0]);
+    struct hash_table* ht = hash_table_create(hash_table_string_hash, hash_table_string_eql);
+    for (size_t i = 0; i < num_names; ++i)
+        hash_table_insert(ht, (hash_key_t)names[i], i);
+    /* Lookups go through equal contents, not equal pointers */
+    char buf[16];
+    for (size_t i = 0; i < num_names; ++i) {
+        strcpy(buf, names[i]);
+        hash_val_t* v = hash_table_search(ht, (hash_key_t)buf);
+        test_check(v && *v == i, "string key '%s' not found", names[i]);
+    }
+    test_check(!hash_table_search(ht, (hash_key_t)"plaster"), "found absent string key");
+    hash_table_destroy(ht);
+}
+
+/*----------------------------------------------------------------------
+ * Benchmarks
+ *----------------------------------------------------------------------*/
+struct vert_ref { int v_idx, vt_idx, vn_idx; };
+
+/* Same mixing as obj_flatten_shape's face table */
+static uint32_t vert_ref_hash(hash_key_t k)
+{
+    struct vert_ref* vi = (struct vert_ref*)k;
+    uint64_t h = (uint64_t)(uint32_t)vi->v_idx;
+    h = h * 0x9e3779b97f4a7c15ull ^ (uint32_t)vi->vt_idx;
+    h = h * 0x9e3779b97f4a7c15ull ^ (uint32_t)vi->vn_idx;
+    return hash_table_int_hash(h);
+}
+
+static int vert_ref_eql(hash_key_t k1, hash_key_t k2)
+{
+    struct vert_ref* a = (struct vert_ref*)k1;
+    struct vert_ref* b = (struct vert_ref*)k2;
+    return a->v_idx == b->v_idx && a->vt_idx == b->vt_idx && a->vn_idx == b->vn_idx;
+}
+
+static void bench_face_dedup()
+{
+    /* Triangulated grid as an OBJ would index it, every interior vertex is referenced six times */
+    const int n = 1024;
+    size_t num_refs = (size_t)(n - 1) * (n - 1) * 6;
+    struct vert_ref* refs = malloc(num_refs * sizeof(*refs));
+    size_t r = 0;
+    for (int y = 0; y < n - 1; ++y) {
+        for (int x = 0; x < n - 1; ++x) {
+            int i = y * n + x;
+            int quad[6] = { i, i + n, i + 1, i + 1, i + n, i + n + 1 };
+            for (int j = 0; j < 6; ++j)
+                refs[r++] = (struct vert_ref){ quad[j], quad[j], 0 };
+        }
+    }
+
+    double t0 = test_time();
+    struct hash_table* ht = hash_table_create(vert_ref_hash, vert_ref_eql);
+    hash_table_reserve(ht, num_refs / 4);
+    size_t num_verts = 0;
+    for (size_t i = 0; i < num_refs; ++i) {
+        int inserted;
+        hash_table_insert_or_get(ht, (hash_key_t)&refs[i], num_verts, &inserted);
+        num_verts += inserted;
+    }
+    double t1 = test_time();
+    test_check(num_verts == (size_t)n * n, "deduped to %zu vertices, expected %zu", num_verts, (size_t)n * n);
+    printf("  face dedup: %zu refs -> %zu verts in %.3f ms (%.1f ns/ref)\n",
+           num_refs, num_verts, (t1 - t0) * 1e3, (t1 - t0) * 1e9 / num_refs);
+    hash_table_destroy(ht);
+    free(refs);
+}
+
+static void bench_material_names()
+{
+    /* Material table lookups, one per face group, against a few hundred names */
+    const size_t num_names = 256, num_lookups = 2000000;
+    char (*names)[32] = malloc(num_names * sizeof(*names));
+    for (size_t i = 0; i < num_names; ++i)
+        snprintf(names[i], sizeof(names[i]), "material_%zu_surface", i);
+
+    struct hash_table* ht = hash_table_create(hash_table_string_hash, hash_table_string_eql);
+    for (size_t i = 0; i < num_names; ++i)
+        hash_table_insert(ht, (hash_key_t)names[i], i);
+
+    uint64_t s = 0x853c49e6748fea9bull;
+    size_t found = 0;
+    double t0 = test_time();
+    for (size_t i = 0; i < num_lookups; ++i)
+        found += hash_table_search(ht, (hash_key_t)names[rng_next(&s) % num_names]) != 0;
+    double t1 = test_time();
+    test_check(found == num_lookups, "missed %zu material lookups", num_lookups - found);
+    printf("  material names: %zu lookups in %.3f ms (%.1f ns/lookup)\n",
+           num_lookups, (t1 - t0) * 1e3, (t1 - t0) * 1e9 / num_lookups);
+    hash_table_destroy(ht);
+    free(names);
+}
+
+void hashtable_test()
+{
+    check_against_reference();
+    check_reserve();
+    check_strings();
+    if (test_bench) {
+        bench_face_dedup();
+        bench_material_names();
+    }
+}
@@ -0,0 +1,78 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#include <string.h>
+#include <time.h>
+#include "test.h"
+
+int test_failures = 0;
+int test_bench = 0;
+
+double test_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const struct {
+    const char* name;
+    void (*run)();
+} suites[] = {
+    { "hashtable", hashtable_test },
+    { "fltparse",  fltparse_test  },
+    { "mshproc",   mshproc_test   },
+};
+
+int main(int argc, char* argv[])
+{
+    /* Optional suite names filter the run, --bench adds the timings */
+    int filtered = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench") == 0)
+            test_bench = 1;
+        else
+            filtered = 1;
+    }
+
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); ++i) {
+        int selected = !filtered;
+        for (int j = 1; j < argc && !selected; ++j)
+            selected = strcmp(argv[j], suites[i].name) == 0;
+        if (!selected)
+            continue;
+        int prev_failures = test_failures;
+        printf("[%s]\n", suites[i].name);
+        suites[i].run();
+        printf("[%s] %s\n", suites[i].name, test_failures == prev_failures ? "ok" : "FAILED");
+    }
+
+    return test_failures != 0;
+}
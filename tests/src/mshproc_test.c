@@ -0,0 +1,286 @@
+/*********************************************************************************************************************/
+/*                                                  /===-_---~~~~~~~~~------____                                     */
+/*                                                 |===-~___                _,-'                                     */
+/*                  -==\\                         `//~\\   ~~~~`---.___.-~~                                          */
+/*              ______-==|                         | |  \\           _-~`                                            */
+/*        __--~~~  ,-/-==\\                        | |   `\        ,'                                                */
+/*     _-~       /'    |  \\                      / /      \      /                                                  */
+/*   .'        /       |   \\                   /' /        \   /'                                                   */
+/*  /  ____  /         |    \`\.__/-~~ ~ \ _ _/'  /          \/'                                                     */
+/* /-'~    ~~~~~---__  |     ~-/~         ( )   /'        _--~`                                                      */
+/*                   \_|      /        _)   ;  ),   __--~~                                                           */
+/*                     '~~--_/      _-~/-  / \   '-~ \                                                               */
+/*                    {\__--_/}    / \\_>- )<__\      \                                                              */
+/*                    /'   (_/  _-~  | |__>--<__|      |                                                             */
+/*                   |0  0 _/) )-~     | |__>--<__|     |                                                            */
+/*                   / /~ ,_/       / /__>---<__/      |                                                             */
+/*                  o o _//        /-~_>---<__-~      /                                                              */
+/*                  (^(~          /~_>---<__-      _-~                                                               */
+/*                 ,/|           /__>--<__/     _-~                                                                  */
+/*              ,//('(          |__>--<__|     /                  .----_                                             */
+/*             ( ( '))          |__>--<__|    |                 /' _---_~\                                           */
+/*          `-)) )) (           |__>--<__|    |               /'  /     ~\`\                                         */
+/*         ,/,'//( (             \__>--<__\    \            /'  //        ||                                         */
+/*       ,( ( ((, ))              ~-__>--<_~-_  ~--____---~' _/'/        /'                                          */
+/*     `~/  )` ) ,/|                 ~-_~>--<_/-__       __-~ _/                                                     */
+/*   ._-~//( )/ )) `                    ~~-'_/_/ /~~~~~~~__--~                                                       */
+/*    ;'( ')/ ,)(                              ~~~~~~~~~~                                                            */
+/*   ' ') '( (/                                                                                                      */
+/*     '   '  `                                                                                                      */
+/*********************************************************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mshproc.h"
+#include "test.h"
+
+/*----------------------------------------------------------------------
+ * Scalar reference
+ *----------------------------------------------------------------------*/
+static vec3f v3_add(vec3f a, vec3f b) { return (vec3f){a.x + b.x, a.y + b.y, a.z + b.z}; }
+static vec3f v3_sub(vec3f a, vec3f b) { return (vec3f){a.x - b.x, a.y - b.y, a.z - b.z}; }
+static vec3f v3_scale(vec3f a, float s) { return (vec3f){a.x * s, a.y * s, a.z * s}; }
+static float v3_dot(vec3f a, vec3f b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static vec3f v3_cross(vec3f a, vec3f b) { return (vec3f){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+
+static vec3f v3_normalize(vec3f a)
+{
+    float l = sqrtf(v3_dot(a, a));
+    return l > 0.0f ? v3_scale(a, 1.0f / l) : a;
+}
+
+static float corner_angle(vec3f p, vec3f a, vec3f b)
+{
+    vec3f e1 = v3_normalize(v3_sub(a, p)), e2 = v3_normalize(v3_sub(b, p));
+    float c = v3_dot(e1, e2);
+    return acosf(c < -1.0f ? -1.0f : c > 1.0f ? 1.0f : c);
+}
+
+static void ref_normals(vec3f* norm, const vec3f* pos, size_t num_verts,
+                        const vec3i* tris, size_t num_tris, enum mshproc_weight weight)
+{
+    memset(norm, 0, num_verts * sizeof(*norm));
+    for (size_t i = 0; i < num_tris; ++i) {
+        const int idx[3] = {tris[i].x, tris[i].y, tris[i].z};
+        vec3f fn = v3_cross(v3_sub(pos[idx[1]], pos[idx[0]]), v3_sub(pos[idx[2]], pos[idx[0]]));
+        for (int k = 0; k < 3; ++k) {
+            vec3f c = fn;
+            if (weight == MSHPROC_WEIGHT_UNIFORM)
+                c = v3_normalize(fn);
+            else if (weight == MSHPROC_WEIGHT_ANGLE)
+                c = v3_scale(v3_normalize(fn), corner_angle(pos[idx[k]], pos[idx[(k + 1) % 3]], pos[idx[(k + 2) % 3]]));
+            norm[idx[k]] = v3_add(norm[idx[k]], c);
+        }
+    }
+    for (size_t i = 0; i < num_verts; ++i)
+        norm[i] = v3_normalize(norm[i]);
+}
+
+/* Tangent frames as shape_compute_tangent_frame produced them before the kernels */
+static void ref_tangents(vec4f* tangsp, const vec3f* pos, const vec3f* norm, const vec2f* uv, size_t num_verts,
+                         const vec3i* tris, size_t num_tris)
+{
+    vec3f* tngu = calloc(num_verts, sizeof(*tngu));
+    vec3f* tngv = calloc(num_verts, sizeof(*tngv));
+    for (size_t i = 0; i < num_tris; ++i) {
+        const int idx[3] = {tris[i].x, tris[i].y, tris[i].z};
+        vec3f p = v3_sub(pos[idx[1]], pos[idx[0]]);
+        vec3f q = v3_sub(pos[idx[2]], pos[idx[0]]);
+        vec2f s = {uv[idx[1]].x - uv[idx[0]].x, uv[idx[2]].x - uv[idx[0]].x};
+        vec2f t = {uv[idx[1]].y - uv[idx[0]].y, uv[idx[2]].y - uv[idx[0]].y};
+        float d = s.x * t.y - s.y * t.x;
+        vec3f tu = {1, 0, 0}, tv = {0, 1, 0};
+        if (d != 0.0f) {
+            tu = v3_scale(v3_sub(v3_scale(p, t.y), v3_scale(q, t.x)), 1.0f / d);
+            tv = v3_scale(v3_sub(v3_scale(q, s.x), v3_scale(p, s.y)), 1.0f / d);
+        }
+        tu = v3_normalize(tu);
+        tv = v3_normalize(tv);
+        for (int k = 0; k < 3; ++k) {
+            tngu[idx[k]] = v3_add(tngu[idx[k]], tu);
+            tngv[idx[k]] = v3_add(tngv[idx[k]], tv);
+        }
+    }
+    for (size_t i = 0; i < num_verts; ++i) {
+        vec3f nm = norm[i], tu = v3_normalize(tngu[i]), tv = v3_normalize(tngv[i]);
+        tu = v3_normalize(v3_sub(tu, v3_scale(nm, v3_dot(nm, tu))));
+        float sgn = v3_dot(v3_cross(nm, tu), tv) < 0.0f ? -1.0f : 1.0f;
+        tangsp[i] = (vec4f){tu.x, tu.y, tu.z, sgn};
+    }
+    free(tngu);
+    free(tngv);
+}
+
+/*----------------------------------------------------------------------
+ * Test mesh
+ *----------------------------------------------------------------------*/
+struct test_mesh {
+    vec3f* pos;
+    vec2f* uv;
+    size_t num_verts;
+    vec3i* tris;
+    size_t num_tris;
+};
+
+/* Open uv sphere band, n x n vertices, away from the poles so every uv triangle is well formed */
+static void sphere_mesh(struct test_mesh* m, int n)
+{
+    m->num_verts = (size_t)n * n;
+    m->pos = malloc(m->num_verts * sizeof(*m->pos));
+    m->uv = malloc(m->num_verts * sizeof(*m->uv));
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            float u = x / (float)n * 6.2831853f, v = 0.2f + y / (float)(n - 1) * 2.7f;
+            m->pos[y * n + x] = (vec3f){sinf(v) * cosf(u), cosf(v), sinf(v) * sinf(u)};
+            m->uv[y * n + x] = (vec2f){x / (float)n, y / (float)n};
+        }
+    }
+    m->num_tris = (size_t)(n - 1) * (n - 1) * 2;
+    m->tris = malloc(m->num_tris * sizeof(*m->tris));
+    size_t t = 0;
+    for (int y = 0; y < n - 1; ++y) {
+        for (int x = 0; x < n - 1; ++x) {
+            int i = y * n + x;
+            m->tris[t++] = (vec3i){i, i + n, i + 1};
+            m->tris[t++] = (vec3i){i + 1, i + n, i + n + 1};
+        }
+    }
+}
+
+static void test_mesh_free(struct test_mesh* m)
+{
+    free(m->pos);
+    free(m->uv);
+    free(m->tris);
+}
+
+static float max_diff3(const vec3f* a, const vec3f* b, size_t n)
+{
+    float md = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        vec3f d = v3_sub(a[i], b[i]);
+        float m = fmaxf(fabsf(d.x), fmaxf(fabsf(d.y), fabsf(d.z)));
+        md = m > md || isnan(m) ? m : md;
+    }
+    return md;
+}
+
+/*----------------------------------------------------------------------
+ * Checks
+ *----------------------------------------------------------------------*/
+static void check_normals()
+{
+    /* Large enough to be split over several partitions */
+    struct test_mesh m;
+    sphere_mesh(&m, 200);
+    vec3f* ref = malloc(m.num_verts * sizeof(*ref));
+    vec3f* out = malloc(m.num_verts * sizeof(*out));
+    static const struct { enum mshproc_weight w; const char* name; float tol; } weights[] = {
+        {MSHPROC_WEIGHT_UNIFORM, "uniform", 1e-5f},
+        {MSHPROC_WEIGHT_AREA,    "area",    1e-5f},
+        /* The kernel's acos approximation is good to ~7e-5 radians */
+        {MSHPROC_WEIGHT_ANGLE,   "angle",   1e-3f},
+    };
+    for (size_t i = 0; i < sizeof(weights) / sizeof(weights[0]); ++i) {
+        ref_normals(ref, m.pos, m.num_verts, m.tris, m.num_tris, weights[i].w);
+        mshproc_normals(out, m.pos, m.num_verts, m.tris, m.num_tris, weights[i].w);
+        float md = max_diff3(out, ref, m.num_verts);
+        test_check(md <= weights[i].tol, "%s normals differ from scalar reference by %g", weights[i].name, md);
+
+        vec3f* again = malloc(m.num_verts * sizeof(*again));
+        mshproc_normals(again, m.pos, m.num_verts, m.tris, m.num_tris, weights[i].w);
+        test_check(memcmp(again, out, m.num_verts * sizeof(*out)) == 0, "%s normals not reproducible", weights[i].name);
+        free(again);
+    }
+    free(out);
+    free(ref);
+    test_mesh_free(&m);
+}
+
+static void check_small_and_degenerate()
+{
+    /* Fewer triangles than a SIMD block, with a zero area one and an unreferenced vertex */
+    vec3f pos[5] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {2, 0, 0}, {5, 5, 5}};
+    vec2f uv[5] = {{0, 0}, {1, 0}, {0, 1}, {2, 0}, {0, 0}};
+    vec3i tris[2] = {{0, 1, 2}, {0, 1, 3}};
+    vec3f norm[5];
+    vec4f tangsp[5];
+    for (int w = MSHPROC_WEIGHT_UNIFORM; w <= MSHPROC_WEIGHT_ANGLE; ++w) {
+        mshproc_normals(norm, pos, 5, tris, 2, (enum mshproc_weight)w);
+        for (int i = 0; i < 5; ++i)
+            test_check(isfinite(norm[i].x) && isfinite(norm[i].y) && isfinite(norm[i].z),
+                       "non finite normal %d with weight %d", i, w);
+        for (int i = 0; i < 3; ++i)
+            test_check(fabsf(norm[i].z - 1.0f) < 1e-6f, "normal %d is not +z with weight %d", i, w);
+    }
+    mshproc_tangents(tangsp, pos, norm, uv, 5, tris, 2);
+    for (int i = 0; i < 5; ++i)
+        test_check(isfinite(tangsp[i].x) && isfinite(tangsp[i].y) && isfinite(tangsp[i].z)
+                && (tangsp[i].w == 1.0f || tangsp[i].w == -1.0f), "bad tangent frame %d", i);
+    test_check(fabsf(tangsp[0].x - 1.0f) < 1e-6f && tangsp[0].w == 1.0f, "tangent 0 is not +x, +1");
+}
+
+static void check_tangents()
+{
+    /* On a smooth parametrization the corner angle weighted frames match the previous ones closely */
+    struct test_mesh m;
+    sphere_mesh(&m, 200);
+    vec3f* norm = malloc(m.num_verts * sizeof(*norm));
+    vec4f* ref = malloc(m.num_verts * sizeof(*ref));
+    vec4f* out = malloc(m.num_verts * sizeof(*out));
+    ref_normals(norm, m.pos, m.num_verts, m.tris, m.num_tris, MSHPROC_WEIGHT_UNIFORM);
+    ref_tangents(ref, m.pos, norm, m.uv, m.num_verts, m.tris, m.num_tris);
+    mshproc_tangents(out, m.pos, norm, m.uv, m.num_verts, m.tris, m.num_tris);
+
+    float min_dot = 1.0f, max_ortho = 0.0f;
+    size_t sign_flips = 0;
+    for (size_t i = 0; i < m.num_verts; ++i) {
+        vec3f a = {ref[i].x, ref[i].y, ref[i].z}, b = {out[i].x, out[i].y, out[i].z};
+        min_dot = fminf(min_dot, v3_dot(a, b));
+        max_ortho = fmaxf(max_ortho, fabsf(v3_dot(b, norm[i])));
+        sign_flips += ref[i].w != out[i].w;
+    }
+    test_check(min_dot > 0.999f, "tangents deviate from reference, min dot %g", min_dot);
+    test_check(max_ortho < 1e-4f, "tangents not orthogonal to normals, max dot %g", max_ortho);
+    test_check(sign_flips == 0, "%zu bitangent sign flips", sign_flips);
+    free(out);
+    free(ref);
+    free(norm);
+    test_mesh_free(&m);
+}
+
+/*----------------------------------------------------------------------
+ * Benchmarks
+ *----------------------------------------------------------------------*/
+static void bench_million_tris()
+{
+    struct test_mesh m;
+    sphere_mesh(&m, 708);
+    vec3f* norm = malloc(m.num_verts * sizeof(*norm));
+    vec4f* tangsp = malloc(m.num_verts * sizeof(*tangsp));
+
+    double t0 = test_time();
+    ref_normals(norm, m.pos, m.num_verts, m.tris, m.num_tris, MSHPROC_WEIGHT_UNIFORM);
+    double t1 = test_time();
+    mshproc_normals(norm, m.pos, m.num_verts, m.tris, m.num_tris, MSHPROC_WEIGHT_ANGLE);
+    double t2 = test_time();
+    ref_tangents(tangsp, m.pos, norm, m.uv, m.num_verts, m.tris, m.num_tris);
+    double t3 = test_time();
+    mshproc_tangents(tangsp, m.pos, norm, m.uv, m.num_verts, m.tris, m.num_tris);
+    double t4 = test_time();
+
+    printf("  %zu tris: normals scalar %.1f ms, kernel %.1f ms; tangents scalar %.1f ms, kernel %.1f ms\n",
+           m.num_tris, (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t3 - t2) * 1e3, (t4 - t3) * 1e3);
+    free(tangsp);
+    free(norm);
+    test_mesh_free(&m);
+}
+
+void mshproc_test()
+{
+    check_normals();
+    check_small_and_degenerate();
+    check_tangents();
+    if (test_bench)
+        bench_million_tris();
+}